@@ -0,0 +1,95 @@
+#include "AllocationCounter.h"
+#include <atomic>
+#include <new>
+
+static std::atomic<unsigned int> s_allocations[ALLOCATION_SUBSYSTEM_COUNT];
+static std::atomic<size_t> s_bytes[ALLOCATION_SUBSYSTEM_COUNT];
+static unsigned int s_frameAllocations[ALLOCATION_SUBSYSTEM_COUNT];
+static size_t s_frameBytes[ALLOCATION_SUBSYSTEM_COUNT];
+
+thread_local AllocationSubsystem CAllocationCounter::s_currentSubsystem = ALLOCATION_OTHER;
+
+void CAllocationCounter::Count(size_t size)
+{
+	s_allocations[s_currentSubsystem].fetch_add(1, std::memory_order_relaxed);
+	s_bytes[s_currentSubsystem].fetch_add(size, std::memory_order_relaxed);
+}
+
+void CAllocationCounter::EndFrame()
+{
+	for (int i = 0; i < ALLOCATION_SUBSYSTEM_COUNT; i++) {
+		s_frameAllocations[i] = s_allocations[i].exchange(0);
+		s_frameBytes[i] = s_bytes[i].exchange(0);
+	}
+}
+
+unsigned int CAllocationCounter::GetFrameAllocations(AllocationSubsystem subsystem)
+{
+	return s_frameAllocations[subsystem];
+}
+
+unsigned int CAllocationCounter::GetFrameAllocations()
+{
+	unsigned int total = 0;
+	for (int i = 0; i < ALLOCATION_SUBSYSTEM_COUNT; i++)
+		total += s_frameAllocations[i];
+	return total;
+}
+
+size_t CAllocationCounter::GetFrameBytes(AllocationSubsystem subsystem)
+{
+	return s_frameBytes[subsystem];
+}
+
+const char* CAllocationCounter::GetSubsystemName(AllocationSubsystem subsystem)
+{
+	static const char* names[ALLOCATION_SUBSYSTEM_COUNT] = { "other", "update", "TV", "scene", "HUD", "jobs" };
+	return names[subsystem];
+}
+
+CAllocationScope::CAllocationScope(AllocationSubsystem subsystem)
+{
+	m_previous = CAllocationCounter::s_currentSubsystem;
+	CAllocationCounter::s_currentSubsystem = subsystem;
+}
+
+CAllocationScope::~CAllocationScope()
+{
+	CAllocationCounter::s_currentSubsystem = m_previous;
+}
+
+// Replacements for the global allocation functions.  The nothrow forms fall back to these, and the sized forms of
+// delete are replaced too so that every delete frees with the same allocator.
+void* operator new(size_t size)
+{
+	CAllocationCounter::Count(size);
+	void* p = malloc(size > 0 ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	free(p);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Common.h"
+
+// Parts of the frame that heap allocations are charged to
+enum AllocationSubsystem
+{
+	ALLOCATION_OTHER = 0,
+	ALLOCATION_UPDATE,
+	ALLOCATION_TV_VIEW,
+	ALLOCATION_SCENE,
+	ALLOCATION_HUD,
+	ALLOCATION_JOBS,
+	ALLOCATION_SUBSYSTEM_COUNT
+};
+
+// Counts every call to the global operator new, which is replaced in AllocationCounter.cpp.  Each thread charges
+// its allocations to the subsystem of the innermost CAllocationScope it is in.  The counts are totalled per frame.
+class CAllocationCounter
+{
+public:
+	// Called once a frame, before anything else: keeps the frame just finished and starts counting the next
+	static void EndFrame();
+
+	// Results for the last frame
+	static unsigned int GetFrameAllocations(AllocationSubsystem subsystem);
+	static unsigned int GetFrameAllocations();
+	static size_t GetFrameBytes(AllocationSubsystem subsystem);
+
+	static const char* GetSubsystemName(AllocationSubsystem subsystem);
+
+	static void Count(size_t size);
+
+private:
+	friend class CAllocationScope;
+	static thread_local AllocationSubsystem s_currentSubsystem;
+};
+
+// Charges the allocations of the current thread to a subsystem until it goes out of scope
+class CAllocationScope
+{
+public:
+	CAllocationScope(AllocationSubsystem subsystem);
+	~CAllocationScope();
+
+private:
+	AllocationSubsystem m_previous;
+};
@@ -0,0 +1,191 @@
+#include "Benchmark.h"
+
+#define BENCHMARK_FILE "benchmark.txt"
+
+CGpuTimer::CGpuTimer()
+{
+	m_queries[0] = 0;
+	m_queries[1] = 0;
+	m_pending[0] = false;
+	m_pending[1] = false;
+	m_current = 0;
+	m_milliseconds = 0.0;
+}
+
+CGpuTimer::~CGpuTimer()
+{}
+
+void CGpuTimer::Begin()
+{
+	if (m_queries[0] == 0)
+		glGenQueries(2, m_queries);
+
+	// Collect the result from the last time this query object was used before reusing it
+	if (m_pending[m_current]) {
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(m_queries[m_current], GL_QUERY_RESULT, &nanoseconds);
+		m_milliseconds = nanoseconds / 1000000.0;
+		m_pending[m_current] = false;
+	}
+	glBeginQuery(GL_TIME_ELAPSED, m_queries[m_current]);
+}
+
+void CGpuTimer::End()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	m_pending[m_current] = true;
+	m_current = 1 - m_current;
+}
+
+double CGpuTimer::GetMilliseconds()
+{
+	return m_milliseconds;
+}
+
+void CGpuTimer::Release()
+{
+	if (m_queries[0] != 0)
+		glDeleteQueries(2, m_queries);
+	m_queries[0] = 0;
+	m_queries[1] = 0;
+}
+
+CBenchmark::CBenchmark()
+{
+	m_currentCase = 0;
+	m_frame = 0;
+	m_warmupFrames = 0;
+	m_measureFrames = 0;
+	m_cpuTotal = 0.0;
+	m_gpuTotal = 0.0;
+	m_cpuMax = 0.0;
+	m_running = false;
+}
+
+CBenchmark::~CBenchmark()
+{}
+
+void CBenchmark::AddCase(const string& name, std::function<void()> setup)
+{
+	Case c;
+	c.name = name;
+	c.setup = setup;
+	m_cases.push_back(c);
+}
+
+void CBenchmark::Start(const string& title, std::function<void()> finished, int warmupFrames, int measureFrames)
+{
+	if (m_cases.empty())
+		return;
+
+	m_title = title;
+	m_finished = finished;
+	m_warmupFrames = warmupFrames;
+	m_measureFrames = measureFrames;
+	m_results.clear();
+	m_currentCase = 0;
+	m_running = true;
+	BeginCase();
+}
+
+bool CBenchmark::IsRunning()
+{
+	return m_running;
+}
+
+void CBenchmark::BeginCase()
+{
+	m_frame = 0;
+	m_cpuTotal = 0.0;
+	m_gpuTotal = 0.0;
+	m_cpuMax = 0.0;
+	if (m_cases[m_currentCase].setup)
+		m_cases[m_currentCase].setup();
+}
+
+void CBenchmark::AddFrame(double cpuMilliseconds, double gpuMilliseconds)
+{
+	if (!m_running)
+		return;
+
+	m_frame++;
+	if (m_frame <= m_warmupFrames)
+		return;
+
+	m_cpuTotal += cpuMilliseconds;
+	m_gpuTotal += gpuMilliseconds;
+	if (cpuMilliseconds > m_cpuMax)
+		m_cpuMax = cpuMilliseconds;
+
+	if (m_frame < m_warmupFrames + m_measureFrames)
+		return;
+
+	char line[256];
+	sprintf_s(line, "%-28s cpu %7.3f ms (max %7.3f)  gpu %7.3f ms", m_cases[m_currentCase].name.c_str(),
+		m_cpuTotal / m_measureFrames, m_cpuMax, m_gpuTotal / m_measureFrames);
+	m_results.push_back(line);
+
+	m_currentCase++;
+	if (m_currentCase < (int)m_cases.size()) {
+		BeginCase();
+		return;
+	}
+
+	m_running = false;
+	m_cases.clear();
+	WriteResults();
+	if (m_finished) {
+		std::function<void()> finished = m_finished;
+		m_finished = nullptr;
+		finished();
+	}
+}
+
+const string& CBenchmark::GetTitle()
+{
+	return m_title;
+}
+
+const string& CBenchmark::GetCurrentCase()
+{
+	static const string none;
+	if (!m_running)
+		return none;
+	return m_cases[m_currentCase].name;
+}
+
+const vector<string>& CBenchmark::GetResults()
+{
+	return m_results;
+}
+
+void CBenchmark::AddResult(const string& title, const string& line)
+{
+	if (title != m_title) {
+		m_title = title;
+		m_results.clear();
+	}
+	m_results.push_back(line);
+
+	FILE* fp;
+	fopen_s(&fp, BENCHMARK_FILE, "at");
+	if (!fp)
+		return;
+	fprintf(fp, "[%s] %s\n", title.c_str(), line.c_str());
+	fclose(fp);
+}
+
+// Append the results of the run to the benchmark file
+void CBenchmark::WriteResults()
+{
+	FILE* fp;
+	fopen_s(&fp, BENCHMARK_FILE, "at");
+	if (!fp)
+		return;
+
+	fprintf(fp, "%s\n", m_title.c_str());
+	for (unsigned int i = 0; i < m_results.size(); i++)
+		fprintf(fp, "  %s\n", m_results[i].c_str());
+	fprintf(fp, "\n");
+	fclose(fp);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "Common.h"
+#include <functional>
+
+// Measures GPU time with GL_TIME_ELAPSED queries.  Two queries are used in turn so that reading the result of the
+// previous frame does not stall the pipeline; the value returned is therefore one frame old.
+class CGpuTimer
+{
+public:
+	CGpuTimer();
+	~CGpuTimer();
+
+	void Begin();
+	void End();
+
+	// Time in milliseconds of the most recent measurement that has completed
+	double GetMilliseconds();
+
+	void Release();
+
+private:
+	GLuint m_queries[2];
+	int m_current;
+	bool m_pending[2];
+	double m_milliseconds;
+};
+
+// Runs a list of named cases, one after another, for a fixed number of frames each and records the average
+// CPU and GPU cost of the work being measured.  Results are shown on the HUD and appended to a text file.
+class CBenchmark
+{
+public:
+	CBenchmark();
+	~CBenchmark();
+
+	// Add a case to the next run.  setup is called once before the case's warm up frames.
+	void AddCase(const string& name, std::function<void()> setup);
+
+	// Start running the cases added since the last run.  finished is called once the last case is done, to put back
+	// any state the cases changed.
+	void Start(const string& title, std::function<void()> finished = nullptr, int warmupFrames = 30, int measureFrames = 120);
+	bool IsRunning();
+
+	// Record the cost of one frame of the current case, and move on to the next case once enough frames are recorded
+	void AddFrame(double cpuMilliseconds, double gpuMilliseconds);
+
+	const string& GetTitle();
+	const string& GetCurrentCase();
+
+	// Results of the last run, one line per case
+	const vector<string>& GetResults();
+
+	// Add a line to the results of a run that measures itself (for example a CPU microbenchmark) and write it to the file
+	void AddResult(const string& title, const string& line);
+
+private:
+	struct Case {
+		string name;
+		std::function<void()> setup;
+	};
+
+	void BeginCase();
+	void WriteResults();
+
+	vector<Case> m_cases;
+	std::function<void()> m_finished;
+	vector<string> m_results;
+	string m_title;
+	int m_currentCase;
+	int m_frame;
+	int m_warmupFrames;
+	int m_measureFrames;
+	double m_cpuTotal;
+	double m_gpuTotal;
+	double m_cpuMax;
+	bool m_running;
+};
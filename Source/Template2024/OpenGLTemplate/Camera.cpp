@@ -185,9 +185,29 @@ glm::mat4 CCamera::GetViewMatrix()
 	return glm::lookAt(m_position, m_view, m_upVector);
 }
 
-// The normal matrix is used to transform normals to eye coordinates -- part of lighting calculations
+// The normal matrix transforms normals to eye coordinates.  It is the inverse transpose of the upper 3x3 of the
+// modelview matrix.  Rotations, translations and scales along the model's own axes leave its columns orthogonal,
+// and then the inverse transpose is simply each column divided by its squared length.  Only a shear needs the full
+// inverse.
 glm::mat3 CCamera::ComputeNormalMatrix(const glm::mat4 &modelViewMatrix)
 {
-	return glm::transpose(glm::inverse(glm::mat3(modelViewMatrix)));
+	glm::mat3 m(modelViewMatrix);
+	float xx = glm::dot(m[0], m[0]);
+	float yy = glm::dot(m[1], m[1]);
+	float zz = glm::dot(m[2], m[2]);
+	float xy = glm::dot(m[0], m[1]);
+	float xz = glm::dot(m[0], m[2]);
+	float yz = glm::dot(m[1], m[2]);
+
+	// Squared cosine of the angle between each pair of columns
+	const float tolerance = 1e-6f;
+	if (xx > 0.0f && yy > 0.0f && zz > 0.0f &&
+		xy * xy <= tolerance * xx * yy && xz * xz <= tolerance * xx * zz && yz * yz <= tolerance * yy * zz) {
+		m[0] /= xx;
+		m[1] /= yy;
+		m[2] /= zz;
+		return m;
+	}
+	return glm::transpose(glm::inverse(m));
 }
 
@@ -1,16 +1,31 @@
 #include "CatmullRom.h"
 #define _USE_MATH_DEFINES
 #include <math.h>
+#include <algorithm>
 
-
+#define SEGMENT_STEPS 32	// Steps in the table used to space the points along a segment
 
 CCatmullRom::CCatmullRom()
 {
-	m_vertexCount = 0;
+	m_vaoCentreline = 0;
+	m_vaoLeftOffsetCurve = 0;
+	m_vaoRightOffsetCurve = 0;
+	m_vaoTrack = 0;
+	m_offsetWidth = 0.0f;
+	m_tolerance = 0.0f;
+	m_maxSpacing = 0.0f;
+	m_chunkSamples = 0;
+	m_trackBuffer = 0;
+	m_slotVertices = 0;
+	m_numResidentChunks = 0;
+	m_numVisibleChunks = 0;
+	m_numChunkUploads = 0;
 }
 
 CCatmullRom::~CCatmullRom()
-{}
+{
+	Release();
+}
 
 // Perform Catmull Rom spline interpolation between four points, interpolating the space between p1 and p2
 glm::vec3 CCatmullRom::Interpolate(glm::vec3& p0, glm::vec3& p1, glm::vec3& p2, glm::vec3& p3, float t)
@@ -27,123 +42,164 @@ glm::vec3 CCatmullRom::Interpolate(glm::vec3& p0, glm::vec3& p1, glm::vec3& p2,
 
 }
 
-// Determine lengths along the control points, which is the set of control points forming the closed curve
-void CCatmullRom::ComputeLengthsAlongControlPoints()
+// First and second derivatives of the Catmull Rom spline between p1 and p2
+void CCatmullRom::InterpolateDerivatives(glm::vec3& p0, glm::vec3& p1, glm::vec3& p2, glm::vec3& p3, float t, glm::vec3& d1, glm::vec3& d2)
 {
-	int M = (int)m_controlPoints.size();
+	glm::vec3 b = 0.5f * (-p0 + p2);
+	glm::vec3 c = 0.5f * (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3);
+	glm::vec3 d = 0.5f * (-p0 + 3.0f * p1 - 3.0f * p2 + p3);
 
-	float fAccumulatedLength = 0.0f;
-	m_distances.push_back(fAccumulatedLength);
-	for (int i = 1; i < M; i++) {
-		fAccumulatedLength += glm::distance(m_controlPoints[i - 1], m_controlPoints[i]);
-		m_distances.push_back(fAccumulatedLength);
-	}
+	d1 = b + 2.0f * c * t + 3.0f * d * t * t;
+	d2 = 2.0f * c + 6.0f * d * t;
+}
+
+// Determine lengths along the centreline points, which form the closed curve, from firstSample onwards
+void CCatmullRom::ComputeLengthsAlongCentreline(int firstSample)
+{
+	int N = (int)m_centrelinePoints.size();
+	m_distances.resize(N + 1);
+	m_distances[0] = 0.0f;
 
-	// Get the distance from the last point to the first
-	fAccumulatedLength += glm::distance(m_controlPoints[M - 1], m_controlPoints[0]);
-	m_distances.push_back(fAccumulatedLength);
+	// The last distance is from the last point back to the first
+	for (int i = glm::max(firstSample, 1); i <= N; i++)
+		m_distances[i] = m_distances[i - 1] + glm::distance(m_centrelinePoints[i - 1], m_centrelinePoints[i % N]);
 }
 
-// Return the point (and upvector, if control upvectors provided) based on a distance d along the control polygon
+// Return the point (and upvector, if centreline upvectors provided) based on a distance d along the centreline
 bool CCatmullRom::Sample(float d, glm::vec3& p, glm::vec3& up)
 {
 	if (d < 0)
 		return false;
 
-	int M = (int)m_controlPoints.size();
+	int M = (int)m_centrelinePoints.size();
 	if (M == 0)
 		return false;
 
 
 	float fTotalLength = m_distances[m_distances.size() - 1];
 
-	// The the current length along the control polygon; handle the case where we've looped around the track
+	// The the current length along the centreline; handle the case where we've looped around the track
 	float fLength = d - (int)(d / fTotalLength) * fTotalLength;
 
-	// Find the current segment
-	int j = -1;
-	for (int i = 0; i < (int)m_distances.size() - 1; i++) {
-		if (fLength >= m_distances[i] && fLength < m_distances[i + 1]) {
-			j = i; // found it!
-			break;
-		}
-	}
-
-	if (j == -1)
+	// Find the current segment.  The distances are sorted, so a binary search keeps sampling long tracks cheap.
+	int j = (int)(std::upper_bound(m_distances.begin(), m_distances.end(), fLength) - m_distances.begin()) - 1;
+	if (j < 0 || j >= (int)m_distances.size() - 1)
 		return false;
 
 	// Interpolate on current segment -- get t
 	float fSegmentLength = m_distances[j + 1] - m_distances[j];
 	float t = (fLength - m_distances[j]) / fSegmentLength;
 
-	// Get the indices of the four points along the control polygon for the current segment
+	// Get the indices of the four centreline points for the current segment
 	int iPrev = ((j - 1) + M) % M;
 	int iCur = j;
 	int iNext = (j + 1) % M;
 	int iNextNext = (j + 2) % M;
 
 	// Interpolate to get the point (and upvector)
-	p = Interpolate(m_controlPoints[iPrev], m_controlPoints[iCur], m_controlPoints[iNext], m_controlPoints[iNextNext], t);
-	if (m_controlUpVectors.size() == m_controlPoints.size())
-		up = glm::normalize(Interpolate(m_controlUpVectors[iPrev], m_controlUpVectors[iCur], m_controlUpVectors[iNext], m_controlUpVectors[iNextNext], t));
+	p = Interpolate(m_centrelinePoints[iPrev], m_centrelinePoints[iCur], m_centrelinePoints[iNext], m_centrelinePoints[iNextNext], t);
+	if (m_centrelineUpVectors.size() == m_centrelinePoints.size())
+		up = glm::normalize(Interpolate(m_centrelineUpVectors[iPrev], m_centrelineUpVectors[iCur], m_centrelineUpVectors[iNext], m_centrelineUpVectors[iNextNext], t));
 
 	return true;
 }
 
-// Sample a set of control points using an open Catmull-Rom spline, to produce a set of iNumSamples that are (roughly) equally spaced
-void CCatmullRom::UniformlySampleControlPoints(int numSamples)
+// Fill costs with the number of centreline points a segment of the closed spline needs up to each of SEGMENT_STEPS + 1
+// even steps of t, and return the segment's total.  A chord of length l across a bend of curvature k strays about
+// l * l * k / 8 from the curve, so keeping that within the tolerance needs sqrt(k / (8 * tolerance)) points per unit
+// length.  Straights still get a point every m_maxSpacing units.
+float CCatmullRom::MeasureSegment(int segment, float* costs)
 {
-	glm::vec3 p, up;
-
-	// Compute the lengths of each segment along the control polygon, and the total length
-	ComputeLengthsAlongControlPoints();
-	float fTotalLength = m_distances[m_distances.size() - 1];
-
-	// The spacing will be based on the control polygon
-	float fSpacing = fTotalLength / numSamples;
-
-	// Call PointAt to sample the spline, to generate the points
-	for (int i = 0; i < numSamples; i++) {
-		Sample(i * fSpacing, p, up);
-		m_centrelinePoints.push_back(p);
-		if (m_controlUpVectors.size() > 0)
-			m_centrelineUpVectors.push_back(up);
+	int M = (int)m_controlPoints.size();
+	glm::vec3& p0 = m_controlPoints[(segment - 1 + M) % M];
+	glm::vec3& p1 = m_controlPoints[segment];
+	glm::vec3& p2 = m_controlPoints[(segment + 1) % M];
+	glm::vec3& p3 = m_controlPoints[(segment + 2) % M];
+
+	glm::vec3 previous = p1;
+	costs[0] = 0.0f;
+	for (int s = 1; s <= SEGMENT_STEPS; s++) {
+		glm::vec3 p = Interpolate(p0, p1, p2, p3, s / (float)SEGMENT_STEPS);
+
+		// Curvature |r' x r''| / |r'|^3 in the middle of the step
+		glm::vec3 d1, d2;
+		InterpolateDerivatives(p0, p1, p2, p3, (s - 0.5f) / SEGMENT_STEPS, d1, d2);
+		float speed = glm::length(d1);
+		float curvature = speed > 0.0f ? glm::length(glm::cross(d1, d2)) / (speed * speed * speed) : 0.0f;
+		float density = glm::max(1.0f / m_maxSpacing, sqrtf(curvature / (8.0f * m_tolerance)));
+
+		costs[s] = costs[s - 1] + density * glm::distance(previous, p);
+		previous = p;
+	}
+	return costs[SEGMENT_STEPS];
+}
 
+// Write a segment's share of the centreline points, spaced evenly by cost along the segment, so they bunch up on the
+// bends and spread out on the straights
+void CCatmullRom::SampleSegment(int segment)
+{
+	int M = (int)m_controlPoints.size();
+	glm::vec3& p0 = m_controlPoints[(segment - 1 + M) % M];
+	glm::vec3& p1 = m_controlPoints[segment];
+	glm::vec3& p2 = m_controlPoints[(segment + 1) % M];
+	glm::vec3& p3 = m_controlPoints[(segment + 2) % M];
+
+	float costs[SEGMENT_STEPS + 1];
+	float cost = MeasureSegment(segment, costs);
+
+	int first = m_segmentFirstSample[segment];
+	int numSamples = m_segmentFirstSample[segment + 1] - first;
+	int s = 0;
+	for (int k = 0; k < numSamples; k++) {
+		float target = cost * k / numSamples;
+		while (s < SEGMENT_STEPS - 1 && costs[s + 1] <= target)
+			s++;
+		float step = costs[s + 1] - costs[s];
+		float t = (s + (step > 0.0f ? (target - costs[s]) / step : 0.0f)) / SEGMENT_STEPS;
+		m_centrelinePoints[first + k] = Interpolate(p0, p1, p2, p3, t);
 	}
+}
 
+// Sample the closed Catmull-Rom spline through the control points, giving each segment as many points as its bends
+// need.  The number of points in each segment is fixed here, so the points of one segment can be sampled again later
+// without moving any of the others.
+void CCatmullRom::SampleControlPoints()
+{
+	int M = (int)m_controlPoints.size();
+	float costs[SEGMENT_STEPS + 1];
 
-	// Repeat once more for truly equidistant points
-	m_controlPoints = m_centrelinePoints;
-	m_controlUpVectors = m_centrelineUpVectors;
-	m_centrelinePoints.clear();
-	m_centrelineUpVectors.clear();
-	m_distances.clear();
-	ComputeLengthsAlongControlPoints();
-	fTotalLength = m_distances[m_distances.size() - 1];
-	fSpacing = fTotalLength / numSamples;
-	for (int i = 0; i < numSamples; i++) {
-		Sample(i * fSpacing, p, up);
-		m_centrelinePoints.push_back(p);
-		if (m_controlUpVectors.size() > 0)
-			m_centrelineUpVectors.push_back(up);
+	m_segmentFirstSample.resize(M + 1);
+	m_segmentFirstSample[0] = 0;
+	for (int j = 0; j < M; j++) {
+		int numSamples = glm::max((int)ceilf(MeasureSegment(j, costs) - 0.001f), 1);
+		m_segmentFirstSample[j + 1] = m_segmentFirstSample[j] + numSamples;
 	}
 
-
+	m_centrelinePoints.resize(m_segmentFirstSample[M]);
+	for (int j = 0; j < M; j++)
+		SampleSegment(j);
+	ComputeLengthsAlongCentreline(0);
 }
 
 // Create the centre line for the path using the control points provided
-void CCatmullRom::CreateCentreline(std::vector<glm::vec3> controlPoints)
+void CCatmullRom::CreateCentreline(std::vector<glm::vec3> controlPoints, float tolerance, float maxSpacing)
 {
 	// Set control points (m_controlPoints) here
 	m_controlPoints = controlPoints;
+	m_tolerance = tolerance;
+	m_maxSpacing = maxSpacing;
 
-	// Call UniformlySampleControlPoints with the number of samples required
-	UniformlySampleControlPoints(500);
+	SampleControlPoints();
+
+	// Space for recording edits, allocated once so that editing does not allocate
+	m_dirtySegments.assign(m_controlPoints.size(), 0);
+	m_changedSampleFlags.assign(m_centrelinePoints.size(), 0);
+	m_changedSamples.reserve(m_centrelinePoints.size());
 
 	// Create a VAO called m_vaoCentreline and a VBO to get the points onto the graphics card
 	glGenVertexArrays(1, &m_vaoCentreline);
 	glBindVertexArray(m_vaoCentreline);
-	CVertexBufferObject vbo;
+	CVertexBufferObject& vbo = m_vboCentreline;
 	vbo.Create();
 	vbo.Bind();
 
@@ -152,16 +208,13 @@ void CCatmullRom::CreateCentreline(std::vector<glm::vec3> controlPoints)
 	glm::vec3 normal(0.0f, 1.0f, 0.0f);
 
 	// add the data to every point in the centreline  
+	CVertexStream<TexturedVertex> vertices;
+	vertices.Reserve((unsigned int)m_centrelinePoints.size());
 	for (unsigned int i = 0; i < m_centrelinePoints.size(); i++)
-	{
-		glm::vec3 v = m_centrelinePoints[i];
-		vbo.AddData(&v, sizeof(glm::vec3));
-		vbo.AddData(&texCoord, sizeof(glm::vec2));
-		vbo.AddData(&normal, sizeof(glm::vec3));
-	}
+		vertices.Add(TexturedVertex(m_centrelinePoints[i], texCoord, normal));
 
 	// Upload the VBO to the GPU
-	vbo.UploadDataToGPU(GL_STATIC_DRAW);
+	vbo.UploadDataToGPU(vertices, GL_STATIC_DRAW, "track centreline");
 	// Set the vertex attribute locations
 	GLsizei stride = 2 * sizeof(glm::vec3) + sizeof(glm::vec2);
 	// Vertex positions
@@ -175,21 +228,28 @@ void CCatmullRom::CreateCentreline(std::vector<glm::vec3> controlPoints)
 	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(glm::vec3) + sizeof(glm::vec2)));
 }
 
+// Compute the left and right offset points of one centreline point, which depend on the direction to the next point
+void CCatmullRom::ComputeOffsetPoints(int i)
+{
+	// use TNB frame to calculate positions of points in left and right offset curves
+	glm::vec3 p = m_centrelinePoints[i];
+	glm::vec3 y = glm::vec3(0, 1, 0);
+	glm::vec3 pNext = m_centrelinePoints[(i + 1) % m_centrelinePoints.size()];
+	glm::vec3 T = normalize(pNext - p);
+	glm::vec3 N = glm::vec3(glm::cross(T, y));
+
+	m_leftOffsetPoints[i] = p - ((m_offsetWidth / 2) * N);
+	m_rightOffsetPoints[i] = p + ((m_offsetWidth / 2) * N);
+}
+
 // Compute the offset curves, one left, and one right.  Store the points in m_leftOffsetPoints and m_rightOffsetPoints respectively
 void CCatmullRom::CreateOffsetCurves(float width)
 {
-	// use TNB frame to calculate positions of points in left and right offset curves
-	for (int i = 0; i < m_centrelinePoints.size(); i++)
-	{
-		glm::vec3 p = m_centrelinePoints[i];
-		glm::vec3 y = glm::vec3(0, 1, 0);
-		glm::vec3 pNext = m_centrelinePoints[(i + 1) % sampleNum];
-		glm::vec3 T = normalize(pNext - p);
-		glm::vec3 N = glm::vec3(glm::cross(T, y));
-
-		m_leftOffsetPoints.push_back(p - ((width / 2) * N));
-		m_rightOffsetPoints.push_back(p + ((width / 2) * N));
-	}
+	m_offsetWidth = width;
+	m_leftOffsetPoints.resize(m_centrelinePoints.size());
+	m_rightOffsetPoints.resize(m_centrelinePoints.size());
+	for (int i = 0; i < (int)m_centrelinePoints.size(); i++)
+		ComputeOffsetPoints(i);
 
 	// set the txture coordinates and normal for the points in the VBO
 	glm::vec2 texCoord(0.0f, 0.0f);
@@ -204,21 +264,18 @@ void CCatmullRom::CreateOffsetCurves(float width)
 	glGenVertexArrays(1, &m_vaoLeftOffsetCurve);
 	glBindVertexArray(m_vaoLeftOffsetCurve);
 
-	CVertexBufferObject leftVBO;
+	CVertexBufferObject& leftVBO = m_vboLeftOffsetCurve;
 	leftVBO.Create();
 	leftVBO.Bind();
 
 	// use a for loop to add points to vbo 
+	CVertexStream<TexturedVertex> leftVertices;
+	leftVertices.Reserve((unsigned int)m_leftOffsetPoints.size());
 	for (unsigned int i = 0; i < m_leftOffsetPoints.size(); i++)
-	{
-		glm::vec3 l = m_leftOffsetPoints[i];
-		leftVBO.AddData(&l, sizeof(glm::vec3));
-		leftVBO.AddData(&texCoord, sizeof(glm::vec2));
-		leftVBO.AddData(&normal, sizeof(glm::vec3));
-	}
+		leftVertices.Add(TexturedVertex(m_leftOffsetPoints[i], texCoord, normal));
 
 	// Upload the VBO to the GPU
-	leftVBO.UploadDataToGPU(GL_STATIC_DRAW);
+	leftVBO.UploadDataToGPU(leftVertices, GL_STATIC_DRAW, "track offset curve");
 	// Vertex positions
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
@@ -236,21 +293,18 @@ void CCatmullRom::CreateOffsetCurves(float width)
 	glGenVertexArrays(1, &m_vaoRightOffsetCurve);
 	glBindVertexArray(m_vaoRightOffsetCurve);
 
-	CVertexBufferObject rightVBO;
+	CVertexBufferObject& rightVBO = m_vboRightOffsetCurve;
 	rightVBO.Create();
 	rightVBO.Bind();
 
 	// use a for loop to add points to vbo 
+	CVertexStream<TexturedVertex> rightVertices;
+	rightVertices.Reserve((unsigned int)m_rightOffsetPoints.size());
 	for (unsigned int i = 0; i < m_rightOffsetPoints.size(); i++)
-	{
-		glm::vec3 r = m_rightOffsetPoints[i];
-		rightVBO.AddData(&r, sizeof(glm::vec3));
-		rightVBO.AddData(&texCoord, sizeof(glm::vec2));
-		rightVBO.AddData(&normal, sizeof(glm::vec3));
-	}
+		rightVertices.Add(TexturedVertex(m_rightOffsetPoints[i], texCoord, normal));
 
 	// Upload the VBO to the GPU
-	rightVBO.UploadDataToGPU(GL_STATIC_DRAW);
+	rightVBO.UploadDataToGPU(rightVertices, GL_STATIC_DRAW, "track offset curve");
 	// Vertex positions
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
@@ -262,11 +316,11 @@ void CCatmullRom::CreateOffsetCurves(float width)
 	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(glm::vec3) + sizeof(glm::vec2)));
 }
 
-// Generate the complete track and upload the data to GPU
-void CCatmullRom::CreateTrack(string sDirectory, string sFilename)
+// Load the track's texture and split the track into chunks.  No chunk is on the GPU until StreamTrack is called.
+void CCatmullRom::CreateTrack(string sDirectory, string sFilename, float textureLength, int chunkSamples, int maxResidentChunks)
 {
 	// Load the texture
-	m_texture.Load(sDirectory + sFilename, true);
+	m_texture.Load(sDirectory + sFilename, true, "track");
 
 	m_directory = sDirectory;
 	m_filename = sFilename;
@@ -277,58 +331,45 @@ void CCatmullRom::CreateTrack(string sDirectory, string sFilename)
 	m_texture.SetSamplerObjectParameter(GL_TEXTURE_WRAP_S, GL_REPEAT);
 	m_texture.SetSamplerObjectParameter(GL_TEXTURE_WRAP_T, GL_REPEAT);
 
-	// Generate a VAO called m_vaoTrack and a VBO to get the offset curve points and indices on the graphics card
-	glGenVertexArrays(1, &m_vaoTrack);
-	glBindVertexArray(m_vaoTrack);
-
-	CVertexBufferObject vbo;
-	vbo.Create();
-	vbo.Bind();
-
-	// set the txture coordinates and normal for the points in the VBO
-	vector<glm::vec2> textures = {
-		glm::vec2(0.0f, 0.0f),
-		glm::vec2(0.0f, 2.0f),
-		glm::vec2(1.0f, 0.0f),
-		glm::vec2(1.0f, 2.0f)
-	};/*
-	glm::vec2 texCoord(0.0f, 0.0f);*/
-	glm::vec3 normal(0.0f, 1.0f, 0.0f);
+	// The texture runs along the track by distance, however far apart the samples are, and repeats a whole number of
+	// times so that it meets itself at the start
+	int numSamples = (int)m_centrelinePoints.size();
+	float length = m_distances.back();
+	float repeats = glm::max(floorf(length / textureLength + 0.5f), 1.0f);
+	m_texCoords.resize(numSamples + 1);
+	for (int i = 0; i <= numSamples; i++)
+		m_texCoords[i] = m_distances[i] * repeats / length;
+
+	// Split the track into chunks and find the bounds of each
+	m_chunkSamples = chunkSamples;
+	for (int first = 0; first < numSamples; first += chunkSamples) {
+		TrackChunk chunk;
+		chunk.firstSample = first;
+		chunk.numSamples = glm::min(chunkSamples, numSamples - first);
+		chunk.slot = -1;
+		chunk.dirtyFirst = chunk.dirtyLast = -1;
+		ComputeChunkBounds(chunk);
+		m_chunks.push_back(chunk);
+	}
 
-	glm::vec2 texCoord;
-	glm::vec2 texCoord1;
-
-	// every loop adds a point from the left offset curve, then the right curve, then loops
-	// loop also increments m_vertexCount to keep count of total vertex numbers
-	for (int i = 0; i < m_centrelinePoints.size() + 1; i++)
-	{
-		if (i % 2 == 0)
-		{
-			texCoord = textures[0];
-			texCoord1 = textures[1];
-		}
-		else
-		{
-			texCoord = textures[2];
-			texCoord1 = textures[3];
-		}
-		glm::vec3 p = m_leftOffsetPoints[i % m_leftOffsetPoints.size()];
-		vbo.AddData(&p, sizeof(glm::vec3));
-		vbo.AddData(&texCoord, sizeof(glm::vec2));
-		vbo.AddData(&normal, sizeof(glm::vec3));
+	// Generate a VAO called m_vaoTrack and the chunk pool, which StreamTrack fills with the chunks near the viewer
+	m_slotVertices = 2 * (chunkSamples + 1);
+	maxResidentChunks = glm::min(maxResidentChunks, (int)m_chunks.size());
+	for (int slot = maxResidentChunks - 1; slot >= 0; slot--)
+		m_freeSlots.push_back(slot);
+	m_scratchVertices.reserve(m_slotVertices);
 
-		glm::vec3 q = m_rightOffsetPoints[i % m_rightOffsetPoints.size()];
-		vbo.AddData(&q, sizeof(glm::vec3));
-		vbo.AddData(&texCoord1, sizeof(glm::vec2));
-		vbo.AddData(&normal, sizeof(glm::vec3));
+	glGenVertexArrays(1, &m_vaoTrack);
+	glBindVertexArray(m_vaoTrack);
 
-		m_vertexCount = m_vertexCount + 2;
-	}
+	size_t poolSize = maxResidentChunks * m_slotVertices * sizeof(TexturedVertex);
+	glGenBuffers(1, &m_trackBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, m_trackBuffer);
+	glBufferData(GL_ARRAY_BUFFER, poolSize, NULL, GL_DYNAMIC_DRAW);
+	CResourceTracker::TrackBuffer(m_trackBuffer, poolSize, "track");
 
 	// Set the vertex attribute locations
-	GLsizei stride = 2 * sizeof(glm::vec3) + sizeof(glm::vec2);
-	// Upload the VBO to the GPU
-	vbo.UploadDataToGPU(GL_STATIC_DRAW);
+	GLsizei stride = sizeof(TexturedVertex);
 	// Vertex positions
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
@@ -338,9 +379,208 @@ void CCatmullRom::CreateTrack(string sDirectory, string sFilename)
 	// Normal vectors
 	glEnableVertexAttribArray(2);
 	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(glm::vec3) + sizeof(glm::vec2)));
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void CCatmullRom::ComputeChunkBounds(TrackChunk& chunk)
+{
+	int numSamples = (int)m_centrelinePoints.size();
+	chunk.boundsMin = glm::vec3(1e30f);
+	chunk.boundsMax = glm::vec3(-1e30f);
+	for (int i = chunk.firstSample; i <= chunk.firstSample + chunk.numSamples; i++) {
+		const glm::vec3& left = m_leftOffsetPoints[i % numSamples];
+		const glm::vec3& right = m_rightOffsetPoints[i % numSamples];
+		chunk.boundsMin = glm::min(chunk.boundsMin, glm::min(left, right));
+		chunk.boundsMax = glm::max(chunk.boundsMax, glm::max(left, right));
+	}
+}
+
+// Build samples [first, last] of a chunk's part of the strip (relative to the chunk's first sample), a point from the
+// left offset curve then one from the right for each sample, and upload them to the chunk's slot
+void CCatmullRom::UploadChunk(TrackChunk& chunk, int first, int last)
+{
+	glm::vec3 normal(0.0f, 1.0f, 0.0f);
+	int numSamples = (int)m_centrelinePoints.size();
+
+	m_scratchVertices.clear();
+	for (int i = chunk.firstSample + first; i <= chunk.firstSample + last; i++) {
+		float s = m_texCoords[i];
+		m_scratchVertices.push_back(TexturedVertex(m_leftOffsetPoints[i % numSamples], glm::vec2(s, 0.0f), normal));
+		m_scratchVertices.push_back(TexturedVertex(m_rightOffsetPoints[i % numSamples], glm::vec2(s, 2.0f), normal));
+	}
 
+	glBindBuffer(GL_ARRAY_BUFFER, m_trackBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, (chunk.slot * m_slotVertices + 2 * first) * sizeof(TexturedVertex),
+		m_scratchVertices.size() * sizeof(TexturedVertex), &m_scratchVertices[0]);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	m_numChunkUploads++;
 }
 
+void CCatmullRom::StreamTrack(const glm::vec3& viewer, float radius)
+{
+	auto isInRange = [&viewer, radius](const TrackChunk& chunk) {
+		return glm::distance(viewer, glm::clamp(viewer, chunk.boundsMin, chunk.boundsMax)) <= radius;
+	};
+
+	// Free the slots of the chunks that have gone out of range first, so the ones coming into range can reuse them
+	for (unsigned int c = 0; c < m_chunks.size(); c++) {
+		TrackChunk& chunk = m_chunks[c];
+		if (chunk.slot >= 0 && !isInRange(chunk)) {
+			m_freeSlots.push_back(chunk.slot);
+			chunk.slot = -1;
+			m_numResidentChunks--;
+		}
+	}
+
+	// If there are more chunks in range than slots, the rest wait until some go out of range
+	for (unsigned int c = 0; c < m_chunks.size() && !m_freeSlots.empty(); c++) {
+		TrackChunk& chunk = m_chunks[c];
+		if (chunk.slot >= 0 || !isInRange(chunk))
+			continue;
+		chunk.slot = m_freeSlots.back();
+		m_freeSlots.pop_back();
+		m_numResidentChunks++;
+		UploadChunk(chunk, 0, chunk.numSamples);
+	}
+}
+
+
+int CCatmullRom::GetNumControlPoints()
+{
+	return (int)m_controlPoints.size();
+}
+
+glm::vec3 CCatmullRom::GetControlPoint(int index)
+{
+	return m_controlPoints[index];
+}
+
+// Segment j is interpolated from control points j - 1 to j + 2, so a control point is used by the two segments
+// before it, its own segment and the one after it
+void CCatmullRom::MoveControlPoint(int index, const glm::vec3& point)
+{
+	int M = (int)m_controlPoints.size();
+	m_controlPoints[index] = point;
+	for (int j = index - 2; j <= index + 1; j++)
+		m_dirtySegments[(j + M) % M] = 1;
+}
+
+bool CCatmullRom::UpdateTrack()
+{
+	int M = (int)m_controlPoints.size();
+	int N = (int)m_centrelinePoints.size();
+
+	// Sample the moved segments again.  The offset points of each new point change, and so do those of the point
+	// before it, which point towards it.
+	for (int j = 0; j < M; j++) {
+		if (!m_dirtySegments[j])
+			continue;
+		m_dirtySegments[j] = 0;
+		SampleSegment(j);
+		for (int i = m_segmentFirstSample[j] - 1; i < m_segmentFirstSample[j + 1]; i++)
+			m_changedSampleFlags[(i + N) % N] = 1;
+	}
+
+	m_changedSamples.clear();
+	for (int i = 0; i < N; i++) {
+		if (m_changedSampleFlags[i]) {
+			m_changedSampleFlags[i] = 0;
+			m_changedSamples.push_back(i);
+		}
+	}
+	if (m_changedSamples.empty())
+		return false;
+
+	bool hasOffsets = m_leftOffsetPoints.size() == m_centrelinePoints.size();
+	if (hasOffsets) {
+		for (unsigned int i = 0; i < m_changedSamples.size(); i++)
+			ComputeOffsetPoints(m_changedSamples[i]);
+	}
+	ComputeLengthsAlongCentreline(m_changedSamples[0]);
+
+	// Upload each run of changed points to the curves, and note which samples of which chunks they are
+	for (unsigned int r = 0; r < m_changedSamples.size(); ) {
+		int first = m_changedSamples[r];
+		int count = 1;
+		while (r + count < m_changedSamples.size() && m_changedSamples[r + count] == first + count)
+			count++;
+		r += count;
+
+		UpdateCurve(m_vboCentreline, m_centrelinePoints, first, count);
+		if (hasOffsets) {
+			UpdateCurve(m_vboLeftOffsetCurve, m_leftOffsetPoints, first, count);
+			UpdateCurve(m_vboRightOffsetCurve, m_rightOffsetPoints, first, count);
+		}
+
+		// Spread the texture over the run again by the new distances, between the unchanged samples either side.  The
+		// start of the track keeps its coordinate, so the texture still meets itself there.
+		if (!m_texCoords.empty()) {
+			int before = glm::max(first - 1, 0);
+			int after = first + count;
+			float distance = m_distances[after] - m_distances[before];
+			float texCoord = m_texCoords[after] - m_texCoords[before];
+			for (int i = before + 1; i < after; i++)
+				m_texCoords[i] = m_texCoords[before] + texCoord * (m_distances[i] - m_distances[before]) / distance;
+		}
+	}
+	if (m_chunks.empty())
+		return true;
+
+	// A chunk's first sample is also the last sample of the chunk before it, and the first sample of the track is the
+	// last sample of the last chunk
+	int numChunks = (int)m_chunks.size();
+	for (unsigned int i = 0; i < m_changedSamples.size(); i++) {
+		int sample = m_changedSamples[i];
+		int chunk = sample / m_chunkSamples;
+		MarkChunkSample(chunk, sample - m_chunks[chunk].firstSample);
+		if (sample % m_chunkSamples == 0) {
+			int previous = (chunk - 1 + numChunks) % numChunks;
+			MarkChunkSample(previous, m_chunks[previous].numSamples);
+		}
+	}
+
+	// Chunks that are not on the GPU are built from scratch when they come into range
+	for (int c = 0; c < numChunks; c++) {
+		TrackChunk& chunk = m_chunks[c];
+		if (chunk.dirtyFirst < 0)
+			continue;
+		ComputeChunkBounds(chunk);
+		if (chunk.slot >= 0)
+			UploadChunk(chunk, chunk.dirtyFirst, chunk.dirtyLast);
+		chunk.dirtyFirst = chunk.dirtyLast = -1;
+	}
+	return true;
+}
+
+const vector<int>& CCatmullRom::GetChangedSamples()
+{
+	return m_changedSamples;
+}
+
+void CCatmullRom::MarkChunkSample(int chunk, int sample)
+{
+	TrackChunk& c = m_chunks[chunk];
+	if (c.dirtyFirst < 0 || sample < c.dirtyFirst)
+		c.dirtyFirst = sample;
+	if (sample > c.dirtyLast)
+		c.dirtyLast = sample;
+}
+
+// Replace count points of one of the debug curves, starting at point first
+void CCatmullRom::UpdateCurve(CVertexBufferObject& vbo, const vector<glm::vec3>& points, int first, int count)
+{
+	glm::vec2 texCoord(0.0f, 0.0f);
+	glm::vec3 normal(0.0f, 1.0f, 0.0f);
+
+	m_scratchVertices.clear();
+	for (int i = first; i < first + count; i++)
+		m_scratchVertices.push_back(TexturedVertex(points[i], texCoord, normal));
+
+	vbo.Bind();
+	vbo.UpdateDataOnGPU(first, &m_scratchVertices[0], count);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
 void CCatmullRom::RenderCentreline()
 {
@@ -381,10 +621,110 @@ void CCatmullRom::RenderOffsetCurves()
 
 void CCatmullRom::RenderTrack()
 {
-	// Bind the VAO m_vaoTrack and texture and then render it
+	// Bind the VAO m_vaoTrack and texture and then render the resident chunks
 	glBindVertexArray(m_vaoTrack);
 	m_texture.Bind();
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, m_vertexCount);
+	for (unsigned int c = 0; c < m_chunks.size(); c++) {
+		if (m_chunks[c].slot >= 0)
+			glDrawArrays(GL_TRIANGLE_STRIP, m_chunks[c].slot * m_slotVertices, 2 * (m_chunks[c].numSamples + 1));
+	}
+}
+
+void CCatmullRom::SubmitTrack(CRenderQueue* queue, RenderItem item, const CFrustum& frustum)
+{
+	m_numVisibleChunks = 0;
+	item.vao = m_vaoTrack;
+	item.SetTexture(GL_TEXTURE_2D, m_texture.GetTextureID(), m_texture.GetSamplerID());
+
+	for (unsigned int c = 0; c < m_chunks.size(); c++) {
+		const TrackChunk& chunk = m_chunks[c];
+		if (chunk.slot < 0 || !frustum.IsBoxVisible(chunk.boundsMin, chunk.boundsMax))
+			continue;
+		m_numVisibleChunks++;
+
+		// Sort the chunk by the view space depth of its centre
+		glm::vec3 centre = (chunk.boundsMin + chunk.boundsMax) * 0.5f;
+		item.depth = -(item.modelViewMatrix * glm::vec4(centre, 1.0f)).z;
+		item.SetDrawArrays(GL_TRIANGLE_STRIP, chunk.slot * m_slotVertices, 2 * (chunk.numSamples + 1));
+		queue->Submit(item);
+	}
+}
+
+int CCatmullRom::GetNumChunks()
+{
+	return (int)m_chunks.size();
+}
+
+int CCatmullRom::GetNumResidentChunks()
+{
+	return m_numResidentChunks;
+}
+
+int CCatmullRom::GetNumVisibleChunks()
+{
+	return m_numVisibleChunks;
+}
+
+int CCatmullRom::GetNumChunkUploads()
+{
+	return m_numChunkUploads;
+}
+
+int CCatmullRom::GetNumSamples()
+{
+	return (int)m_centrelinePoints.size();
+}
+
+// Each chunk's strip has a pair of vertices for each of its samples and for the first sample of the next chunk
+int CCatmullRom::GetNumVertices()
+{
+	return 2 * ((int)m_centrelinePoints.size() + (int)m_chunks.size());
+}
+
+float CCatmullRom::GetLength()
+{
+	return m_distances.back();
+}
+
+float CCatmullRom::GetSampleDistance(int sample)
+{
+	return m_distances[sample];
+}
+
+int CCatmullRom::GetSampleAtDistance(float d)
+{
+	float fTotalLength = m_distances.back();
+	float fLength = d - floorf(d / fTotalLength) * fTotalLength;
+	int j = (int)(std::upper_bound(m_distances.begin(), m_distances.end(), fLength) - m_distances.begin()) - 1;
+	return glm::clamp(j, 0, (int)m_centrelinePoints.size() - 1);
+}
+
+void CCatmullRom::Release()
+{
+	if (m_trackBuffer != 0) {
+		CResourceTracker::UntrackBuffer(m_trackBuffer);
+		glDeleteBuffers(1, &m_trackBuffer);
+		m_trackBuffer = 0;
+		m_texture.Release();
+	}
+	if (m_vaoTrack != 0)
+		glDeleteVertexArrays(1, &m_vaoTrack);
+	m_vaoTrack = 0;
+	if (m_vaoCentreline != 0) {
+		m_vboCentreline.Release();
+		glDeleteVertexArrays(1, &m_vaoCentreline);
+		m_vaoCentreline = 0;
+	}
+	if (m_vaoLeftOffsetCurve != 0) {
+		m_vboLeftOffsetCurve.Release();
+		m_vboRightOffsetCurve.Release();
+		glDeleteVertexArrays(1, &m_vaoLeftOffsetCurve);
+		glDeleteVertexArrays(1, &m_vaoRightOffsetCurve);
+		m_vaoLeftOffsetCurve = m_vaoRightOffsetCurve = 0;
+	}
+	m_chunks.clear();
+	m_freeSlots.clear();
+	m_numResidentChunks = 0;
 }
 
 int CCatmullRom::CurrentLap(float d)
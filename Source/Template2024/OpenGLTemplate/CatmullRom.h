@@ -4,22 +4,64 @@
 #include "vertexBufferObjectIndexed.h"
 #include "Texture.h"
 #include "Shaders.h"
-
-
+#include "RenderQueue.h"
+#include "Frustum.h"
+
+// A closed Catmull-Rom spline through a set of control points, resampled into centreline points, with offset curves
+// either side and a textured track between them.  The points are placed by curvature: close together on the bends,
+// where the curve has to stay within a tolerance of the spline, and far apart on the straights.
+//
+// Each segment of the spline gets a fixed share of the centreline points when it is created.  Moving a control point
+// only re-samples the four segments that use it, and UpdateTrack writes just the changed ranges of the buffers.
+//
+// The track is split into chunks of a fixed number of samples, each with its own bounds.  Only the chunks near the
+// viewer are kept on the GPU, in a fixed pool of slots in one buffer, so the GPU memory and the number of draws stay
+// the same however long the track is.  The CPU keeps the centreline and offset points for the whole track.
 class CCatmullRom
 {
 public:
 	CCatmullRom();
 	~CCatmullRom();
+	void Release();
 
-	void CreateCentreline(std::vector<glm::vec3>);
+	// Sample the spline through the control points so that the centreline strays no more than tolerance from it, with
+	// no more than maxSpacing between points.  A smaller tolerance gives a smoother track with more vertices.
+	void CreateCentreline(std::vector<glm::vec3>, float tolerance = 0.1f, float maxSpacing = 50.0f);
 	void RenderCentreline();
 
 	void CreateOffsetCurves(float);
 	void RenderOffsetCurves();
 
-	void CreateTrack(string sDirectory, string sFilename);
+	// Split the track into chunks of chunkSamples quads, with room on the GPU for maxResidentChunks of them.  The
+	// texture repeats about every textureLength units along the track.
+	void CreateTrack(string sDirectory, string sFilename, float textureLength = 18.5f, int chunkSamples = 32, int maxResidentChunks = 64);
+	// Upload the chunks within radius of the viewer that are not on the GPU yet and free the slots of those outside it
+	void StreamTrack(const glm::vec3& viewer, float radius);
 	void RenderTrack();
+	// Submit the resident chunks that are inside the frustum
+	void SubmitTrack(CRenderQueue* queue, RenderItem item, const CFrustum& frustum);
+
+	int GetNumChunks();
+	int GetNumResidentChunks();
+	int GetNumVisibleChunks();		// In the last SubmitTrack
+	int GetNumChunkUploads();		// Since the track was created
+	int GetNumSamples();			// Centreline points
+	int GetNumVertices();			// Vertices in the track's strips
+
+	// Length of the centreline, the distance along it of a centreline point (up to GetNumSamples, which is the end of
+	// the loop), and the centreline point at or just before a distance along it
+	float GetLength();
+	float GetSampleDistance(int sample);
+	int GetSampleAtDistance(float d);
+
+	// Edit the track.  MoveControlPoint only records the move; UpdateTrack then re-samples the affected segments and
+	// updates the offset curves and the track to match.  Returns false if nothing had moved.
+	int GetNumControlPoints();
+	glm::vec3 GetControlPoint(int index);
+	void MoveControlPoint(int index, const glm::vec3& point);
+	bool UpdateTrack();
+	// Centreline points whose offset points changed in the last UpdateTrack, in ascending order
+	const vector<int>& GetChangedSamples();
 
 	int CurrentLap(float d); // Return the current lap (starting from 0) based on distance along the control curve.
 
@@ -30,27 +72,64 @@ public:
 	vector<glm::vec3> m_rightOffsetPoints;	// Right offset curve points
 
 private:
-
-	void ComputeLengthsAlongControlPoints();
-	void UniformlySampleControlPoints(int numSamples);
+	// A run of the track's triangle strip.  The strip also uses the first sample of the next chunk, so there are no
+	// gaps between chunks.
+	struct TrackChunk
+	{
+		int firstSample;
+		int numSamples;
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		int slot;			// Slot in the chunk pool, or -1 if the chunk is not on the GPU
+		int dirtyFirst;		// Samples of the chunk changed by UpdateTrack, relative to firstSample, or -1 if none
+		int dirtyLast;
+	};
+
+	void ComputeLengthsAlongCentreline(int firstSample);
+	void SampleControlPoints();
+	float MeasureSegment(int segment, float* costs);
+	void SampleSegment(int segment);
+	void ComputeOffsetPoints(int sample);
+	void UpdateCurve(CVertexBufferObject& vbo, const vector<glm::vec3>& points, int first, int count);
+	void MarkChunkSample(int chunk, int sample);
+	void ComputeChunkBounds(TrackChunk& chunk);
+	void UploadChunk(TrackChunk& chunk, int first, int last);
 	glm::vec3 Interpolate(glm::vec3& p0, glm::vec3& p1, glm::vec3& p2, glm::vec3& p3, float t);
+	void InterpolateDerivatives(glm::vec3& p0, glm::vec3& p1, glm::vec3& p2, glm::vec3& p3, float t, glm::vec3& d1, glm::vec3& d2);
 
 	vector<float> m_distances;
+	vector<float> m_texCoords;				// Texture coordinate along the track of each centreline point, and of the end
 	CTexture m_texture;
 
 	GLuint m_vaoCentreline;
 	GLuint m_vaoLeftOffsetCurve;
 	GLuint m_vaoRightOffsetCurve;
 	GLuint m_vaoTrack;
+	CVertexBufferObject m_vboCentreline;
+	CVertexBufferObject m_vboLeftOffsetCurve;
+	CVertexBufferObject m_vboRightOffsetCurve;
 
 	static glm::vec3 _dummy_vector;
 	vector<glm::vec3> m_controlPoints;		// Control points, which are interpolated to produce the centreline points
-	vector<glm::vec3> m_controlUpVectors;	// Control upvectors, which are interpolated to produce the centreline upvectors
-	vector<glm::vec3> m_centrelineUpVectors;// Centreline upvectors
-
-	unsigned int m_vertexCount;				// Number of vertices in the track VBO
-
-	int sampleNum = 500;					// Number of uniformly created smaples stored in a variable for ease of use
+	vector<glm::vec3> m_centrelineUpVectors;// Centreline upvectors, if any
+	vector<int> m_segmentFirstSample;		// First centreline point of each segment, and the number of points at the end
+	float m_offsetWidth;
+	float m_tolerance;						// Furthest the centreline may stray from the spline
+	float m_maxSpacing;						// Furthest apart the centreline points may be
+
+	vector<char> m_dirtySegments;			// Segments using a moved control point
+	vector<char> m_changedSampleFlags;		// Scratch space for UpdateTrack
+	vector<int> m_changedSamples;
+
+	vector<TrackChunk> m_chunks;
+	vector<int> m_freeSlots;				// Unused slots of the chunk pool
+	vector<TexturedVertex> m_scratchVertices;	// For building a chunk or a changed range of a curve
+	GLuint m_trackBuffer;					// Chunk pool, maxResidentChunks slots of m_slotVertices vertices
+	int m_chunkSamples;
+	int m_slotVertices;
+	int m_numResidentChunks;
+	int m_numVisibleChunks;
+	int m_numChunkUploads;
 
 	string m_directory;
 	string m_filename;
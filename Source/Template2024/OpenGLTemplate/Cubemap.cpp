@@ -1,6 +1,7 @@
 #include "Common.h"
 
 #include "Cubemap.h"
+#include "ResourceTracker.h"
 
 
 #include "include\freeimage\FreeImage.h"
@@ -65,6 +66,16 @@ void CCubemap::Bind(int iTextureUnit)
 	glBindSampler(iTextureUnit, m_uiSampler);
 }
 
+GLuint CCubemap::GetTextureID()
+{
+	return m_uiTexture;
+}
+
+GLuint CCubemap::GetSamplerID()
+{
+	return m_uiSampler;
+}
+
 
 // Create the plane, including its geometry, texture mapping, normal, and colour
 void CCubemap::Create(string sPositiveX, string sNegativeX, string sPositiveY, string sNegativeY, string sPositiveZ, string sNegativeZ)
@@ -108,7 +119,7 @@ void CCubemap::Create(string sPositiveX, string sNegativeX, string sPositiveY, s
 	glSamplerParameteri(m_uiSampler, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
 	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
-
+	CResourceTracker::TrackTexture(m_uiTexture, 6 * CResourceTracker::GetTextureBytes(GL_RGB, iWidth, iHeight, true), "cubemap", sPositiveX);
 }
 
 
@@ -116,6 +127,7 @@ void CCubemap::Create(string sPositiveX, string sNegativeX, string sPositiveY, s
 // Release resources
 void CCubemap::Release()
 {
+	CResourceTracker::UntrackTexture(m_uiTexture);
 	glDeleteSamplers(1, &m_uiSampler);
 	glDeleteTextures(1, &m_uiTexture);
 }
\ No newline at end of file
@@ -11,6 +11,8 @@ public:
 	void Release();
 	bool LoadTexture(string filename, BYTE **bmpBytes, int &iWidth, int &iHeight);
 	void Bind(int iTextureUnit = 0);
+	GLuint GetTextureID();
+	GLuint GetSamplerID();
 
 
 private:
@@ -1,4 +1,5 @@
 #include "FaceVertexMesh.h"
+#include "ResourceTracker.h"
 #define BUFFER_OFFSET(i) ((char *)NULL + (i))
 
 CFaceVertexMesh::CFaceVertexMesh()
@@ -51,7 +52,7 @@ void CFaceVertexMesh::ComputeVertexNormals()
 
 
 
-bool CFaceVertexMesh::CreateFromTriangleList(const std::vector<CVertex>& vertices, const std::vector<unsigned int>& triangles)
+bool CFaceVertexMesh::CreateFromTriangleList(const std::vector<CVertex>& vertices, const std::vector<unsigned int>& triangles, const char* owner)
 {
 	// Set the vertices and indices
 	m_vertices = vertices;
@@ -102,6 +103,15 @@ bool CFaceVertexMesh::CreateFromTriangleList(const std::vector<CVertex>& vertice
 	glEnableVertexAttribArray(2);
 	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(glm::vec3) + sizeof(glm::vec2)));
 
+	// The mesh keeps its vertices, triangles and the triangles around each vertex on the CPU
+	size_t adjacencyBytes = m_onTriangle.capacity() * sizeof(TriangleList);
+	for (unsigned int i = 0; i < m_onTriangle.size(); i++)
+		adjacencyBytes += m_onTriangle[i].id.capacity() * sizeof(unsigned int);
+	CResourceTracker::TrackBuffer(uiVBOVertices, vertices.size() * sizeof(CVertex), owner);
+	CResourceTracker::TrackBuffer(uiVBOIndices, m_triangles.size() * sizeof(GLuint), owner);
+	CResourceTracker::TrackCpuCopy(&m_vertices, m_vertices.capacity() * sizeof(CVertex), owner);
+	CResourceTracker::TrackCpuCopy(&m_triangles, m_triangles.capacity() * sizeof(unsigned int), owner);
+	CResourceTracker::TrackCpuCopy(&m_onTriangle, adjacencyBytes, owner);
 
 	return true;
 }
@@ -116,3 +126,13 @@ void CFaceVertexMesh::Render()
 	glDrawElements(GL_TRIANGLES, m_triangles.size(), GL_UNSIGNED_INT, BUFFER_OFFSET(0));
 
 }
+
+UINT CFaceVertexMesh::GetVAO()
+{
+	return m_uiVAO;
+}
+
+unsigned int CFaceVertexMesh::GetIndexCount()
+{
+	return (unsigned int)m_triangles.size();
+}
@@ -31,10 +31,12 @@ public:
 	CFaceVertexMesh();
 	~CFaceVertexMesh();
 	void Render();
-	bool CreateFromTriangleList(const std::vector<CVertex>& vertices, const std::vector<unsigned int>& triangles);
+	bool CreateFromTriangleList(const std::vector<CVertex>& vertices, const std::vector<unsigned int>& triangles, const char* owner = "face vertex mesh");
 	void ComputeVertexNormals();
 	glm::vec3 ComputeTriangleNormal(unsigned int tId);
 	void ComputeTextureCoordsXZ(float xScale, float zScale);
+	UINT GetVAO();
+	unsigned int GetIndexCount();
 
 
 private:
@@ -0,0 +1,87 @@
+#include "FrameArena.h"
+
+CFrameArena::CFrameArena()
+{
+	m_pBlock = NULL;
+	m_capacity = 0;
+	m_used = 0;
+	m_overflowBytes = 0;
+	m_frameBytes = 0;
+	m_peakBytes = 0;
+}
+
+CFrameArena::~CFrameArena()
+{
+	Release();
+}
+
+void CFrameArena::Create(size_t capacity)
+{
+	Release();
+	m_pBlock = (BYTE*)malloc(capacity);
+	m_capacity = capacity;
+	m_used = 0;
+}
+
+void* CFrameArena::Allocate(size_t size, size_t alignment)
+{
+	// malloc only aligns the block to 16 bytes, so it is the address that is aligned rather than the offset
+	size_t start = (size_t)m_pBlock + m_used;
+	size_t offset = m_used + (((start + alignment - 1) & ~(alignment - 1)) - start);
+	if (offset + size <= m_capacity) {
+		m_used = offset + size;
+		return m_pBlock + offset;
+	}
+
+	// Out of room this frame.  Note how much more was needed so that Reset can grow the block.
+	void* p = _aligned_malloc(size, alignment);
+	m_overflowBlocks.push_back(p);
+	m_overflowBytes += size + alignment;
+	return p;
+}
+
+void CFrameArena::Reset()
+{
+	m_frameBytes = m_used + m_overflowBytes;
+	if (m_frameBytes > m_peakBytes)
+		m_peakBytes = m_frameBytes;
+
+	if (!m_overflowBlocks.empty()) {
+		for (unsigned int i = 0; i < m_overflowBlocks.size(); i++)
+			_aligned_free(m_overflowBlocks[i]);
+		m_overflowBlocks.clear();
+		free(m_pBlock);
+		m_capacity = glm::max(m_capacity * 2, m_frameBytes * 2);
+		m_pBlock = (BYTE*)malloc(m_capacity);
+	}
+	m_used = 0;
+	m_overflowBytes = 0;
+}
+
+size_t CFrameArena::GetFrameBytes()
+{
+	return m_frameBytes;
+}
+
+size_t CFrameArena::GetPeakBytes()
+{
+	return m_peakBytes;
+}
+
+size_t CFrameArena::GetCapacity()
+{
+	return m_capacity;
+}
+
+void CFrameArena::Release()
+{
+	for (unsigned int i = 0; i < m_overflowBlocks.size(); i++)
+		_aligned_free(m_overflowBlocks[i]);
+	m_overflowBlocks.clear();
+	if (m_pBlock)
+		free(m_pBlock);
+	m_pBlock = NULL;
+	m_capacity = 0;
+	m_used = 0;
+	m_overflowBytes = 0;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Common.h"
+
+// Linear allocator for data that only lives for one frame.  Allocate just moves a pointer along one block, nothing
+// is freed on its own, and Reset at the start of the next frame makes the whole block free again.  If a frame needs
+// more than the block holds, the extra allocations come from the heap and the block is enlarged at the next Reset,
+// so a steady state frame never touches the heap.
+class CFrameArena
+{
+public:
+	CFrameArena();
+	~CFrameArena();
+
+	void Create(size_t capacity);
+
+	// alignment must be a power of two
+	void* Allocate(size_t size, size_t alignment = 16);
+
+	// Free everything allocated since the last Reset
+	void Reset();
+
+	// Bytes used by the last frame before it was reset, and the most any frame has used
+	size_t GetFrameBytes();
+	size_t GetPeakBytes();
+	size_t GetCapacity();
+
+	void Release();
+
+private:
+	BYTE* m_pBlock;
+	size_t m_capacity;
+	size_t m_used;
+	vector<void*> m_overflowBlocks;
+	size_t m_overflowBytes;
+	size_t m_frameBytes;
+	size_t m_peakBytes;
+};
+
+// Standard library allocator that takes its memory from a frame arena.  Containers using it must not outlive the
+// frame, and deallocation does nothing.
+template <class T>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+
+	ArenaAllocator(CFrameArena* arena) : m_pArena(arena) {}
+	template <class U> ArenaAllocator(const ArenaAllocator<U>& other) : m_pArena(other.m_pArena) {}
+
+	T* allocate(size_t n) { return (T*)m_pArena->Allocate(n * sizeof(T), alignof(T) > 16 ? alignof(T) : 16); }
+	void deallocate(T*, size_t) {}
+
+	template <class U> bool operator==(const ArenaAllocator<U>& other) const { return m_pArena == other.m_pArena; }
+	template <class U> bool operator!=(const ArenaAllocator<U>& other) const { return m_pArena != other.m_pArena; }
+
+	CFrameArena* m_pArena;
+};
+
+// Containers for transient per frame data.  Construct them with the arena, e.g. FrameString text(arena);
+template <class T> using FrameVector = std::vector<T, ArenaAllocator<T>>;
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>> FrameString;
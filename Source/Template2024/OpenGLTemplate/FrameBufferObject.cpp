@@ -1,5 +1,6 @@
 #include "Common.h"
 #include "FrameBufferObject.h"
+#include "ResourceTracker.h"
 #include "./include/glm/gtc/matrix_transform.hpp"
 
 CFrameBufferObject::CFrameBufferObject()
@@ -54,6 +55,8 @@ bool CFrameBufferObject::Create(int a_iWidth, int a_iHeight)
 
 	m_iWidth = a_iWidth;
 	m_iHeight = a_iHeight;
+	CResourceTracker::TrackTexture(m_uiColourTexture, CResourceTracker::GetTextureBytes(GL_RGBA8, a_iWidth, a_iHeight, true), "framebuffer");
+	CResourceTracker::TrackTexture(m_uiDepthTexture, CResourceTracker::GetTextureBytes(GL_DEPTH_COMPONENT24, a_iWidth, a_iHeight, false), "framebuffer");
 	
 	// Check completeness
 	return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
@@ -101,11 +104,21 @@ void CFrameBufferObject::Release()
 		m_uiFramebuffer = 0;
 	}
 	
+	CResourceTracker::UntrackTexture(m_uiColourTexture);
+	CResourceTracker::UntrackTexture(m_uiDepthTexture);
 	glDeleteSamplers(1, &m_uiSampler);
 	glDeleteTextures(1, &m_uiColourTexture);
 	glDeleteTextures(1, &m_uiDepthTexture);
 }
 
+// Regenerate the mipmaps of the colour texture without leaving it bound to a texture unit used for drawing
+void CFrameBufferObject::GenerateTextureMipmaps()
+{
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, m_uiColourTexture);
+	glGenerateMipmap(GL_TEXTURE_2D);
+}
+
 int CFrameBufferObject::GetWidth()
 {
 	return m_iWidth;
@@ -116,6 +129,16 @@ int CFrameBufferObject::GetHeight()
 	return m_iHeight;
 }
 
+UINT CFrameBufferObject::GetTextureID()
+{
+	return m_uiColourTexture;
+}
+
+UINT CFrameBufferObject::GetSamplerID()
+{
+	return m_uiSampler;
+}
+
 void CFrameBufferObject::SetSamplerObjectParameter(GLenum parameter, GLenum value)
 {
 	glSamplerParameteri(m_uiSampler, parameter, value);
@@ -18,6 +18,9 @@ public:
 	// Bind the texture (usually on a 2nd or later pass in a multi-pass rendering technique)
 	void BindTexture(int iTextureUnit);
 
+	// Regenerate the mipmaps of the colour texture after rendering into it
+	void GenerateTextureMipmaps();
+
 	// Bind the depth (usually on a 2nd or later pass in a multi-pass rendering technique)
 	void BindDepth(int iTextureUnit);
 
@@ -33,6 +36,10 @@ public:
 	int GetWidth();
 	int GetHeight();
 
+	// Get the colour texture and its sampler
+	UINT GetTextureID();
+	UINT GetSamplerID();
+
 private:
 
 	
@@ -23,7 +23,7 @@ Result:	Creates one single character (its
 
 inline int next_p2(int n){int res = 1; while(res < n)res <<= 1; return res;}
 
-void CFreeTypeFont::CreateChar(int index)
+void CFreeTypeFont::CreateChar(int index, CVertexStream<GlyphVertex>& vertices)
 {
 	FT_Load_Glyph(m_ftFace, FT_Get_Char_Index(m_ftFace, index), FT_LOAD_DEFAULT);
 
@@ -41,7 +41,7 @@ void CFreeTypeFont::CreateChar(int index)
  
 	// And create a texture from it
 
-	m_charTextures[index].CreateFromData(bData, iTW, iTH, 8, GL_DEPTH_COMPONENT, false);
+	m_charTextures[index].CreateFromData(bData, iTW, iTH, 8, GL_DEPTH_COMPONENT, false, "font");
 	m_charTextures[index].SetSamplerObjectParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	m_charTextures[index].SetSamplerObjectParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	m_charTextures[index].SetSamplerObjectParameter(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -70,8 +70,10 @@ void CFreeTypeFont::CreateChar(int index)
 
 	// Add this char to VBO
 	for (int i = 0; i < 4; i++) {
-		m_vbo.AddData(&vQuad[i], sizeof(glm::vec2));
-		m_vbo.AddData(&vTexQuad[i], sizeof(glm::vec2));
+		GlyphVertex vertex;
+		vertex.position = vQuad[i];
+		vertex.texCoord = vTexQuad[i];
+		vertices.Add(vertex);
 	}
 	delete[] bData;
 }
@@ -97,14 +99,17 @@ bool CFreeTypeFont::LoadFont(string file, int ipixelSize)
 	m_vbo.Create();
 	m_vbo.Bind();
 
+	// Write the quads straight into the VBO
+	CVertexStream<GlyphVertex> vertices;
+	vertices.Map(GL_ARRAY_BUFFER, 128 * 4, GL_STATIC_DRAW);
 	for (int i = 0; i < 128; i++)
-		CreateChar(i);
+		CreateChar(i, vertices);
 	m_isLoaded = true;
 
 	FT_Done_Face(m_ftFace);
 	FT_Done_FreeType(m_ftLib);
 	
-	m_vbo.UploadDataToGPU(GL_STATIC_DRAW);
+	m_vbo.UploadDataToGPU(vertices, GL_STATIC_DRAW, "font");
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2)*2, 0);
 	glEnableVertexAttribArray(1);
@@ -125,7 +130,7 @@ bool CFreeTypeFont::LoadSystemFont(string name, int ipixelSize)
 
 
 // Prints text at the specified location (x, y) with the given pixel size (iPXSize)
-void CFreeTypeFont::Print(string text, int x, int y, int pixelSize)
+void CFreeTypeFont::Print(const char* text, int x, int y, int pixelSize)
 {
 	if(!m_isLoaded)
 		return;
@@ -138,7 +143,7 @@ void CFreeTypeFont::Print(string text, int x, int y, int pixelSize)
 	if (pixelSize == -1)
 		pixelSize = m_loadedPixelSize;
 	float fScale = float(pixelSize) / float(m_loadedPixelSize);
-	for (int i = 0; i < (int) text.size(); i++) {
+	for (int i = 0; text[i] != 0; i++) {
 		if (text[i] == '\n')
 		{
 			iCurX = x;
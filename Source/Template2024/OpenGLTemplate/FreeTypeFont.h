@@ -8,6 +8,12 @@
 #include "Shaders.h"
 #include "VertexBufferObject.h"
 
+// A corner of a glyph's quad
+struct GlyphVertex
+{
+	glm::vec2 position;
+	glm::vec2 texCoord;
+};
 
 // This class is a wrapper for FreeType fonts and their usage with OpenGL
 class CFreeTypeFont
@@ -21,7 +27,7 @@ public:
 
 	int GetTextWidth(string text, int pixelSize);
 
-	void Print(string text, int x, int y, int pixelSize = -1);
+	void Print(const char* text, int x, int y, int pixelSize = -1);
 	void Render(int x, int y, int pixelSize, const char* text, ...);
 
 	
@@ -30,7 +36,7 @@ public:
 	void SetShaderProgram(CShaderProgram* shaderProgram);
 
 private:
-	void CreateChar(int index);
+	void CreateChar(int index, CVertexStream<GlyphVertex>& vertices);
 
 	CTexture m_charTextures[256];
 	int m_advX[256], m_advY[256];
@@ -0,0 +1,57 @@
+#include "Frustum.h"
+
+CFrustum::CFrustum()
+{
+	for (int i = 0; i < 6; i++)
+		m_planes[i] = glm::vec4(0.0f);
+}
+
+CFrustum::~CFrustum()
+{}
+
+// Gribb/Hartmann plane extraction.  Each plane is a sum or difference of the fourth row and one of the other rows.
+void CFrustum::Set(const glm::mat4& m)
+{
+	glm::vec4 row0 = glm::vec4(m[0][0], m[1][0], m[2][0], m[3][0]);
+	glm::vec4 row1 = glm::vec4(m[0][1], m[1][1], m[2][1], m[3][1]);
+	glm::vec4 row2 = glm::vec4(m[0][2], m[1][2], m[2][2], m[3][2]);
+	glm::vec4 row3 = glm::vec4(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	m_planes[0] = row3 + row0;
+	m_planes[1] = row3 - row0;
+	m_planes[2] = row3 + row1;
+	m_planes[3] = row3 - row1;
+	m_planes[4] = row3 + row2;
+	m_planes[5] = row3 - row2;
+
+	for (int i = 0; i < 6; i++)
+		m_planes[i] /= glm::length(glm::vec3(m_planes[i]));
+}
+
+// Test the corner of the box furthest along each plane normal; if it is behind any plane the whole box is outside
+bool CFrustum::IsBoxVisible(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+{
+	for (int i = 0; i < 6; i++) {
+		glm::vec3 p;
+		p.x = m_planes[i].x >= 0.0f ? boxMax.x : boxMin.x;
+		p.y = m_planes[i].y >= 0.0f ? boxMax.y : boxMin.y;
+		p.z = m_planes[i].z >= 0.0f ? boxMax.z : boxMin.z;
+		if (glm::dot(glm::vec3(m_planes[i]), p) + m_planes[i].w < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+bool CFrustum::IsSphereVisible(const glm::vec3& centre, float radius) const
+{
+	for (int i = 0; i < 6; i++) {
+		if (glm::dot(glm::vec3(m_planes[i]), centre) + m_planes[i].w < -radius)
+			return false;
+	}
+	return true;
+}
+
+const glm::vec4& CFrustum::GetPlane(int i) const
+{
+	return m_planes[i];
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Common.h"
+
+// The six clipping planes of a camera, used to skip geometry that cannot be seen
+class CFrustum
+{
+public:
+	CFrustum();
+	~CFrustum();
+
+	// Extract the planes from a combined projection * view matrix.  Planes are in world coordinates.
+	void Set(const glm::mat4& viewProjectionMatrix);
+
+	// Return true if any part of the axis aligned box may be inside the frustum
+	bool IsBoxVisible(const glm::vec3& boxMin, const glm::vec3& boxMax) const;
+
+	// Return true if any part of the sphere may be inside the frustum
+	bool IsSphereVisible(const glm::vec3& centre, float radius) const;
+
+	const glm::vec4& GetPlane(int i) const;
+
+private:
+	glm::vec4 m_planes[6];	// Left, right, bottom, top, near, far.  xyz is the inward facing normal.
+};
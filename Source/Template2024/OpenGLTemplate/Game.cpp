@@ -41,7 +41,10 @@ Source code drawn from a number of sources and examples, including contributions
 #include "OpenAssetImportMesh.h"
 #include "Audio.h"
 #include "FrameBufferObject.h"
+#include "ResourceTracker.h"
 #include <chrono>
+#include <stack>
+#include <float.h>
 
 
 // Constructor
@@ -53,6 +56,8 @@ Game::Game()
 	m_pShaderPrograms = NULL;
 	m_pFtFont = NULL;
 	m_pCarMesh = NULL;
+	m_pCarMesh1 = NULL;
+	m_pCarMesh2 = NULL;
 	m_pIceMesh = NULL;
 	m_pSignMesh = NULL;
 	m_pTunnelMesh = NULL;
@@ -61,8 +66,10 @@ Game::Game()
 	m_pIceBergMesh = NULL;
 	m_pStreetLightMesh = NULL;
 	m_pTree = NULL;
+	m_pCubeTree = NULL;
 	m_pSnow = NULL;
 	m_pHighResolutionTimer = NULL;
+	m_pGameLoopTimer = NULL;
 	m_pAudio = NULL;
 	m_pHeightmapTerrain = NULL;
 	m_pCatmullRom = NULL;
@@ -71,6 +78,29 @@ Game::Game()
 	m_pPlane = NULL;
 	m_pPlaneFBO = NULL;
 	m_pSpeedometerImage = NULL;
+	m_pRenderQueue = NULL;
+	m_pStaticBatch = NULL;
+	m_pIndirectRenderer = NULL;
+	m_pBenchmark = NULL;
+	m_pStressGpuTimer = NULL;
+	m_pSnowGpuTimer = NULL;
+	m_pJobSystem = NULL;
+	m_pShaderCache = NULL;
+	m_pMainShaderVariants = NULL;
+	m_pLightClusters = NULL;
+	m_pLightmap = NULL;
+	m_pPipelineStatistics = NULL;
+	m_pOverdrawHeatmap = NULL;
+	m_pFrameArena = NULL;
+	m_pStreamBuffer = NULL;
+	m_pTrackIndex = NULL;
+	m_pOcclusionCuller = NULL;
+	m_carOcclusionObjects[0] = m_carOcclusionObjects[1] = -1;
+	m_carOcclusionRadius[0] = m_carOcclusionRadius[1] = 0.0f;
+	m_editControlPoint = 0;
+	m_trackEditSamples = 0;
+	m_trackEditMilliseconds = 0.0;
+	m_pStressTransforms = NULL;
 
 	m_dt = 0.0;
 	m_framesPerSecond = 0;
@@ -82,17 +112,41 @@ Game::Game()
 	m_cameraSpeed = 3000;
 	m_cameraRadius = 50;
 	m_currentDistance = 0;
+	m_playerCarExplode = false;
+	m_playerCarJoin = false;
+	m_playerCarExplodeFactor = 0;
+	m_stressObjectCount = 0;
+	m_stressGpuDriven = false;
+	m_stressCpuTime = 0.0;
+	m_snowCpuTime = 0.0;
 }
 
 // Destructor
 Game::~Game()
 {
+	// These objects do not free their GL resources when they are deleted
+	if (m_pSkybox != NULL)
+		m_pSkybox->Release();
+	if (m_pFtFont != NULL)
+		m_pFtFont->ReleaseFont();
+	if (m_pPlane != NULL)
+		m_pPlane->Release();
+	if (m_pTree != NULL)
+		m_pTree->Release();
+	if (m_pCubeTree != NULL)
+		m_pCubeTree->Release();
+	if (m_pSpeedometerImage != NULL)
+		m_pSpeedometerImage->Release();
+
 	//game objects
 	delete m_pCamera;
 	delete m_pTVCamera;
 	delete m_pSkybox;
 	delete m_pFtFont;
 	delete m_pCarMesh;
+	delete m_pCarMesh1;
+	delete m_pCarMesh2;
+	delete m_pSnowmanMesh;
 	delete m_pIceMesh;
 	delete m_pSnow;
 	delete m_pSignMesh;
@@ -110,6 +164,24 @@ Game::~Game()
 	delete m_pPlane;
 	delete m_pPlaneFBO;
 	delete m_pSpeedometerImage;
+	delete m_pRenderQueue;
+	delete m_pStaticBatch;
+	delete m_pIndirectRenderer;
+	delete m_pBenchmark;
+	delete m_pStressGpuTimer;
+	delete m_pSnowGpuTimer;
+	delete m_pJobSystem;
+	delete m_pShaderCache;
+	delete m_pMainShaderVariants;
+	delete m_pLightClusters;
+	delete m_pLightmap;
+	delete m_pPipelineStatistics;
+	delete m_pOverdrawHeatmap;
+	delete m_pFrameArena;
+	delete m_pStreamBuffer;
+	delete m_pTrackIndex;
+	delete m_pOcclusionCuller;
+	delete m_pStressTransforms;
 
 	if (m_pShaderPrograms != NULL) {
 		for (unsigned int i = 0; i < m_pShaderPrograms->size(); i++)
@@ -119,6 +191,10 @@ Game::~Game()
 
 	//setup objects
 	delete m_pHighResolutionTimer;
+	delete m_pGameLoopTimer;
+
+	// Anything still tracked now was never released
+	CResourceTracker::ReportLeaks("resource_leaks.txt");
 }
 
 // Initialisation:  This method only runs once at startup
@@ -165,6 +241,30 @@ void Game::Initialise()
 	m_pPlane = new CPlane;
 	m_pPlaneFBO = new CFrameBufferObject;
 	m_pSpeedometerImage = new CTexture;
+	m_pRenderQueue = new CRenderQueue;
+	m_pStaticBatch = new CStaticBatch;
+	m_pIndirectRenderer = new CIndirectRenderer;
+	m_pBenchmark = new CBenchmark;
+	m_pStressGpuTimer = new CGpuTimer;
+	m_pSnowGpuTimer = new CGpuTimer;
+	m_pJobSystem = new CJobSystem;
+	m_pJobSystem->Initialise();
+	m_pShaderCache = new CShaderCache;
+	m_pMainShaderVariants = new CShaderVariants;
+	// Per-frame uploads go through a persistently mapped ring when the context supports it.  Each frame's region has
+	// room for a million snowflakes and the light cluster data.
+	m_pStreamBuffer = new CStreamBuffer;
+	m_pStreamBuffer->Create(20 * 1024 * 1024);
+	m_pLightClusters = new CLightClusters;
+	m_pLightClusters->Create(m_pJobSystem);
+	m_pLightClusters->SetStreamBuffer(m_pStreamBuffer);
+	m_pLightmap = new CLightmap;
+	m_pPipelineStatistics = new CPipelineStatistics;
+	m_pOverdrawHeatmap = new COverdrawHeatmap;
+	m_pOcclusionCuller = new COcclusionCuller;
+	m_pFrameArena = new CFrameArena;
+	m_pFrameArena->Create(256 * 1024);
+	m_pStressTransforms = new CTransformBatch;
 
 	m_resetCar = false;
 	m_lives = 3;
@@ -181,9 +281,35 @@ void Game::Initialise()
 	m_pTVCamera->SetPerspectiveProjectionMatrix(45.0f, (float)width / (float)height, 0.5f, 5000.0f);
 
 	LoadShaders();
+	CreateRenderPipelines();
+	m_pRenderQueue->SetFarDistance(5000.0f);
+
+	// Decode the meshes on the worker threads while the main thread creates the rest of the scene.  Each mesh's
+	// buffers and textures are created on the main thread as soon as that mesh has been decoded.
+	COpenAssetImportMesh* meshes[] = { m_pCarMesh, m_pCarMesh1, m_pCarMesh2, m_pSignMesh, m_pTunnelMesh,
+		m_pBarricadeMesh, m_pIceMesh, m_pStreetLightMesh, m_pIceBergMesh, m_pSnowmanMesh };
+	string meshFiles[] = { "resources\\models\\Car\\maincar.fbx", "resources\\models\\Car\\car1.fbx",
+		"resources\\models\\Car\\car2.fbx", "resources\\models\\TunnelSign\\objSign.obj", "resources\\models\\Tunnel\\tunnel.obj",
+		"resources\\models\\Barricade\\Barricade1.fbx", "resources\\models\\Iceberg\\gg.fbx", "resources\\models\\StreetLight\\streetlight.obj",
+		"resources\\models\\Iceberg\\ice.obj", "resources\\models\\Iceberg\\snowman.obj" };
+	// The large scenery that is often far away is simplified into levels of detail as it is decoded
+	int meshLods[] = { 1, 1, 1, 1, 4, 1, 4, 1, 4, 4 };
+	const int numMeshes = sizeof(meshes) / sizeof(meshes[0]);
+	CJobCounter meshDecodeJobs[numMeshes];
+	CJobCounter meshUploadJobs;
+	for (int i = 0; i < numMeshes; i++) {
+		COpenAssetImportMesh* mesh = meshes[i];
+		string filename = meshFiles[i];
+		int numLods = meshLods[i];
+		m_pJobSystem->Run([mesh, filename, numLods]() {
+			if (mesh->Decode(filename) && numLods > 1)
+				mesh->GenerateLods(numLods, 0.35f);
+		}, &meshDecodeJobs[i]);
+		m_pJobSystem->RunOnMainThread([mesh]() { mesh->Upload(); }, &meshUploadJobs, &meshDecodeJobs[i]);
+	}
 
 	// Load Textures
-	m_pSpeedometerImage->Load("resources\\textures\\grass.jpg");
+	m_pSpeedometerImage->Load("resources\\textures\\grass.jpg", true, "HUD");
 
 	// Create the skybox
 	// Skybox downloaded from http://www.akimbo.in/forum/viewtopic.php?f=10&t=9
@@ -194,17 +320,8 @@ void Game::Initialise()
 	string terrainTex = "resources\\textures\\Ice.jpg";
 	m_pHeightmapTerrain->Create(&terrainMap[0], &terrainTex[0], glm::vec3(0, 1, 0), 7000.0f, 7000.0f, 175.f);
 
-	// Load some meshes
-	m_pCarMesh->Load("resources\\models\\Car\\maincar.fbx");
-	m_pCarMesh1->Load("resources\\models\\Car\\car1.fbx");
-	m_pCarMesh2->Load("resources\\models\\Car\\car2.fbx");
-	m_pSignMesh->Load("resources\\models\\TunnelSign\\objSign.obj");
-	m_pTunnelMesh->Load("resources\\models\\Tunnel\\tunnel.obj");
-	m_pBarricadeMesh->Load("resources\\models\\Barricade\\Barricade1.fbx");
-	m_pIceMesh->Load("resources\\models\\Iceberg\\gg.fbx");
-	m_pStreetLightMesh->Load("resources\\models\\StreetLight\\streetlight.obj");
-	m_pIceBergMesh->Load("resources\\models\\Iceberg\\ice.obj");
-	m_pSnowmanMesh->Load("resources\\models\\Iceberg\\snowman.obj");
+	// Finish creating the meshes started above
+	m_pJobSystem->Wait(&meshUploadJobs);
 
 	// Create the plane for the tv
 	m_pPlane->Create("resources\\textures\\", "ice.jpg", 40.0f, 30.0f, 1.0f);
@@ -216,8 +333,8 @@ void Game::Initialise()
 	m_pTree->Create("resources\\textures\\", "TreeTex1.png");
 	glEnable(GL_CULL_FACE);
 
-	// Create Snow
-	m_pSnow->Create();
+	// Start with light snow.  The snow itself is created in LoadShaders, once its programs exist.
+	m_pSnow->SetParticleCount(100000);
 
 	// Create a Cube Tree
 	m_pCubeTree->Create("resources\\textures\\", "TreeTex2.png");
@@ -244,20 +361,68 @@ void Game::Initialise()
 	m_pCatmullRom->CreateOffsetCurves(40);
 	m_pCatmullRom->CreateTrack("resources\\textures\\", "road1.jpg");
 
+	//Create the edge for the road, and place the props along the track
+	vector<glm::vec3> leftOffsetPoints, rightOffsetPoints;
+	PlaceTrackProps(leftOffsetPoints, rightOffsetPoints);
+	m_pCatmullRomLeft->CreateCentreline(rightOffsetPoints);
+	m_pCatmullRomLeft->CreateOffsetCurves(2);
+	m_pCatmullRomLeft->CreateTrack("resources\\textures\\", "yellow.jpg");
+	m_pCatmullRomRight->CreateCentreline(leftOffsetPoints);
+	m_pCatmullRomRight->CreateOffsetCurves(2);
+	m_pCatmullRomRight->CreateTrack("resources\\textures\\", "yellow.jpg");
+
+	// Upload the track chunks around the start, so the first frame has them
+	m_pCatmullRom->StreamTrack(m_pCamera->GetPosition(), 5000.0f);
+	m_pCatmullRomLeft->StreamTrack(m_pCamera->GetPosition(), 5000.0f);
+	m_pCatmullRomRight->StreamTrack(m_pCamera->GetPosition(), 5000.0f);
+
+	// Index the road for finding where things off the track are relative to it
+	m_pTrackIndex = new CTrackIndex;
+	m_pTrackIndex->Build(m_pCatmullRom, 100.0f);
+
+	// The streetlights only move when the track is edited, so their light on the terrain and track is baked here and
+	// again after each edit
+	m_pLightmap->Create("lightmapcache", m_pJobSystem, m_pHeightmapTerrain, m_pCatmullRom, m_streetlights);
+
+	m_pPlaneFBO->Create(width, height);
+
+	CreateStaticBatch();
+	CreateStressTest();
+	CreateOcclusionObjects();
+}
+
+// Work out the points of the edge lines and place the props that follow the track: the trees, the barricades and the
+// streetlights with their lights.  There is one edge point for each of the road's centreline points.
+void Game::PlaceTrackProps(vector<glm::vec3>& leftOffsetPoints, vector<glm::vec3>& rightOffsetPoints)
+{
+	m_tree_positions.clear();
+	m_barricade_positions.clear();
+	m_collidables.clear();
+	m_streetlight_positions.clear();
+	m_streetlight_rotations.clear();
+	m_streetlights.clear();
+
 	//Create the edge for the road
-	auto centreLinePoints = m_pCatmullRom->m_centrelinePoints;
-	auto rightOffsetPoints = m_pCatmullRom->m_rightOffsetPoints;
-	auto leftOffsetPoints = m_pCatmullRom->m_leftOffsetPoints;
+	const vector<glm::vec3>& centreLinePoints = m_pCatmullRom->m_centrelinePoints;
+	rightOffsetPoints = m_pCatmullRom->m_rightOffsetPoints;
+	leftOffsetPoints = m_pCatmullRom->m_leftOffsetPoints;
 	for (int i = 0; i < rightOffsetPoints.size(); i++)
 	{
 		rightOffsetPoints[i] += ((centreLinePoints[i] - rightOffsetPoints[i]) * 2.05f);
 		leftOffsetPoints[i] += ((centreLinePoints[i] - leftOffsetPoints[i]) * 2.05f);
+	}
 
+	// The props are placed at 500 stations spaced evenly along the road, each at the nearest centreline point, so
+	// their layout does not depend on how finely the road is sampled
+	const int numStations = 500;
+	for (int station = 0; station < numStations; station++)
+	{
+		int i = m_pCatmullRom->GetSampleAtDistance(station * m_pCatmullRom->GetLength() / numStations);
 
 		//Set the tree positions
-		if (i < 50 || (i > 250 && i < 300))
+		if (station < 50 || (station > 250 && station < 300))
 		{
-			if (i % 2 == 0)
+			if (station % 2 == 0)
 			{
 				m_tree_positions.push_back(rightOffsetPoints[i] + (centreLinePoints[i] - rightOffsetPoints[i]) * 3.f);
 			}
@@ -268,14 +433,14 @@ void Game::Initialise()
 		}
 
 		//Set the barricade positions
-		if (i % 50 == 0)
+		if (station % 50 == 0)
 		{
-			if (i % 150 == 0)
+			if (station % 150 == 0)
 			{
 				m_barricade_positions.push_back(centreLinePoints[i]);
 				m_collidables.push_back(centreLinePoints[i]);
 			}
-			else if (i % 100 == 0)
+			else if (station % 100 == 0)
 			{
 				m_barricade_positions.push_back(rightOffsetPoints[i] + glm::normalize(centreLinePoints[i] - rightOffsetPoints[i]) * 4.f);
 				m_collidables.push_back(rightOffsetPoints[i] + glm::normalize(centreLinePoints[i] - rightOffsetPoints[i]) * 4.f);
@@ -287,92 +452,676 @@ void Game::Initialise()
 			}
 		}
 
-		//Set the streetlight positions
-		if (i % 100 == 0)
+		//Set the streetlight positions, with the arm of each post turned to reach out over the road
+		if (station % 100 == 0)
 		{
+			glm::vec3 toCentre = centreLinePoints[i] - rightOffsetPoints[i];
+			toCentre.y = 0;
+			toCentre = glm::normalize(toCentre);
 			m_streetlight_positions.push_back(rightOffsetPoints[i]);
+			m_streetlight_rotations.push_back(glm::degrees(atan2(-toCentre.x, -toCentre.z)));
+
+			// The light shines down from the lamp at the end of the arm.  Its colours are multiplied by the
+			// streetlight material's reflectance.
+			ClusterLight light;
+			light.position = rightOffsetPoints[i] + toCentre * 10.f + glm::vec3(0, 30, 0);
+			light.direction = glm::vec3(0, -1, 0);
+			light.ambient = glm::vec3(1.0f, 1.0f, 0.0f) * glm::vec3(0.001f);
+			light.diffuse = glm::vec3(1.0f, 1.0f, 0.0f) * glm::vec3(0.25f, 0.25f, 0);
+			light.specular = glm::vec3(1.0f, 1.0f, 0.0f) * glm::vec3(0.25f, 0.25f, 0.0f);
+			light.range = 150.0f;
+			light.cutoff = 90.0f;
+			light.exponent = 2.0f;
+			light.shininess = 0.1f;
+			light.baked = true;
+			m_streetlights.push_back(light);
 		}
 	}
 	m_barricade_positions[0].z = -10;
 	m_barricade_positions[0].x += 30;
 	m_collidables[0] = m_barricade_positions[0];
 	m_collidables[0].z = -10;
-	m_pCatmullRomLeft->CreateCentreline(rightOffsetPoints);
-	m_pCatmullRomLeft->CreateOffsetCurves(2);
-	m_pCatmullRomLeft->CreateTrack("resources\\textures\\", "yellow.jpg");
-	m_pCatmullRomRight->CreateCentreline(leftOffsetPoints);
-	m_pCatmullRomRight->CreateOffsetCurves(2);
-	m_pCatmullRomRight->CreateTrack("resources\\textures\\", "yellow.jpg");
+}
 
-	m_pPlaneFBO->Create(width, height);
+// Move one of the road's control points and update everything derived from the track to match.  The road and edge
+// lines only re-sample and upload the parts that moved; the props are cheap to place again, but the static batch and
+// the lightmap have to be rebuilt around them.
+void Game::MoveTrackControlPoint(int index, const glm::vec3& point)
+{
+	CHighResolutionTimer timer;
+	timer.Start();
+
+	m_pCatmullRom->MoveControlPoint(index, point);
+	if (!m_pCatmullRom->UpdateTrack())
+		return;
+
+	// The edge lines' control points are the road's edge points, so only the ones next to the changed samples move
+	vector<glm::vec3> leftOffsetPoints, rightOffsetPoints;
+	PlaceTrackProps(leftOffsetPoints, rightOffsetPoints);
+	const vector<int>& changed = m_pCatmullRom->GetChangedSamples();
+	for (unsigned int i = 0; i < changed.size(); i++) {
+		m_pCatmullRomLeft->MoveControlPoint(changed[i], rightOffsetPoints[changed[i]]);
+		m_pCatmullRomRight->MoveControlPoint(changed[i], leftOffsetPoints[changed[i]]);
+	}
+	m_pCatmullRomLeft->UpdateTrack();
+	m_pCatmullRomRight->UpdateTrack();
+	m_trackEditSamples = (int)changed.size();
+	m_pTrackIndex->Build(m_pCatmullRom, 100.0f);
+
+	m_pStaticBatch->Release();
+	CreateStaticBatch();
+	CreateOcclusionObjects();
+	m_pLightmap->Release();
+	m_pLightmap->Create("lightmapcache", m_pJobSystem, m_pHeightmapTerrain, m_pCatmullRom, m_streetlights);
+
+	m_trackEditMilliseconds = timer.Elapsed();
+}
+
+// Place the props that never move and merge them into the static batch.  Called once the track derived positions are known.
+void Game::CreateStaticBatch()
+{
+	glutil::MatrixStack modelMatrixStack;
+	modelMatrixStack.SetIdentity();
+
+	// Add the Tunnel 
+	modelMatrixStack.Push();
+	modelMatrixStack.Translate(glm::vec3(831, 0, 2000));
+	modelMatrixStack.RotateRadians(glm::vec3(0, 1, 0), glm::radians(-29.0f));
+	modelMatrixStack.Scale(7.f);
+	m_pStaticBatch->AddMesh(m_pTunnelMesh, modelMatrixStack.Top());
+	modelMatrixStack.Pop();
+
+	// Add the Icebergs
+	modelMatrixStack.Push();
+	modelMatrixStack.Translate(glm::vec3(-300, 0, 500));
+	modelMatrixStack.RotateRadians(glm::vec3(0, 1, 1), glm::radians(-29.0f));
+	modelMatrixStack.Scale(50.f);
+	m_pStaticBatch->AddMesh(m_pIceMesh, modelMatrixStack.Top());
+	modelMatrixStack.Pop();
+
+	modelMatrixStack.Push();
+	modelMatrixStack.Translate(glm::vec3(-250, 30, 1500));
+	modelMatrixStack.RotateRadians(glm::vec3(1, 1, 0), glm::radians(-75.0f));
+	modelMatrixStack.Scale(70.f);
+	m_pStaticBatch->AddMesh(m_pIceMesh, modelMatrixStack.Top());
+	modelMatrixStack.Pop();
+
+	modelMatrixStack.Push();
+	modelMatrixStack.Translate(glm::vec3(1050, 30, 200));
+	modelMatrixStack.RotateRadians(glm::vec3(1, 1, 0), glm::radians(-75.0f));
+	modelMatrixStack.Scale(70.f);
+	m_pStaticBatch->AddMesh(m_pIceMesh, modelMatrixStack.Top());
+	modelMatrixStack.Pop();
+
+	modelMatrixStack.Push();
+	modelMatrixStack.Translate(glm::vec3(-750, 30, -700));
+	modelMatrixStack.RotateRadians(glm::vec3(1, 1, 0), glm::radians(-75.0f));
+	modelMatrixStack.Scale(70.f);
+	m_pStaticBatch->AddMesh(m_pIceMesh, modelMatrixStack.Top());
+	modelMatrixStack.Pop();
+
+	modelMatrixStack.Push();
+	modelMatrixStack.Translate(glm::vec3(-1250, 50, -300));
+	modelMatrixStack.RotateRadians(glm::vec3(1, 1, 0), glm::radians(-15.0f));
+	modelMatrixStack.Scale(70.f);
+	m_pStaticBatch->AddMesh(m_pIceMesh, modelMatrixStack.Top());
+	modelMatrixStack.Pop();
+
+	modelMatrixStack.Push();
+	modelMatrixStack.Translate(glm::vec3(-1350, 50, 500));
+	modelMatrixStack.RotateRadians(glm::vec3(1, 1, 0), glm::radians(-1845.0f));
+	modelMatrixStack.Scale(70.f);
+	m_pStaticBatch->AddMesh(m_pIceMesh, modelMatrixStack.Top());
+	modelMatrixStack.Pop();
+
+	modelMatrixStack.Push();
+	modelMatrixStack.Translate(glm::vec3(350, 50, 300));
+	modelMatrixStack.RotateRadians(glm::vec3(1, 1, 0), glm::radians(-185.0f));
+	modelMatrixStack.Scale(70.f);
+	m_pStaticBatch->AddMesh(m_pIceMesh, modelMatrixStack.Top());
+	modelMatrixStack.Pop();
+
+	modelMatrixStack.Push();
+	modelMatrixStack.Translate(glm::vec3(550, 50, 1900));
+	modelMatrixStack.RotateRadians(glm::vec3(1, 1, 0), glm::radians(-145.0f));
+	modelMatrixStack.Scale(70.f);
+	m_pStaticBatch->AddMesh(m_pIceMesh, modelMatrixStack.Top());
+	modelMatrixStack.Pop();
+
+	modelMatrixStack.Push();
+	modelMatrixStack.Translate(glm::vec3(1550, -10, 1200));
+	modelMatrixStack.Scale(10.f);
+	m_pStaticBatch->AddMesh(m_pIceBergMesh, modelMatrixStack.Top());
+	modelMatrixStack.Pop();
+
+	modelMatrixStack.Push();
+	modelMatrixStack.Translate(glm::vec3(-550, -10, 200));
+	modelMatrixStack.Scale(7.f);
+	m_pStaticBatch->AddMesh(m_pIceBergMesh, modelMatrixStack.Top());
+	modelMatrixStack.Pop();
+
+	modelMatrixStack.Push();
+	modelMatrixStack.Translate(glm::vec3(-2050, -10, 200));
+	modelMatrixStack.Scale(7.f);
+	m_pStaticBatch->AddMesh(m_pIceBergMesh, modelMatrixStack.Top());
+	modelMatrixStack.Pop();
+
+	// Add the Sign Board
+	modelMatrixStack.Push();
+	modelMatrixStack.Translate(glm::vec3(550, 0, 2500));
+	modelMatrixStack.RotateRadians(glm::vec3(0, 1, 0), glm::radians(90.0f));
+	modelMatrixStack.Scale(10.5f);
+	m_pStaticBatch->AddMesh(m_pSignMesh, modelMatrixStack.Top());
+	modelMatrixStack.Pop();
+
+	// Add the Street Lights
+	for (int i = 0; i < m_streetlight_positions.size(); i++)
+	{
+		modelMatrixStack.Push();
+		modelMatrixStack.Translate(m_streetlight_positions[i]);
+		modelMatrixStack.RotateRadians(glm::vec3(0, 1, 0), glm::radians(90.0f));
+		modelMatrixStack.RotateRadians(glm::vec3(0, 1, 0), glm::radians(m_streetlight_rotations[i]));
+		m_pStaticBatch->AddMesh(m_pStreetLightMesh, modelMatrixStack.Top());
+		modelMatrixStack.Pop();
+	}
+
+	// Add the Snowman
+	modelMatrixStack.Push();
+	modelMatrixStack.Translate(glm::vec3(-1500,0,1000));
+	modelMatrixStack.Scale(3000.f);
+	m_pStaticBatch->AddMesh(m_pSnowmanMesh, modelMatrixStack.Top());
+	modelMatrixStack.Pop();
+
+	modelMatrixStack.Push();
+	modelMatrixStack.Translate(glm::vec3(-100, 0, -300));
+	modelMatrixStack.RotateRadians(glm::vec3(0, 1, 0), glm::radians(-150.0));
+	modelMatrixStack.Scale(5000.f);
+	m_pStaticBatch->AddMesh(m_pSnowmanMesh, modelMatrixStack.Top());
+	modelMatrixStack.Pop();
+
+	modelMatrixStack.Push();
+	modelMatrixStack.Translate(glm::vec3(1000, 0, 1400));
+	modelMatrixStack.RotateRadians(glm::vec3(0, 1, 0), glm::radians(-150.0));
+	modelMatrixStack.Scale(1000.f);
+	m_pStaticBatch->AddMesh(m_pSnowmanMesh, modelMatrixStack.Top());
+	modelMatrixStack.Pop();
+
+	// Add the Barricade
+	vector<float> barricade_rotations = {
+		0, 0, 0, 90, 0, 130, 70, 90, 90, 90
+	};
+	for (int i = 0; i < m_barricade_positions.size(); i++)
+	{
+		modelMatrixStack.Push();
+		modelMatrixStack.Translate(m_barricade_positions[i]);
+		modelMatrixStack.RotateRadians(glm::vec3(0, 1, 0), glm::radians(-90.0));
+		modelMatrixStack.RotateRadians(glm::vec3(0, 1, 0), glm::radians(barricade_rotations[i % barricade_rotations.size()]));
+		modelMatrixStack.Scale(0.04);
+		m_pStaticBatch->AddMesh(m_pBarricadeMesh, modelMatrixStack.Top());
+		modelMatrixStack.Pop();
+	}
+
+	m_pStaticBatch->Build(750.0f);
+}
+
+// Flatten the geometry of a tree into arrays and return its local bounding sphere
+template <class T>
+static glm::vec4 GetTreeGeometry(T* tree, vector<glm::vec3>& positions, vector<glm::vec2>& texCoords, vector<glm::vec3>& normals, vector<unsigned int>& indices)
+{
+	positions = tree->GetVertices();
+	vector<vector<int>> triangles = tree->GetIndices();
+	normals = tree->GetNormals(positions, triangles);
+	texCoords = tree->GetTexCoords();
+	indices.clear();
+	for (unsigned int i = 0; i < triangles.size(); i++) {
+		indices.push_back(triangles[i][0]);
+		indices.push_back(triangles[i][1]);
+		indices.push_back(triangles[i][2]);
+	}
+
+	glm::vec3 boundsMin = positions[0], boundsMax = positions[0];
+	for (unsigned int i = 1; i < positions.size(); i++) {
+		boundsMin = glm::min(boundsMin, positions[i]);
+		boundsMax = glm::max(boundsMax, positions[i]);
+	}
+	return glm::vec4((boundsMin + boundsMax) * 0.5f, glm::length(boundsMax - boundsMin) * 0.5f);
+}
+
+// Register the two tree meshes with the GPU driven renderer and record their bounds for the CPU path
+void Game::CreateStressTest()
+{
+	vector<glm::vec3> positions, normals;
+	vector<glm::vec2> texCoords;
+	vector<unsigned int> indices;
+
+	m_stressBounds[0] = GetTreeGeometry(m_pTree, positions, texCoords, normals, indices);
+	if (CIndirectRenderer::IsSupported())
+		m_pIndirectRenderer->AddMesh(positions, texCoords, normals, indices, m_pTree->GetTexture());
+
+	m_stressBounds[1] = GetTreeGeometry(m_pCubeTree, positions, texCoords, normals, indices);
+	if (CIndirectRenderer::IsSupported())
+		m_pIndirectRenderer->AddMesh(positions, texCoords, normals, indices, m_pCubeTree->GetTexture());
+}
+
+// Register the heavy objects with the occlusion culler: the props in the static batch that have levels of detail, the
+// trees in runs along the track, and the opponent cars, which move too quickly to use last frame's results
+void Game::CreateOcclusionObjects()
+{
+	m_pOcclusionCuller->ClearObjects();
+	m_pStaticBatch->AddOcclusionObjects(m_pOcclusionCuller);
+
+	// The trees are drawn at twice their size with their base at y = 0, and only in the main view (see Render)
+	m_treeClusterObjects.clear();
+	for (unsigned int first = 0; first < m_tree_positions.size(); first += TREE_CLUSTER_SIZE) {
+		unsigned int last = glm::min(first + TREE_CLUSTER_SIZE, (unsigned int)m_tree_positions.size());
+		glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+		for (unsigned int i = first; i < last; i++) {
+			const glm::vec4& bounds = m_stressBounds[i < 50 ? 0 : 1];
+			glm::vec3 centre = glm::vec3(m_tree_positions[i].x, 0.0f, m_tree_positions[i].z) + 2.0f * glm::vec3(bounds);
+			boundsMin = glm::min(boundsMin, centre - glm::vec3(2.0f * bounds.w));
+			boundsMax = glm::max(boundsMax, centre + glm::vec3(2.0f * bounds.w));
+		}
+		m_treeClusterObjects.push_back(m_pOcclusionCuller->AddObject(boundsMin, boundsMax, false, 1 << 0));
+	}
+
+	// The cars turn, so their boxes hold the sphere around their origin that they are drawn in, at a scale of 3.5
+	COpenAssetImportMesh* cars[2] = { m_pCarMesh1, m_pCarMesh2 };
+	for (int c = 0; c < 2; c++) {
+		const vector<Vertex>& vertices = cars[c]->GetVertices();
+		float radius = 0.0f;
+		for (unsigned int i = 0; i < vertices.size(); i++)
+			radius = glm::max(radius, glm::length(vertices[i].m_pos));
+		m_carOcclusionRadius[c] = 3.5f * radius;
+		m_carOcclusionObjects[c] = m_pOcclusionCuller->AddObject(glm::vec3(-m_carOcclusionRadius[c]), glm::vec3(m_carOcclusionRadius[c]), true);
+	}
+}
+
+// Called by the render queue once the opaque scene is drawn
+void Game::IssueOcclusionQueries(void* context)
+{
+	OcclusionPass* occlusion = (OcclusionPass*)context;
+	occlusion->game->m_pOcclusionCuller->IssueQueries(occlusion->view, occlusion->viewMatrix, *occlusion->frustum, occlusion->eye);
+}
+
+// Scatter a number of trees over the terrain.  The same seed is used each time so runs can be compared.
+void Game::SetStressObjectCount(int count)
+{
+	m_stressObjectCount = count;
+	m_stressMatrices.resize(count);
+	m_stressMeshes.resize(count);
+	// The CPU path makes the model-view and normal matrices of every tree each frame with the batch kernel
+	m_pStressTransforms->Resize(count);
+	m_stressTransformed.resize(count);
+
+	srand(1234);
+	vector<glm::vec3> positions(count);
+	vector<float> angles(count);
+	for (int i = 0; i < count; i++) {
+		positions[i].x = -3000.0f + 6000.0f * (rand() / (float)RAND_MAX);
+		positions[i].z = -3000.0f + 6000.0f * (rand() / (float)RAND_MAX);
+		positions[i].y = m_pHeightmapTerrain->ReturnGroundHeight(positions[i]);
+		angles[i] = glm::radians(360.0f * (rand() / (float)RAND_MAX));
+	}
+
+	// Push the trees that landed on the road out to the side of it
+	const float clearance = 40.0f;
+	vector<TrackProjection> projections(count);
+	m_pTrackIndex->Project(positions.data(), count, projections.data(), m_pJobSystem);
+
+	for (int i = 0; i < count; i++) {
+		glm::vec3 p = positions[i];
+		const TrackProjection& projection = projections[i];
+		if (projection.gap < clearance) {
+			p += projection.normal * ((projection.offset < 0.0f ? -clearance : clearance) - projection.offset);
+			p.y = m_pHeightmapTerrain->ReturnGroundHeight(p);
+		}
+		float angle = angles[i];
+		m_stressMatrices[i] = glm::scale(glm::rotate(glm::translate(glm::mat4(1), p), angle, glm::vec3(0, 1, 0)), glm::vec3(2.0f));
+		m_stressMeshes[i] = i % 2;
+		m_pStressTransforms->SetTransform(i, p, glm::angleAxis(angle, glm::vec3(0, 1, 0)), glm::vec3(2.0f));
+	}
+
+	if (CIndirectRenderer::IsSupported())
+		m_pIndirectRenderer->SetObjects(m_stressMeshes, m_stressMatrices);
+}
+
+// Draw the stress test trees, timing the CPU and GPU cost of whichever path is selected
+void Game::RenderStressTest(CCamera* camera, const glm::mat4& viewMatrix, const CFrustum& frustum, const glm::vec4& lightPosition, float la, float ld, float ls)
+{
+	CHighResolutionTimer timer;
+	timer.Start();
+	m_pStressGpuTimer->Begin();
+
+	if (m_stressGpuDriven) {
+		CShaderProgram* pDrawProgram = m_pIndirectRenderer->GetDrawProgram();
+		pDrawProgram->UseProgram();
+		pDrawProgram->SetUniform("light1.position", lightPosition);
+		pDrawProgram->SetUniform("light1.La", glm::vec3(la));
+		pDrawProgram->SetUniform("light1.Ld", glm::vec3(ld));
+		pDrawProgram->SetUniform("light1.Ls", glm::vec3(ls));
+		pDrawProgram->SetUniform("fogDensity", m_gameMode == Dark ? 0.003f : 0.001f);
+		m_pIndirectRenderer->Render(viewMatrix, *camera->GetPerspectiveProjectionMatrix(), frustum);
+	}
+	else {
+		// The CPU path culls the trees and makes their matrices in parallel, then submits the visible ones
+		// individually, as Game::Render does for the track side trees
+		m_stressVisible.resize(m_stressObjectCount);
+		m_pJobSystem->ParallelFor(m_stressObjectCount, 2048, [this, &frustum, &viewMatrix](int first, int last) {
+			for (int i = first; i < last; i++) {
+				const glm::mat4& model = m_stressMatrices[i];
+				const glm::vec4& bounds = m_stressBounds[m_stressMeshes[i]];
+				m_stressVisible[i] = frustum.IsSphereVisible(glm::vec3(model * glm::vec4(glm::vec3(bounds), 1.0f)), bounds.w * 2.0f);
+			}
+			m_pStressTransforms->Transform(viewMatrix, &m_stressTransformed[first], first, last - first);
+		});
+		for (int i = 0; i < m_stressObjectCount; i++) {
+			if (!m_stressVisible[i])
+				continue;
+			const ObjectTransform& transform = m_stressTransformed[i];
+			RenderItem item = m_pRenderQueue->CreateItem(m_treePipeline, transform.modelViewMatrix, transform.GetNormalMatrix());
+			if (m_stressMeshes[i] == 0)
+				m_pTree->Submit(m_pRenderQueue, item);
+			else
+				m_pCubeTree->Submit(m_pRenderQueue, item);
+		}
+		m_pRenderQueue->Flush();
+	}
+
+	m_pStressGpuTimer->End();
+	m_stressCpuTime = timer.Elapsed();
+	m_pBenchmark->AddFrame(m_stressCpuTime, m_pStressGpuTimer->GetMilliseconds());
+}
+
+// Compare the CPU and GPU driven paths at increasing object counts
+void Game::StartStressBenchmark()
+{
+	if (m_pBenchmark->IsRunning())
+		return;
+
+	// The snow is turned off while measuring and put back afterwards
+	int snowCount = m_pSnow->GetParticleCount();
+	int counts[] = { 1000, 10000, 50000 };
+	for (int i = 0; i < 3; i++) {
+		int count = counts[i];
+		m_pBenchmark->AddCase("CPU queue, " + std::to_string(count) + " trees", [this, count]() {
+			m_pSnow->SetParticleCount(0);
+			SetStressObjectCount(count);
+			m_stressGpuDriven = false;
+		});
+		if (CIndirectRenderer::IsSupported()) {
+			m_pBenchmark->AddCase("GPU indirect, " + std::to_string(count) + " trees", [this, count]() {
+				m_pSnow->SetParticleCount(0);
+				SetStressObjectCount(count);
+				m_stressGpuDriven = true;
+			});
+		}
+	}
+	m_pBenchmark->Start("Stress test: CPU render queue vs GPU culling + multi draw indirect", [this, snowCount]() {
+		m_pSnow->SetParticleCount(snowCount);
+	});
+}
+
+// Simulate and draw the snow around the camera, timing the CPU and GPU cost of the selected simulation
+void Game::RenderSnow(CCamera* camera, const glm::mat4& viewMatrix)
+{
+	CHighResolutionTimer timer;
+	timer.Start();
+	m_pSnowGpuTimer->Begin();
+
+	m_pSnow->Update((float)m_dt / 1000.0f, camera->GetPosition());
+	m_pSnow->Render(viewMatrix, *camera->GetPerspectiveProjectionMatrix());
+
+	m_pSnowGpuTimer->End();
+	m_snowCpuTime = timer.Elapsed();
+	m_pBenchmark->AddFrame(m_snowCpuTime, m_pSnowGpuTimer->GetMilliseconds());
+}
+
+// Compare the CPU (SSE, multithreaded) and compute shader snow simulations at increasing densities
+void Game::StartSnowBenchmark()
+{
+	if (m_pBenchmark->IsRunning())
+		return;
+
+	int counts[] = { 10000, 100000, 1000000 };
+	for (int i = 0; i < 3; i++) {
+		int count = counts[i];
+		m_pBenchmark->AddCase("CPU SSE, " + std::to_string(count) + " flakes", [this, count]() {
+			SetStressObjectCount(0);
+			m_pSnow->SetGpuSimulation(false);
+			m_pSnow->SetParticleCount(count);
+		});
+		if (m_pSnow->IsGpuSimulationSupported()) {
+			m_pBenchmark->AddCase("GPU compute, " + std::to_string(count) + " flakes", [this, count]() {
+				SetStressObjectCount(0);
+				m_pSnow->SetGpuSimulation(true);
+				m_pSnow->SetParticleCount(count);
+			});
+		}
+	}
+	m_pBenchmark->Start("Snow: CPU SSE + threads vs GPU compute simulation");
+}
+
+// Time the matrix work of a render pass: a new matrix stack, then a push, transform, normal matrix and pop for each
+// draw.  The old way used a std::stack, which allocates on the first push, and a full 3x3 inverse for every normal
+// matrix; the new way uses the inline stack and CCamera::ComputeNormalMatrix.  Then time the batch transform
+// kernel against glm for large numbers of objects.
+void Game::RunMatrixBenchmark()
+{
+	const int passes = 20000;
+	const int drawsPerPass = 60;
+	glm::vec3 eye = m_pCamera->GetPosition();
+	glm::vec3 view = m_pCamera->GetView();
+	glm::vec3 up = m_pCamera->GetUpVector();
+	glm::mat3 sum(0.0f);
+	CHighResolutionTimer timer;
+
+	timer.Start();
+	for (int pass = 0; pass < passes; pass++) {
+		std::stack<glm::mat4> stack;
+		glm::mat4 top = glm::lookAt(eye, view, up);
+		for (int i = 0; i < drawsPerPass; i++) {
+			stack.push(top);
+			top = glm::translate(top, glm::vec3((float)i, 0.0f, (float)pass));
+			top = glm::rotate(top, (float)i, glm::vec3(0.0f, 1.0f, 0.0f));
+			top = glm::scale(top, glm::vec3(2.0f));
+			sum += glm::transpose(glm::inverse(glm::mat3(top)));
+			top = stack.top();
+			stack.pop();
+		}
+	}
+	double oldMilliseconds = timer.Elapsed();
+
+	timer.Start();
+	for (int pass = 0; pass < passes; pass++) {
+		glutil::MatrixStack stack;
+		stack.LookAt(eye, view, up);
+		for (int i = 0; i < drawsPerPass; i++) {
+			stack.Push();
+			stack.Translate(glm::vec3((float)i, 0.0f, (float)pass));
+			stack.Rotate(glm::vec3(0.0f, 1.0f, 0.0f), (float)i);
+			stack.Scale(2.0f);
+			sum += m_pCamera->ComputeNormalMatrix(stack.Top());
+			stack.Pop();
+		}
+	}
+	double newMilliseconds = timer.Elapsed();
+
+	// Keep the results alive so that the work cannot be optimised away
+	volatile float sink = sum[0][0];
+	(void)sink;
+
+	// The game draws two passes a frame, the TV view and the main view
+	char line[256];
+	sprintf_s(line, "%d draws/pass  std::stack + inverse %.3f us/pass  inline stack + fast normal %.3f us/pass  saving %.3f us/frame",
+		drawsPerPass, oldMilliseconds * 1000.0 / passes, newMilliseconds * 1000.0 / passes,
+		2.0 * (oldMilliseconds - newMilliseconds) * 1000.0 / passes);
+	m_pBenchmark->AddResult("Matrix microbenchmarks", line);
+
+	// The batch kernel against glm one object at a time, both writing into a mapped buffer as they would for
+	// instanced drawing.  Each size does about a million objects in all.
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	int counts[] = { 1000, 10000, 100000 };
+	for (int c = 0; c < 3; c++) {
+		int count = counts[c];
+		int repeats = 1000000 / count;
+		CTransformBatch batch;
+		batch.Resize(count);
+		vector<glm::vec3> translations(count), scales(count);
+		vector<glm::quat> rotations(count);
+		srand(1234);
+		for (int i = 0; i < count; i++) {
+			translations[i] = glm::vec3(rand() % 6000 - 3000.0f, rand() % 100, rand() % 6000 - 3000.0f);
+			rotations[i] = glm::angleAxis(glm::radians(360.0f * (rand() / (float)RAND_MAX)), glm::vec3(0, 1, 0));
+			scales[i] = glm::vec3(1.0f + (rand() % 3));
+			batch.SetTransform(i, translations[i], rotations[i], scales[i]);
+		}
+		glBufferData(GL_ARRAY_BUFFER, count * sizeof(ObjectTransform), NULL, GL_STREAM_DRAW);
+		glm::mat4 viewMatrix = glm::lookAt(eye, view, up);
+
+		timer.Start();
+		for (int r = 0; r < repeats; r++) {
+			ObjectTransform* output = (ObjectTransform*)glMapBufferRange(GL_ARRAY_BUFFER, 0, count * sizeof(ObjectTransform), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+			for (int i = 0; i < count; i++) {
+				glm::mat4 modelView = viewMatrix * glm::scale(glm::translate(glm::mat4(1.0f), translations[i]) * glm::mat4_cast(rotations[i]), scales[i]);
+				glm::mat3 normalMatrix = m_pCamera->ComputeNormalMatrix(modelView);
+				output[i].modelViewMatrix = modelView;
+				for (int j = 0; j < 3; j++)
+					output[i].normalMatrix[j] = glm::vec4(normalMatrix[j], 0.0f);
+			}
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+		}
+		double glmMilliseconds = timer.Elapsed();
+
+		sprintf_s(line, "%6d objects  glm %.2f ns/object", count, glmMilliseconds * 1000000.0 / (repeats * count));
+		string result = line;
+		for (int p = TRANSFORM_PATH_SCALAR; p <= CTransformBatch::GetBestPath(); p++) {
+			batch.SetPath((TransformPath)p);
+			timer.Start();
+			for (int r = 0; r < repeats; r++) {
+				ObjectTransform* output = (ObjectTransform*)glMapBufferRange(GL_ARRAY_BUFFER, 0, count * sizeof(ObjectTransform), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+				batch.Transform(viewMatrix, output, 0, count);
+				glUnmapBuffer(GL_ARRAY_BUFFER);
+			}
+			sprintf_s(line, "  batch %s %.2f ns", CTransformBatch::GetPathName((TransformPath)p), timer.Elapsed() * 1000000.0 / (repeats * count));
+			result += line;
+		}
+		m_pBenchmark->AddResult("Matrix microbenchmarks", result);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glDeleteBuffers(1, &buffer);
 }
 
 void Game::LoadShaders()
 {
-	// Load shaders
-	vector<CShader> shShaders;
-	vector<string> sShaderFileNames;
-	sShaderFileNames.push_back("mainShader.vert");
-	sShaderFileNames.push_back("mainShader.frag");
-	sShaderFileNames.push_back("textShader.vert");
-	sShaderFileNames.push_back("textShader.frag");
-	sShaderFileNames.push_back("treeShader.vert");
-	sShaderFileNames.push_back("treeShader.frag");
-	sShaderFileNames.push_back("carShader.vert");
-	sShaderFileNames.push_back("carShader.geom");
-	sShaderFileNames.push_back("carShader.frag");
-
-	for (int i = 0; i < (int)sShaderFileNames.size(); i++) {
-		string sExt = sShaderFileNames[i].substr((int)sShaderFileNames[i].size() - 4, 4);
-		int iShaderType;
-		if (sExt == "vert") iShaderType = GL_VERTEX_SHADER;
-		else if (sExt == "frag") iShaderType = GL_FRAGMENT_SHADER;
-		else if (sExt == "geom") iShaderType = GL_GEOMETRY_SHADER;
-		else if (sExt == "tcnl") iShaderType = GL_TESS_CONTROL_SHADER;
-		else iShaderType = GL_TESS_EVALUATION_SHADER;
-		CShader shader;
-		shader.LoadShader("resources\\shaders\\" + sShaderFileNames[i], iShaderType);
-		shShaders.push_back(shader);
+	// Add every program to the shader cache first, so that the ones that are not cached can all be compiled together
+	m_pShaderCache->Initialise("shadercache");
+	// The main shader is built once per combination of features that is drawn with, rather than branching on uniforms
+	m_pMainShaderVariants->SetFeatures({ "SKYBOX", "PHONG_MODEL", "CLUSTERED_LIGHTS", "LIGHTMAP" });
+	m_pShaderCache->AddVariants(m_pMainShaderVariants, { "mainShader.vert", "mainShader.frag" }, {
+		MAIN_SHADER_PHONG,
+		MAIN_SHADER_PHONG | MAIN_SHADER_CLUSTERED_LIGHTS,
+		MAIN_SHADER_PHONG | MAIN_SHADER_CLUSTERED_LIGHTS | MAIN_SHADER_LIGHTMAP,
+		MAIN_SHADER_SKYBOX,
+		0 });
+	CShaderProgram* pFontProgram = m_pShaderCache->AddProgram({ "textShader.vert", "textShader.frag" });
+	CShaderProgram* pTreeProgram = m_pShaderCache->AddProgram({ "treeShader.vert", "treeShader.frag" });
+	CShaderProgram* pCarProgram = m_pShaderCache->AddProgram({ "carShader.vert", "carShader.geom", "carShader.frag" });
+	CShaderProgram* pSnowProgram = m_pShaderCache->AddProgram({ "snowShader.vert", "snowShader.frag" });
+	CShaderProgram* pDepthProgram = m_pShaderCache->AddProgram({ "depthOnly.vert", "depthOnly.frag" });
+	CShaderProgram* pOverdrawProgram = m_pShaderCache->AddProgram({ "overdraw.vert", "overdraw.frag" });
+
+	// The GPU driven culling and drawing programs need compute shaders (OpenGL 4.3)
+	CShaderProgram* pCullProgram = NULL;
+	CShaderProgram* pGpuDrivenProgram = NULL;
+	if (CIndirectRenderer::IsSupported()) {
+		pCullProgram = m_pShaderCache->AddProgram({ "gpuCull.comp" });
+		pGpuDrivenProgram = m_pShaderCache->AddProgram({ "gpuDriven.vert", "gpuDriven.frag" });
 	}
 
-	// Create the main shader program
-	CShaderProgram* pMainProgram = new CShaderProgram;
-	pMainProgram->CreateProgram();
-	pMainProgram->AddShaderToProgram(&shShaders[0]);
-	pMainProgram->AddShaderToProgram(&shShaders[1]);
-	pMainProgram->LinkProgram();
-	m_pShaderPrograms->push_back(pMainProgram);
+	// The snow is simulated by a compute shader where it is available and on the CPU otherwise
+	CShaderProgram* pSnowUpdateProgram = NULL;
+	if (GLEW_VERSION_4_3)
+		pSnowUpdateProgram = m_pShaderCache->AddProgram({ "snowUpdate.comp" });
 
-	// Create a shader program for fonts
-	CShaderProgram* pFontProgram = new CShaderProgram;
-	pFontProgram->CreateProgram();
-	pFontProgram->AddShaderToProgram(&shShaders[2]);
-	pFontProgram->AddShaderToProgram(&shShaders[3]);
-	pFontProgram->LinkProgram();
-	m_pShaderPrograms->push_back(pFontProgram);
+	m_pShaderCache->Build();
+	CShaderProgram* pMainProgram = m_pMainShaderVariants->GetVariant(MAIN_SHADER_PHONG);
 
-	// Create the tree shader program
-	CShaderProgram* pTreeProgram = new CShaderProgram;
-	pTreeProgram->CreateProgram();
-	pTreeProgram->AddShaderToProgram(&shShaders[4]);
-	pTreeProgram->AddShaderToProgram(&shShaders[5]);
-	pTreeProgram->LinkProgram();
+	// The order of the first programs is relied on elsewhere: 0 main, 1 font, 2 tree, 3 car, 4 snow
+	m_pShaderPrograms->push_back(pMainProgram);
+	m_pShaderPrograms->push_back(pFontProgram);
 	m_pShaderPrograms->push_back(pTreeProgram);
-
-	// Create the car shader program
-	CShaderProgram* pCarProgram = new CShaderProgram;
-	pCarProgram->CreateProgram();
-	pCarProgram->AddShaderToProgram(&shShaders[6]);
-	pCarProgram->AddShaderToProgram(&shShaders[7]);
-	pCarProgram->AddShaderToProgram(&shShaders[8]);
-	pCarProgram->LinkProgram();
 	m_pShaderPrograms->push_back(pCarProgram);
-
+	m_pShaderPrograms->push_back(pSnowProgram);
+	if (pCullProgram) {
+		m_pShaderPrograms->push_back(pCullProgram);
+		m_pShaderPrograms->push_back(pGpuDrivenProgram);
+		m_pIndirectRenderer->Create(pCullProgram, pGpuDrivenProgram);
+	}
+	if (pSnowUpdateProgram)
+		m_pShaderPrograms->push_back(pSnowUpdateProgram);
+	m_pShaderPrograms->push_back(pDepthProgram);
+	m_pShaderPrograms->push_back(pOverdrawProgram);
+
+	// m_pShaderPrograms owns every program, so the other main shader variants are added after the fixed ones
+	vector<CShaderProgram*> variants = m_pMainShaderVariants->GetPrograms();
+	for (unsigned int i = 0; i < variants.size(); i++) {
+		if (variants[i] != pMainProgram)
+			m_pShaderPrograms->push_back(variants[i]);
+	}
+	m_pRenderQueue->SetDepthPrepassProgram(pDepthProgram);
+	m_pOverdrawHeatmap->Create(pOverdrawProgram);
+	m_pOcclusionCuller->Create(pDepthProgram);
 
 	pCarProgram->SetUniform("bExplodeObject", false);
 	pCarProgram->SetUniform("explodeFactor", 0);
 
 	m_pFtFont->SetShaderProgram(pFontProgram);
+
+	m_pSnow->Create(pSnowProgram, pSnowUpdateProgram, m_pJobSystem);
+	m_pSnow->SetStreamBuffer(m_pStreamBuffer);
+}
+
+// Register the combinations of shader program and shared uniforms used by the render queue
+void Game::CreateRenderPipelines()
+{
+	CShaderProgram* pMainProgram = (*m_pShaderPrograms)[0];
+	CShaderProgram* pCarProgram = (*m_pShaderPrograms)[3];
+
+	// The main shader pipelines have nothing to set per pipeline; Render points them at this frame's variants instead
+	m_mainPipeline = m_pRenderQueue->AddPipeline(pMainProgram);
+	m_lightmappedPipeline = m_pRenderQueue->AddPipeline(pMainProgram);
+	m_skyboxPipeline = m_pRenderQueue->AddPipeline(m_pMainShaderVariants->GetVariant(MAIN_SHADER_SKYBOX));
+	m_treePipeline = m_pRenderQueue->AddPipeline(m_pMainShaderVariants->GetVariant(0));
+	m_playerCarPipeline = m_pRenderQueue->AddPipeline(pCarProgram, ApplyPlayerCarPipeline, this);
+	m_carPipeline = m_pRenderQueue->AddPipeline(pCarProgram, ApplyCarPipeline, this);
+
+	// The main shader places vertices exactly as the depth only program does.  The cars are left out of the
+	// depth pre-pass, since their geometry shader moves the triangles when they explode.
+	m_pRenderQueue->SetPipelineDepthPrepass(m_mainPipeline, true);
+	m_pRenderQueue->SetPipelineDepthPrepass(m_lightmappedPipeline, true);
+	m_pRenderQueue->SetPipelineDepthPrepass(m_treePipeline, true);
+}
+
+void Game::ApplyPlayerCarPipeline(CShaderProgram* program, void* context)
+{
+	Game* game = (Game*)context;
+	program->SetUniform("bExplodeObject", game->m_playerCarExplode);
+	program->SetUniform("bJoinObject", game->m_playerCarJoin);
+	program->SetUniform("explodeFactor", game->m_playerCarExplodeFactor);
+}
+
+void Game::ApplyCarPipeline(CShaderProgram* program, void*)
+{
+	program->SetUniform("bExplodeObject", false);
+	program->SetUniform("bJoinObject", false);
+}
+
+// Create a render queue item for the current modelview matrix
+RenderItem Game::CreateRenderItem(int pipeline, const glm::mat4& modelViewMatrix, CCamera* camera, RenderLayer layer)
+{
+	return m_pRenderQueue->CreateItem(pipeline, modelViewMatrix, camera->ComputeNormalMatrix(modelViewMatrix), layer);
 }
 
 void Game::RestartGame()
@@ -413,6 +1162,14 @@ void Game::Render(int pass)
 	// Clear the buffers and enable depth testing (z-buffering)
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glEnable(GL_DEPTH_TEST);
+	// Less or equal, so the colour pass still draws where the depth pre-pass has already written the same depth,
+	// and the skybox still draws at the far plane
+	glDepthFunc(GL_LEQUAL);
+
+	// Count the fragments drawn into each pixel of the main view for the overdraw heatmap
+	bool countOverdraw = pass == 0 && m_pOverdrawHeatmap->IsEnabled();
+	if (countOverdraw)
+		m_pOverdrawHeatmap->BeginCounting();
 
 	// Set up a matrix stack
 	glutil::MatrixStack modelViewMatrixStack;
@@ -436,338 +1193,162 @@ void Game::Render(int pass)
 	}
 
 	// Call LookAt to create the view matrix and put this on the modelViewMatrix stack. 
-	// Store the view matrix and the normal matrix associated with the view matrix for later (they're useful for lighting -- since lighting is done in eye coordinates)
+	// Store the view matrix for later (it's useful for lighting -- since lighting is done in eye coordinates)
 	modelViewMatrixStack.LookAt(currCamera->GetPosition(), currCamera->GetView(), currCamera->GetUpVector());
 	glm::mat4 viewMatrix = modelViewMatrixStack.Top();
-	glm::mat3 viewNormalMatrix = currCamera->ComputeNormalMatrix(viewMatrix);
-
-	// Use the main shader program 
-	CShaderProgram* pMainProgram = (*m_pShaderPrograms)[0];
-	pMainProgram->UseProgram();
-	pMainProgram->SetUniform("bUseTexture", true);
+	CFrustum frustum;
+	frustum.Set(*currCamera->GetPerspectiveProjectionMatrix() * viewMatrix);
+	m_pOcclusionCuller->BeginFrame(pass);
+
+	// Pick the variants of the main shader for this frame.  The streetlights and headlights are only on at night;
+	// in the day they are compiled out of the variant rather than skipped for every fragment.  At night the
+	// terrain and track take the streetlights from the lightmap.
+	unsigned int lighting = MAIN_SHADER_PHONG;
+	unsigned int lightmapped = MAIN_SHADER_PHONG;
 	if (m_gameMode == Dark)
 	{
-		pMainProgram->SetUniform("bUseStreetlight", true);
-		if (!m_gameOver)
-			pMainProgram->SetUniform("bUseSpotlight", true);
-	}
-	else if (m_gameMode == Light)
-	{
-		pMainProgram->SetUniform("bUseStreetlight", false);
-		pMainProgram->SetUniform("bUseSpotlight", false);
+		lighting |= MAIN_SHADER_CLUSTERED_LIGHTS;
+		lightmapped |= MAIN_SHADER_CLUSTERED_LIGHTS | MAIN_SHADER_LIGHTMAP;
 	}
-	if(m_gameOver)
-		pMainProgram->SetUniform("bUseSpotlight", false);
-	pMainProgram->SetUniform("bUsePhongModel", true);
-	pMainProgram->SetUniform("bExplodeObject", false);
+	CShaderProgram* pMainProgram = m_pMainShaderVariants->GetVariant(lighting);
+	CShaderProgram* pLightmappedProgram = m_pMainShaderVariants->GetVariant(lightmapped);
+	CShaderProgram* pTreeProgram = m_pMainShaderVariants->GetVariant(0);
+	CShaderProgram* pSkyboxProgram = m_pMainShaderVariants->GetVariant(MAIN_SHADER_SKYBOX);
+	m_pRenderQueue->SetPipelineProgram(m_mainPipeline, pMainProgram);
+	m_pRenderQueue->SetPipelineProgram(m_lightmappedPipeline, pLightmappedProgram);
+	m_pRenderQueue->SetPipelineProgram(m_treePipeline, pTreeProgram);
+	m_pRenderQueue->SetPipelineProgram(m_skyboxPipeline, pSkyboxProgram);
 
-	pMainProgram->SetUniform("sampler0", 0);
 	// Note: cubemap and non-cubemap textures should not be mixed in the same texture unit.  Setting unit 10 to be a cubemap texture.
 	int cubeMapTextureUnit = 10;
-	pMainProgram->SetUniform("CubeMapTex", cubeMapTextureUnit);
-
-	// Set the projection matrix
-	pMainProgram->SetUniform("matrices.projMatrix", currCamera->GetPerspectiveProjectionMatrix());
-
-	// Set light and materials in main shader program
 	glm::vec4 lightPosition1 = glm::vec4(100, 30, -100, 1); // Position of light source *in world coordinates*
-	pMainProgram->SetUniform("light1.position", viewMatrix * lightPosition1); // Position of light source *in eye coordinates*
-	pMainProgram->SetUniform("light1.La", glm::vec3(la));		// Ambient colour of light
-	pMainProgram->SetUniform("light1.Ld", glm::vec3(ld));		// Diffuse colour of light
-	pMainProgram->SetUniform("light1.Ls", glm::vec3(ls));		// Specular colour of light
-	pMainProgram->SetUniform("material1.Ma", glm::vec3(ma));	// Ambient material reflectance
-	pMainProgram->SetUniform("material1.Md", glm::vec3(0.0f));	// Diffuse material reflectance
-	pMainProgram->SetUniform("material1.Ms", glm::vec3(0.0f));	// Specular material reflectance
-	pMainProgram->SetUniform("material1.shininess", 15.0f);		// Shininess material property
-
-	pMainProgram->SetUniform("spotlight1.position", viewMatrix * glm::vec4(m_playerPos - m_playerT - m_playerN * 2.f, 1));
-	pMainProgram->SetUniform("spotlight1.La", glm::vec3(0.0f, 0.0f, 0.50f));
-	pMainProgram->SetUniform("spotlight1.Ld", glm::vec3(0.0f, 0.0f, 0.1f));
-	pMainProgram->SetUniform("spotlight1.Ls", glm::vec3(0.0f, 0.0f, 1.90f));
-	pMainProgram->SetUniform("spotlight1.direction", glm::normalize(viewNormalMatrix * glm::normalize(m_playerT)));
-	pMainProgram->SetUniform("spotlight1.exponent", 0.0f);
-	pMainProgram->SetUniform("spotlight1.cutoff", 10.0f);
-
-	pMainProgram->SetUniform("spotlight2.position", viewMatrix * glm::vec4(m_playerPos - m_playerT + m_playerN * 2.f, 1));
-	pMainProgram->SetUniform("spotlight2.La", glm::vec3(0.0f, 0.0f, 0.50f));
-	pMainProgram->SetUniform("spotlight2.Ld", glm::vec3(0.0f, 0.0f, 0.1f));
-	pMainProgram->SetUniform("spotlight2.Ls", glm::vec3(0.0f, 0.0f, 1.90f));
-	pMainProgram->SetUniform("spotlight2.direction", glm::normalize(viewNormalMatrix * glm::normalize(m_playerT)));
-	pMainProgram->SetUniform("spotlight2.exponent", 0.0f);
-	pMainProgram->SetUniform("spotlight2.cutoff", 10.0f);
 
+	CShaderProgram* pDepthProgram = m_pRenderQueue->GetDepthPrepassProgram();
+	pDepthProgram->UseProgram();
+	pDepthProgram->SetUniform("matrices.projMatrix", currCamera->GetPerspectiveProjectionMatrix());
+
+	// Set the uniforms that every variant uses.  The main variant is set last so that it is left in use.
+	CShaderProgram* pVariants[4] = { pSkyboxProgram, pTreeProgram, pLightmappedProgram, pMainProgram };
 	for (int i = 0; i < 4; i++)
 	{
-		string spotlightVar = "spotlights[" + std::to_string(i) + "]";
-		if (i < 2)
-		{
-			float multiplier = (i == 1) ? -1 : 1;
-			pMainProgram->SetUniform(spotlightVar + ".position", viewMatrix * glm::vec4(m_car1Pos - m_car1T + m_car1N * 2.f * multiplier, 1));
-			pMainProgram->SetUniform(spotlightVar + ".direction", glm::normalize(viewNormalMatrix * glm::normalize(m_car1T)));
-		}
-		else 
-		{
-			float multiplier = (i == 3) ? -1 : 1;
-			pMainProgram->SetUniform(spotlightVar + ".position", viewMatrix * glm::vec4(m_car2Pos - m_car2T + m_car2N * 2.f * multiplier, 1));
-			pMainProgram->SetUniform(spotlightVar + ".direction", glm::normalize(viewNormalMatrix * glm::normalize(m_car2T)));
-		}
-		pMainProgram->SetUniform(spotlightVar+".La", glm::vec3(0.0f, 0.0f, 0.50f));
-		pMainProgram->SetUniform(spotlightVar+".Ld", glm::vec3(0.0f, 0.0f, 0.01f));
-		pMainProgram->SetUniform(spotlightVar+".Ls", glm::vec3(0.0f, 0.0f, 0.90f));
-		pMainProgram->SetUniform(spotlightVar+".exponent", 0.01f);
-		pMainProgram->SetUniform(spotlightVar+".cutoff", 5.0f);
+		pVariants[i]->UseProgram();
+		pVariants[i]->SetUniform("sampler0", 0);
+		pVariants[i]->SetUniform("CubeMapTex", cubeMapTextureUnit);
+		pVariants[i]->SetUniform("fogDensity", m_gameMode == Dark ? 0.003f : 0.001f);
+
+		// Set the projection matrix
+		pVariants[i]->SetUniform("matrices.projMatrix", currCamera->GetPerspectiveProjectionMatrix());
+
+		// Set light in main shader program
+		pVariants[i]->SetUniform("light1.position", viewMatrix * lightPosition1); // Position of light source *in eye coordinates*
+		pVariants[i]->SetUniform("light1.La", glm::vec3(la));		// Ambient colour of light
+		pVariants[i]->SetUniform("light1.Ld", glm::vec3(ld));		// Diffuse colour of light
+		pVariants[i]->SetUniform("light1.Ls", glm::vec3(ls));		// Specular colour of light
 	}
 
-	pMainProgram->SetUniform("spotmaterial1.Ma", glm::vec3(0.0f, 0.0f, 0.05f));
-	pMainProgram->SetUniform("spotmaterial1.Md", glm::vec3(0.0f, 0.0f, 0.0001f));
-	pMainProgram->SetUniform("spotmaterial1.Ms", glm::vec3(0.0f, 0.0f, 0.1f));
-	pMainProgram->SetUniform("spotmaterial1.shininess", 0.0f);
+	CShaderProgram* pLitPrograms[2] = { pLightmappedProgram, pMainProgram };
+	for (int i = 0; i < 2; i++)
+	{
+		pLitPrograms[i]->UseProgram();
+		pLitPrograms[i]->SetUniform("material1.Ma", glm::vec3(ma));	// Ambient material reflectance
+		pLitPrograms[i]->SetUniform("material1.Md", glm::vec3(0.0f));	// Diffuse material reflectance
+		pLitPrograms[i]->SetUniform("material1.Ms", glm::vec3(0.0f));	// Specular material reflectance
+		pLitPrograms[i]->SetUniform("material1.shininess", 15.0f);		// Shininess material property
+	}
 
-	pMainProgram->SetUniform("streetmaterial1.Ma", glm::vec3(0.001f));	
-	pMainProgram->SetUniform("streetmaterial1.Md", glm::vec3(0.25f, 0.25f, 0));
-	pMainProgram->SetUniform("streetmaterial1.Ms", glm::vec3(0.25f, 0.25f, 0.0f));
-	pMainProgram->SetUniform("streetmaterial1.shininess", 0.1f);	
+	if (lighting & MAIN_SHADER_CLUSTERED_LIGHTS)
+	{
+		// Gather the night lights and bin them into the clusters of this view.  The colours of each light are
+		// multiplied by the reflectance of the material it lights.
+		m_pLightClusters->ClearLights();
+		ClusterLight light;
 
+		if (!m_gameOver)
+		{
+			glm::vec3 spotMa = glm::vec3(0.0f, 0.0f, 0.05f);
+			glm::vec3 spotMd = glm::vec3(0.0f, 0.0f, 0.0001f);
+			glm::vec3 spotMs = glm::vec3(0.0f, 0.0f, 0.1f);
+			light.range = 300.0f;
+			light.shininess = 0.0f;
+			light.baked = false;
+
+			// The player's headlights count double
+			light.direction = glm::normalize(m_playerT);
+			light.ambient = 2.0f * glm::vec3(0.0f, 0.0f, 0.50f) * spotMa;
+			light.diffuse = 2.0f * glm::vec3(0.0f, 0.0f, 0.1f) * spotMd;
+			light.specular = 2.0f * glm::vec3(0.0f, 0.0f, 1.90f) * spotMs;
+			light.exponent = 0.0f;
+			light.cutoff = 10.0f;
+			for (int side = -1; side <= 1; side += 2)
+			{
+				light.position = m_playerPos - m_playerT + m_playerN * 2.f * (float)side;
+				m_pLightClusters->AddLight(light);
+			}
 
-	vector<float> streetlight_x = {
-		0,0,0,10, -10
-	};
-	vector<float> streetlight_z = {
-		10, 10, -10, 0, 0
-	};
-	for (int i = 0; i < m_streetlight_positions.size(); i++)
-	{
-		glm::vec3 pos = m_streetlight_positions[i];
-		pos.x -= streetlight_x[i];
-		pos.y -= -30;
-		pos.z -= streetlight_z[i];
-		string streetlightVar = "streetlights[" + std::to_string(i) + "]";
-		pMainProgram->SetUniform(streetlightVar + ".position", viewMatrix * glm::vec4(pos, 1));
-		pMainProgram->SetUniform(streetlightVar + ".La", glm::vec3(1.0f, 1.0f, 0.0f));
-		pMainProgram->SetUniform(streetlightVar + ".Ld", glm::vec3(1.0f, 1.0f, 0.0f));
-		pMainProgram->SetUniform(streetlightVar + ".Ls", glm::vec3(1.0f, 1.0f, 0.0f));
-		pMainProgram->SetUniform(streetlightVar + ".direction", glm::normalize(viewNormalMatrix * glm::vec3(0,-1,0)));
-		pMainProgram->SetUniform(streetlightVar + ".exponent", 2.0f);
-		pMainProgram->SetUniform(streetlightVar + ".cutoff", 250.5f);
+			light.ambient = glm::vec3(0.0f, 0.0f, 0.50f) * spotMa;
+			light.diffuse = glm::vec3(0.0f, 0.0f, 0.01f) * spotMd;
+			light.specular = glm::vec3(0.0f, 0.0f, 0.90f) * spotMs;
+			light.exponent = 0.01f;
+			light.cutoff = 5.0f;
+			for (int side = -1; side <= 1; side += 2)
+			{
+				light.direction = glm::normalize(m_car1T);
+				light.position = m_car1Pos - m_car1T + m_car1N * 2.f * (float)side;
+				m_pLightClusters->AddLight(light);
+				light.direction = glm::normalize(m_car2T);
+				light.position = m_car2Pos - m_car2T + m_car2N * 2.f * (float)side;
+				m_pLightClusters->AddLight(light);
+			}
+		}
+
+		for (unsigned int i = 0; i < m_streetlights.size(); i++)
+			m_pLightClusters->AddLight(m_streetlights[i]);
+
+		m_pLightClusters->Update(viewMatrix, *currCamera->GetPerspectiveProjectionMatrix());
+		m_pLightClusters->Bind(pMainProgram, 11);
+
+		pLightmappedProgram->UseProgram();
+		m_pLightClusters->Bind(pLightmappedProgram, 11);
+		m_pLightmap->Bind(pLightmappedProgram, 14);
+		pLightmappedProgram->SetUniform("inverseViewMatrix", glm::inverse(viewMatrix));
+		pMainProgram->UseProgram();
 	}
 
 	if (pass == 0) {
 		// Render the plane for the TV
 		// Back face actually places the horse the right way round
-		glDisable(GL_CULL_FACE);
 		modelViewMatrixStack.Push();
 		modelViewMatrixStack.Translate(glm::vec3(0.0f, 100.0f, 0.0f));
 		modelViewMatrixStack.RotateRadians(glm::vec3(1, 0, 0), glm::radians(90.0f));
 		modelViewMatrixStack.Rotate(glm::vec3(0.0f, 0.0f, 1.0f), 180.0);
 		modelViewMatrixStack.Scale(-1.0);
-		pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-		pMainProgram->SetUniform("matrices.normalMatrix", currCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-		m_pPlaneFBO->BindTexture(0);
-		m_pPlane->Render(false);
+		m_pPlaneFBO->GenerateTextureMipmaps();
+		RenderItem tvItem = CreateRenderItem(m_mainPipeline, modelViewMatrixStack.Top(), currCamera);
+		tvItem.flags |= RENDER_FLAG_NO_CULL;
+		tvItem.SetTexture(GL_TEXTURE_2D, m_pPlaneFBO->GetTextureID(), m_pPlaneFBO->GetSamplerID());
+		m_pPlane->Submit(m_pRenderQueue, tvItem, false);
 		modelViewMatrixStack.Pop();
-		glEnable(GL_CULL_FACE);
 	}
 
 	// Render the skybox and terrain with full ambient reflectance 
 	modelViewMatrixStack.Push();
-	pMainProgram->SetUniform("renderSkybox", true);
 	// Translate the modelview matrix to the camera eye point so skybox stays centred around camera
 	glm::vec3 vEye = currCamera->GetPosition();
 	modelViewMatrixStack.Translate(vEye);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", currCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pSkybox->Render(cubeMapTextureUnit);
-	pMainProgram->SetUniform("renderSkybox", false);
+	m_pSkybox->Submit(m_pRenderQueue, CreateRenderItem(m_skyboxPipeline, modelViewMatrixStack.Top(), currCamera, RENDER_LAYER_BACKGROUND), cubeMapTextureUnit);
 	modelViewMatrixStack.Pop();
 
 	//Render the HeightMap
-	modelViewMatrixStack.Push();
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", currCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pHeightmapTerrain->Render();
-	modelViewMatrixStack.Pop();
+	m_pHeightmapTerrain->Submit(m_pRenderQueue, CreateRenderItem(m_lightmappedPipeline, modelViewMatrixStack.Top(), currCamera));
 
 	// Render the Track
-	m_pCatmullRom->RenderTrack();
-	m_pCatmullRomLeft->RenderTrack();
-	m_pCatmullRomRight->RenderTrack();
+	m_pCatmullRom->SubmitTrack(m_pRenderQueue, CreateRenderItem(m_lightmappedPipeline, modelViewMatrixStack.Top(), currCamera), frustum);
+	m_pCatmullRomLeft->SubmitTrack(m_pRenderQueue, CreateRenderItem(m_mainPipeline, modelViewMatrixStack.Top(), currCamera), frustum);
+	m_pCatmullRomRight->SubmitTrack(m_pRenderQueue, CreateRenderItem(m_mainPipeline, modelViewMatrixStack.Top(), currCamera), frustum);
 
-	// Render the Tunnel 
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(831, 0, 2000));
-	modelViewMatrixStack.RotateRadians(glm::vec3(0, 1, 0), glm::radians(-29.0f));
-	modelViewMatrixStack.Scale(7.f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", currCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pTunnelMesh->Render();
-	modelViewMatrixStack.Pop();
-
-	// Render the Icebergs
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(-300, 0, 500));
-	modelViewMatrixStack.RotateRadians(glm::vec3(0, 1, 1), glm::radians(-29.0f));
-	modelViewMatrixStack.Scale(50.f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", currCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pIceMesh->Render();
-	modelViewMatrixStack.Pop();
-
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(-250, 30, 1500));
-	modelViewMatrixStack.RotateRadians(glm::vec3(1, 1, 0), glm::radians(-75.0f));
-	modelViewMatrixStack.Scale(70.f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", currCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pIceMesh->Render();
-	modelViewMatrixStack.Pop();
-
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(1050, 30, 200));
-	modelViewMatrixStack.RotateRadians(glm::vec3(1, 1, 0), glm::radians(-75.0f));
-	modelViewMatrixStack.Scale(70.f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", currCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pIceMesh->Render();
-	modelViewMatrixStack.Pop();
-
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(-750, 30, -700));
-	modelViewMatrixStack.RotateRadians(glm::vec3(1, 1, 0), glm::radians(-75.0f));
-	modelViewMatrixStack.Scale(70.f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", currCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pIceMesh->Render();
-	modelViewMatrixStack.Pop();
-
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(-1250, 50, -300));
-	modelViewMatrixStack.RotateRadians(glm::vec3(1, 1, 0), glm::radians(-15.0f));
-	modelViewMatrixStack.Scale(70.f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", currCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pIceMesh->Render();
-	modelViewMatrixStack.Pop();
-
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(-1350, 50, 500));
-	modelViewMatrixStack.RotateRadians(glm::vec3(1, 1, 0), glm::radians(-1845.0f));
-	modelViewMatrixStack.Scale(70.f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", currCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pIceMesh->Render();
-	modelViewMatrixStack.Pop();
-
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(350, 50, 300));
-	modelViewMatrixStack.RotateRadians(glm::vec3(1, 1, 0), glm::radians(-185.0f));
-	modelViewMatrixStack.Scale(70.f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", currCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pIceMesh->Render();
-	modelViewMatrixStack.Pop();
-
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(550, 50, 1900));
-	modelViewMatrixStack.RotateRadians(glm::vec3(1, 1, 0), glm::radians(-145.0f));
-	modelViewMatrixStack.Scale(70.f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", currCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pIceMesh->Render();
-	modelViewMatrixStack.Pop();
-
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(1550, -10, 1200));
-	modelViewMatrixStack.Scale(10.f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", currCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pIceBergMesh->Render();
-	modelViewMatrixStack.Pop();
-
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(-550, -10, 200));
-	modelViewMatrixStack.Scale(7.f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", currCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pIceBergMesh->Render();
-	modelViewMatrixStack.Pop();
-
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(-2050, -10, 200));
-	modelViewMatrixStack.Scale(7.f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", currCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pIceBergMesh->Render();
-	modelViewMatrixStack.Pop();
-
-	// Render the Sign Board
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(550, 0, 2500));
-	modelViewMatrixStack.RotateRadians(glm::vec3(0, 1, 0), glm::radians(90.0f));
-	modelViewMatrixStack.Scale(10.5f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", currCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pSignMesh->Render();
-	modelViewMatrixStack.Pop();
-
-	vector<float> streetlight_rotations = {
-		0, 0, 180, 90, -90
-	};
-	// Render the Street Lights
-	for (int i = 0; i < m_streetlight_positions.size(); i++)
-	{
-		modelViewMatrixStack.Push();
-		modelViewMatrixStack.Translate(m_streetlight_positions[i]);
-		modelViewMatrixStack.RotateRadians(glm::vec3(0, 1, 0), glm::radians(90.0f));
-		modelViewMatrixStack.RotateRadians(glm::vec3(0, 1, 0), glm::radians(streetlight_rotations[i]));
-		pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-		pMainProgram->SetUniform("matrices.normalMatrix", currCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-		m_pStreetLightMesh->Render();
-		modelViewMatrixStack.Pop();
-	}
-
-	// Render the Snowman
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(-1500,0,1000));
-	modelViewMatrixStack.Scale(3000.f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", currCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pSnowmanMesh->Render();
-	modelViewMatrixStack.Pop();
-
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(-100, 0, -300));
-	modelViewMatrixStack.RotateRadians(glm::vec3(0, 1, 0), glm::radians(-150.0));
-	modelViewMatrixStack.Scale(5000.f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", currCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pSnowmanMesh->Render();
-	modelViewMatrixStack.Pop();
-
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(1000, 0, 1400));
-	modelViewMatrixStack.RotateRadians(glm::vec3(0, 1, 0), glm::radians(-150.0));
-	modelViewMatrixStack.Scale(1000.f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", currCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pSnowmanMesh->Render();
-	modelViewMatrixStack.Pop();
-
-	// Render the Barricade
-	vector<float> barricade_rotations = {
-		0, 0, 0, 90, 0, 130, 70, 90, 90, 90
-	};
-	for (int i = 0; i < m_barricade_positions.size(); i++)
-	{
-		modelViewMatrixStack.Push();
-		modelViewMatrixStack.Translate(m_barricade_positions[i]);
-		modelViewMatrixStack.RotateRadians(glm::vec3(0, 1, 0), glm::radians(-90.0));
-		modelViewMatrixStack.RotateRadians(glm::vec3(0, 1, 0), glm::radians(barricade_rotations[i]));
-		modelViewMatrixStack.Scale(0.04);
-		pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-		pMainProgram->SetUniform("matrices.normalMatrix", currCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-		m_pBarricadeMesh->Render();
-		modelViewMatrixStack.Pop();
-	}
+	// Render the static props (tunnel, sign, icebergs, snowmen, streetlights and barricades) from the pre-transformed batch
+	float pixelsPerUnit = height / (2.0f * tan(glm::radians(45.0f) / 2.0f));
+	m_pStaticBatch->Submit(m_pRenderQueue, CreateRenderItem(m_mainPipeline, viewMatrix, currCamera), frustum, pixelsPerUnit, pass);
 
 	// Render the Car
 
@@ -789,6 +1370,9 @@ void Game::Render(int pass)
 	// Set the projection matrix
 	pCarProgram->SetUniform("matrices.projMatrix", currCamera->GetPerspectiveProjectionMatrix());
 
+	// The explode/join uniforms for the player car are set by its pipeline when the queue is flushed
+	m_playerCarExplode = false;
+	m_playerCarJoin = false;
 	if (m_explodeFactor <= 3.5 || m_resetCar)
 	{
 		if (m_gameOver && m_health <= 0)
@@ -796,17 +1380,16 @@ void Game::Render(int pass)
 			if (m_explodeFactor == 0 && m_lives > 0)
 				m_lives -= 1;
 
-			pCarProgram->SetUniform("bExplodeObject", true);
-			pCarProgram->SetUniform("bJoinObject", false); 
-			pCarProgram->SetUniform("explodeFactor", m_explodeFactor);
+			m_playerCarExplode = true;
+			m_playerCarExplodeFactor = m_explodeFactor;
 			m_explodeFactor += 0.09f;
 			m_resetCar = false;
 		}
 		if (m_resetCar && m_explodeFactor >= 0)
 		{
-			pCarProgram->SetUniform("bExplodeObject", false); 
-			pCarProgram->SetUniform("bJoinObject", true);
-			pCarProgram->SetUniform("explodeFactor", m_explodeFactor);
+			m_playerCarExplode = false;
+			m_playerCarJoin = true;
+			m_playerCarExplodeFactor = m_explodeFactor;
 			m_explodeFactor -= 0.09f;
 		}
 		if (m_explodeFactor == 0)
@@ -818,24 +1401,22 @@ void Game::Render(int pass)
 		modelViewMatrixStack.RotateRadians(glm::vec3(0, 0, 1), glm::radians(90.0f));
 		modelViewMatrixStack.RotateRadians(glm::vec3(0, 0, 1), glm::radians(m_rotateAngle));
 		modelViewMatrixStack.Scale(3.5f - m_explodeFactor);
-		pCarProgram->SetUniform("matrices.projMatrix", currCamera->GetPerspectiveProjectionMatrix());
-		pCarProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-		pCarProgram->SetUniform("matrices.normalMatrix", currCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-		m_pCarMesh->Render();
+		m_pCarMesh->Submit(m_pRenderQueue, CreateRenderItem(m_playerCarPipeline, modelViewMatrixStack.Top(), currCamera));
 		modelViewMatrixStack.Pop();
 	}
 
-	pCarProgram->SetUniform("bExplodeObject", false);
 	modelViewMatrixStack.Push();
 	modelViewMatrixStack.Translate(m_car1Pos);
 	modelViewMatrixStack *= m_car1Angle;
 	modelViewMatrixStack.RotateRadians(glm::vec3(1, 0, 0), glm::radians(-90.0f));
 	modelViewMatrixStack.RotateRadians(glm::vec3(0, 0, 1), glm::radians(90.0f));
 	modelViewMatrixStack.Scale(3.5f);
-	pCarProgram->SetUniform("matrices.projMatrix", currCamera->GetPerspectiveProjectionMatrix());
-	pCarProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pCarProgram->SetUniform("matrices.normalMatrix", currCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pCarMesh1->Render();
+	// The opponent cars are drawn only if their boxes pass the occlusion test made once the rest of the opaque scene is drawn
+	glm::vec3 carRadius = glm::vec3(m_carOcclusionRadius[0]);
+	m_pOcclusionCuller->SetBounds(m_carOcclusionObjects[0], m_car1Pos - carRadius, m_car1Pos + carRadius);
+	RenderItem carItem = CreateRenderItem(m_carPipeline, modelViewMatrixStack.Top(), currCamera);
+	carItem.occlusionQuery = m_pOcclusionCuller->GetConditionalQuery(m_carOcclusionObjects[0], pass, currCamera->GetPosition());
+	m_pCarMesh1->Submit(m_pRenderQueue, carItem);
 	modelViewMatrixStack.Pop();
 
 	modelViewMatrixStack.Push();
@@ -844,68 +1425,112 @@ void Game::Render(int pass)
 	modelViewMatrixStack.RotateRadians(glm::vec3(1, 0, 0), glm::radians(-90.0f));
 	modelViewMatrixStack.RotateRadians(glm::vec3(0, 0, 1), glm::radians(90.0f));
 	modelViewMatrixStack.Scale(3.5f);
-	pCarProgram->SetUniform("matrices.projMatrix", currCamera->GetPerspectiveProjectionMatrix());
-	pCarProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pCarProgram->SetUniform("matrices.normalMatrix", currCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pCarMesh2->Render();
+	carRadius = glm::vec3(m_carOcclusionRadius[1]);
+	m_pOcclusionCuller->SetBounds(m_carOcclusionObjects[1], m_car2Pos - carRadius, m_car2Pos + carRadius);
+	carItem = CreateRenderItem(m_carPipeline, modelViewMatrixStack.Top(), currCamera);
+	carItem.occlusionQuery = m_pOcclusionCuller->GetConditionalQuery(m_carOcclusionObjects[1], pass, currCamera->GetPosition());
+	m_pCarMesh2->Submit(m_pRenderQueue, carItem);
 	modelViewMatrixStack.Pop();
 
 	if (pass == 0)
 	{
 		// Render the trees
-
-		pMainProgram->UseProgram();
-
-		pMainProgram->SetUniform("bUsePhongModel", false);
-		pMainProgram->SetUniform("bExplodeObject", false);
-
 		for (int i = 0; i < m_tree_positions.size(); i++)
 		{
+			if (!m_pOcclusionCuller->IsVisible(m_treeClusterObjects[i / TREE_CLUSTER_SIZE], pass))
+				continue;
 			modelViewMatrixStack.Push();
 			m_tree_positions[i].y = 0;
 			modelViewMatrixStack.Translate(m_tree_positions[i]);
 			modelViewMatrixStack.Scale(2);
-			pMainProgram->SetUniform("matrices.projMatrix", currCamera->GetPerspectiveProjectionMatrix());
-			pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-			pMainProgram->SetUniform("matrices.normalMatrix", currCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
+			RenderItem treeItem = CreateRenderItem(m_treePipeline, modelViewMatrixStack.Top(), currCamera);
 			if (i < 50)
 			{
-				m_pTree->Render();
+				m_pTree->Submit(m_pRenderQueue, treeItem);
 			}
 			else
 			{
-				m_pCubeTree->Render();
+				m_pCubeTree->Submit(m_pRenderQueue, treeItem);
 			}
 			modelViewMatrixStack.Pop();
 		}
 	}
 
+	// Sort and draw everything submitted above.  The occlusion queries are tested against the opaque scene, for the
+	// opponent cars in this frame and for the props and trees in the next.
+	OcclusionPass occlusion = { this, pass, viewMatrix, &frustum, currCamera->GetPosition() };
+	m_pRenderQueue->SetOcclusionCallback(IssueOcclusionQueries, &occlusion);
+	m_pPipelineStatistics->Begin(pass == 1 ? "TV view" : "Scene");
+	m_pRenderQueue->Flush();
+	m_pPipelineStatistics->End();
+	m_pRenderQueue->SetOcclusionCallback(NULL, NULL);
+
+	if (pass == 0 && m_stressObjectCount > 0)
+	{
+		m_pPipelineStatistics->Begin("Stress test");
+		RenderStressTest(currCamera, viewMatrix, frustum, viewMatrix * lightPosition1, la, ld, ls);
+		m_pPipelineStatistics->End();
+	}
+
+	// Snow is blended over everything else in the scene
+	if (pass == 0 && m_pSnow->GetParticleCount() > 0)
+	{
+		m_pPipelineStatistics->Begin("Snow");
+		RenderSnow(currCamera, viewMatrix);
+		m_pPipelineStatistics->End();
+	}
+
+	if (countOverdraw)
+	{
+		m_pOverdrawHeatmap->EndCounting();
+		m_pOverdrawHeatmap->Render();
+	}
+
 	if (pass == 0)
 	{
 		// Draw the 2D graphics after the 3D graphics
-		DisplayFrameRate();
-		DisplayLaps();
-		DisplayHealthAndLapTimes();
-		DisplayControls();
-		RenderSpeedTexture();
-		if (m_gameOver)
-		{
-			int lap = m_pCatmullRom->CurrentLap(m_currentDistance);
-			if (lap >= 3)
-			{
-				DisplayGameOverText();
-			}
-			else
-			{
-				DisplayDeathText();
-			}
-		}
+		CAllocationScope allocationScope(ALLOCATION_HUD);
+		m_pPipelineStatistics->Begin("HUD");
+		RenderHUD();
+		m_pPipelineStatistics->End();
 	}
 
 	// Swap buffers to show the rendered image
 	SwapBuffers(m_gameWindow.Hdc());
 }
 
+// Draw the 2D graphics.  The font program and the uniforms shared by all of the text are set once here, so the
+// Display functions below render their text with it bound and only set their colour.
+void Game::RenderHUD()
+{
+	CShaderProgram* fontProgram = (*m_pShaderPrograms)[1];
+	fontProgram->UseProgram();
+	glDisable(GL_DEPTH_TEST);
+	fontProgram->SetUniform("matrices.modelViewMatrix", glm::mat4(1));
+	fontProgram->SetUniform("matrices.projMatrix", m_pCamera->GetOrthographicProjectionMatrix());
+
+	DisplayFrameRate();
+	DisplayLaps();
+	DisplayHealthAndLapTimes();
+	DisplayControls();
+	DisplayRenderStats();
+	DisplayBenchmark();
+	RenderSpeedTexture();
+	if (m_gameOver)
+	{
+		int lap = m_pCatmullRom->CurrentLap(m_currentDistance);
+		if (lap >= 3)
+		{
+			DisplayGameOverText();
+		}
+		else
+		{
+			DisplayDeathText();
+		}
+	}
+	glEnable(GL_DEPTH_TEST);
+}
+
 void Game::RenderSpeedTexture()
 {
 
@@ -1060,6 +1685,12 @@ void Game::Update()
 		}
 	}
 
+	// Keep the track chunks within the far plane of the camera on the GPU
+	glm::vec3 viewer = m_pCamera->GetPosition();
+	m_pCatmullRom->StreamTrack(viewer, 5000.0f);
+	m_pCatmullRomLeft->StreamTrack(viewer, 5000.0f);
+	m_pCatmullRomRight->StreamTrack(viewer, 5000.0f);
+
 	// Play Audio
 	m_pAudio->Update();
 }
@@ -1082,17 +1713,13 @@ void Game::DisplayFrameRate()
 	{
 		m_elapsedTime = 0;
 		m_framesPerSecond = m_frameCount;
+		m_pJobSystem->UpdateStats();
 
 		// Reset the frames per second
 		m_frameCount = 0;
 	}
 
 	if (m_framesPerSecond > 0) {
-		// Use the font shader program and render the text
-		fontProgram->UseProgram();
-		glDisable(GL_DEPTH_TEST);
-		fontProgram->SetUniform("matrices.modelViewMatrix", glm::mat4(1));
-		fontProgram->SetUniform("matrices.projMatrix", m_pCamera->GetOrthographicProjectionMatrix());
 		fontProgram->SetUniform("vColour", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
 		m_pFtFont->Render(20, height - 20, 20, "FPS: %d", m_framesPerSecond);
 	}
@@ -1106,11 +1733,6 @@ void Game::DisplayLaps()
 	int height = dimensions.bottom - dimensions.top;
 	int width = dimensions.right - dimensions.left;
 
-	// Use the font shader program and render the text
-	fontProgram->UseProgram();
-	glDisable(GL_DEPTH_TEST);
-	fontProgram->SetUniform("matrices.modelViewMatrix", glm::mat4(1));
-	fontProgram->SetUniform("matrices.projMatrix", m_pCamera->GetOrthographicProjectionMatrix());
 	fontProgram->SetUniform("vColour", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
 	int noLaps = m_pCatmullRom->CurrentLap(m_currentDistance) + 1;
 	if (noLaps > 3) {
@@ -1150,18 +1772,11 @@ void Game::DisplayHealthAndLapTimes()
 	time3.minutes = totalSeconds / 60;
 	time3.seconds = totalSeconds % 60;
 
-	auto text = "Lives left : " + std::to_string(m_lives) + " \n Lap 1 : " + std::to_string(time1.minutes) + ":" + std::to_string(time1.seconds) + 
-		"\n Lap 2 : " + std::to_string(time2.minutes) + ":" + std::to_string(time2.seconds) + 
-		"\n Lap 3 : " + std::to_string(time3.minutes) + ":" + std::to_string(time3.seconds);
-
-	// Use the font shader program and render the text
-	fontProgram->UseProgram();
-	glDisable(GL_DEPTH_TEST);
-	fontProgram->SetUniform("matrices.modelViewMatrix", glm::mat4(1));
-	fontProgram->SetUniform("matrices.projMatrix", m_pCamera->GetOrthographicProjectionMatrix());
+	// The font formats the text into a fixed buffer, so nothing is allocated
 	fontProgram->SetUniform("vColour", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
 	//m_pFtFont->Render(width - 175, height - 20, 20, "Car Health: %d%% \n Lap 1 : %a%% \n Lap 2 : %a%%\n Lap 3 : %a%%", m_health, lap1, lap2, lap3);
-	m_pFtFont->Render(width - 175, height - 20, 20, text.c_str());
+	m_pFtFont->Render(width - 175, height - 20, 20, "Lives left : %d \n Lap 1 : %d:%d\n Lap 2 : %d:%d\n Lap 3 : %d:%d", m_lives,
+		time1.minutes, time1.seconds, time2.minutes, time2.seconds, time3.minutes, time3.seconds);
 }
 
 void Game::DisplayDeathText()
@@ -1172,25 +1787,12 @@ void Game::DisplayDeathText()
 	int height = dimensions.bottom - dimensions.top;
 	int width = dimensions.right - dimensions.left;
 
-	// Use the font shader program and render the text
-	fontProgram->UseProgram();
-	glDisable(GL_DEPTH_TEST);
-	fontProgram->SetUniform("matrices.modelViewMatrix", glm::mat4(1));
-	fontProgram->SetUniform("matrices.projMatrix", m_pCamera->GetOrthographicProjectionMatrix());
 	fontProgram->SetUniform("vColour", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
 
-	string m_deathText;
-
 	if (m_lives <= 0)
-	{
-		m_deathText = "Press R to restart the game";
-		m_pFtFont->Render(width / 2 - 300, height - height / 2, 40, m_deathText.c_str());
-	}
+		m_pFtFont->Render(width / 2 - 300, height - height / 2, 40, "Press R to restart the game");
 	else
-	{
-		m_deathText = "Press R to respawn";
-		m_pFtFont->Render(width / 2 - 200, height - height / 2, 40, m_deathText.c_str());
-	}
+		m_pFtFont->Render(width / 2 - 200, height - height / 2, 40, "Press R to respawn");
 }
 
 void Game::DisplayGameOverText()
@@ -1201,15 +1803,9 @@ void Game::DisplayGameOverText()
 	int height = dimensions.bottom - dimensions.top;
 	int width = dimensions.right - dimensions.left;
 
-	// Use the font shader program and render the text
-	fontProgram->UseProgram();
-	glDisable(GL_DEPTH_TEST);
-	fontProgram->SetUniform("matrices.modelViewMatrix", glm::mat4(1));
-	fontProgram->SetUniform("matrices.projMatrix", m_pCamera->GetOrthographicProjectionMatrix());
 	fontProgram->SetUniform("vColour", glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
 
-	string gameText = "GAME OVER";
-	m_pFtFont->Render(width / 2 - 120, height - height / 2, 40, gameText.c_str());
+	m_pFtFont->Render(width / 2 - 120, height - height / 2, 40, "GAME OVER");
 
 	fontProgram->SetUniform("vColour", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
 
@@ -1226,11 +1822,8 @@ void Game::DisplayGameOverText()
 	time1.minutes = totalSeconds / 60;
 	time1.seconds = totalSeconds % 60;
 
-	gameText = "Best Lap : " + std::to_string(time1.minutes) + " min " + std::to_string(time1.seconds) + " seconds";
-	m_pFtFont->Render(width / 2 - 140, height - height / 2 - 30, 20, gameText.c_str());
-
-	gameText = "Press R to restart";
-	m_pFtFont->Render(width / 2 - 100, height - height / 2 - 170, 20, gameText.c_str());
+	m_pFtFont->Render(width / 2 - 140, height - height / 2 - 30, 20, "Best Lap : %d min %d seconds", time1.minutes, time1.seconds);
+	m_pFtFont->Render(width / 2 - 100, height - height / 2 - 170, 20, "Press R to restart");
 }
 
 void Game::DisplayControls()
@@ -1241,18 +1834,209 @@ void Game::DisplayControls()
 	int height = dimensions.bottom - dimensions.top;
 	int width = dimensions.right - dimensions.left;
 
-	// Use the font shader program and render the text
-	fontProgram->UseProgram();
-	glDisable(GL_DEPTH_TEST);
-	fontProgram->SetUniform("matrices.modelViewMatrix", glm::mat4(1));
-	fontProgram->SetUniform("matrices.projMatrix", m_pCamera->GetOrthographicProjectionMatrix());
 	fontProgram->SetUniform("vColour", glm::vec4(1.0f, 1.0f, 1.0f, 0.7f));
 
-	string gameText = "Controls";
-	m_pFtFont->Render(100, 180, 20, gameText.c_str());
+	m_pFtFont->Render(100, 180, 20, "Controls");
+	m_pFtFont->Render(60, 150, 20, "W A S D - Movement \n N - Toggle Night Mode \n C - Switch Camera \n F - Toggle Freelook");
+}
+
+// Display the number of GL state changes the render queue needed this frame, before and after sorting
+void Game::DisplayRenderStats()
+{
+	CShaderProgram* fontProgram = (*m_pShaderPrograms)[1];
+
+	RECT dimensions = m_gameWindow.GetDimensions();
+	int width = dimensions.right - dimensions.left;
+
+	const RenderQueueStats& unsorted = m_pRenderQueue->GetUnsortedStats();
+	const RenderQueueStats& sorted = m_pRenderQueue->GetSortedStats();
+
+	fontProgram->SetUniform("vColour", glm::vec4(1.0f, 1.0f, 1.0f, 0.7f));
+	m_pFtFont->Render(width - 330, 80, 16, "Draws: %d  Sorting (F1): %s", sorted.items, m_pRenderQueue->IsSortingEnabled() ? "on" : "off");
+	m_pFtFont->Render(width - 330, 60, 16, "State changes unsorted: %d (prog %d tex %d vao %d)",
+		unsorted.Total(), unsorted.programChanges, unsorted.textureChanges, unsorted.vaoChanges);
+	m_pFtFont->Render(width - 330, 40, 16, "State changes sorted: %d (prog %d tex %d vao %d)",
+		sorted.Total(), sorted.programChanges, sorted.textureChanges, sorted.vaoChanges);
+	DisplayPipelineStatistics();
+	DisplayAllocations();
+	DisplayResourceMemory();
+	DisplayStreamBuffer();
+
+	const char* opaqueOrder = "state order";
+	if (m_pRenderQueue->IsDepthPrepassEnabled())
+		opaqueOrder = "depth pre-pass";
+	else if (m_pRenderQueue->IsFrontToBackEnabled())
+		opaqueOrder = "front to back";
+	m_pFtFont->Render(width - 330, 180, 16, "Opaque (F8): %s, %d pre-pass draws", opaqueOrder, m_pRenderQueue->GetNumDepthPrepassItems());
+	m_pFtFont->Render(width - 330, 20, 16, "Static batch cells: %d/%d visible, %d ranges, %d tris  LOD (L): %s %d/%d/%d/%d",
+		m_pStaticBatch->GetNumVisibleCells(), m_pStaticBatch->GetNumCells(), m_pStaticBatch->GetNumRanges(),
+		m_pStaticBatch->GetNumSubmittedTriangles(), m_pStaticBatch->IsLodEnabled() ? "on" : "off", m_pStaticBatch->GetNumLodObjects(0),
+		m_pStaticBatch->GetNumLodObjects(1), m_pStaticBatch->GetNumLodObjects(2), m_pStaticBatch->GetNumLodObjects(3));
+	m_pFtFont->Render(width - 330, 280, 16, "Track: %d points, %d vertices, chunks %d/%d/%d  Edit (E): %d points, %.1f ms",
+		m_pCatmullRom->GetNumSamples(), m_pCatmullRom->GetNumVertices(), m_pCatmullRom->GetNumVisibleChunks(),
+		m_pCatmullRom->GetNumResidentChunks(), m_pCatmullRom->GetNumChunks(), m_trackEditSamples, m_trackEditMilliseconds);
+	m_pFtFont->Render(width - 330, 300, 16, "Occlusion (O): %s, %d objects, %d tested, %d hidden", m_pOcclusionCuller->IsEnabled() ? "on" : "off",
+		m_pOcclusionCuller->GetNumObjects(), m_pOcclusionCuller->GetNumTested(), m_pOcclusionCuller->GetNumOccluded());
+
+	// Share of the last second each job worker (0 is the main thread) spent running jobs
+	FrameString utilisation("Job workers:", m_pFrameArena);
+	for (int i = 0; i < m_pJobSystem->GetNumWorkers(); i++) {
+		char text[16];
+		sprintf_s(text, " %d%%", (int)(m_pJobSystem->GetWorkerStats(i).utilisation * 100.0 + 0.5));
+		utilisation += text;
+	}
+	m_pFtFont->Render(width - 330, 100, 16, "%s", utilisation.c_str());
+	m_pFtFont->Render(width - 330, 120, 16, "Shaders: %d from cache, %d compiled, %.0f ms",
+		m_pShaderCache->GetNumCacheHits(), m_pShaderCache->GetNumCompiled(), m_pShaderCache->GetBuildMilliseconds());
+	if (m_gameMode == Dark) {
+		m_pFtFont->Render(width - 330, 140, 16, "Lights: %d, %d in view, %d cluster entries (max %d)", m_pLightClusters->GetNumLights(),
+			m_pLightClusters->GetNumVisibleLights(), m_pLightClusters->GetNumLightIndices(), m_pLightClusters->GetMaxLightsPerCluster());
+		m_pFtFont->Render(width - 330, 160, 16, "Lightmap: %dx%d %s, %.0f ms", m_pLightmap->GetWidth(), m_pLightmap->GetHeight(),
+			m_pLightmap->IsFromCache() ? "from cache" : "baked", m_pLightmap->GetBakeMilliseconds());
+	}
+}
+
+// Display the GPU work done in each block of the last frame but one, with the fragments as a multiple of the pixels
+void Game::DisplayPipelineStatistics()
+{
+	if (!m_pPipelineStatistics->IsEnabled())
+		return;
+
+	RECT dimensions = m_gameWindow.GetDimensions();
+	int width = dimensions.right - dimensions.left;
+	int height = dimensions.bottom - dimensions.top;
+	double pixels = (double)width * height;
+
+	int y = 320;
+	for (int i = m_pPipelineStatistics->GetNumBlocks() - 1; i >= 0; i--) {
+		GLuint64 fragments = m_pPipelineStatistics->GetCounter(i, PIPELINE_STATISTIC_FRAGMENTS);
+		m_pFtFont->Render(width - 330, y, 16, "%s: %llu verts, %llu/%llu prims, %.2f frags/pixel",
+			m_pPipelineStatistics->GetBlockName(i).c_str(),
+			m_pPipelineStatistics->GetCounter(i, PIPELINE_STATISTIC_VERTICES),
+			m_pPipelineStatistics->GetCounter(i, PIPELINE_STATISTIC_CLIPPED_PRIMITIVES),
+			m_pPipelineStatistics->GetCounter(i, PIPELINE_STATISTIC_PRIMITIVES), fragments / pixels);
+		y += 20;
+	}
+	if (m_pOverdrawHeatmap->IsEnabled())
+		m_pFtFont->Render(width - 330, y, 16, "Overdraw heatmap (F9): blue 1, green 4, red 7, white 8+");
+}
+
+// Display the heap allocations of the last frame by subsystem, and the frame arena's use
+void Game::DisplayAllocations()
+{
+	RECT dimensions = m_gameWindow.GetDimensions();
+	int width = dimensions.right - dimensions.left;
+
+	FrameString text(m_pFrameArena);
+	char count[32];
+	sprintf_s(count, "Heap allocs: %u (", CAllocationCounter::GetFrameAllocations());
+	text += count;
+	for (int i = 0; i < ALLOCATION_SUBSYSTEM_COUNT; i++) {
+		sprintf_s(count, i == 0 ? "%s %u" : ", %s %u", CAllocationCounter::GetSubsystemName((AllocationSubsystem)i),
+			CAllocationCounter::GetFrameAllocations((AllocationSubsystem)i));
+		text += count;
+	}
+	sprintf_s(count, ")  arena %u KB", (unsigned int)(m_pFrameArena->GetFrameBytes() / 1024));
+	text += count;
+	m_pFtFont->Render(width - 330, 200, 16, "%s", text.c_str());
+}
+
+// Display the memory held by GL resources and their CPU copies, and the owners holding the most of it
+void Game::DisplayResourceMemory()
+{
+	RECT dimensions = m_gameWindow.GetDimensions();
+	int width = dimensions.right - dimensions.left;
+	const float mb = 1.0f / (1024.0f * 1024.0f);
+
+	m_pFtFont->Render(width - 330, 240, 16, "Memory (M): buffers %.1f MB (%d), textures %.1f MB (%d), CPU copies %.1f MB",
+		CResourceTracker::GetTotalBytes(RESOURCE_BUFFER) * mb, CResourceTracker::GetCount(RESOURCE_BUFFER),
+		CResourceTracker::GetTotalBytes(RESOURCE_TEXTURE) * mb, CResourceTracker::GetCount(RESOURCE_TEXTURE),
+		CResourceTracker::GetTotalBytes(RESOURCE_CPU_COPY) * mb);
+
+	const char* owners[4];
+	size_t bytes[4];
+	int numOwners = CResourceTracker::GetLargestOwners(owners, bytes, 4);
+	FrameString text("Largest:", m_pFrameArena);
+	for (int i = 0; i < numOwners; i++) {
+		char owner[64];
+		sprintf_s(owner, i == 0 ? " %s %.1f MB" : ", %s %.1f MB", owners[i], bytes[i] * mb);
+		text += owner;
+	}
+	m_pFtFont->Render(width - 330, 220, 16, "%s", text.c_str());
+}
+
+// Display how full the stream buffer got and how often the CPU had to wait for the GPU to finish with it
+void Game::DisplayStreamBuffer()
+{
+	RECT dimensions = m_gameWindow.GetDimensions();
+	int width = dimensions.right - dimensions.left;
+
+	if (!m_pStreamBuffer->IsCreated()) {
+		m_pFtFont->Render(width - 330, 260, 16, "Stream buffer: not supported, uploading with glBufferSubData");
+		return;
+	}
+
+	const float mb = 1.0f / (1024.0f * 1024.0f);
+	float frameSize = (float)m_pStreamBuffer->GetFrameSize();
+	m_pFtFont->Render(width - 330, 260, 16, "Stream buffer: %d x %.0f MB, used %.1f MB (%.0f%%, peak %.0f%%), %d failed, %d stalls %.1f ms",
+		m_pStreamBuffer->GetNumFrames(), frameSize * mb, m_pStreamBuffer->GetLastFrameBytes() * mb,
+		100.0f * m_pStreamBuffer->GetLastFrameBytes() / frameSize, 100.0f * m_pStreamBuffer->GetPeakFrameBytes() / frameSize,
+		m_pStreamBuffer->GetLastFrameFailures(), m_pStreamBuffer->GetNumStalls(), m_pStreamBuffer->GetStallMilliseconds());
+}
+
+// Append the current pipeline statistics to the benchmark file, together with the settings they were taken with
+void Game::WritePipelineStatistics()
+{
+	if (!m_pPipelineStatistics->IsEnabled())
+		return;
+
+	char title[128];
+	sprintf_s(title, "Pipeline statistics (%s, %d trees, %d flakes)", m_pRenderQueue->IsDepthPrepassEnabled() ? "depth pre-pass" :
+		m_pRenderQueue->IsFrontToBackEnabled() ? "front to back" : "state order", m_stressObjectCount, m_pSnow->GetParticleCount());
+	for (int i = 0; i < m_pPipelineStatistics->GetNumBlocks(); i++) {
+		string line = m_pPipelineStatistics->GetBlockName(i) + ":";
+		for (int s = 0; s < PIPELINE_STATISTIC_COUNT; s++) {
+			char counter[64];
+			sprintf_s(counter, " %s %llu", CPipelineStatistics::GetCounterName((PipelineStatistic)s),
+				m_pPipelineStatistics->GetCounter(i, (PipelineStatistic)s));
+			line += counter;
+		}
+		m_pBenchmark->AddResult(title, line);
+	}
+}
+
+// Display the stress test settings and the results of the last benchmark run
+void Game::DisplayBenchmark()
+{
+	CShaderProgram* fontProgram = (*m_pShaderPrograms)[1];
 
-	gameText = "W A S D - Movement \n N - Toggle Night Mode \n C - Switch Camera \n F - Toggle Freelook";
-	m_pFtFont->Render(60, 150, 20, gameText.c_str());
+	RECT dimensions = m_gameWindow.GetDimensions();
+	int height = dimensions.bottom - dimensions.top;
+
+	fontProgram->SetUniform("vColour", glm::vec4(1.0f, 1.0f, 0.6f, 0.8f));
+	int y = height - 160;
+	if (m_stressObjectCount > 0) {
+		m_pFtFont->Render(20, y, 16, "Stress (F2): %d trees, %s (F3)  cpu %.2f ms  gpu %.2f ms", m_stressObjectCount,
+			m_stressGpuDriven ? "GPU indirect" : "CPU queue", m_stressCpuTime, m_pStressGpuTimer->GetMilliseconds());
+		y -= 20;
+	}
+	if (m_pSnow->GetParticleCount() > 0) {
+		m_pFtFont->Render(20, y, 16, "Snow (F5): %d flakes, %s (F6)  cpu %.2f ms  gpu %.2f ms", m_pSnow->GetParticleCount(),
+			m_pSnow->IsGpuSimulation() ? "GPU compute" : "CPU SSE", m_snowCpuTime, m_pSnowGpuTimer->GetMilliseconds());
+		y -= 20;
+	}
+	if (m_pBenchmark->IsRunning()) {
+		m_pFtFont->Render(20, y, 16, "Benchmark running: %s", m_pBenchmark->GetCurrentCase().c_str());
+		return;
+	}
+	const vector<string>& results = m_pBenchmark->GetResults();
+	if (results.empty())
+		return;
+	m_pFtFont->Render(20, y, 16, "%s", m_pBenchmark->GetTitle().c_str());
+	for (unsigned int i = 0; i < results.size(); i++) {
+		y -= 18;
+		m_pFtFont->Render(20, y, 16, "%s", results[i].c_str());
+	}
 }
 
 // The game loop runs repeatedly until game over
@@ -1261,13 +2045,37 @@ void Game::GameLoop()
 	// Variable timer
 	m_pGameLoopTimer->Start();
 
-	m_pPlaneFBO->Bind();
-	Render(1);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	// Start counting heap allocations for the new frame, and free the last frame's transient data
+	CAllocationCounter::EndFrame();
+	m_pFrameArena->Reset();
 
-	Update();
-	Render(0);
+	// Wait for the GPU to finish with the stream buffer region this frame writes to
+	m_pStreamBuffer->BeginFrame();
+
+	// Run any OpenGL work that jobs have handed back to the main thread
+	{
+		CAllocationScope allocationScope(ALLOCATION_JOBS);
+		m_pJobSystem->ProcessMainThreadJobs();
+	}
+
+	{
+		CAllocationScope allocationScope(ALLOCATION_TV_VIEW);
+		m_pPlaneFBO->Bind();
+		Render(1);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	{
+		CAllocationScope allocationScope(ALLOCATION_UPDATE);
+		Update();
+	}
+
+	{
+		CAllocationScope allocationScope(ALLOCATION_SCENE);
+		Render(0);
+	}
 
+	m_pStreamBuffer->EndFrame();
 
 	m_dt = m_pGameLoopTimer->Elapsed();
 
@@ -1408,6 +2216,86 @@ LRESULT Game::ProcessEvents(HWND window, UINT message, WPARAM w_param, LPARAM l_
 			else
 				m_gameMode = Light;
 			break;
+		case VK_F1:
+			m_pRenderQueue->SetSortingEnabled(!m_pRenderQueue->IsSortingEnabled());
+			break;
+		case VK_F2:
+			// Cycle the stress test through 0, 1000, 10000 and 50000 trees
+			if (m_stressObjectCount == 0)
+				SetStressObjectCount(1000);
+			else if (m_stressObjectCount < 50000)
+				SetStressObjectCount(m_stressObjectCount == 1000 ? 10000 : 50000);
+			else
+				SetStressObjectCount(0);
+			break;
+		case VK_F3:
+			if (CIndirectRenderer::IsSupported())
+				m_stressGpuDriven = !m_stressGpuDriven;
+			break;
+		case VK_F4:
+			StartStressBenchmark();
+			break;
+		case VK_F5:
+			// Cycle the snow density through none, light, heavy and a million flakes
+			if (m_pSnow->GetParticleCount() == 0)
+				m_pSnow->SetParticleCount(10000);
+			else if (m_pSnow->GetParticleCount() < m_pSnow->GetMaxParticles())
+				m_pSnow->SetParticleCount(m_pSnow->GetParticleCount() == 10000 ? 100000 : m_pSnow->GetMaxParticles());
+			else
+				m_pSnow->SetParticleCount(0);
+			break;
+		case VK_F6:
+			m_pSnow->SetGpuSimulation(!m_pSnow->IsGpuSimulation());
+			break;
+		case VK_F7:
+			StartSnowBenchmark();
+			break;
+		case VK_F9:
+			// Cycle the diagnostics through off, pipeline statistics, and pipeline statistics with the overdraw heatmap
+			if (m_pOverdrawHeatmap->IsEnabled()) {
+				m_pOverdrawHeatmap->SetEnabled(false);
+				m_pPipelineStatistics->SetEnabled(false);
+			}
+			else if (m_pPipelineStatistics->IsEnabled() || !CPipelineStatistics::IsSupported())
+				m_pOverdrawHeatmap->SetEnabled(true);
+			else
+				m_pPipelineStatistics->SetEnabled(true);
+			break;
+		case VK_F10:
+			WritePipelineStatistics();
+			break;
+		case VK_F11:
+			RunMatrixBenchmark();
+			break;
+		case 'M':
+			CResourceTracker::WriteJson("resources.json");
+			break;
+		case 'L':
+			m_pStaticBatch->SetLodEnabled(!m_pStaticBatch->IsLodEnabled());
+			break;
+		case 'O':
+			m_pOcclusionCuller->SetEnabled(!m_pOcclusionCuller->IsEnabled());
+			break;
+		case 'E':
+			// Raise the next of the road's control points, to try out editing the track
+			{
+				int index = m_editControlPoint++ % m_pCatmullRom->GetNumControlPoints();
+				MoveTrackControlPoint(index, m_pCatmullRom->GetControlPoint(index) + glm::vec3(0.0f, 20.0f, 0.0f));
+			}
+			break;
+		case VK_F8:
+			// Cycle the opaque layer through front to back, a depth pre-pass followed by state order, and state order
+			if (m_pRenderQueue->IsDepthPrepassEnabled()) {
+				m_pRenderQueue->SetDepthPrepassEnabled(false);
+				m_pRenderQueue->SetFrontToBackEnabled(false);
+			}
+			else if (m_pRenderQueue->IsFrontToBackEnabled()) {
+				m_pRenderQueue->SetDepthPrepassEnabled(true);
+				m_pRenderQueue->SetFrontToBackEnabled(false);
+			}
+			else
+				m_pRenderQueue->SetFrontToBackEnabled(true);
+			break;
 		case 'R':
 			if (m_gameOver)
 			{
@@ -8,6 +8,22 @@
 #include "HeightMapTerrain.h"
 #include "FrameBufferObject.h"
 #include "Snow.h"
+#include "RenderQueue.h"
+#include "StaticBatch.h"
+#include "Frustum.h"
+#include "IndirectRenderer.h"
+#include "Benchmark.h"
+#include "JobSystem.h"
+#include "ShaderCache.h"
+#include "LightClusters.h"
+#include "Lightmap.h"
+#include "RenderStatistics.h"
+#include "TransformBatch.h"
+#include "FrameArena.h"
+#include "StreamBuffer.h"
+#include "TrackIndex.h"
+#include "OcclusionCuller.h"
+#include "AllocationCounter.h"
 
 // Classes used in game.  For a new class, declare it here and provide a pointer to an object of this class below.  Then, in Game.cpp, 
 // include the header.  In the Game constructor, set the pointer to NULL and in Game::Initialise, create a new object.  Don't forget to 
@@ -30,11 +46,27 @@ private:
 	void Initialise();
 	void Update();
 	void Render(int pass);
-	void UseSnowShader(glm::mat4 viewMatrix);
 	void RenderSpeedTexture();
 	void LoadShaders();
+	void PlaceTrackProps(vector<glm::vec3>& leftOffsetPoints, vector<glm::vec3>& rightOffsetPoints);
+	void MoveTrackControlPoint(int index, const glm::vec3& point);
+	void CreateStaticBatch();
+	void CreateStressTest();
+	void CreateOcclusionObjects();
+	void SetStressObjectCount(int count);
+	void RenderStressTest(CCamera* camera, const glm::mat4& viewMatrix, const CFrustum& frustum, const glm::vec4& lightPosition, float la, float ld, float ls);
+	void StartStressBenchmark();
+	void RenderSnow(CCamera* camera, const glm::mat4& viewMatrix);
+	void StartSnowBenchmark();
+	void RunMatrixBenchmark();
 	void RestartGame();
 	void Revive();
+	void CreateRenderPipelines();
+	RenderItem CreateRenderItem(int pipeline, const glm::mat4& modelViewMatrix, CCamera* camera, RenderLayer layer = RENDER_LAYER_OPAQUE);
+	void RenderHUD();
+	static void ApplyPlayerCarPipeline(CShaderProgram* program, void* context);
+	static void ApplyCarPipeline(CShaderProgram* program, void* context);
+	static void IssueOcclusionQueries(void* context);
 
 	// Pointers to game objects.  They will get allocated in Game::Initialise()
 	CSkybox *m_pSkybox;
@@ -65,6 +97,31 @@ private:
 	CPlane* m_pPlane;
 	CFrameBufferObject* m_pPlaneFBO;
 	CTexture* m_pSpeedometerImage;
+	CRenderQueue* m_pRenderQueue;
+	CStaticBatch* m_pStaticBatch;
+	CIndirectRenderer* m_pIndirectRenderer;
+	CBenchmark* m_pBenchmark;
+	CGpuTimer* m_pStressGpuTimer;
+	CGpuTimer* m_pSnowGpuTimer;
+	CJobSystem* m_pJobSystem;
+	CShaderCache* m_pShaderCache;
+	CShaderVariants* m_pMainShaderVariants;
+	CLightClusters* m_pLightClusters;
+	CLightmap* m_pLightmap;
+	CPipelineStatistics* m_pPipelineStatistics;
+	COverdrawHeatmap* m_pOverdrawHeatmap;
+	CFrameArena* m_pFrameArena;
+	CStreamBuffer* m_pStreamBuffer;
+	CTrackIndex* m_pTrackIndex;
+	COcclusionCuller* m_pOcclusionCuller;
+
+	// Render queue pipelines, registered once in CreateRenderPipelines
+	int m_mainPipeline;
+	int m_lightmappedPipeline;
+	int m_skyboxPipeline;
+	int m_treePipeline;
+	int m_playerCarPipeline;
+	int m_carPipeline;
 
 	// Some other member variables
 	double m_dt;
@@ -89,6 +146,8 @@ private:
 	enum CameraType {First, Third, Top, FreeLook};
 	enum PlayerMove {None, Left, Right, Front, Back};
 	enum GameMode {Light, Dark};
+	// Feature bits of the main shader variants, in the order of the features given to m_pMainShaderVariants
+	enum MainShaderFeature {MAIN_SHADER_SKYBOX = 1, MAIN_SHADER_PHONG = 2, MAIN_SHADER_CLUSTERED_LIGHTS = 4, MAIN_SHADER_LIGHTMAP = 8};
 	CameraType m_cameraType;
 	PlayerMove m_movePlayer;
 	GameMode m_gameMode;
@@ -96,6 +155,8 @@ private:
 	std::vector<glm::vec3> m_tree_positions;
 	std::vector<glm::vec3> m_barricade_positions;
 	std::vector<glm::vec3> m_streetlight_positions;
+	std::vector<float> m_streetlight_rotations;			// Degrees about y that turn the arm of the post over the road
+	std::vector<ClusterLight> m_streetlights;
 	std::vector<glm::vec3> m_collidables;
 	glm::vec3 m_playerT;
 	glm::vec3 m_playerN;
@@ -132,12 +193,20 @@ public:
 
 private:
 	static const int FPS = 60;
+	static const int TREE_CLUSTER_SIZE = 8;		// Trees tested for occlusion together
 	void DisplayFrameRate();
 	void DisplayLaps();
 	void DisplayHealthAndLapTimes();
 	void DisplayDeathText();
 	void DisplayGameOverText();
 	void DisplayControls();
+	void DisplayRenderStats();
+	void DisplayBenchmark();
+	void DisplayPipelineStatistics();
+	void DisplayAllocations();
+	void DisplayResourceMemory();
+	void DisplayStreamBuffer();
+	void WritePipelineStatistics();
 	void GameLoop();
 	float CalculateDistance(glm::vec3, glm::vec3);
 	GameWindow m_gameWindow;
@@ -149,5 +218,37 @@ private:
 	float m_playerSpeed;
 	int m_cameraRadius;
 	float m_explodeFactor;
+	bool m_playerCarExplode;
+	bool m_playerCarJoin;
+	float m_playerCarExplodeFactor;
+
+	// Stress test: many trees scattered over the terrain, drawn either through the render queue or by the GPU driven path
+	vector<glm::mat4> m_stressMatrices;
+	CTransformBatch* m_pStressTransforms;
+	vector<ObjectTransform> m_stressTransformed;
+	vector<int> m_stressMeshes;
+	vector<char> m_stressVisible;
+	glm::vec4 m_stressBounds[2];	// Local bounding sphere of the tree and the cube tree
+	int m_stressObjectCount;
+	bool m_stressGpuDriven;
+	double m_stressCpuTime;
+	double m_snowCpuTime;
 	float m_shaderElapsedTime;
+
+	// Track editing
+	int m_editControlPoint;			// Next control point moved by the edit key
+	int m_trackEditSamples;			// Centreline points changed by the last edit
+	double m_trackEditMilliseconds;
+
+	// Occlusion culling
+	struct OcclusionPass {				// The view being drawn, for IssueOcclusionQueries
+		Game* game;
+		int view;
+		glm::mat4 viewMatrix;
+		const CFrustum* frustum;
+		glm::vec3 eye;
+	};
+	vector<int> m_treeClusterObjects;	// Occlusion object of each run of TREE_CLUSTER_SIZE trees
+	int m_carOcclusionObjects[2];		// The opponent cars, which are drawn conditionally
+	float m_carOcclusionRadius[2];
 };
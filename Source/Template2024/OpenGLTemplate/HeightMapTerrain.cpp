@@ -151,10 +151,10 @@ bool CHeightMapTerrain::Create(char* terrainFilename, char* textureFilename, glm
 	}
 
 	// Create a face vertex mesh
-	m_mesh.CreateFromTriangleList(vertices, triangles);
+	m_mesh.CreateFromTriangleList(vertices, triangles, "terrain");
 
 	// Load a texture for texture mapping the mesh
-	m_texture.Load(textureFilename, true);
+	m_texture.Load(textureFilename, true, "terrain");
 
 
 
@@ -190,4 +190,12 @@ void CHeightMapTerrain::Render()
 {
 	m_texture.Bind();
 	m_mesh.Render();
+}
+
+void CHeightMapTerrain::Submit(CRenderQueue* queue, RenderItem item)
+{
+	item.vao = m_mesh.GetVAO();
+	item.SetTexture(GL_TEXTURE_2D, m_texture.GetTextureID(), m_texture.GetSamplerID());
+	item.SetDrawElements(GL_TRIANGLES, m_mesh.GetIndexCount(), GL_UNSIGNED_INT);
+	queue->Submit(item);
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include "include\freeimage\FreeImage.h"
 #include "Texture.h"
 #include "FaceVertexMesh.h"
+#include "RenderQueue.h"
 
 class CHeightMapTerrain
 {
@@ -13,6 +14,7 @@ public:
 	bool Create(char* terrainFilename, char* textureFilename, glm::vec3 origin, float terrainSizeX, float terrainSizeZ, float terrainHeightScale);
 	float ReturnGroundHeight(glm::vec3 p);
 	void Render();
+	void Submit(CRenderQueue* queue, RenderItem item);
 
 private:
 	int m_width, m_height;
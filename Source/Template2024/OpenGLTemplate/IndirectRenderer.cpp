@@ -0,0 +1,248 @@
+#include "IndirectRenderer.h"
+#include "ResourceTracker.h"
+
+#define CULL_WORKGROUP_SIZE 64
+
+CIndirectRenderer::CIndirectRenderer()
+{
+	m_pCullProgram = NULL;
+	m_pDrawProgram = NULL;
+	m_vao = 0;
+	m_vbo = 0;
+	m_ibo = 0;
+	m_objectBuffer = 0;
+	m_commandBuffer = 0;
+	m_visibleBuffer = 0;
+	m_numObjects = 0;
+	m_numDrawCalls = 0;
+}
+
+CIndirectRenderer::~CIndirectRenderer()
+{
+	Release();
+}
+
+bool CIndirectRenderer::IsSupported()
+{
+	return GLEW_VERSION_4_3 != 0;
+}
+
+void CIndirectRenderer::Create(CShaderProgram* cullProgram, CShaderProgram* drawProgram)
+{
+	m_pCullProgram = cullProgram;
+	m_pDrawProgram = drawProgram;
+}
+
+int CIndirectRenderer::AddMesh(const vector<glm::vec3>& positions, const vector<glm::vec2>& texCoords, const vector<glm::vec3>& normals,
+	const vector<unsigned int>& indices, CTexture* texture)
+{
+	Mesh mesh;
+	mesh.firstIndex = (GLuint)m_indexData.size();
+	mesh.numIndices = (GLuint)indices.size();
+	mesh.baseVertex = (GLint)(m_vertexData.size() / (2 * sizeof(glm::vec3) + sizeof(glm::vec2)));
+	mesh.texture = texture;
+
+	// Bounding sphere around the centre of the bounding box
+	glm::vec3 boundsMin = positions[0];
+	glm::vec3 boundsMax = positions[0];
+	for (unsigned int i = 1; i < positions.size(); i++) {
+		boundsMin = glm::min(boundsMin, positions[i]);
+		boundsMax = glm::max(boundsMax, positions[i]);
+	}
+	glm::vec3 centre = (boundsMin + boundsMax) * 0.5f;
+	float radius = 0.0f;
+	for (unsigned int i = 0; i < positions.size(); i++)
+		radius = glm::max(radius, glm::length(positions[i] - centre));
+	mesh.boundingSphere = glm::vec4(centre, radius);
+
+	for (unsigned int i = 0; i < positions.size(); i++) {
+		const BYTE* p = (const BYTE*)&positions[i];
+		const BYTE* t = (const BYTE*)&texCoords[i];
+		const BYTE* n = (const BYTE*)&normals[i];
+		m_vertexData.insert(m_vertexData.end(), p, p + sizeof(glm::vec3));
+		m_vertexData.insert(m_vertexData.end(), t, t + sizeof(glm::vec2));
+		m_vertexData.insert(m_vertexData.end(), n, n + sizeof(glm::vec3));
+	}
+	m_indexData.insert(m_indexData.end(), indices.begin(), indices.end());
+
+	m_meshes.push_back(mesh);
+	return (int)m_meshes.size() - 1;
+}
+
+// Upload the mesh geometry and set up the vertex array.  Attribute 3 is the index of the object being drawn; it
+// advances once per instance and starts at the command's baseInstance, which is where that mesh's visible list begins.
+void CIndirectRenderer::CreateBuffers()
+{
+	GLsizei stride = 2 * sizeof(glm::vec3) + sizeof(glm::vec2);
+
+	glGenVertexArrays(1, &m_vao);
+	glBindVertexArray(m_vao);
+
+	glGenBuffers(1, &m_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBufferData(GL_ARRAY_BUFFER, m_vertexData.size(), &m_vertexData[0], GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)sizeof(glm::vec3));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(glm::vec3) + sizeof(glm::vec2)));
+
+	glGenBuffers(1, &m_ibo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indexData.size() * sizeof(unsigned int), &m_indexData[0], GL_STATIC_DRAW);
+
+	glGenBuffers(1, &m_visibleBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, m_visibleBuffer);
+	glEnableVertexAttribArray(3);
+	glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), 0);
+	glVertexAttribDivisor(3, 1);
+
+	glBindVertexArray(0);
+
+	glGenBuffers(1, &m_objectBuffer);
+	glGenBuffers(1, &m_commandBuffer);
+
+	CResourceTracker::TrackBuffer(m_vbo, m_vertexData.size(), "indirect renderer");
+	CResourceTracker::TrackBuffer(m_ibo, m_indexData.size() * sizeof(unsigned int), "indirect renderer");
+	CResourceTracker::TrackCpuCopy(&m_vertexData, m_vertexData.capacity(), "indirect renderer");
+	CResourceTracker::TrackCpuCopy(&m_indexData, m_indexData.capacity() * sizeof(unsigned int), "indirect renderer");
+}
+
+void CIndirectRenderer::SetObjects(const vector<int>& meshes, const vector<glm::mat4>& modelMatrices)
+{
+	if (m_meshes.empty())
+		return;
+	if (m_vao == 0)
+		CreateBuffers();
+
+	m_numObjects = (int)meshes.size();
+
+	// Group the objects by mesh so each mesh's visible list can start at a fixed offset
+	vector<GLuint> meshCounts(m_meshes.size(), 0);
+	for (unsigned int i = 0; i < meshes.size(); i++)
+		meshCounts[meshes[i]]++;
+
+	m_commands.resize(m_meshes.size());
+	GLuint offset = 0;
+	for (unsigned int m = 0; m < m_meshes.size(); m++) {
+		m_commands[m].count = m_meshes[m].numIndices;
+		m_commands[m].instanceCount = 0;
+		m_commands[m].firstIndex = m_meshes[m].firstIndex;
+		m_commands[m].baseVertex = m_meshes[m].baseVertex;
+		m_commands[m].baseInstance = offset;
+		offset += meshCounts[m];
+	}
+
+	vector<Object> objects(meshes.size());
+	for (unsigned int i = 0; i < meshes.size(); i++) {
+		const glm::mat4& model = modelMatrices[i];
+		const glm::vec4& sphere = m_meshes[meshes[i]].boundingSphere;
+		float scale = glm::max(glm::length(glm::vec3(model[0])), glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+		objects[i].modelMatrix = model;
+		objects[i].boundingSphere = glm::vec4(glm::vec3(model * glm::vec4(glm::vec3(sphere), 1.0f)), sphere.w * scale);
+		objects[i].mesh = meshes[i];
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_objectBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, glm::max<size_t>(objects.size(), 1) * sizeof(Object), objects.empty() ? NULL : &objects[0], GL_STATIC_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_visibleBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, glm::max<size_t>(objects.size(), 1) * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_commandBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, m_commands.size() * sizeof(DrawCommand), &m_commands[0], GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	CResourceTracker::TrackBuffer(m_objectBuffer, glm::max<size_t>(objects.size(), 1) * sizeof(Object), "indirect renderer");
+	CResourceTracker::TrackBuffer(m_visibleBuffer, glm::max<size_t>(objects.size(), 1) * sizeof(GLuint), "indirect renderer");
+	CResourceTracker::TrackBuffer(m_commandBuffer, m_commands.size() * sizeof(DrawCommand), "indirect renderer");
+}
+
+void CIndirectRenderer::Render(const glm::mat4& viewMatrix, const glm::mat4& projMatrix, const CFrustum& frustum)
+{
+	m_numDrawCalls = 0;
+	if (m_numObjects == 0)
+		return;
+
+	// Reset the instance counts, then let the compute shader append the visible objects
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_commandBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, m_commands.size() * sizeof(DrawCommand), &m_commands[0]);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glm::vec4 planes[6];
+	for (int i = 0; i < 6; i++)
+		planes[i] = frustum.GetPlane(i);
+
+	m_pCullProgram->UseProgram();
+	m_pCullProgram->SetUniform("frustumPlanes", planes, 6);
+	m_pCullProgram->SetUniform("objectCount", m_numObjects);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_objectBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_commandBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_visibleBuffer);
+	glDispatchCompute((m_numObjects + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+
+	// The commands are read by the indirect draw and the visible list by the vertex fetch
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+	m_pDrawProgram->UseProgram();
+	m_pDrawProgram->SetUniform("matrices.projMatrix", projMatrix);
+	m_pDrawProgram->SetUniform("matrices.viewMatrix", viewMatrix);
+	m_pDrawProgram->SetUniform("sampler0", 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_objectBuffer);
+
+	glBindVertexArray(m_vao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+
+	// One multi draw per run of meshes that share a texture
+	unsigned int first = 0;
+	while (first < m_meshes.size()) {
+		unsigned int last = first + 1;
+		while (last < m_meshes.size() && m_meshes[last].texture == m_meshes[first].texture)
+			last++;
+		if (m_meshes[first].texture)
+			m_meshes[first].texture->Bind(0);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)(first * sizeof(DrawCommand)), last - first, 0);
+		m_numDrawCalls++;
+		first = last;
+	}
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
+CShaderProgram* CIndirectRenderer::GetDrawProgram()
+{
+	return m_pDrawProgram;
+}
+
+int CIndirectRenderer::GetNumObjects()
+{
+	return m_numObjects;
+}
+
+int CIndirectRenderer::GetNumDrawCalls()
+{
+	return m_numDrawCalls;
+}
+
+void CIndirectRenderer::Release()
+{
+	if (m_vao) {
+		CResourceTracker::UntrackBuffer(m_vbo);
+		CResourceTracker::UntrackBuffer(m_ibo);
+		CResourceTracker::UntrackBuffer(m_objectBuffer);
+		CResourceTracker::UntrackBuffer(m_commandBuffer);
+		CResourceTracker::UntrackBuffer(m_visibleBuffer);
+		CResourceTracker::UntrackCpuCopy(&m_vertexData);
+		CResourceTracker::UntrackCpuCopy(&m_indexData);
+		glDeleteVertexArrays(1, &m_vao);
+		glDeleteBuffers(1, &m_vbo);
+		glDeleteBuffers(1, &m_ibo);
+		glDeleteBuffers(1, &m_objectBuffer);
+		glDeleteBuffers(1, &m_commandBuffer);
+		glDeleteBuffers(1, &m_visibleBuffer);
+	}
+	m_vao = 0;
+	m_numObjects = 0;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Common.h"
+#include "Shaders.h"
+#include "Texture.h"
+#include "Frustum.h"
+
+// GPU driven drawing of many copies of a few meshes (GL 4.3).  The model matrix and bounding sphere of every object
+// are kept in a shader storage buffer.  Each frame a compute shader tests the objects against the frustum and fills
+// in one DrawElementsIndirectCommand per mesh, and the visible objects are drawn with glMultiDrawElementsIndirect,
+// one call per texture.  The CPU cost is independent of the number of objects.
+class CIndirectRenderer
+{
+public:
+	CIndirectRenderer();
+	~CIndirectRenderer();
+
+	// Return true if the context supports compute shaders, storage buffers and multi draw indirect
+	static bool IsSupported();
+
+	// cullProgram is the culling compute shader and drawProgram draws the visible objects
+	void Create(CShaderProgram* cullProgram, CShaderProgram* drawProgram);
+
+	// Add a mesh and return its index.  All meshes must be added before the first call to SetObjects.
+	int AddMesh(const vector<glm::vec3>& positions, const vector<glm::vec2>& texCoords, const vector<glm::vec3>& normals,
+		const vector<unsigned int>& indices, CTexture* texture);
+
+	// Replace the objects.  meshes[i] is the mesh drawn with modelMatrices[i].
+	void SetObjects(const vector<int>& meshes, const vector<glm::mat4>& modelMatrices);
+
+	// Cull and draw the objects.  The draw program must already have its lighting uniforms set.
+	void Render(const glm::mat4& viewMatrix, const glm::mat4& projMatrix, const CFrustum& frustum);
+
+	CShaderProgram* GetDrawProgram();
+	int GetNumObjects();
+	int GetNumDrawCalls();
+
+	void Release();
+
+private:
+	// Matches the layout of DrawElementsIndirectCommand and of the DrawCommand struct in gpuCull.comp
+	struct DrawCommand {
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	// Matches the Object struct in the shaders (std430)
+	struct Object {
+		glm::mat4 modelMatrix;
+		glm::vec4 boundingSphere;
+		GLuint mesh;
+		GLuint padding[3];
+	};
+
+	struct Mesh {
+		GLuint firstIndex;
+		GLuint numIndices;
+		GLint baseVertex;
+		glm::vec4 boundingSphere;
+		CTexture* texture;
+	};
+
+	void CreateBuffers();
+
+	CShaderProgram* m_pCullProgram;
+	CShaderProgram* m_pDrawProgram;
+
+	vector<BYTE> m_vertexData;
+	vector<unsigned int> m_indexData;
+	vector<Mesh> m_meshes;
+	vector<DrawCommand> m_commands;	// Commands with instanceCount cleared, copied to the GPU before culling
+
+	GLuint m_vao;
+	GLuint m_vbo;
+	GLuint m_ibo;
+	GLuint m_objectBuffer;
+	GLuint m_commandBuffer;
+	GLuint m_visibleBuffer;
+	int m_numObjects;
+	int m_numDrawCalls;
+};
@@ -0,0 +1,282 @@
+#include "JobSystem.h"
+#include "AllocationCounter.h"
+
+#define JOB_MAX_THREADS 15
+
+// Index of the worker the current thread is, or -1 for a thread the job system did not create
+static thread_local int s_workerIndex = -1;
+
+CJobCounter::CJobCounter()
+{
+	m_count = 0;
+}
+
+CJobCounter::~CJobCounter()
+{}
+
+bool CJobCounter::IsDone() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_count.load() == 0;
+}
+
+CJobSystem::CJobSystem()
+{
+	m_numQueued = 0;
+	m_quit = false;
+	m_nextWorker = 0;
+}
+
+CJobSystem::~CJobSystem()
+{
+	Shutdown();
+}
+
+void CJobSystem::Initialise(int numThreads)
+{
+	if (numThreads <= 0)
+		numThreads = (int)std::thread::hardware_concurrency() - 1;
+	if (numThreads > JOB_MAX_THREADS)
+		numThreads = JOB_MAX_THREADS;
+	if (numThreads < 0)
+		numThreads = 0;
+
+	// Worker 0 is the calling (main) thread
+	for (int i = 0; i <= numThreads; i++) {
+		Worker* worker = new Worker;
+		worker->jobCount = 0;
+		worker->stealCount = 0;
+		worker->busyMicroseconds = 0;
+		memset(&worker->stats, 0, sizeof(JobWorkerStats));
+		m_workers.push_back(worker);
+	}
+	s_workerIndex = 0;
+	m_statsTime = std::chrono::high_resolution_clock::now();
+
+	for (int i = 1; i <= numThreads; i++)
+		m_workers[i]->thread = std::thread(&CJobSystem::WorkerLoop, this, i);
+}
+
+void CJobSystem::Shutdown()
+{
+	if (m_workers.empty())
+		return;
+
+	m_quit = true;
+	m_wake.notify_all();
+	for (unsigned int i = 1; i < m_workers.size(); i++)
+		m_workers[i]->thread.join();
+	for (unsigned int i = 0; i < m_workers.size(); i++)
+		delete m_workers[i];
+	m_workers.clear();
+}
+
+void CJobSystem::Run(std::function<void()> function, CJobCounter* counter, CJobCounter* dependency)
+{
+	Job job;
+	job.function = function;
+	job.counter = counter;
+	job.mainThread = false;
+	if (counter) {
+		std::lock_guard<std::mutex> lock(counter->m_mutex);
+		counter->m_count++;
+	}
+	Queue(job, dependency);
+}
+
+void CJobSystem::RunOnMainThread(std::function<void()> function, CJobCounter* counter, CJobCounter* dependency)
+{
+	Job job;
+	job.function = function;
+	job.counter = counter;
+	job.mainThread = true;
+	if (counter) {
+		std::lock_guard<std::mutex> lock(counter->m_mutex);
+		counter->m_count++;
+	}
+	Queue(job, dependency);
+}
+
+// Hold the job back on its dependency if that is still running, otherwise make it available now
+void CJobSystem::Queue(const Job& job, CJobCounter* dependency)
+{
+	if (dependency) {
+		std::lock_guard<std::mutex> lock(dependency->m_mutex);
+		if (dependency->m_count > 0) {
+			dependency->m_waitingJobs.push_back(job);
+			return;
+		}
+	}
+	Push(job);
+}
+
+void CJobSystem::Push(const Job& job)
+{
+	if (job.mainThread) {
+		std::lock_guard<std::mutex> lock(m_mainThreadMutex);
+		m_mainThreadJobs.push_back(job);
+		return;
+	}
+
+	// Without any worker threads the job waits for the main thread to run it in Wait
+	int index = s_workerIndex;
+	if (index < 0 || index >= (int)m_workers.size())
+		index = m_nextWorker++ % m_workers.size();
+
+	Worker* worker = m_workers[index];
+	{
+		std::lock_guard<std::mutex> lock(worker->mutex);
+		worker->jobs.push_back(job);
+	}
+	m_numQueued++;
+	m_wake.notify_one();
+}
+
+// Take the newest job from this worker's own deque, or failing that the oldest job from another worker's deque
+bool CJobSystem::GetJob(int worker, Job& job)
+{
+	Worker* own = m_workers[worker];
+	{
+		std::lock_guard<std::mutex> lock(own->mutex);
+		if (!own->jobs.empty()) {
+			job = own->jobs.back();
+			own->jobs.pop_back();
+			m_numQueued--;
+			return true;
+		}
+	}
+
+	int numWorkers = (int)m_workers.size();
+	for (int i = 1; i < numWorkers; i++) {
+		Worker* victim = m_workers[(worker + i) % numWorkers];
+		std::lock_guard<std::mutex> lock(victim->mutex);
+		if (!victim->jobs.empty()) {
+			job = victim->jobs.front();
+			victim->jobs.pop_front();
+			m_numQueued--;
+			own->stealCount++;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool CJobSystem::RunOneJob(int worker)
+{
+	Job job;
+	if (!GetJob(worker, job))
+		return false;
+	Execute(worker, job);
+	return true;
+}
+
+void CJobSystem::Execute(int worker, Job& job)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	job.function();
+	std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+
+	m_workers[worker]->busyMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+	m_workers[worker]->jobCount++;
+	Finish(job.counter);
+}
+
+// Count the job as done and release anything that was waiting for its group to finish
+void CJobSystem::Finish(CJobCounter* counter)
+{
+	if (counter == NULL)
+		return;
+
+	// The owner may destroy the counter as soon as the mutex is released, so it is not touched after that
+	vector<Job> released;
+	{
+		std::lock_guard<std::mutex> lock(counter->m_mutex);
+		if (--counter->m_count > 0)
+			return;
+		released.swap(counter->m_waitingJobs);
+	}
+	for (unsigned int i = 0; i < released.size(); i++)
+		Push(released[i]);
+}
+
+void CJobSystem::WorkerLoop(int worker)
+{
+	s_workerIndex = worker;
+	CAllocationScope allocationScope(ALLOCATION_JOBS);
+	while (!m_quit) {
+		if (RunOneJob(worker))
+			continue;
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_wake.wait_for(lock, std::chrono::milliseconds(2), [this]() { return m_numQueued > 0 || m_quit; });
+	}
+}
+
+void CJobSystem::ParallelFor(int count, int grainSize, std::function<void(int first, int last)> function)
+{
+	if (count <= 0)
+		return;
+	if (grainSize < 1)
+		grainSize = 1;
+
+	CJobCounter counter;
+	for (int first = 0; first < count; first += grainSize) {
+		int last = first + grainSize < count ? first + grainSize : count;
+		Run([&function, first, last]() { function(first, last); }, &counter);
+	}
+	Wait(&counter);
+}
+
+// IsDone takes the counter's mutex, so once it returns true the job that finished the group has let go of the
+// counter and the caller can destroy it
+void CJobSystem::Wait(CJobCounter* counter)
+{
+	int worker = s_workerIndex < 0 ? 0 : s_workerIndex;
+	while (!counter->IsDone()) {
+		if (worker == 0)
+			ProcessMainThreadJobs();
+		if (!RunOneJob(worker))
+			std::this_thread::yield();
+	}
+}
+
+void CJobSystem::ProcessMainThreadJobs()
+{
+	if (s_workerIndex != 0)
+		return;
+
+	// Jobs queued while these run wait for the next call, so a job that queues itself cannot loop forever
+	std::deque<Job> jobs;
+	{
+		std::lock_guard<std::mutex> lock(m_mainThreadMutex);
+		jobs.swap(m_mainThreadJobs);
+	}
+	for (unsigned int i = 0; i < jobs.size(); i++)
+		Execute(0, jobs[i]);
+}
+
+int CJobSystem::GetNumWorkers()
+{
+	return (int)m_workers.size();
+}
+
+void CJobSystem::UpdateStats()
+{
+	std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
+	double periodMilliseconds = std::chrono::duration_cast<std::chrono::microseconds>(now - m_statsTime).count() / 1000.0;
+	m_statsTime = now;
+
+	for (unsigned int i = 0; i < m_workers.size(); i++) {
+		Worker* worker = m_workers[i];
+		JobWorkerStats& stats = worker->stats;
+		stats.jobs = worker->jobCount.exchange(0);
+		stats.steals = worker->stealCount.exchange(0);
+		stats.busyMilliseconds = worker->busyMicroseconds.exchange(0) / 1000.0;
+		stats.utilisation = periodMilliseconds > 0.0 ? stats.busyMilliseconds / periodMilliseconds : 0.0;
+	}
+}
+
+const JobWorkerStats& CJobSystem::GetWorkerStats(int worker)
+{
+	return m_workers[worker]->stats;
+}
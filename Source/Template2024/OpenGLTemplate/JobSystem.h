@@ -0,0 +1,116 @@
+#pragma once
+
+#include "Common.h"
+#include <functional>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+
+// Counts the unfinished jobs in a group.  Pass the same counter to several CJobSystem::Run calls and then Wait on it,
+// or make other jobs depend on it so they only start once the whole group has finished.
+class CJobCounter
+{
+public:
+	CJobCounter();
+	~CJobCounter();
+
+	bool IsDone() const;
+
+private:
+	friend class CJobSystem;
+
+	struct Job {
+		std::function<void()> function;
+		CJobCounter* counter;
+		bool mainThread;
+	};
+
+	// The count only changes to or from zero with the mutex held, so a thread that has seen zero with the mutex
+	// held knows the job that finished the group is done with the counter, and the counter can be destroyed
+	std::atomic<int> m_count;
+	mutable std::mutex m_mutex;
+	vector<Job> m_waitingJobs;	// Jobs that depend on this counter and are released when it reaches zero
+};
+
+// Per worker activity since the previous call to CJobSystem::UpdateStats
+struct JobWorkerStats
+{
+	int jobs;
+	int steals;
+	double busyMilliseconds;
+	double utilisation;		// Fraction of the period spent running jobs
+};
+
+// Work stealing job scheduler.  Each thread has its own deque of jobs: a thread pushes and pops at the back of its
+// own deque (so recently created, cache warm work runs first) and, when it runs out, steals from the front of
+// another thread's deque.  The main thread is worker 0; it runs jobs while it waits, and it is the only thread
+// that runs jobs queued with RunOnMainThread, which is where anything that touches OpenGL has to go.
+class CJobSystem
+{
+public:
+	CJobSystem();
+	~CJobSystem();
+
+	// Start the worker threads.  Must be called from the main thread.  0 uses one thread per remaining core.
+	void Initialise(int numThreads = 0);
+	void Shutdown();
+
+	// Queue a job.  counter (if given) is incremented now and decremented when the job finishes.  If dependency
+	// is given, the job is not started until the dependency counter reaches zero.
+	void Run(std::function<void()> function, CJobCounter* counter = NULL, CJobCounter* dependency = NULL);
+
+	// As Run, but the job is only ever run by the main thread, in Wait or ProcessMainThreadJobs
+	void RunOnMainThread(std::function<void()> function, CJobCounter* counter = NULL, CJobCounter* dependency = NULL);
+
+	// Call function(first, last) over [0, count) in blocks of about grainSize, and return when all blocks are done
+	void ParallelFor(int count, int grainSize, std::function<void(int first, int last)> function);
+
+	// Run jobs until the counter reaches zero
+	void Wait(CJobCounter* counter);
+
+	// Run the main thread jobs that are ready.  Called once a frame by the game loop.
+	void ProcessMainThreadJobs();
+
+	// Number of workers, including the main thread
+	int GetNumWorkers();
+
+	// Work out the per worker stats for the period since the last call
+	void UpdateStats();
+	const JobWorkerStats& GetWorkerStats(int worker);
+
+private:
+	typedef CJobCounter::Job Job;
+
+	struct Worker {
+		std::deque<Job> jobs;
+		std::mutex mutex;
+		std::thread thread;
+		std::atomic<int> jobCount;
+		std::atomic<int> stealCount;
+		std::atomic<long long> busyMicroseconds;
+		JobWorkerStats stats;
+	};
+
+	void Queue(const Job& job, CJobCounter* dependency);
+	void Push(const Job& job);
+	bool GetJob(int worker, Job& job);
+	bool RunOneJob(int worker);
+	void Execute(int worker, Job& job);
+	void Finish(CJobCounter* counter);
+	void WorkerLoop(int worker);
+
+	vector<Worker*> m_workers;
+	std::deque<Job> m_mainThreadJobs;
+	std::mutex m_mainThreadMutex;
+
+	std::mutex m_sleepMutex;
+	std::condition_variable m_wake;
+	std::atomic<int> m_numQueued;
+	std::atomic<bool> m_quit;
+	std::atomic<unsigned int> m_nextWorker;
+
+	std::chrono::high_resolution_clock::time_point m_statsTime;
+};
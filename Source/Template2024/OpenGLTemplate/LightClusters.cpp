@@ -0,0 +1,322 @@
+#include "LightClusters.h"
+#include "ResourceTracker.h"
+#include <algorithm>
+
+#define CLUSTERS_X 16
+#define CLUSTERS_Y 9
+#define CLUSTERS_Z 24
+#define CLUSTER_COUNT (CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z)
+#define TEXELS_PER_LIGHT 5
+
+CLightClusters::CLightClusters()
+{
+	m_pJobSystem = NULL;
+	m_pStreamBuffer = NULL;
+	m_offsetAlignment = 256;
+	m_maxLights = 0;
+	m_maxTexels = 0;
+	m_lightBuffer = m_lightTexture = 0;
+	m_rangeBuffer = m_rangeTexture = 0;
+	m_indexBuffer = m_indexTexture = 0;
+	m_lightBufferSize = m_rangeBufferSize = m_indexBufferSize = 0;
+	m_tileSize = glm::vec2(1.0f);
+	m_depthScale = glm::vec2(1.0f);
+	m_numDynamicLights = 0;
+	m_numVisibleLights = 0;
+	m_numLightIndices = 0;
+	m_maxLightsPerCluster = 0;
+}
+
+CLightClusters::~CLightClusters()
+{
+	Release();
+}
+
+void CLightClusters::Create(CJobSystem* jobSystem, int maxLights)
+{
+	m_pJobSystem = jobSystem;
+
+	// Buffer textures can be as small as 64K texels, which limits both the lights and the total length of the lists
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &m_maxTexels);
+	m_maxLights = maxLights;
+	if (m_maxLights > m_maxTexels / TEXELS_PER_LIGHT)
+		m_maxLights = m_maxTexels / TEXELS_PER_LIGHT;
+
+	m_clusterRanges.resize(CLUSTER_COUNT);
+	m_sliceIndices.resize(CLUSTERS_Z);
+
+	CreateBufferTexture(m_lightBuffer, m_lightTexture, m_lightBufferSize, GL_RGBA32F);
+	CreateBufferTexture(m_rangeBuffer, m_rangeTexture, m_rangeBufferSize, GL_RG32UI);
+	CreateBufferTexture(m_indexBuffer, m_indexTexture, m_indexBufferSize, GL_R32UI);
+}
+
+void CLightClusters::SetStreamBuffer(CStreamBuffer* streamBuffer)
+{
+	// Viewing part of the stream buffer needs glTexBufferRange
+	if (!GLEW_VERSION_4_3 && !GLEW_ARB_texture_buffer_range)
+		streamBuffer = NULL;
+	m_pStreamBuffer = streamBuffer;
+	if (m_pStreamBuffer != NULL)
+		glGetIntegerv(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT, &m_offsetAlignment);
+}
+
+void CLightClusters::CreateBufferTexture(UINT& buffer, UINT& texture, int& bufferSize, GLenum format)
+{
+	bufferSize = sizeof(glm::vec4);
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBufferData(GL_TEXTURE_BUFFER, bufferSize, NULL, GL_STREAM_DRAW);
+
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_BUFFER, texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	// The texture only views the buffer's storage
+	CResourceTracker::TrackBuffer(buffer, bufferSize, "light clusters");
+	CResourceTracker::TrackTexture(texture, 0, "light clusters");
+}
+
+// Copy data into this frame's part of the stream buffer and point the texture at it.  If there is no room, replace
+// the contents of the texture's own buffer instead, orphaning the old storage so the upload does not wait for draws
+// still using it.  The buffer keeps its size unless the data does not fit, so the tracker is only told when it grows.
+void CLightClusters::UploadBufferTexture(UINT buffer, UINT texture, int& bufferSize, GLenum format, const void* data, int size)
+{
+	StreamAllocation allocation;
+	if (m_pStreamBuffer != NULL && m_pStreamBuffer->Allocate(size, m_offsetAlignment, allocation)) {
+		memcpy(allocation.data, data, size);
+		glBindTexture(GL_TEXTURE_BUFFER, texture);
+		glTexBufferRange(GL_TEXTURE_BUFFER, format, allocation.buffer, allocation.offset, size);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		return;
+	}
+
+	bool grow = size > bufferSize;
+	if (grow)
+		bufferSize = glm::max(size, 2 * bufferSize);
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBufferData(GL_TEXTURE_BUFFER, bufferSize, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	if (grow)
+		CResourceTracker::TrackBuffer(buffer, bufferSize, "light clusters");
+
+	if (m_pStreamBuffer != NULL) {
+		glBindTexture(GL_TEXTURE_BUFFER, texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+}
+
+void CLightClusters::ClearLights()
+{
+	m_lights.clear();
+}
+
+void CLightClusters::AddLight(const ClusterLight& light)
+{
+	if ((int)m_lights.size() < m_maxLights)
+		m_lights.push_back(light);
+}
+
+int CLightClusters::GetNumLights()
+{
+	return (int)m_lights.size();
+}
+
+void CLightClusters::Update(const glm::mat4& viewMatrix, const glm::mat4& projMatrix)
+{
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	m_tileSize = glm::vec2(viewport[2] / (float)CLUSTERS_X, viewport[3] / (float)CLUSTERS_Y);
+
+	// Recover the clipping planes from the projection matrix
+	float nearPlane = projMatrix[3][2] / (projMatrix[2][2] - 1.0f);
+	float farPlane = projMatrix[3][2] / (projMatrix[2][2] + 1.0f);
+	m_depthScale = glm::vec2(nearPlane, CLUSTERS_Z / log(farPlane / nearPlane));
+
+	// Put the baked lights last.  The lists are built in light order, so this puts them last in every list too.  The
+	// order within each group does not matter, so std::partition is enough and, unlike std::stable_partition, it
+	// does not allocate.
+	vector<ClusterLight>::iterator firstBaked = std::partition(m_lights.begin(), m_lights.end(),
+		[](const ClusterLight& light) { return !light.baked; });
+	m_numDynamicLights = (int)(firstBaked - m_lights.begin());
+
+	// Move the lights into view space and find the block of clusters that each light's bounding sphere overlaps
+	glm::mat3 viewRotation = glm::mat3(viewMatrix);
+	int numLights = (int)m_lights.size();
+	m_lightTexels.resize(glm::max(numLights, 1) * TEXELS_PER_LIGHT);
+	m_bounds.resize(numLights);
+	m_numVisibleLights = 0;
+	for (int i = 0; i < numLights; i++) {
+		const ClusterLight& light = m_lights[i];
+		glm::vec3 centre = glm::vec3(viewMatrix * glm::vec4(light.position, 1.0f));
+		float r = light.range;
+
+		glm::vec4* texels = &m_lightTexels[i * TEXELS_PER_LIGHT];
+		texels[0] = glm::vec4(centre, r);
+		texels[1] = glm::vec4(glm::normalize(viewRotation * light.direction), cos(glm::radians(glm::clamp(light.cutoff, 0.0f, 90.0f))));
+		texels[2] = glm::vec4(light.ambient, light.exponent);
+		texels[3] = glm::vec4(light.diffuse, light.shininess);
+		texels[4] = glm::vec4(light.specular, 0.0f);
+
+		// An empty block marks a light that cannot be seen
+		ClusterBounds& bounds = m_bounds[i];
+		bounds.min = glm::ivec3(0);
+		bounds.max = glm::ivec3(-1);
+
+		float minDepth = glm::max(-centre.z - r, nearPlane);
+		float maxDepth = glm::min(-centre.z + r, farPlane);
+		if (minDepth > maxDepth)
+			continue;
+
+		// The sphere's bounding box lies in front of the camera, so it projects inside its corners' projections
+		glm::vec2 ndcMin(1e30f), ndcMax(-1e30f);
+		for (int corner = 0; corner < 8; corner++) {
+			float depth = (corner & 4) ? maxDepth : minDepth;
+			glm::vec2 ndc;
+			ndc.x = projMatrix[0][0] * (centre.x + ((corner & 1) ? r : -r)) / depth;
+			ndc.y = projMatrix[1][1] * (centre.y + ((corner & 2) ? r : -r)) / depth;
+			ndcMin = glm::min(ndcMin, ndc);
+			ndcMax = glm::max(ndcMax, ndc);
+		}
+		if (ndcMax.x < -1.0f || ndcMax.y < -1.0f || ndcMin.x > 1.0f || ndcMin.y > 1.0f)
+			continue;
+
+		glm::vec2 tileMin = (glm::clamp(ndcMin, -1.0f, 1.0f) * 0.5f + 0.5f) * glm::vec2(CLUSTERS_X, CLUSTERS_Y);
+		glm::vec2 tileMax = (glm::clamp(ndcMax, -1.0f, 1.0f) * 0.5f + 0.5f) * glm::vec2(CLUSTERS_X, CLUSTERS_Y);
+		bounds.min = glm::ivec3((int)tileMin.x, (int)tileMin.y, (int)(log(minDepth / nearPlane) * m_depthScale.y));
+		bounds.max = glm::ivec3((int)tileMax.x, (int)tileMax.y, (int)(log(maxDepth / nearPlane) * m_depthScale.y));
+		bounds.min = glm::clamp(bounds.min, glm::ivec3(0), glm::ivec3(CLUSTERS_X - 1, CLUSTERS_Y - 1, CLUSTERS_Z - 1));
+		bounds.max = glm::clamp(bounds.max, glm::ivec3(0), glm::ivec3(CLUSTERS_X - 1, CLUSTERS_Y - 1, CLUSTERS_Z - 1));
+		m_numVisibleLights++;
+	}
+
+	// Each slice's clusters are only written by the job binning that slice
+	m_pJobSystem->ParallelFor(CLUSTERS_Z, 1, [this](int first, int last) {
+		for (int slice = first; slice < last; slice++)
+			BinSlice(slice);
+	});
+
+	// Join the slices' lists into one, leaving out any that would not fit in the buffer texture
+	m_lightIndices.clear();
+	m_maxLightsPerCluster = 0;
+	for (int slice = 0; slice < CLUSTERS_Z; slice++) {
+		unsigned int base = (unsigned int)m_lightIndices.size();
+		bool fits = base + m_sliceIndices[slice].size() <= (unsigned int)m_maxTexels;
+		for (int c = slice * CLUSTERS_X * CLUSTERS_Y; c < (slice + 1) * CLUSTERS_X * CLUSTERS_Y; c++) {
+			if (fits)
+				m_clusterRanges[c].x += base;
+			else
+				m_clusterRanges[c] = glm::uvec2(0);
+			if ((int)m_clusterRanges[c].y > m_maxLightsPerCluster)
+				m_maxLightsPerCluster = m_clusterRanges[c].y;
+		}
+		if (fits)
+			m_lightIndices.insert(m_lightIndices.end(), m_sliceIndices[slice].begin(), m_sliceIndices[slice].end());
+	}
+	m_numLightIndices = (int)m_lightIndices.size();
+	if (m_lightIndices.empty())
+		m_lightIndices.push_back(0);
+
+	UploadBufferTexture(m_lightBuffer, m_lightTexture, m_lightBufferSize, GL_RGBA32F, &m_lightTexels[0], (int)(m_lightTexels.size() * sizeof(glm::vec4)));
+	UploadBufferTexture(m_rangeBuffer, m_rangeTexture, m_rangeBufferSize, GL_RG32UI, &m_clusterRanges[0], (int)(m_clusterRanges.size() * sizeof(glm::uvec2)));
+	UploadBufferTexture(m_indexBuffer, m_indexTexture, m_indexBufferSize, GL_R32UI, &m_lightIndices[0], (int)(m_lightIndices.size() * sizeof(unsigned int)));
+}
+
+// Build the light lists of one depth slice: count the lights in each cluster, turn the counts into offsets, then
+// write the light indices
+void CLightClusters::BinSlice(int slice)
+{
+	glm::uvec2* ranges = &m_clusterRanges[slice * CLUSTERS_X * CLUSTERS_Y];
+	vector<unsigned int>& indices = m_sliceIndices[slice];
+	for (int c = 0; c < CLUSTERS_X * CLUSTERS_Y; c++)
+		ranges[c] = glm::uvec2(0);
+
+	for (unsigned int i = 0; i < m_bounds.size(); i++) {
+		const ClusterBounds& bounds = m_bounds[i];
+		if (slice < bounds.min.z || slice > bounds.max.z)
+			continue;
+		for (int y = bounds.min.y; y <= bounds.max.y; y++) {
+			for (int x = bounds.min.x; x <= bounds.max.x; x++)
+				ranges[y * CLUSTERS_X + x].y++;
+		}
+	}
+
+	unsigned int offset = 0;
+	for (int c = 0; c < CLUSTERS_X * CLUSTERS_Y; c++) {
+		ranges[c].x = offset;
+		offset += ranges[c].y;
+		ranges[c].y = 0;
+	}
+	indices.resize(offset);
+
+	for (unsigned int i = 0; i < m_bounds.size(); i++) {
+		const ClusterBounds& bounds = m_bounds[i];
+		if (slice < bounds.min.z || slice > bounds.max.z)
+			continue;
+		for (int y = bounds.min.y; y <= bounds.max.y; y++) {
+			for (int x = bounds.min.x; x <= bounds.max.x; x++) {
+				glm::uvec2& range = ranges[y * CLUSTERS_X + x];
+				indices[range.x + range.y] = i;
+				range.y++;
+			}
+		}
+	}
+}
+
+void CLightClusters::Bind(CShaderProgram* program, int firstTextureUnit)
+{
+	glActiveTexture(GL_TEXTURE0 + firstTextureUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, m_lightTexture);
+	glActiveTexture(GL_TEXTURE0 + firstTextureUnit + 1);
+	glBindTexture(GL_TEXTURE_BUFFER, m_rangeTexture);
+	glActiveTexture(GL_TEXTURE0 + firstTextureUnit + 2);
+	glBindTexture(GL_TEXTURE_BUFFER, m_indexTexture);
+	glActiveTexture(GL_TEXTURE0);
+
+	program->SetUniform("clusterLights", firstTextureUnit);
+	program->SetUniform("clusterRanges", firstTextureUnit + 1);
+	program->SetUniform("clusterIndices", firstTextureUnit + 2);
+	program->SetUniform("clusterCount", glm::vec3(CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z));
+	program->SetUniform("clusterTileSize", m_tileSize);
+	program->SetUniform("clusterDepthScale", m_depthScale);
+	program->SetUniform("clusterDynamicLights", m_numDynamicLights);
+}
+
+int CLightClusters::GetNumVisibleLights()
+{
+	return m_numVisibleLights;
+}
+
+int CLightClusters::GetNumLightIndices()
+{
+	return m_numLightIndices;
+}
+
+int CLightClusters::GetMaxLightsPerCluster()
+{
+	return m_maxLightsPerCluster;
+}
+
+void CLightClusters::Release()
+{
+	if (m_lightTexture) {
+		CResourceTracker::UntrackTexture(m_lightTexture);
+		CResourceTracker::UntrackTexture(m_rangeTexture);
+		CResourceTracker::UntrackTexture(m_indexTexture);
+		CResourceTracker::UntrackBuffer(m_lightBuffer);
+		CResourceTracker::UntrackBuffer(m_rangeBuffer);
+		CResourceTracker::UntrackBuffer(m_indexBuffer);
+		glDeleteTextures(1, &m_lightTexture);
+		glDeleteTextures(1, &m_rangeTexture);
+		glDeleteTextures(1, &m_indexTexture);
+		glDeleteBuffers(1, &m_lightBuffer);
+		glDeleteBuffers(1, &m_rangeBuffer);
+		glDeleteBuffers(1, &m_indexBuffer);
+		m_lightTexture = m_rangeTexture = m_indexTexture = 0;
+		m_lightBuffer = m_rangeBuffer = m_indexBuffer = 0;
+		m_lightBufferSize = m_rangeBufferSize = m_indexBufferSize = 0;
+	}
+}
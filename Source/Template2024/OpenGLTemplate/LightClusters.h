@@ -0,0 +1,96 @@
+#pragma once
+
+#include "Common.h"
+#include "Shaders.h"
+#include "JobSystem.h"
+#include "StreamBuffer.h"
+
+// A spotlight lit by the clustered lighting.  The colours are the light's colours already multiplied by the
+// reflectance of the material they are used with.  The light fades out smoothly to nothing at range.
+struct ClusterLight
+{
+	glm::vec3 position;		// World coordinates
+	glm::vec3 direction;	// World coordinates, normalised
+	glm::vec3 ambient;
+	glm::vec3 diffuse;
+	glm::vec3 specular;
+	float range;
+	float cutoff;			// Half angle of the cone in degrees
+	float exponent;
+	float shininess;
+	bool baked;				// Already in the lightmap, so left out when lighting lightmapped surfaces
+};
+
+// Clustered forward lighting.  The view frustum is divided into a grid of clusters, tiles on screen by slices in
+// depth (spaced exponentially, so near clusters are thin).  Each frame every light is binned into the clusters its
+// bounding sphere overlaps, and the fragment shader only lights a fragment with the lights in its own cluster, so
+// the cost per fragment depends on how many lights are nearby rather than on how many lights there are.
+//
+// The lights, the range of each cluster's list and the lists themselves are stored in buffer textures, which the
+// main shader reads with texelFetch.  Binning is done on the CPU, one depth slice per job.  With a stream buffer the
+// buffer textures view this frame's copy of the data in it instead of their own buffers.
+class CLightClusters
+{
+public:
+	CLightClusters();
+	~CLightClusters();
+
+	void Create(CJobSystem* jobSystem, int maxLights = 4096);
+
+	// Upload through streamBuffer when buffer texture ranges are supported, or always into the own buffers if NULL
+	void SetStreamBuffer(CStreamBuffer* streamBuffer);
+
+	// Set the lights for the frame
+	void ClearLights();
+	void AddLight(const ClusterLight& light);
+	int GetNumLights();
+
+	// Bin the lights for a view and upload the result.  Uses the current viewport for the size of the screen tiles.
+	void Update(const glm::mat4& viewMatrix, const glm::mat4& projMatrix);
+
+	// Bind the buffer textures to firstTextureUnit and the two units after it, and set the shader's cluster uniforms.
+	// The lights are numbered with the baked ones last, so a lightmapped surface stops at the first baked light.
+	void Bind(CShaderProgram* program, int firstTextureUnit);
+
+	// Result of the last Update
+	int GetNumVisibleLights();
+	int GetNumLightIndices();
+	int GetMaxLightsPerCluster();
+
+	void Release();
+
+private:
+	struct ClusterBounds {
+		glm::ivec3 min;
+		glm::ivec3 max;
+	};
+
+	void BinSlice(int slice);
+	void CreateBufferTexture(UINT& buffer, UINT& texture, int& bufferSize, GLenum format);
+	void UploadBufferTexture(UINT buffer, UINT texture, int& bufferSize, GLenum format, const void* data, int size);
+
+	CJobSystem* m_pJobSystem;
+	CStreamBuffer* m_pStreamBuffer;
+	int m_offsetAlignment;		// Of buffer texture ranges
+	int m_maxLights;
+	int m_maxTexels;
+
+	vector<ClusterLight> m_lights;
+	vector<ClusterBounds> m_bounds;			// Clusters covered by each light, empty if the light cannot be seen
+	vector<glm::vec4> m_lightTexels;		// View space light data in the layout read by the shader
+	vector<glm::uvec2> m_clusterRanges;		// Offset and count of each cluster's lights in m_lightIndices
+	vector<vector<unsigned int>> m_sliceIndices;	// Light lists of each depth slice, offsets relative to the slice
+	vector<unsigned int> m_lightIndices;
+
+	UINT m_lightBuffer, m_lightTexture;
+	UINT m_rangeBuffer, m_rangeTexture;
+	UINT m_indexBuffer, m_indexTexture;
+	int m_lightBufferSize, m_rangeBufferSize, m_indexBufferSize;		// Bytes of storage in each buffer
+
+	glm::vec2 m_tileSize;		// Size of a screen tile in pixels
+	glm::vec2 m_depthScale;		// Near plane distance, and slices per unit of log depth
+	int m_numDynamicLights;
+	int m_numVisibleLights;
+	int m_numLightIndices;
+	int m_maxLightsPerCluster;
+};
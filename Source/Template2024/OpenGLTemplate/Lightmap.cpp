@@ -0,0 +1,322 @@
+#include "Lightmap.h"
+#include "ResourceTracker.h"
+#include "HighResolutionTimer.h"
+
+#define LIGHTMAP_VERSION 1
+#define LIGHTMAP_MAX_SIZE 2048
+#define LIGHTMAP_NO_TRACK -1e30f
+
+// Header written in front of each cached lightmap
+struct LightmapHeader
+{
+	unsigned int version;
+	int width;
+	int height;
+};
+
+CLightmap::CLightmap()
+{
+	m_pJobSystem = NULL;
+	m_width = m_height = 0;
+	m_origin = glm::vec2(0.0f);
+	m_texelSize = glm::vec2(1.0f);
+	m_texture = 0;
+	m_fromCache = false;
+	m_bakeMilliseconds = 0.0;
+}
+
+CLightmap::~CLightmap()
+{
+	Release();
+}
+
+void CLightmap::Create(const string& cacheDirectory, CJobSystem* jobSystem, CHeightMapTerrain* terrain, CCatmullRom* track,
+	const vector<ClusterLight>& lights, float texelSize)
+{
+	CHighResolutionTimer timer;
+	timer.Start();
+	m_pJobSystem = jobSystem;
+
+	// Cover the area the lights reach
+	glm::vec2 areaMin(1e30f), areaMax(-1e30f);
+	for (unsigned int i = 0; i < lights.size(); i++) {
+		glm::vec2 centre(lights[i].position.x, lights[i].position.z);
+		areaMin = glm::min(areaMin, centre - lights[i].range);
+		areaMax = glm::max(areaMax, centre + lights[i].range);
+	}
+	if (lights.empty()) {
+		areaMin = glm::vec2(0.0f);
+		areaMax = glm::vec2(texelSize);
+	}
+
+	m_origin = areaMin;
+	m_width = glm::clamp((int)ceil((areaMax.x - areaMin.x) / texelSize), 1, LIGHTMAP_MAX_SIZE);
+	m_height = glm::clamp((int)ceil((areaMax.y - areaMin.y) / texelSize), 1, LIGHTMAP_MAX_SIZE);
+	m_texelSize = (areaMax - areaMin) / glm::vec2(m_width, m_height);
+
+	FindSurface(terrain, track);
+
+	char name[32];
+	sprintf_s(name, "%016llx.bin", Hash(lights));
+	string file = cacheDirectory + "\\" + name;
+	CreateDirectory(cacheDirectory.c_str(), NULL);
+
+	m_fromCache = LoadFromCache(file);
+	if (!m_fromCache) {
+		m_light.assign(m_width * m_height, glm::vec3(0.0f));
+		m_pJobSystem->ParallelFor(m_height, 8, [this, &lights](int first, int last) {
+			for (int row = first; row < last; row++)
+				BakeRow(row, lights);
+		});
+		SaveToCache(file);
+	}
+
+	CreateTexture();
+
+	// Only the texture is needed from here on
+	vector<float>().swap(m_trackHeight);
+	vector<glm::vec3>().swap(m_position);
+	vector<glm::vec3>().swap(m_normal);
+	vector<glm::vec3>().swap(m_light);
+
+	m_bakeMilliseconds = timer.Elapsed();
+}
+
+// Find the point and normal of the surface that is lit at the centre of each texel
+void CLightmap::FindSurface(CHeightMapTerrain* terrain, CCatmullRom* track)
+{
+	RasteriseTrack(track);
+
+	m_position.resize(m_width * m_height);
+	m_normal.resize(m_width * m_height);
+	m_pJobSystem->ParallelFor(m_height, 16, [this, terrain](int first, int last) {
+		glm::vec3 dx(m_texelSize.x, 0.0f, 0.0f);
+		glm::vec3 dz(0.0f, 0.0f, m_texelSize.y);
+		for (int z = first; z < last; z++) {
+			for (int x = 0; x < m_width; x++) {
+				int i = z * m_width + x;
+				glm::vec3 p(m_origin.x + (x + 0.5f) * m_texelSize.x, 0.0f, m_origin.y + (z + 0.5f) * m_texelSize.y);
+				if (m_trackHeight[i] > LIGHTMAP_NO_TRACK) {
+					// The track is flat shaded with an upward normal
+					p.y = m_trackHeight[i];
+					m_normal[i] = glm::vec3(0, 1, 0);
+				}
+				else {
+					p.y = terrain->ReturnGroundHeight(p);
+					float slopeX = (terrain->ReturnGroundHeight(p + dx) - terrain->ReturnGroundHeight(p - dx)) / (2.0f * dx.x);
+					float slopeZ = (terrain->ReturnGroundHeight(p + dz) - terrain->ReturnGroundHeight(p - dz)) / (2.0f * dz.z);
+					m_normal[i] = glm::normalize(glm::vec3(-slopeX, 1.0f, -slopeZ));
+				}
+				m_position[i] = p;
+			}
+		}
+	});
+}
+
+// Record the height of the track over the texels it covers, two triangles per track segment
+void CLightmap::RasteriseTrack(CCatmullRom* track)
+{
+	m_trackHeight.assign(m_width * m_height, LIGHTMAP_NO_TRACK);
+
+	const vector<glm::vec3>& left = track->m_leftOffsetPoints;
+	const vector<glm::vec3>& right = track->m_rightOffsetPoints;
+	int numPoints = (int)left.size();
+	for (int i = 0; i < numPoints; i++) {
+		int next = (i + 1) % numPoints;
+		glm::vec3 triangles[2][3] = { { left[i], right[i], left[next] }, { right[i], right[next], left[next] } };
+
+		for (int t = 0; t < 2; t++) {
+			glm::vec3* tri = triangles[t];
+			glm::vec2 a(tri[0].x, tri[0].z), b(tri[1].x, tri[1].z), c(tri[2].x, tri[2].z);
+			float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+			if (fabs(area) < 1e-6f)
+				continue;
+
+			glm::vec2 triMin = (glm::min(glm::min(a, b), c) - m_origin) / m_texelSize;
+			glm::vec2 triMax = (glm::max(glm::max(a, b), c) - m_origin) / m_texelSize;
+			int x0 = glm::max((int)floor(triMin.x), 0), x1 = glm::min((int)ceil(triMax.x), m_width - 1);
+			int z0 = glm::max((int)floor(triMin.y), 0), z1 = glm::min((int)ceil(triMax.y), m_height - 1);
+
+			for (int z = z0; z <= z1; z++) {
+				for (int x = x0; x <= x1; x++) {
+					glm::vec2 p = m_origin + (glm::vec2(x, z) + 0.5f) * m_texelSize;
+					float wa = ((b.x - p.x) * (c.y - p.y) - (b.y - p.y) * (c.x - p.x)) / area;
+					float wb = ((c.x - p.x) * (a.y - p.y) - (c.y - p.y) * (a.x - p.x)) / area;
+					float wc = 1.0f - wa - wb;
+					if (wa < 0.0f || wb < 0.0f || wc < 0.0f)
+						continue;
+					float height = wa * tri[0].y + wb * tri[1].y + wc * tri[2].y;
+					float& trackHeight = m_trackHeight[z * m_width + x];
+					if (height > trackHeight)
+						trackHeight = height;
+				}
+			}
+		}
+	}
+}
+
+// Add up the light falling on one row of texels.  This is BlinnPhongSpotlightModel from mainShader.frag, with the
+// viewer taken to be along the surface normal.
+void CLightmap::BakeRow(int row, const vector<ClusterLight>& lights)
+{
+	float z = m_origin.y + (row + 0.5f) * m_texelSize.y;
+	for (unsigned int l = 0; l < lights.size(); l++) {
+		const ClusterLight& light = lights[l];
+		if (fabs(light.position.z - z) > light.range)
+			continue;
+
+		float cosCutoff = cos(glm::radians(glm::clamp(light.cutoff, 0.0f, 90.0f)));
+		int x0 = glm::max((int)((light.position.x - light.range - m_origin.x) / m_texelSize.x), 0);
+		int x1 = glm::min((int)((light.position.x + light.range - m_origin.x) / m_texelSize.x), m_width - 1);
+		for (int x = x0; x <= x1; x++) {
+			int i = row * m_width + x;
+			glm::vec3 toLight = light.position - m_position[i];
+			float d = glm::length(toLight);
+			if (d >= light.range || d <= 0.0f)
+				continue;
+			float attenuation = 1.0f - d / light.range;
+			attenuation *= attenuation;
+
+			glm::vec3 s = toLight / d;
+			glm::vec3 n = m_normal[i];
+			glm::vec3 colour = light.ambient;
+			float cosAngle = glm::dot(-s, light.direction);
+			if (cosAngle > cosCutoff) {
+				float sDotN = glm::max(glm::dot(s, n), 0.0f);
+				glm::vec3 lit = light.diffuse * sDotN;
+				if (sDotN > 0.0f)
+					lit += light.specular * pow(glm::max(glm::dot(glm::normalize(n + s), n), 0.0f), light.shininess);
+				colour += pow(cosAngle, light.exponent) * lit;
+			}
+			m_light[i] += attenuation * colour;
+		}
+	}
+}
+
+static void HashBytes(unsigned long long& hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+}
+
+// 64-bit FNV-1a hash of the lightmap's layout, the lights and the surface they light
+unsigned long long CLightmap::Hash(const vector<ClusterLight>& lights)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	unsigned int version = LIGHTMAP_VERSION;
+	HashBytes(hash, &version, sizeof(version));
+	HashBytes(hash, &m_width, sizeof(m_width));
+	HashBytes(hash, &m_height, sizeof(m_height));
+	HashBytes(hash, &m_origin, sizeof(m_origin));
+	HashBytes(hash, &m_texelSize, sizeof(m_texelSize));
+
+	for (unsigned int i = 0; i < lights.size(); i++) {
+		const ClusterLight& light = lights[i];
+		HashBytes(hash, &light.position, sizeof(light.position));
+		HashBytes(hash, &light.direction, sizeof(light.direction));
+		HashBytes(hash, &light.ambient, sizeof(light.ambient));
+		HashBytes(hash, &light.diffuse, sizeof(light.diffuse));
+		HashBytes(hash, &light.specular, sizeof(light.specular));
+		HashBytes(hash, &light.range, sizeof(light.range));
+		HashBytes(hash, &light.cutoff, sizeof(light.cutoff));
+		HashBytes(hash, &light.exponent, sizeof(light.exponent));
+		HashBytes(hash, &light.shininess, sizeof(light.shininess));
+	}
+
+	HashBytes(hash, &m_position[0], m_position.size() * sizeof(glm::vec3));
+	HashBytes(hash, &m_normal[0], m_normal.size() * sizeof(glm::vec3));
+	return hash;
+}
+
+bool CLightmap::LoadFromCache(const string& file)
+{
+	FILE* fp;
+	fopen_s(&fp, file.c_str(), "rb");
+	if (!fp)
+		return false;
+
+	LightmapHeader header;
+	bool read = fread(&header, sizeof(header), 1, fp) == 1 && header.version == LIGHTMAP_VERSION &&
+		header.width == m_width && header.height == m_height;
+	if (read) {
+		m_light.resize(m_width * m_height);
+		read = fread(&m_light[0], sizeof(glm::vec3), m_light.size(), fp) == m_light.size();
+	}
+	fclose(fp);
+	return read;
+}
+
+void CLightmap::SaveToCache(const string& file)
+{
+	FILE* fp;
+	fopen_s(&fp, file.c_str(), "wb");
+	if (!fp)
+		return;
+
+	LightmapHeader header;
+	header.version = LIGHTMAP_VERSION;
+	header.width = m_width;
+	header.height = m_height;
+	fwrite(&header, sizeof(header), 1, fp);
+	fwrite(&m_light[0], sizeof(glm::vec3), m_light.size(), fp);
+	fclose(fp);
+}
+
+void CLightmap::CreateTexture()
+{
+	glGenTextures(1, &m_texture);
+	glBindTexture(GL_TEXTURE_2D, m_texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, m_width, m_height, 0, GL_RGB, GL_FLOAT, &m_light[0]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	// Outside the lightmap there is no baked light
+	float border[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	CResourceTracker::TrackTexture(m_texture, CResourceTracker::GetTextureBytes(GL_RGB16F, m_width, m_height, false), "lightmap");
+}
+
+void CLightmap::Bind(CShaderProgram* program, int textureUnit)
+{
+	glActiveTexture(GL_TEXTURE0 + textureUnit);
+	glBindTexture(GL_TEXTURE_2D, m_texture);
+	glBindSampler(textureUnit, 0);
+	glActiveTexture(GL_TEXTURE0);
+
+	program->SetUniform("lightmap", textureUnit);
+	program->SetUniform("lightmapBounds", glm::vec4(m_origin, 1.0f / (m_width * m_texelSize.x), 1.0f / (m_height * m_texelSize.y)));
+}
+
+bool CLightmap::IsFromCache()
+{
+	return m_fromCache;
+}
+
+double CLightmap::GetBakeMilliseconds()
+{
+	return m_bakeMilliseconds;
+}
+
+int CLightmap::GetWidth()
+{
+	return m_width;
+}
+
+int CLightmap::GetHeight()
+{
+	return m_height;
+}
+
+void CLightmap::Release()
+{
+	if (m_texture) {
+		CResourceTracker::UntrackTexture(m_texture);
+		glDeleteTextures(1, &m_texture);
+		m_texture = 0;
+	}
+}
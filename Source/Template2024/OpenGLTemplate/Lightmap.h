@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Common.h"
+#include "Shaders.h"
+#include "JobSystem.h"
+#include "LightClusters.h"
+#include "HeightMapTerrain.h"
+#include "CatmullRom.h"
+
+// Static lighting of the terrain and track, baked on the CPU.  The lightmap looks straight down on the area the
+// lights reach, and each texel holds the light falling on the topmost static surface there: the track where
+// there is track and the terrain everywhere else.  The shader finds its texel from the fragment's world x and z.
+//
+// The bake is split into rows run by the job system.  The result is saved in the cache directory under a hash of
+// everything it depends on (the lights and the surface), so later runs only bake again when something changed.
+class CLightmap
+{
+public:
+	CLightmap();
+	~CLightmap();
+
+	// Bake or load the lighting from lights onto the terrain and track.  texelSize is in world units.
+	void Create(const string& cacheDirectory, CJobSystem* jobSystem, CHeightMapTerrain* terrain, CCatmullRom* track,
+		const vector<ClusterLight>& lights, float texelSize = 4.0f);
+
+	// Bind the lightmap to textureUnit and set the shader's lightmap uniforms
+	void Bind(CShaderProgram* program, int textureUnit);
+
+	bool IsFromCache();
+	double GetBakeMilliseconds();
+	int GetWidth();
+	int GetHeight();
+
+	void Release();
+
+private:
+	void FindSurface(CHeightMapTerrain* terrain, CCatmullRom* track);
+	void RasteriseTrack(CCatmullRom* track);
+	void BakeRow(int row, const vector<ClusterLight>& lights);
+	unsigned long long Hash(const vector<ClusterLight>& lights);
+	bool LoadFromCache(const string& file);
+	void SaveToCache(const string& file);
+	void CreateTexture();
+
+	CJobSystem* m_pJobSystem;
+	int m_width, m_height;
+	glm::vec2 m_origin;			// World x and z of the corner of texel (0, 0)
+	glm::vec2 m_texelSize;
+
+	vector<float> m_trackHeight;		// Height of the track over each texel, or a large negative number where there is none
+	vector<glm::vec3> m_position;		// Surface point at the centre of each texel
+	vector<glm::vec3> m_normal;
+	vector<glm::vec3> m_light;			// Baked light
+
+	UINT m_texture;
+	bool m_fromCache;
+	double m_bakeMilliseconds;
+};
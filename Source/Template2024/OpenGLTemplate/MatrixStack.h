@@ -11,11 +11,13 @@
 \brief Contains a \ref module_glutil_matrixstack "matrix stack and associated classes".
 **/
 
-#include <stack>
-#include <vector>
+#include <assert.h>
 #include "include\glm\glm.hpp"
 #include "include\glm\gtc\type_ptr.hpp"
 
+///Number of matrices a MatrixStack can preserve at once.
+#define GLUTIL_MATRIX_STACK_CAPACITY 32
+
 namespace glutil
 {
 	///\addtogroup module_glutil_matrixstack
@@ -35,9 +37,11 @@ namespace glutil
 
 	The main power of the matrix stack is the ability to preserve and restore matrices in a stack fashion.
 	The current matrix can be preserved on the stack with Push() and the most recently preserved matrix
-	can be restored with Pop(). You must ensure that you do not Pop() more times than you Push(). Also,
-	while this matrix stack does not have an explicit size limit, if you Push() more times than you Pop(),
-	then you can eventually run out of memory (unless you create and destroy the MatrixStack every frame).
+	can be restored with Pop(). You must ensure that you do not Pop() more times than you Push(). The
+	preserved matrices are stored inline in a fixed array of GLUTIL_MATRIX_STACK_CAPACITY matrices, so
+	creating a stack and pushing on it never allocates; you must not Push() more deeply than that. In a
+	release build a deeper Push() is still counted but its matrix is not preserved, so the matching Pop()
+	leaves the current matrix as it is rather than writing outside the array.
 
 	The best way to manage the stack is to never use the Push() and Pop() methods directly.
 	Instead, use the PushStack object to do all pushing and popping. That will ensure that
@@ -49,11 +53,13 @@ namespace glutil
 		///Initializes the matrix stack with the identity matrix.
 		MatrixStack()
 			: m_currMatrix(1)
+			, m_depth(0)
 		{}
 
 		///Initializes the matrix stack with the given matrix.
 		explicit MatrixStack(const glm::mat4 &initialMatrix)
 			: m_currMatrix(initialMatrix)
+			, m_depth(0)
 		{}
 
 		/**
@@ -66,14 +72,20 @@ namespace glutil
 		///Preserves the current matrix on the stack.
 		void Push()
 		{
-			m_stack.push(m_currMatrix);
+			assert(m_depth < GLUTIL_MATRIX_STACK_CAPACITY);
+			if (m_depth < GLUTIL_MATRIX_STACK_CAPACITY)
+				m_stack[m_depth] = m_currMatrix;
+			m_depth++;
 		}
 
 		///Restores the most recently preserved matrix.
 		void Pop()
 		{
-			m_currMatrix = m_stack.top();
-			m_stack.pop();
+			assert(m_depth > 0);
+			if (m_depth == 0)
+				return;
+			if (--m_depth < GLUTIL_MATRIX_STACK_CAPACITY)
+				m_currMatrix = m_stack[m_depth];
 		}
 
 		/**
@@ -81,7 +93,14 @@ namespace glutil
 		
 		This function does not affect the depth of the matrix stack.
 		**/
-		void Reset() { m_currMatrix = m_stack.top(); }
+		void Reset()
+		{
+			if (m_depth > 0 && m_depth <= GLUTIL_MATRIX_STACK_CAPACITY)
+				m_currMatrix = m_stack[m_depth - 1];
+		}
+
+		///Number of matrices currently preserved on the stack.
+		int Depth() const { return m_depth; }
 
 		///Retrieve the current matrix.
 		const glm::mat4 &Top() const
@@ -245,8 +264,9 @@ namespace glutil
 		///@}
 
 	private:
-		std::stack<glm::mat4, std::vector<glm::mat4> > m_stack;
+		glm::mat4 m_stack[GLUTIL_MATRIX_STACK_CAPACITY];
 		glm::mat4 m_currMatrix;
+		int m_depth;
 	};
 
 	/**
@@ -0,0 +1,248 @@
+#include "MeshOptimizer.h"
+#include "include/glm/gtc/packing.hpp"
+#include <algorithm>
+
+void CMeshOptimizer::OptimizeTriangleOrder(const Vertex* vertices, unsigned int numVertices, unsigned int* indices, unsigned int numIndices)
+{
+	unsigned int numTriangles = numIndices / 3;
+	if (numTriangles == 0)
+		return;
+
+	// Triangles around each vertex
+	vector<unsigned int> adjacencyStart(numVertices + 1, 0);
+	for (unsigned int i = 0; i < numIndices; i++)
+		adjacencyStart[indices[i] + 1]++;
+	for (unsigned int v = 0; v < numVertices; v++)
+		adjacencyStart[v + 1] += adjacencyStart[v];
+	vector<unsigned int> adjacency(numIndices);
+	vector<unsigned int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+	for (unsigned int i = 0; i < numIndices; i++)
+		adjacency[fill[indices[i]]++] = i / 3;
+
+	// Triangles not yet drawn around each vertex, and when each vertex last went into the cache
+	vector<int> live(numVertices);
+	for (unsigned int v = 0; v < numVertices; v++)
+		live[v] = adjacencyStart[v + 1] - adjacencyStart[v];
+	vector<unsigned int> cacheTime(numVertices, 0);
+	vector<char> emitted(numTriangles, 0);
+	vector<unsigned int> deadEnds;
+	vector<unsigned int> candidates;
+
+	// The triangles in their new order, split into clusters where the ordering jumps to vertices that are no longer
+	// in the cache
+	vector<unsigned int> order;
+	vector<unsigned int> clusterStart;
+	order.reserve(numTriangles);
+	clusterStart.push_back(0);
+
+	unsigned int time = VERTEX_CACHE_SIZE + 1;
+	unsigned int cursor = 0;
+	int fan = (int)indices[0];
+	while (fan >= 0) {
+		// Draw every remaining triangle around the fan vertex
+		candidates.clear();
+		for (unsigned int a = adjacencyStart[fan]; a < adjacencyStart[fan + 1]; a++) {
+			unsigned int t = adjacency[a];
+			if (emitted[t])
+				continue;
+			emitted[t] = 1;
+			order.push_back(t);
+			for (int k = 0; k < 3; k++) {
+				unsigned int v = indices[t * 3 + k];
+				deadEnds.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - cacheTime[v] > VERTEX_CACHE_SIZE)
+					cacheTime[v] = time++;
+			}
+		}
+
+		// Fan around the vertex that has been in the cache longest but will still be there once its own triangles
+		// have been drawn
+		fan = -1;
+		int bestPriority = -1;
+		for (unsigned int c = 0; c < candidates.size(); c++) {
+			unsigned int v = candidates[c];
+			if (live[v] <= 0)
+				continue;
+			int priority = 0;
+			if (time - cacheTime[v] + 2 * live[v] <= VERTEX_CACHE_SIZE)
+				priority = time - cacheTime[v];
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				fan = (int)v;
+			}
+		}
+		if (fan >= 0)
+			continue;
+
+		// A dead end: go back to a recently used vertex with triangles left, or failing that the next one in order
+		while (fan < 0 && !deadEnds.empty()) {
+			unsigned int v = deadEnds.back();
+			deadEnds.pop_back();
+			if (live[v] > 0)
+				fan = (int)v;
+		}
+		while (fan < 0 && cursor < numVertices) {
+			if (live[cursor] > 0)
+				fan = (int)cursor;
+			else
+				cursor++;
+		}
+		if (fan >= 0 && time - cacheTime[fan] > VERTEX_CACHE_SIZE)
+			clusterStart.push_back((unsigned int)order.size());
+	}
+	clusterStart.push_back((unsigned int)order.size());
+
+	// Draw the clusters that face away from the middle of the mesh first, as they are the most likely to be in front
+	vector<unsigned int> original(indices, indices + numIndices);
+	glm::vec3 meshCentre(0.0f);
+	float meshArea = 0.0f;
+	int numClusters = (int)clusterStart.size() - 1;
+	vector<glm::vec3> clusterCentre(numClusters, glm::vec3(0.0f));
+	vector<glm::vec3> clusterNormal(numClusters, glm::vec3(0.0f));
+	for (int c = 0; c < numClusters; c++) {
+		float clusterArea = 0.0f;
+		for (unsigned int o = clusterStart[c]; o < clusterStart[c + 1]; o++) {
+			const unsigned int* triangle = &original[order[o] * 3];
+			const glm::vec3& p0 = vertices[triangle[0]].m_pos;
+			const glm::vec3& p1 = vertices[triangle[1]].m_pos;
+			const glm::vec3& p2 = vertices[triangle[2]].m_pos;
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			float area = glm::length(normal);
+			clusterCentre[c] += (p0 + p1 + p2) * (area / 3.0f);
+			clusterNormal[c] += normal;
+			clusterArea += area;
+		}
+		meshCentre += clusterCentre[c];
+		meshArea += clusterArea;
+		if (clusterArea > 0.0f)
+			clusterCentre[c] /= clusterArea;
+	}
+	if (meshArea > 0.0f)
+		meshCentre /= meshArea;
+
+	vector<float> facing(numClusters);
+	vector<int> clusters(numClusters);
+	for (int c = 0; c < numClusters; c++) {
+		float length = glm::length(clusterNormal[c]);
+		facing[c] = length > 0.0f ? glm::dot(clusterCentre[c] - meshCentre, clusterNormal[c] / length) : 0.0f;
+		clusters[c] = c;
+	}
+	std::stable_sort(clusters.begin(), clusters.end(), [&facing](int a, int b) { return facing[a] > facing[b]; });
+
+	unsigned int* out = indices;
+	for (int i = 0; i < numClusters; i++) {
+		int c = clusters[i];
+		for (unsigned int o = clusterStart[c]; o < clusterStart[c + 1]; o++) {
+			const unsigned int* triangle = &original[order[o] * 3];
+			*out++ = triangle[0];
+			*out++ = triangle[1];
+			*out++ = triangle[2];
+		}
+	}
+}
+
+void CMeshOptimizer::OptimizeVertexFetch(Vertex* vertices, unsigned int numVertices, unsigned int* indices, unsigned int numIndices)
+{
+	const unsigned int unused = 0xFFFFFFFF;
+	vector<unsigned int> remap(numVertices, unused);
+	unsigned int next = 0;
+	for (unsigned int i = 0; i < numIndices; i++) {
+		unsigned int& v = indices[i];
+		if (remap[v] == unused)
+			remap[v] = next++;
+		v = remap[v];
+	}
+
+	// Vertices no triangle uses go at the end
+	for (unsigned int v = 0; v < numVertices; v++) {
+		if (remap[v] == unused)
+			remap[v] = next++;
+	}
+
+	vector<Vertex> original(vertices, vertices + numVertices);
+	for (unsigned int v = 0; v < numVertices; v++)
+		vertices[remap[v]] = original[v];
+}
+
+float CMeshOptimizer::ComputeAcmr(const unsigned int* indices, unsigned int numIndices, unsigned int numVertices)
+{
+	if (numIndices < 3)
+		return 0.0f;
+
+	// A vertex is in the FIFO until VERTEX_CACHE_SIZE more vertices have been added after it
+	vector<unsigned int> cacheTime(numVertices, 0);
+	unsigned int time = VERTEX_CACHE_SIZE + 1;
+	unsigned int misses = 0;
+	for (unsigned int i = 0; i < numIndices; i++) {
+		unsigned int v = indices[i];
+		if (time - cacheTime[v] > VERTEX_CACHE_SIZE) {
+			cacheTime[v] = time++;
+			misses++;
+		}
+	}
+	return misses / (numIndices / 3.0f);
+}
+
+bool CMeshOptimizer::CanUseHalfTexCoords(const Vertex* vertices, unsigned int numVertices)
+{
+	// Half floats between 2 and 4 are 1/512 apart, which is about a texel of the textures used here
+	for (unsigned int v = 0; v < numVertices; v++) {
+		if (fabs(vertices[v].m_tex.x) > 4.0f || fabs(vertices[v].m_tex.y) > 4.0f)
+			return false;
+	}
+	return true;
+}
+
+GLsizei CMeshOptimizer::PackVertices(const Vertex* vertices, unsigned int numVertices, bool halfTexCoords, std::vector<BYTE>& packed)
+{
+	GLsizei texCoordSize = halfTexCoords ? sizeof(GLuint) : sizeof(glm::vec2);
+	GLsizei stride = sizeof(glm::vec3) + texCoordSize + sizeof(GLuint);
+	packed.resize((size_t)stride * numVertices);
+
+	BYTE* out = packed.data();
+	for (unsigned int v = 0; v < numVertices; v++) {
+		const Vertex& vertex = vertices[v];
+		memcpy(out, &vertex.m_pos, sizeof(glm::vec3));
+		if (halfTexCoords) {
+			GLuint texCoord = glm::packHalf2x16(vertex.m_tex);
+			memcpy(out + sizeof(glm::vec3), &texCoord, sizeof(GLuint));
+		}
+		else
+			memcpy(out + sizeof(glm::vec3), &vertex.m_tex, sizeof(glm::vec2));
+
+		float length = glm::length(vertex.m_normal);
+		glm::vec3 n = length > 0.0f ? vertex.m_normal / length : vertex.m_normal;
+		GLuint normal = glm::packSnorm3x10_1x2(glm::vec4(n, 0.0f));
+		memcpy(out + sizeof(glm::vec3) + texCoordSize, &normal, sizeof(GLuint));
+		out += stride;
+	}
+	return stride;
+}
+
+void CMeshOptimizer::SetPackedVertexAttributes(bool halfTexCoords)
+{
+	GLsizei texCoordSize = halfTexCoords ? sizeof(GLuint) : sizeof(glm::vec2);
+	GLsizei stride = sizeof(glm::vec3) + texCoordSize + sizeof(GLuint);
+
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
+	glVertexAttribPointer(1, 2, halfTexCoords ? GL_HALF_FLOAT : GL_FLOAT, GL_FALSE, stride, (const GLvoid*)sizeof(glm::vec3));
+	// The shaders read the normal as a vec3, which takes the first three of the four components
+	glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (const GLvoid*)(sizeof(glm::vec3) + texCoordSize));
+}
+
+bool CMeshOptimizer::PackIndices16(const std::vector<unsigned int>& indices, std::vector<GLushort>& packed)
+{
+	for (unsigned int i = 0; i < indices.size(); i++) {
+		if (indices[i] > 0xFFFF)
+			return false;
+	}
+	packed.resize(indices.size());
+	for (unsigned int i = 0; i < indices.size(); i++)
+		packed[i] = (GLushort)indices[i];
+	return true;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Common.h"
+#include "OpenAssetImportMesh.h"
+
+#define VERTEX_CACHE_SIZE 16		// Post-transform cache entries assumed by the triangle ordering
+
+// Import time optimisations for indexed triangle meshes.
+//
+// OptimizeTriangleOrder reorders the triangles with Tipsify (Sander, Nehab and Barczak, "Fast triangle reordering for
+// vertex locality and reduced overdraw"), which fans around recently used vertices so they are still in the
+// post-transform cache.  The runs of triangles between the points where it has to jump elsewhere are then drawn
+// outward facing first, so the front of the mesh tends to hide the back.  OptimizeVertexFetch then stores the
+// vertices in the order they are first used.
+//
+// The packed vertex format stores the normal as signed normalised 10:10:10 bits and the texture coordinates as half
+// floats when that keeps them precise enough, which is 20 bytes rather than the 32 of a Vertex.
+class CMeshOptimizer
+{
+public:
+	static void OptimizeTriangleOrder(const Vertex* vertices, unsigned int numVertices, unsigned int* indices, unsigned int numIndices);
+	static void OptimizeVertexFetch(Vertex* vertices, unsigned int numVertices, unsigned int* indices, unsigned int numIndices);
+
+	// Average number of vertices transformed per triangle with a FIFO cache of VERTEX_CACHE_SIZE entries
+	static float ComputeAcmr(const unsigned int* indices, unsigned int numIndices, unsigned int numVertices);
+
+	// Whether half floats are precise enough for the texture coordinates, which they are for coordinates that do not
+	// repeat the texture many times
+	static bool CanUseHalfTexCoords(const Vertex* vertices, unsigned int numVertices);
+	// Pack the vertices, and return the stride
+	static GLsizei PackVertices(const Vertex* vertices, unsigned int numVertices, bool halfTexCoords, std::vector<BYTE>& packed);
+	// Point attributes 0 (position), 1 (texture coordinates) and 2 (normal) at the packed vertices in the bound buffer
+	static void SetPackedVertexAttributes(bool halfTexCoords);
+
+	// Copy the indices into 16 bits if they all fit.  Returns false, and leaves packed alone, if they do not.
+	static bool PackIndices16(const std::vector<unsigned int>& indices, std::vector<GLushort>& packed);
+};
@@ -0,0 +1,272 @@
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <unordered_map>
+#include <float.h>
+
+// Hash of a position's bits, for welding vertices that are at exactly the same place
+struct PositionHash
+{
+	size_t operator()(const glm::vec3& p) const
+	{
+		unsigned int h[3];
+		memcpy(h, &p[0], sizeof(h));
+		return (h[0] * 73856093u) ^ (h[1] * 19349663u) ^ (h[2] * 83492791u);
+	}
+};
+
+CMeshSimplifier::CMeshSimplifier()
+{
+	m_vertices = NULL;
+}
+
+CMeshSimplifier::~CMeshSimplifier()
+{}
+
+void CMeshSimplifier::AddPlane(Quadric& q, const glm::vec3& n, float d)
+{
+	q.a2 += n.x * n.x; q.ab += n.x * n.y; q.ac += n.x * n.z; q.ad += n.x * d;
+	q.b2 += n.y * n.y; q.bc += n.y * n.z; q.bd += n.y * d;
+	q.c2 += n.z * n.z; q.cd += n.z * d;
+	q.d2 += d * d;
+}
+
+void CMeshSimplifier::AddQuadric(Quadric& q, const Quadric& other)
+{
+	q.a2 += other.a2; q.ab += other.ab; q.ac += other.ac; q.ad += other.ad;
+	q.b2 += other.b2; q.bc += other.bc; q.bd += other.bd;
+	q.c2 += other.c2; q.cd += other.cd;
+	q.d2 += other.d2;
+}
+
+// The sum of the squared distances from p to the quadric's planes
+double CMeshSimplifier::Evaluate(const Quadric& q, const glm::vec3& p)
+{
+	double x = p.x, y = p.y, z = p.z;
+	double error = q.a2 * x * x + 2 * q.ab * x * y + 2 * q.ac * x * z + 2 * q.ad * x
+		+ q.b2 * y * y + 2 * q.bc * y * z + 2 * q.bd * y
+		+ q.c2 * z * z + 2 * q.cd * z
+		+ q.d2;
+	return error > 0.0 ? error : 0.0;
+}
+
+// Point each vertex at the first vertex at its position, write the triangles in terms of those, and lock the vertices
+// on edges that are not shared by exactly two triangles and the positions on seams
+void CMeshSimplifier::Weld(const Vertex* vertices, unsigned int numVertices, const std::vector<unsigned int>& indices)
+{
+	m_vertices = vertices;
+	m_remap.resize(numVertices);
+
+	std::unordered_map<glm::vec3, unsigned int, PositionHash> positions;
+	positions.reserve(numVertices);
+	for (unsigned int i = 0; i < numVertices; i++) {
+		// Adding zero turns -0 into 0, so that the two hash the same
+		glm::vec3 p = vertices[i].m_pos + glm::vec3(0.0f);
+		m_remap[i] = positions.insert(std::make_pair(p, i)).first->second;
+	}
+
+	m_triangles.resize(indices.size());
+	for (unsigned int i = 0; i < indices.size(); i++)
+		m_triangles[i] = m_remap[indices[i]];
+	m_corners = indices;
+	RemoveDegenerateTriangles();
+
+	std::unordered_map<unsigned long long, int> edges;
+	edges.reserve(m_triangles.size());
+	for (unsigned int i = 0; i < m_triangles.size(); i++) {
+		unsigned int a = m_triangles[i];
+		unsigned int b = m_triangles[i % 3 == 2 ? i - 2 : i + 1];
+		edges[((unsigned long long)glm::min(a, b) << 32) | glm::max(a, b)]++;
+	}
+
+	m_locked.assign(numVertices, 0);
+	for (unsigned int i = 0; i < numVertices; i++) {
+		const Vertex& v = vertices[i];
+		const Vertex& representative = vertices[m_remap[i]];
+		if (v.m_tex != representative.m_tex || v.m_normal != representative.m_normal)
+			m_locked[m_remap[i]] = 1;
+	}
+	for (auto it = edges.begin(); it != edges.end(); ++it) {
+		if (it->second != 2) {
+			m_locked[(unsigned int)(it->first >> 32)] = 1;
+			m_locked[(unsigned int)(it->first & 0xffffffff)] = 1;
+		}
+	}
+}
+
+void CMeshSimplifier::BuildAdjacency()
+{
+	unsigned int numVertices = (unsigned int)m_remap.size();
+	m_adjacencyStart.assign(numVertices + 1, 0);
+	for (unsigned int i = 0; i < m_triangles.size(); i++)
+		m_adjacencyStart[m_triangles[i] + 1]++;
+	for (unsigned int v = 0; v < numVertices; v++)
+		m_adjacencyStart[v + 1] += m_adjacencyStart[v];
+
+	m_adjacency.resize(m_triangles.size());
+	for (unsigned int i = 0; i < m_triangles.size(); i++)
+		m_adjacency[m_adjacencyStart[m_triangles[i]]++] = i / 3;
+
+	// Filling moved each start on to the next vertex's start, so move them back
+	for (unsigned int v = numVertices; v > 0; v--)
+		m_adjacencyStart[v] = m_adjacencyStart[v - 1];
+	m_adjacencyStart[0] = 0;
+}
+
+// Whether moving from onto to would turn any of the triangles around from (other than the ones that disappear) over
+bool CMeshSimplifier::FlipsTriangle(unsigned int from, unsigned int to)
+{
+	const glm::vec3& target = m_vertices[to].m_pos;
+	for (unsigned int a = m_adjacencyStart[from]; a < m_adjacencyStart[from + 1]; a++) {
+		const unsigned int* triangle = &m_triangles[m_adjacency[a] * 3];
+		if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+			continue;
+
+		glm::vec3 p[3], q[3];
+		for (int k = 0; k < 3; k++) {
+			p[k] = m_vertices[triangle[k]].m_pos;
+			q[k] = triangle[k] == from ? target : p[k];
+		}
+		glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+		glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+		float lengths = glm::length(before) * glm::length(after);
+		if (lengths <= 0.0f || glm::dot(before, after) < 0.2f * lengths)
+			return true;
+	}
+	return false;
+}
+
+// Find the original vertex that the corners of from should use once from is collapsed onto to.  That is the vertex the
+// triangles on the collapsed edge use for to, and if they do not agree the edge is not collapsed.
+bool CMeshSimplifier::FindCollapseCorner(unsigned int from, unsigned int to, unsigned int& corner)
+{
+	bool found = false;
+	for (unsigned int a = m_adjacencyStart[from]; a < m_adjacencyStart[from + 1]; a++) {
+		unsigned int t = m_adjacency[a] * 3;
+		for (int k = 0; k < 3; k++) {
+			if (m_triangles[t + k] != to)
+				continue;
+			if (found && m_corners[t + k] != corner)
+				return false;
+			corner = m_corners[t + k];
+			found = true;
+		}
+	}
+	return found;
+}
+
+void CMeshSimplifier::RemoveDegenerateTriangles()
+{
+	unsigned int kept = 0;
+	for (unsigned int i = 0; i < m_triangles.size(); i += 3) {
+		unsigned int a = m_triangles[i], b = m_triangles[i + 1], c = m_triangles[i + 2];
+		if (a == b || b == c || c == a)
+			continue;
+		m_corners[kept] = m_corners[i];
+		m_corners[kept + 1] = m_corners[i + 1];
+		m_corners[kept + 2] = m_corners[i + 2];
+		m_triangles[kept++] = a;
+		m_triangles[kept++] = b;
+		m_triangles[kept++] = c;
+	}
+	m_triangles.resize(kept);
+	m_corners.resize(kept);
+}
+
+float CMeshSimplifier::Simplify(const Vertex* vertices, unsigned int numVertices, const std::vector<unsigned int>& indices,
+	unsigned int targetIndices, std::vector<unsigned int>& result)
+{
+	Weld(vertices, numVertices, indices);
+
+	Quadric zero = {};
+	m_quadrics.assign(numVertices, zero);
+	for (unsigned int i = 0; i < m_triangles.size(); i += 3) {
+		const glm::vec3& p0 = vertices[m_triangles[i]].m_pos;
+		glm::vec3 n = glm::cross(vertices[m_triangles[i + 1]].m_pos - p0, vertices[m_triangles[i + 2]].m_pos - p0);
+		float length = glm::length(n);
+		if (length <= 0.0f)
+			continue;
+		n /= length;
+		for (int k = 0; k < 3; k++)
+			AddPlane(m_quadrics[m_triangles[i + k]], n, -glm::dot(n, p0));
+	}
+
+	m_collapseTo.resize(numVertices);
+	m_collapseCorner.resize(numVertices);
+	for (unsigned int v = 0; v < numVertices; v++)
+		m_collapseTo[v] = v;
+
+	// Each pass collapses the cheapest edges that do not share a triangle with an edge already collapsed in the pass,
+	// so the costs and the flip tests stay valid for the whole pass
+	double maxCost = 0.0;
+	while (m_triangles.size() > targetIndices) {
+		BuildAdjacency();
+
+		m_collapses.clear();
+		for (unsigned int i = 0; i < m_triangles.size(); i++) {
+			unsigned int a = m_triangles[i];
+			unsigned int b = m_triangles[i % 3 == 2 ? i - 2 : i + 1];
+			if (a > b)
+				continue;
+
+			Quadric q = m_quadrics[a];
+			AddQuadric(q, m_quadrics[b]);
+			Collapse collapse = { a, b, DBL_MAX };
+			if (!m_locked[a])
+				collapse.cost = Evaluate(q, vertices[b].m_pos);
+			if (!m_locked[b]) {
+				double cost = Evaluate(q, vertices[a].m_pos);
+				if (cost < collapse.cost) {
+					collapse.from = b;
+					collapse.to = a;
+					collapse.cost = cost;
+				}
+			}
+			if (collapse.cost < DBL_MAX)
+				m_collapses.push_back(collapse);
+		}
+		if (m_collapses.empty())
+			break;
+		std::sort(m_collapses.begin(), m_collapses.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+		m_touched.assign(numVertices, 0);
+		size_t trianglesToRemove = (m_triangles.size() - targetIndices + 2) / 3;
+		size_t removed = 0;
+		int numCollapsed = 0;
+		for (unsigned int c = 0; c < m_collapses.size() && removed < trianglesToRemove; c++) {
+			const Collapse& collapse = m_collapses[c];
+			unsigned int corner = 0;
+			if (m_touched[collapse.from] || m_touched[collapse.to] || FlipsTriangle(collapse.from, collapse.to) ||
+				!FindCollapseCorner(collapse.from, collapse.to, corner))
+				continue;
+
+			for (unsigned int a = m_adjacencyStart[collapse.from]; a < m_adjacencyStart[collapse.from + 1]; a++) {
+				const unsigned int* triangle = &m_triangles[m_adjacency[a] * 3];
+				if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+					removed++;
+				m_touched[triangle[0]] = m_touched[triangle[1]] = m_touched[triangle[2]] = 1;
+			}
+			m_collapseTo[collapse.from] = collapse.to;
+			m_collapseCorner[collapse.from] = corner;
+			AddQuadric(m_quadrics[collapse.to], m_quadrics[collapse.from]);
+			maxCost = glm::max(maxCost, collapse.cost);
+			numCollapsed++;
+		}
+		if (numCollapsed == 0)
+			break;
+
+		// Corners that did not move keep their own vertex
+		for (unsigned int i = 0; i < m_triangles.size(); i++) {
+			unsigned int v = m_triangles[i];
+			if (m_collapseTo[v] == v)
+				continue;
+			m_corners[i] = m_collapseCorner[v];
+			m_triangles[i] = m_collapseTo[v];
+		}
+		for (unsigned int v = 0; v < numVertices; v++)
+			m_collapseTo[v] = v;
+		RemoveDegenerateTriangles();
+	}
+
+	result = m_corners;
+	return (float)sqrt(maxCost);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Common.h"
+#include "OpenAssetImportMesh.h"
+
+// Quadric error mesh simplification by collapsing edges.  Each vertex keeps the sum of the squared distances to the
+// planes of the triangles around it (its quadric), and the edges whose collapse moves the surface least are collapsed
+// first.  An edge is always collapsed onto one of its own vertices, so the simplified triangles index the original
+// vertices and can share their vertex buffer.
+//
+// Vertices at the same position are welded while simplifying, so meshes with a vertex per triangle corner still
+// collapse.  Vertices on the edge of the mesh are never moved, which keeps the borders between mesh entries closed,
+// and neither are positions shared by vertices with different texture coordinates or normals (seams), so the
+// corners that are not collapsed keep their own vertices and attributes.
+class CMeshSimplifier
+{
+public:
+	CMeshSimplifier();
+	~CMeshSimplifier();
+
+	// Simplify a triangle list over numVertices vertices until it has no more than targetIndices indices, or until no
+	// more edges can be collapsed without folding a triangle over.  Returns how far (roughly) the surface moved.
+	float Simplify(const Vertex* vertices, unsigned int numVertices, const std::vector<unsigned int>& indices,
+		unsigned int targetIndices, std::vector<unsigned int>& result);
+
+private:
+	// The symmetric 4x4 matrix of a quadric, stored as its upper triangle
+	struct Quadric {
+		double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+	};
+
+	struct Collapse {
+		unsigned int from;
+		unsigned int to;
+		double cost;
+	};
+
+	static void AddPlane(Quadric& q, const glm::vec3& normal, float d);
+	static void AddQuadric(Quadric& q, const Quadric& other);
+	static double Evaluate(const Quadric& q, const glm::vec3& p);
+
+	void Weld(const Vertex* vertices, unsigned int numVertices, const std::vector<unsigned int>& indices);
+	void BuildAdjacency();
+	bool FlipsTriangle(unsigned int from, unsigned int to);
+	bool FindCollapseCorner(unsigned int from, unsigned int to, unsigned int& corner);
+	void RemoveDegenerateTriangles();
+
+	const Vertex* m_vertices;
+	std::vector<unsigned int> m_remap;			// Each vertex's representative, the first vertex at its position
+	std::vector<unsigned int> m_triangles;		// Three representatives per triangle
+	std::vector<unsigned int> m_corners;		// The original vertex of each corner in m_triangles
+	std::vector<Quadric> m_quadrics;
+	std::vector<char> m_locked;					// Vertices on the edge of the mesh
+	std::vector<char> m_touched;				// Vertices whose triangles changed in this pass
+	std::vector<unsigned int> m_collapseTo;
+	std::vector<unsigned int> m_collapseCorner;	// The original vertex the corners of a collapsed vertex move to
+	std::vector<unsigned int> m_adjacencyStart;	// Triangles around each vertex
+	std::vector<unsigned int> m_adjacency;
+	std::vector<Collapse> m_collapses;
+};
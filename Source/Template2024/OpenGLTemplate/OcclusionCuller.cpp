@@ -0,0 +1,251 @@
+#include "OcclusionCuller.h"
+#include "ResourceTracker.h"
+
+// The near plane cuts into a box the camera is this close to, so such a box could seem hidden when it is not
+#define OCCLUSION_NEAR_MARGIN 1.0f
+
+COcclusionCuller::COcclusionCuller()
+{
+	m_pProgram = NULL;
+	m_vao = 0;
+	m_vbo = 0;
+	m_ibo = 0;
+	m_numTested = 0;
+	m_enabled = true;
+}
+
+COcclusionCuller::~COcclusionCuller()
+{
+	Release();
+}
+
+void COcclusionCuller::Create(CShaderProgram* program)
+{
+	m_pProgram = program;
+
+	// A unit cube from (0, 0, 0) to (1, 1, 1), scaled and moved onto each box when it is drawn
+	glm::vec3 corners[8];
+	for (int i = 0; i < 8; i++)
+		corners[i] = glm::vec3((float)(i & 1), (float)((i >> 1) & 1), (float)((i >> 2) & 1));
+	GLushort indices[36] = {
+		0, 2, 1, 1, 2, 3,	// -z
+		4, 5, 6, 5, 7, 6,	// +z
+		0, 1, 4, 1, 5, 4,	// -y
+		2, 6, 3, 3, 6, 7,	// +y
+		0, 4, 2, 2, 4, 6,	// -x
+		1, 3, 5, 3, 7, 5	// +x
+	};
+
+	glGenVertexArrays(1, &m_vao);
+	glBindVertexArray(m_vao);
+	glGenBuffers(1, &m_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+	glGenBuffers(1, &m_ibo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
+	glBindVertexArray(0);
+	CResourceTracker::TrackBuffer(m_vbo, sizeof(corners), "occlusion");
+	CResourceTracker::TrackBuffer(m_ibo, sizeof(indices), "occlusion");
+}
+
+int COcclusionCuller::AddObject(const glm::vec3& boundsMin, const glm::vec3& boundsMax, bool conditional, unsigned int views)
+{
+	Object object;
+	object.boundsMin = boundsMin;
+	object.boundsMax = boundsMax;
+	object.conditional = conditional;
+	object.views = views;
+	glGenQueries(OCCLUSION_VIEWS, object.queries);
+	for (int v = 0; v < OCCLUSION_VIEWS; v++) {
+		object.pending[v] = false;
+		object.visible[v] = true;
+		object.requested[v] = false;
+	}
+	m_objects.push_back(object);
+	return (int)m_objects.size() - 1;
+}
+
+void COcclusionCuller::SetBounds(int object, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	m_objects[object].boundsMin = boundsMin;
+	m_objects[object].boundsMax = boundsMax;
+}
+
+void COcclusionCuller::ClearObjects()
+{
+	for (unsigned int i = 0; i < m_objects.size(); i++)
+		glDeleteQueries(OCCLUSION_VIEWS, m_objects[i].queries);
+	m_objects.clear();
+	m_numTested = 0;
+}
+
+// Only results that are already available are read, so this never waits for the GPU.  An object keeps its last
+// visibility until its query finishes.
+void COcclusionCuller::BeginFrame(int view)
+{
+	for (unsigned int i = 0; i < m_objects.size(); i++) {
+		Object& object = m_objects[i];
+		if (!object.pending[view])
+			continue;
+
+		GLuint available = 0;
+		glGetQueryObjectuiv(object.queries[view], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			continue;
+		GLuint samplesPassed = 0;
+		glGetQueryObjectuiv(object.queries[view], GL_QUERY_RESULT, &samplesPassed);
+		object.visible[view] = samplesPassed != 0;
+		object.pending[view] = false;
+	}
+}
+
+bool COcclusionCuller::IsVisible(int object, int view)
+{
+	return !m_enabled || m_objects[object].visible[view];
+}
+
+GLuint COcclusionCuller::GetConditionalQuery(int object, int view, const glm::vec3& eye)
+{
+	Object& o = m_objects[object];
+	if (!m_enabled || Contains(o, eye))
+		return 0;
+	o.requested[view] = true;
+	return o.queries[view];
+}
+
+void COcclusionCuller::IssueQueries(int view, const glm::mat4& viewMatrix, const CFrustum& frustum, const glm::vec3& eye)
+{
+	if (view == 0)
+		m_numTested = 0;
+	if (!m_enabled)
+		return;
+
+	BeginBoxes();
+	for (unsigned int i = 0; i < m_objects.size(); i++) {
+		Object& object = m_objects[i];
+		if (!(object.views & (1 << view)))
+			continue;
+		if (object.conditional) {
+			// Outside the frustum the box has no samples, so the draws are skipped, as they would be by clipping
+			if (!object.requested[view])
+				continue;
+			object.requested[view] = false;
+		}
+		else {
+			if (object.pending[view])
+				continue;
+
+			// An object outside the frustum is culled anyway, and one the camera is in or next to is visible.  Either
+			// way it is counted as visible, so that it is drawn as soon as it comes into view and is then tested.
+			if (!frustum.IsBoxVisible(object.boundsMin, object.boundsMax) || Contains(object, eye)) {
+				object.visible[view] = true;
+				continue;
+			}
+			object.pending[view] = true;
+		}
+
+		glBeginQuery(GL_ANY_SAMPLES_PASSED, object.queries[view]);
+		DrawBox(object, viewMatrix);
+		glEndQuery(GL_ANY_SAMPLES_PASSED);
+		if (view == 0)
+			m_numTested++;
+	}
+	EndBoxes();
+}
+
+// The boxes are tested against the depth buffer but leave it, the colour buffer and the overdraw count alone.  Both
+// sides of each box are drawn so the winding does not matter.
+void COcclusionCuller::BeginBoxes()
+{
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+	glStencilMask(0);
+	glDisable(GL_CULL_FACE);
+	m_pProgram->UseProgram();
+	glBindVertexArray(m_vao);
+}
+
+void COcclusionCuller::DrawBox(const Object& object, const glm::mat4& viewMatrix)
+{
+	glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), object.boundsMin);
+	modelMatrix = glm::scale(modelMatrix, object.boundsMax - object.boundsMin);
+	m_pProgram->SetUniform("matrices.modelViewMatrix", viewMatrix * modelMatrix);
+	glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0);
+}
+
+void COcclusionCuller::EndBoxes()
+{
+	glEnable(GL_CULL_FACE);
+	glStencilMask(0xFF);
+	glDepthMask(GL_TRUE);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+bool COcclusionCuller::Contains(const Object& object, const glm::vec3& eye)
+{
+	glm::vec3 margin(OCCLUSION_NEAR_MARGIN);
+	return glm::all(glm::greaterThanEqual(eye, object.boundsMin - margin)) && glm::all(glm::lessThanEqual(eye, object.boundsMax + margin));
+}
+
+void COcclusionCuller::SetEnabled(bool enabled)
+{
+	m_enabled = enabled;
+	if (enabled)
+		return;
+
+	// Start again from visible, as the results from before may be long out of date.  Queries still in flight are
+	// dropped too, or BeginFrame would pick up their results once the culler is enabled again.
+	for (unsigned int i = 0; i < m_objects.size(); i++) {
+		for (int v = 0; v < OCCLUSION_VIEWS; v++) {
+			m_objects[i].visible[v] = true;
+			m_objects[i].pending[v] = false;
+			m_objects[i].requested[v] = false;
+		}
+	}
+}
+
+bool COcclusionCuller::IsEnabled()
+{
+	return m_enabled;
+}
+
+int COcclusionCuller::GetNumObjects()
+{
+	return (int)m_objects.size();
+}
+
+int COcclusionCuller::GetNumTested()
+{
+	return m_numTested;
+}
+
+int COcclusionCuller::GetNumOccluded()
+{
+	int count = 0;
+	for (unsigned int i = 0; i < m_objects.size(); i++) {
+		if (!m_objects[i].visible[0])
+			count++;
+	}
+	return count;
+}
+
+void COcclusionCuller::Release()
+{
+	ClearObjects();
+	if (m_vbo) {
+		CResourceTracker::UntrackBuffer(m_vbo);
+		glDeleteBuffers(1, &m_vbo);
+	}
+	if (m_ibo) {
+		CResourceTracker::UntrackBuffer(m_ibo);
+		glDeleteBuffers(1, &m_ibo);
+	}
+	if (m_vao)
+		glDeleteVertexArrays(1, &m_vao);
+	m_vao = 0;
+	m_vbo = 0;
+	m_ibo = 0;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Common.h"
+#include "Shaders.h"
+#include "Frustum.h"
+
+#define OCCLUSION_VIEWS 2		// Views with their own queries: the main camera and the TV
+#define OCCLUSION_ALL_VIEWS ((1 << OCCLUSION_VIEWS) - 1)
+
+// Hardware occlusion culling of heavy objects by their world space bounding boxes.  Once the opaque scene has been
+// drawn, each object's box is drawn into the depth buffer, without writing anything, inside a GL_ANY_SAMPLES_PASSED
+// query.  An object whose box was completely hidden is occluded.
+//
+// Most objects use the result in the next frame, read back only once the GPU has it, so the CPU never waits and an
+// occluded object is not even submitted.  An object that comes into view is then drawn one frame late, which is not
+// noticeable for the props, but is for objects that move quickly.  Those are added as conditional objects instead:
+// their query is issued just before they are drawn in the same frame, and their draws are wrapped in
+// glBeginConditionalRender (see RenderItem::occlusionQuery), so the GPU skips them if the box was hidden.
+class COcclusionCuller
+{
+public:
+	COcclusionCuller();
+	~COcclusionCuller();
+
+	// The program draws the boxes.  It must take the position from attribute 0 and the matrices.projMatrix and
+	// matrices.modelViewMatrix uniforms, like the depth pre-pass program, with matrices.projMatrix set by the caller.
+	void Create(CShaderProgram* program);
+
+	// Add an object and return its index.  An object is visible until it has been tested.  views has a bit for each
+	// view the object is drawn in, and it is only tested in those.
+	int AddObject(const glm::vec3& boundsMin, const glm::vec3& boundsMax, bool conditional = false, unsigned int views = OCCLUSION_ALL_VIEWS);
+	void SetBounds(int object, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	void ClearObjects();
+
+	// Pick up the results of the view's queries that the GPU has finished
+	void BeginFrame(int view);
+
+	// Whether the object was visible when it was last tested in the view.  Always true while disabled, and queries
+	// still in flight when the culler is disabled are discarded.
+	bool IsVisible(int object, int view);
+
+	// Return the query a conditional object's draws should be conditional on in the view this frame, or 0 if they
+	// should be drawn regardless.  The next IssueQueries for the view issues it.
+	GLuint GetConditionalQuery(int object, int view, const glm::vec3& eye);
+
+	// Test the boxes of the view's objects against the depth buffer.  Call once the opaque scene is drawn, and before
+	// the conditional objects are drawn.  Objects not drawn in the view or outside the frustum are not tested, and
+	// objects whose previous query is still in flight are not tested again until it finishes.
+	void IssueQueries(int view, const glm::mat4& viewMatrix, const CFrustum& frustum, const glm::vec3& eye);
+
+	void SetEnabled(bool enabled);
+	bool IsEnabled();
+
+	int GetNumObjects();
+	int GetNumTested();		// In the last IssueQueries of the main view
+	int GetNumOccluded();	// In the main view
+
+	void Release();
+
+private:
+	struct Object {
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		bool conditional;
+		unsigned int views;
+		GLuint queries[OCCLUSION_VIEWS];
+		bool pending[OCCLUSION_VIEWS];
+		bool visible[OCCLUSION_VIEWS];
+		bool requested[OCCLUSION_VIEWS];	// Conditional objects drawn this frame
+	};
+
+	void BeginBoxes();
+	void DrawBox(const Object& object, const glm::mat4& viewMatrix);
+	void EndBoxes();
+	static bool Contains(const Object& object, const glm::vec3& eye);
+
+	vector<Object> m_objects;
+	CShaderProgram* m_pProgram;
+	GLuint m_vao;
+	GLuint m_vbo;
+	GLuint m_ibo;
+	int m_numTested;
+	bool m_enabled;
+};
@@ -18,42 +18,33 @@
 
 #include <assert.h>
 #include "OpenAssetImportMesh.h"
+#include "ResourceTracker.h"
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
 
 #pragma comment(lib, "lib/assimp.lib")
 
 COpenAssetImportMesh::MeshEntry::MeshEntry()
 {
-    vbo = INVALID_OGL_VALUE;
-    ibo = INVALID_OGL_VALUE;
+    BaseVertex = 0;
+    BaseIndex = 0;
     NumIndices  = 0;
     MaterialIndex = INVALID_MATERIAL;
+    for (int i = 0; i < MAX_MESH_LODS; i++) {
+        LodBaseIndex[i] = 0;
+        LodNumIndices[i] = 0;
+    }
 };
 
-COpenAssetImportMesh::MeshEntry::~MeshEntry()
-{
-    if (vbo != INVALID_OGL_VALUE)
-        glDeleteBuffers(1, &vbo);
-
-    if (ibo != INVALID_OGL_VALUE)
-        glDeleteBuffers(1, &ibo);
-}
-
-void COpenAssetImportMesh::MeshEntry::Init(const std::vector<Vertex>& Vertices,
-                          const std::vector<unsigned int>& Indices)
-{
-    NumIndices = int(Indices.size());
-
-	glGenBuffers(1, &vbo);
-  	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * Vertices.size(), &Vertices[0], GL_STATIC_DRAW);
-
-    glGenBuffers(1, &ibo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * NumIndices, &Indices[0], GL_STATIC_DRAW);
-}
-
 COpenAssetImportMesh::COpenAssetImportMesh()
 {
+    m_vao = INVALID_OGL_VALUE;
+    m_vbo = INVALID_OGL_VALUE;
+    m_ibo = INVALID_OGL_VALUE;
+    m_NumLods = 1;
+    m_LodErrors[0] = 0.0f;
+    m_IndexType = GL_UNSIGNED_INT;
+    m_IndexSize = sizeof(unsigned int);
 }
 
 
@@ -66,24 +57,62 @@ COpenAssetImportMesh::~COpenAssetImportMesh()
 void COpenAssetImportMesh::Clear()
 {
     for (unsigned int i = 0 ; i < m_Textures.size() ; i++) {
+        if (m_Textures[i])
+            m_Textures[i]->Release();
         SAFE_DELETE(m_Textures[i]);
     }
-	glDeleteVertexArrays(1, &m_vao);
+
+    if (m_vbo != INVALID_OGL_VALUE) {
+        CResourceTracker::UntrackBuffer(m_vbo);
+        glDeleteBuffers(1, &m_vbo);
+    }
+
+    if (m_ibo != INVALID_OGL_VALUE) {
+        CResourceTracker::UntrackBuffer(m_ibo);
+        glDeleteBuffers(1, &m_ibo);
+    }
+
+    if (m_vao != INVALID_OGL_VALUE)
+        glDeleteVertexArrays(1, &m_vao);
+
+    m_vao = INVALID_OGL_VALUE;
+    m_vbo = INVALID_OGL_VALUE;
+    m_ibo = INVALID_OGL_VALUE;
+    m_Entries.clear();
+    m_Materials.clear();
+    m_Textures.clear();
+    m_Vertices.clear();
+    m_Indices.clear();
+    m_NumLods = 1;
+    m_IndexType = GL_UNSIGNED_INT;
+    m_IndexSize = sizeof(unsigned int);
+    CResourceTracker::UntrackCpuCopy(&m_Vertices);
+    CResourceTracker::UntrackCpuCopy(&m_Indices);
 }
 
 
 bool COpenAssetImportMesh::Load(const std::string& Filename)
+{
+    return Decode(Filename) && Upload();
+}
+
+bool COpenAssetImportMesh::Decode(const std::string& Filename)
 {
     // Release the previously loaded mesh (if it exists)
     Clear();
-    
+
     bool Ret = false;
     Assimp::Importer Importer;
 
-    const aiScene* pScene = Importer.ReadFile(Filename.c_str(), aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs);
+    // Joining identical vertices gives the triangles shared vertices, which the vertex cache can then reuse
+    const aiScene* pScene = Importer.ReadFile(Filename.c_str(), aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs |
+        aiProcess_JoinIdenticalVertices);
     
+    m_Filename = Filename;
     if (pScene) {
         Ret = InitFromScene(pScene, Filename);
+        if (Ret)
+            OptimizeEntries();
     }
     else {
         MessageBox(NULL, Importer.GetErrorString(), "Error loading mesh model", MB_ICONHAND);
@@ -105,31 +134,108 @@ const aiScene* COpenAssetImportMesh::LoadImage(const std::string& filename) {
 
 bool COpenAssetImportMesh::InitFromScene(const aiScene* pScene, const std::string& Filename)
 {  
-    m_Entries.resize(pScene->mNumMeshes);
-    m_Textures.resize(pScene->mNumMaterials);
+    // Group the meshes in the scene by material so that each material is drawn once.  The vertices of a group are
+    // stored contiguously and its indices are relative to the first vertex of the group, so a group can be drawn
+    // with a single glDrawElementsBaseVertex call.
+    for (unsigned int m = 0 ; m < pScene->mNumMaterials ; m++) {
+        MeshEntry Entry;
+        Entry.MaterialIndex = m;
+        Entry.BaseVertex = (unsigned int)m_Vertices.size();
+        Entry.BaseIndex = (unsigned int)m_Indices.size();
+
+        std::vector<Vertex> Vertices;
+        std::vector<unsigned int> Indices;
+        for (unsigned int i = 0 ; i < pScene->mNumMeshes ; i++) {
+            if (pScene->mMeshes[i]->mMaterialIndex == m)
+                InitMesh(pScene->mMeshes[i], Vertices, Indices);
+        }
 
-	glGenVertexArrays(1, &m_vao); 
-	glBindVertexArray(m_vao);
+        if (Indices.empty())
+            continue;
 
+        Entry.NumIndices = (unsigned int)Indices.size();
+        Entry.LodBaseIndex[0] = Entry.BaseIndex;
+        Entry.LodNumIndices[0] = Entry.NumIndices;
+        m_Vertices.insert(m_Vertices.end(), Vertices.begin(), Vertices.end());
+        m_Indices.insert(m_Indices.end(), Indices.begin(), Indices.end());
+        m_Entries.push_back(Entry);
+    }
 
-    // Initialize the meshes in the scene one by one
+    ReadMaterials(pScene, Filename);
+    return true;
+}
+
+// Reorder each entry's triangles for the post-transform vertex cache, then its vertices in the order the triangles use them
+void COpenAssetImportMesh::OptimizeEntries()
+{
+    float MissesBefore = 0.0f, MissesAfter = 0.0f;
     for (unsigned int i = 0 ; i < m_Entries.size() ; i++) {
-        const aiMesh* paiMesh = pScene->mMeshes[i];
-        InitMesh(i, paiMesh);
+        const MeshEntry& Entry = m_Entries[i];
+        unsigned int EndVertex = i + 1 < m_Entries.size() ? m_Entries[i + 1].BaseVertex : (unsigned int)m_Vertices.size();
+        unsigned int NumVertices = EndVertex - Entry.BaseVertex;
+        Vertex* Vertices = &m_Vertices[Entry.BaseVertex];
+        unsigned int* Indices = &m_Indices[Entry.BaseIndex];
+
+        MissesBefore += CMeshOptimizer::ComputeAcmr(Indices, Entry.NumIndices, NumVertices) * Entry.NumIndices / 3;
+        CMeshOptimizer::OptimizeTriangleOrder(Vertices, NumVertices, Indices, Entry.NumIndices);
+        CMeshOptimizer::OptimizeVertexFetch(Vertices, NumVertices, Indices, Entry.NumIndices);
+        MissesAfter += CMeshOptimizer::ComputeAcmr(Indices, Entry.NumIndices, NumVertices) * Entry.NumIndices / 3;
     }
 
-    return InitMaterials(pScene, Filename);
+    unsigned int NumTriangles = (unsigned int)m_Indices.size() / 3;
+    if (NumTriangles > 0)
+        printf("Optimised '%s': %u vertices, %u triangles, ACMR %.2f -> %.2f\n", m_Filename.c_str(),
+            (unsigned int)m_Vertices.size(), NumTriangles, MissesBefore / NumTriangles, MissesAfter / NumTriangles);
 }
 
-void COpenAssetImportMesh::InitMesh(unsigned int Index, const aiMesh* paiMesh)
+bool COpenAssetImportMesh::Upload()
 {
-    m_Entries[Index].MaterialIndex = paiMesh->mMaterialIndex;
-    
-    std::vector<Vertex> Vertices;
-    std::vector<unsigned int> Indices;
+    InitBuffers();
+    return InitMaterials();
+}
+
+// Simplify each entry level by level, each level from the one before, so the levels form a chain.  A level's error
+// adds up the errors of the steps that led to it.
+void COpenAssetImportMesh::GenerateLods(int numLevels, float reduction)
+{
+    numLevels = glm::clamp(numLevels, 1, MAX_MESH_LODS);
+    for (int l = 0; l < numLevels; l++)
+        m_LodErrors[l] = 0.0f;
+
+    CMeshSimplifier simplifier;
+    std::vector<unsigned int> source, simplified;
+    for (unsigned int i = 0 ; i < m_Entries.size() ; i++) {
+        MeshEntry& Entry = m_Entries[i];
+        source.assign(m_Indices.begin() + Entry.BaseIndex, m_Indices.begin() + Entry.BaseIndex + Entry.NumIndices);
+
+        unsigned int NumVertices = 0;
+        for (unsigned int j = 0 ; j < source.size() ; j++)
+            NumVertices = glm::max(NumVertices, source[j] + 1);
+
+        float Error = 0.0f;
+        for (int l = 1; l < numLevels; l++) {
+            unsigned int Target = (unsigned int)(Entry.NumIndices * pow(reduction, (float)l)) / 3 * 3;
+            Error += simplifier.Simplify(&m_Vertices[Entry.BaseVertex], NumVertices, source, Target, simplified);
+            m_LodErrors[l] = glm::max(m_LodErrors[l], Error);
+            if (!simplified.empty())
+                CMeshOptimizer::OptimizeTriangleOrder(&m_Vertices[Entry.BaseVertex], NumVertices, &simplified[0], (unsigned int)simplified.size());
+
+            Entry.LodBaseIndex[l] = (unsigned int)m_Indices.size();
+            Entry.LodNumIndices[l] = (unsigned int)simplified.size();
+            m_Indices.insert(m_Indices.end(), simplified.begin(), simplified.end());
+            source.swap(simplified);
+        }
+    }
+    m_NumLods = numLevels;
+}
 
+// Append the vertices and indices of an assimp mesh.  Indices are offset by the number of vertices already in the list.
+void COpenAssetImportMesh::InitMesh(const aiMesh* paiMesh, std::vector<Vertex>& Vertices, std::vector<unsigned int>& Indices)
+{
+    const unsigned int FirstVertex = (unsigned int)Vertices.size();
     const aiVector3D Zero3D(0.0f, 0.0f, 0.0f);
 
+    Vertices.reserve(Vertices.size() + paiMesh->mNumVertices);
     for (unsigned int i = 0 ; i < paiMesh->mNumVertices ; i++) {
         const aiVector3D* pPos      = &(paiMesh->mVertices[i]);
         const aiVector3D* pNormal   = &(paiMesh->mNormals[i]);
@@ -142,18 +248,61 @@ void COpenAssetImportMesh::InitMesh(unsigned int Index, const aiMesh* paiMesh)
         Vertices.push_back(v);
     }
 
+    Indices.reserve(Indices.size() + paiMesh->mNumFaces * 3);
     for (unsigned int i = 0 ; i < paiMesh->mNumFaces ; i++) {
         const aiFace& Face = paiMesh->mFaces[i];
         assert(Face.mNumIndices == 3);
-        Indices.push_back(Face.mIndices[0]);
-        Indices.push_back(Face.mIndices[1]);
-        Indices.push_back(Face.mIndices[2]);
+        Indices.push_back(FirstVertex + Face.mIndices[0]);
+        Indices.push_back(FirstVertex + Face.mIndices[1]);
+        Indices.push_back(FirstVertex + Face.mIndices[2]);
+    }
+}
+
+// Upload all of the entries into one vertex buffer and one index buffer, and record the vertex format in the VAO.  The
+// vertices are packed (see CMeshOptimizer::PackVertices), and the indices are 16 bit if they fit, which they do when no
+// entry has more than 65536 vertices as each entry's indices start from its own first vertex.
+void COpenAssetImportMesh::InitBuffers()
+{
+    if (m_Vertices.empty() || m_Indices.empty())
+        return;
+
+    bool HalfTexCoords = CMeshOptimizer::CanUseHalfTexCoords(&m_Vertices[0], (unsigned int)m_Vertices.size());
+    std::vector<BYTE> PackedVertices;
+    GLsizei Stride = CMeshOptimizer::PackVertices(&m_Vertices[0], (unsigned int)m_Vertices.size(), HalfTexCoords, PackedVertices);
+
+    std::vector<GLushort> ShortIndices;
+    const GLvoid* IndexData = &m_Indices[0];
+    m_IndexType = GL_UNSIGNED_INT;
+    m_IndexSize = sizeof(unsigned int);
+    if (CMeshOptimizer::PackIndices16(m_Indices, ShortIndices)) {
+        IndexData = &ShortIndices[0];
+        m_IndexType = GL_UNSIGNED_SHORT;
+        m_IndexSize = sizeof(GLushort);
     }
 
-    m_Entries[Index].Init(Vertices, Indices);
+	glGenVertexArrays(1, &m_vao);
+	glBindVertexArray(m_vao);
+
+	glGenBuffers(1, &m_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBufferData(GL_ARRAY_BUFFER, PackedVertices.size(), &PackedVertices[0], GL_STATIC_DRAW);
+
+	glGenBuffers(1, &m_ibo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_IndexSize * m_Indices.size(), IndexData, GL_STATIC_DRAW);
+
+	CMeshOptimizer::SetPackedVertexAttributes(HalfTexCoords);
+	glBindVertexArray(0);
+
+	// The geometry stays on the CPU as well, unpacked, for building static batches
+	CResourceTracker::TrackBuffer(m_vbo, Stride * m_Vertices.size(), "mesh", m_Filename);
+	CResourceTracker::TrackBuffer(m_ibo, m_IndexSize * m_Indices.size(), "mesh", m_Filename);
+	CResourceTracker::TrackCpuCopy(&m_Vertices, sizeof(Vertex) * m_Vertices.capacity(), "mesh", m_Filename);
+	CResourceTracker::TrackCpuCopy(&m_Indices, sizeof(unsigned int) * m_Indices.capacity(), "mesh", m_Filename);
 }
 
-bool COpenAssetImportMesh::InitMaterials(const aiScene* pScene, const std::string& Filename)
+// Record the diffuse texture path and colour of each material
+void COpenAssetImportMesh::ReadMaterials(const aiScene* pScene, const std::string& Filename)
 {
     // Extract the directory part from the file name
     std::string::size_type SlashIndex = Filename.find_last_of("\\");
@@ -169,44 +318,56 @@ bool COpenAssetImportMesh::InitMaterials(const aiScene* pScene, const std::strin
         Dir = Filename.substr(0, SlashIndex);
     }
 
-    bool Ret = true;
-
-    // Initialize the materials
+    // Materials start with no texture and a black diffuse colour, which Get leaves alone if the key is missing
+    m_Materials.clear();
+    m_Materials.resize(pScene->mNumMaterials);
     for (unsigned int i = 0 ; i < pScene->mNumMaterials ; i++) {
         const aiMaterial* pMaterial = pScene->mMaterials[i];
 
-        m_Textures[i] = NULL;
-
         if (pMaterial->GetTextureCount(aiTextureType_DIFFUSE) > 0) {
             aiString Path;
+            if (pMaterial->GetTexture(aiTextureType_DIFFUSE, 0, &Path, NULL, NULL, NULL, NULL, NULL) == AI_SUCCESS)
+                m_Materials[i].TexturePath = Dir + "\\" + Path.data;
+        }
+
+        pMaterial->Get(AI_MATKEY_COLOR_DIFFUSE, m_Materials[i].DiffuseColour);
+    }
+}
+
+bool COpenAssetImportMesh::InitMaterials()
+{
+    bool Ret = true;
 
-			if (pMaterial->GetTexture(aiTextureType_DIFFUSE, 0, &Path, NULL, NULL, NULL, NULL, NULL) == AI_SUCCESS) {
-                std::string FullPath = Dir + "\\" + Path.data;
-                m_Textures[i] = new CTexture();
-                if (!m_Textures[i]->Load(FullPath, true)) {
- 					MessageBox(NULL, FullPath.c_str(), "Error loading mesh texture", MB_ICONHAND);
-                    delete m_Textures[i];
-                    m_Textures[i] = NULL;
-                    Ret = false;
-                }
-                else {
-                    printf("Loaded texture '%s'\n", FullPath.c_str());
-                }
+    // Initialize the materials
+    m_Textures.resize(m_Materials.size());
+    for (unsigned int i = 0 ; i < m_Materials.size() ; i++) {
+        m_Textures[i] = NULL;
+
+        if (!m_Materials[i].TexturePath.empty()) {
+            const std::string& FullPath = m_Materials[i].TexturePath;
+            m_Textures[i] = new CTexture();
+            if (!m_Textures[i]->Load(FullPath, true, "mesh")) {
+				MessageBox(NULL, FullPath.c_str(), "Error loading mesh texture", MB_ICONHAND);
+                delete m_Textures[i];
+                m_Textures[i] = NULL;
+                Ret = false;
+            }
+            else {
+                printf("Loaded texture '%s'\n", FullPath.c_str());
             }
         }
 
         // Load a single colour texture matching the diffuse colour if no texture added
         if (!m_Textures[i]) {
 		
-			aiColor3D color (0.f,0.f,0.f);
-			pMaterial->Get(AI_MATKEY_COLOR_DIFFUSE,color);
+			const aiColor3D& color = m_Materials[i].DiffuseColour;
 
 			m_Textures[i] = new CTexture();
 			BYTE data[3];
 			data[0] = (BYTE) (color[2]*255);
 			data[1] = (BYTE) (color[1]*255);
 			data[2] = (BYTE) (color[0]*255);
-			m_Textures[i]->CreateFromData(data, 1, 1, 24, GL_BGR, false);
+			m_Textures[i]->CreateFromData(data, 1, 1, 24, GL_BGR, false, "mesh");
 
         }
     }
@@ -219,31 +380,70 @@ void COpenAssetImportMesh::Render()
 	glBindVertexArray(m_vao);
 
     for (unsigned int i = 0 ; i < m_Entries.size() ; i++) {
-		glEnableVertexAttribArray(0);
-		glEnableVertexAttribArray(1);
-		glEnableVertexAttribArray(2);
-        glBindBuffer(GL_ARRAY_BUFFER, m_Entries[i].vbo);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)12);
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)20);
-
+        const unsigned int MaterialIndex = m_Entries[i].MaterialIndex;
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_Entries[i].ibo);
+        if (MaterialIndex < m_Textures.size() && m_Textures[MaterialIndex]) {
+            m_Textures[MaterialIndex]->Bind(0);
+        }
 
+        glDrawElementsBaseVertex(GL_TRIANGLES, m_Entries[i].NumIndices, m_IndexType,
+            (GLvoid*)((size_t)m_IndexSize * m_Entries[i].BaseIndex), m_Entries[i].BaseVertex);
+    }
+}
 
+// Add one item per mesh entry to the render queue.  The item passed in supplies the pipeline and matrices.
+void COpenAssetImportMesh::Submit(CRenderQueue* queue, RenderItem item)
+{
+    item.vao = m_vao;
+    for (unsigned int i = 0 ; i < m_Entries.size() ; i++) {
         const unsigned int MaterialIndex = m_Entries[i].MaterialIndex;
 
         if (MaterialIndex < m_Textures.size() && m_Textures[MaterialIndex]) {
-            m_Textures[MaterialIndex]->Bind(0);
+            item.SetTexture(GL_TEXTURE_2D, m_Textures[MaterialIndex]->GetTextureID(), m_Textures[MaterialIndex]->GetSamplerID());
         }
 
-
-        glDrawElements(GL_TRIANGLES, m_Entries[i].NumIndices, GL_UNSIGNED_INT, 0);
-		glDisableVertexAttribArray(0);
-		glDisableVertexAttribArray(1);
-		glDisableVertexAttribArray(2);
+        item.SetDrawElements(GL_TRIANGLES, m_Entries[i].NumIndices, m_IndexType,
+            m_IndexSize * m_Entries[i].BaseIndex, m_Entries[i].BaseVertex);
+        queue->Submit(item);
     }
+}
+
+unsigned int COpenAssetImportMesh::GetNumEntries()
+{
+    return (unsigned int)m_Entries.size();
+}
+
+void COpenAssetImportMesh::GetEntry(unsigned int i, unsigned int& BaseVertex, unsigned int& BaseIndex, unsigned int& NumIndices, unsigned int Lod)
+{
+    BaseVertex = m_Entries[i].BaseVertex;
+    BaseIndex = m_Entries[i].LodBaseIndex[Lod];
+    NumIndices = m_Entries[i].LodNumIndices[Lod];
+}
 
+CTexture* COpenAssetImportMesh::GetEntryTexture(unsigned int i)
+{
+    const unsigned int MaterialIndex = m_Entries[i].MaterialIndex;
+    if (MaterialIndex < m_Textures.size())
+        return m_Textures[MaterialIndex];
+    return NULL;
+}
 
+const std::vector<Vertex>& COpenAssetImportMesh::GetVertices()
+{
+    return m_Vertices;
+}
 
+const std::vector<unsigned int>& COpenAssetImportMesh::GetIndices()
+{
+    return m_Indices;
+}
+
+unsigned int COpenAssetImportMesh::GetNumLods()
+{
+    return m_NumLods;
+}
+
+float COpenAssetImportMesh::GetLodError(unsigned int Lod)
+{
+    return m_LodErrors[Lod];
 }
@@ -29,8 +29,10 @@
 
 #include "Common.h"
 #include "Texture.h"
+#include "RenderQueue.h"
 
 #define INVALID_OGL_VALUE 0xFFFFFFFF
+#define MAX_MESH_LODS 4
 #define SAFE_DELETE(p) if (p) { delete p; p = NULL; }
 
 
@@ -57,34 +59,76 @@ public:
     COpenAssetImportMesh();
     ~COpenAssetImportMesh();
     bool Load(const std::string& Filename);
+
+    // Load in two steps: Decode reads the file and builds the geometry without touching OpenGL, so it can run on a
+    // worker thread, and Upload then creates the buffers and textures on the thread that owns the GL context
+    bool Decode(const std::string& Filename);
+    bool Upload();
+
+    // Build numLevels - 1 simpler versions of each entry, each with about reduction times the triangles of the one
+    // before.  Call after Decode and before Upload; like Decode it does not touch OpenGL.  The levels use the same
+    // vertices as the full mesh, and their indices go after the full mesh's.
+    void GenerateLods(int numLevels, float reduction);
+
     const aiScene* LoadImage(const std::string& filename);
     void Render();
+    void Submit(CRenderQueue* queue, RenderItem item);
+
+    // Access to the CPU copy of the geometry, used to build static batches
+    unsigned int GetNumEntries();
+    void GetEntry(unsigned int i, unsigned int& BaseVertex, unsigned int& BaseIndex, unsigned int& NumIndices, unsigned int Lod = 0);
+    CTexture* GetEntryTexture(unsigned int i);
+    const std::vector<Vertex>& GetVertices();
+    const std::vector<unsigned int>& GetIndices();
+
+    // Level 0 is the full mesh.  The error is roughly how far, in model units, a level's surface is from the full mesh.
+    unsigned int GetNumLods();
+    float GetLodError(unsigned int Lod);
 
 private:
     bool InitFromScene(const aiScene* pScene, const std::string& Filename);
-    void InitMesh(unsigned int Index, const aiMesh* paiMesh);
-    bool InitMaterials(const aiScene* pScene, const std::string& Filename);
+    void InitMesh(const aiMesh* paiMesh, std::vector<Vertex>& Vertices, std::vector<unsigned int>& Indices);
+    void ReadMaterials(const aiScene* pScene, const std::string& Filename);
+    bool InitMaterials();
+    void OptimizeEntries();
+    void InitBuffers();
     void Clear();
 	
 
 #define INVALID_MATERIAL 0xFFFFFFFF
 
+    // A range of the shared vertex and index buffers drawn with one material.  All of the assimp meshes
+    // that use the same material are merged into a single entry at load time.
     struct MeshEntry {
         MeshEntry();
 
-        ~MeshEntry();
-
-        void Init(const std::vector<Vertex>& Vertices,
-                  const std::vector<unsigned int>& Indices);
-        GLuint vbo;
-        GLuint ibo;
+        unsigned int BaseVertex;
+        unsigned int BaseIndex;
         unsigned int NumIndices;
         unsigned int MaterialIndex;
+        unsigned int LodBaseIndex[MAX_MESH_LODS];
+        unsigned int LodNumIndices[MAX_MESH_LODS];
+    };
+
+    // What Decode found out about a material, turned into a texture by Upload
+    struct MaterialInfo {
+        std::string TexturePath;
+        aiColor3D DiffuseColour;
     };
 
     std::vector<MeshEntry> m_Entries;
+    std::vector<MaterialInfo> m_Materials;
     std::vector<CTexture*> m_Textures;
+    std::vector<Vertex> m_Vertices;
+    std::vector<unsigned int> m_Indices;
+    std::string m_Filename;
+    unsigned int m_NumLods;
+    float m_LodErrors[MAX_MESH_LODS];
+    GLenum m_IndexType;         // GL_UNSIGNED_SHORT when every entry has few enough vertices, otherwise GL_UNSIGNED_INT
+    unsigned int m_IndexSize;
 	GLuint m_vao;
+	GLuint m_vbo;
+	GLuint m_ibo;
 };
 
 
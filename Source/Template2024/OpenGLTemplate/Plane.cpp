@@ -18,7 +18,7 @@ void CPlane::Create(string directory, string filename, float width, float height
 	m_height = height;
 
 	// Load the texture
-	m_texture.Load(directory+filename, true);
+	m_texture.Load(directory+filename, true, "plane");
 
 	m_directory = directory;
 	m_filename = filename;
@@ -63,15 +63,14 @@ void CPlane::Create(string directory, string filename, float width, float height
 	glm::vec3 planeNormal = glm::vec3(0.0f, 1.0f, 0.0f);
 
 	// Put the vertex attributes in the VBO
-	for (unsigned int i = 0; i < 4; i++) {
-		m_vbo.AddData(&planeVertices[i], sizeof(glm::vec3));
-		m_vbo.AddData(&planeTexCoords[i], sizeof(glm::vec2));
-		m_vbo.AddData(&planeNormal, sizeof(glm::vec3));
-	}
+	CVertexStream<TexturedVertex> vertices;
+	vertices.Reserve(4);
+	for (unsigned int i = 0; i < 4; i++)
+		vertices.Add(TexturedVertex(planeVertices[i], planeTexCoords[i], planeNormal));
 
 
 	// Upload the VBO to the GPU
-	m_vbo.UploadDataToGPU(GL_STATIC_DRAW);
+	m_vbo.UploadDataToGPU(vertices, GL_STATIC_DRAW, "plane");
 
 	// Set the vertex attribute locations
 	GLsizei istride = 2*sizeof(glm::vec3)+sizeof(glm::vec2);
@@ -98,6 +97,16 @@ void CPlane::Render(bool bindTexture)
 	
 }
 
+// Add the plane to the render queue.  If bindTexture is false the item keeps the texture set by the caller.
+void CPlane::Submit(CRenderQueue* queue, RenderItem item, bool bindTexture)
+{
+	item.vao = m_vao;
+	if (bindTexture)
+		item.SetTexture(GL_TEXTURE_2D, m_texture.GetTextureID(), m_texture.GetSamplerID());
+	item.SetDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	queue->Submit(item);
+}
+
 // Release resources
 void CPlane::Release()
 {
@@ -0,0 +1,372 @@
+#include "RenderQueue.h"
+#include <algorithm>
+
+#define RENDER_KEY_DEPTH_BITS 24
+#define RENDER_KEY_DEPTH_MAX ((1u << RENDER_KEY_DEPTH_BITS) - 1)
+#define RENDER_MAX_TEXTURE_UNITS 16
+
+CRenderQueue::CRenderQueue()
+{
+	m_farDistance = 5000.0f;
+	m_sortingEnabled = true;
+	m_frontToBack = true;
+	m_depthPrepass = false;
+	m_pDepthPrepassProgram = NULL;
+	m_occlusionCallback = NULL;
+	m_occlusionContext = NULL;
+	memset(&m_unsortedStats, 0, sizeof(RenderQueueStats));
+	memset(&m_sortedStats, 0, sizeof(RenderQueueStats));
+}
+
+CRenderQueue::~CRenderQueue()
+{}
+
+// Register a pipeline.  The index is stored in 8 bits of the key, so at most 256 pipelines can be used
+int CRenderQueue::AddPipeline(CShaderProgram* program, RenderPipelineApply apply, void* context)
+{
+	RenderPipeline pipeline;
+	pipeline.program = program;
+	pipeline.apply = apply;
+	pipeline.context = context;
+	pipeline.depthPrepass = false;
+	m_pipelines.push_back(pipeline);
+	return (int)m_pipelines.size() - 1;
+}
+
+void CRenderQueue::SetPipelineProgram(int pipeline, CShaderProgram* program)
+{
+	m_pipelines[pipeline].program = program;
+}
+
+void CRenderQueue::SetPipelineDepthPrepass(int pipeline, bool depthPrepass)
+{
+	m_pipelines[pipeline].depthPrepass = depthPrepass;
+}
+
+void CRenderQueue::SetFarDistance(float farDistance)
+{
+	m_farDistance = farDistance;
+}
+
+// Create an item for a pipeline.  The depth is taken from the translation of the modelview matrix,
+// which is the eye space position of the object's origin
+RenderItem CRenderQueue::CreateItem(int pipeline, const glm::mat4& modelViewMatrix, const glm::mat3& normalMatrix, RenderLayer layer)
+{
+	RenderItem item = {};
+	item.pipeline = (unsigned short)pipeline;
+	item.layer = (unsigned char)layer;
+	item.modelViewMatrix = modelViewMatrix;
+	item.normalMatrix = normalMatrix;
+	item.depth = -modelViewMatrix[3].z;
+	item.mode = GL_TRIANGLES;
+	return item;
+}
+
+// Pack the item state into a single integer so that a plain integer sort groups items by state
+unsigned long long CRenderQueue::BuildKey(const RenderItem& item) const
+{
+	float normalisedDepth = glm::clamp(item.depth / m_farDistance, 0.0f, 1.0f);
+	unsigned long long depth = (unsigned long long)(normalisedDepth * RENDER_KEY_DEPTH_MAX);
+	if (item.layer == RENDER_LAYER_TRANSPARENT)
+		depth = RENDER_KEY_DEPTH_MAX - depth;
+
+	unsigned long long key = 0;
+	key |= ((unsigned long long)item.layer & 0x3) << 62;
+	if (m_frontToBack && item.layer == RENDER_LAYER_OPAQUE) {
+		key |= (depth & RENDER_KEY_DEPTH_MAX) << 38;
+		key |= ((unsigned long long)item.pipeline & 0xFF) << 30;
+		key |= ((unsigned long long)item.texture & 0xFFFF) << 14;
+		key |= (unsigned long long)item.vao & 0x3FFF;
+		return key;
+	}
+	key |= ((unsigned long long)item.pipeline & 0xFF) << 54;
+	key |= ((unsigned long long)item.texture & 0xFFFF) << 38;
+	key |= ((unsigned long long)item.vao & 0x3FFF) << 24;
+	key |= depth & RENDER_KEY_DEPTH_MAX;
+	return key;
+}
+
+void CRenderQueue::Submit(const RenderItem& item)
+{
+	m_items.push_back(item);
+	m_items.back().key = BuildKey(item);
+}
+
+void CRenderQueue::Clear()
+{
+	m_items.clear();
+}
+
+void CRenderQueue::SetSortingEnabled(bool enabled)
+{
+	m_sortingEnabled = enabled;
+}
+
+bool CRenderQueue::IsSortingEnabled() const
+{
+	return m_sortingEnabled;
+}
+
+void CRenderQueue::SetFrontToBackEnabled(bool enabled)
+{
+	m_frontToBack = enabled;
+}
+
+bool CRenderQueue::IsFrontToBackEnabled() const
+{
+	return m_frontToBack;
+}
+
+void CRenderQueue::SetDepthPrepassProgram(CShaderProgram* program)
+{
+	m_pDepthPrepassProgram = program;
+}
+
+CShaderProgram* CRenderQueue::GetDepthPrepassProgram() const
+{
+	return m_pDepthPrepassProgram;
+}
+
+void CRenderQueue::SetDepthPrepassEnabled(bool enabled)
+{
+	m_depthPrepass = enabled;
+}
+
+bool CRenderQueue::IsDepthPrepassEnabled() const
+{
+	return m_depthPrepass;
+}
+
+void CRenderQueue::SetOcclusionCallback(RenderOcclusionCallback callback, void* context)
+{
+	m_occlusionCallback = callback;
+	m_occlusionContext = context;
+}
+
+int CRenderQueue::GetNumDepthPrepassItems() const
+{
+	return (int)m_prepassOrder.size();
+}
+
+const RenderQueueStats& CRenderQueue::GetUnsortedStats() const
+{
+	return m_unsortedStats;
+}
+
+const RenderQueueStats& CRenderQueue::GetSortedStats() const
+{
+	return m_sortedStats;
+}
+
+// Walk the items in the given order and count how many times each piece of state would change
+RenderQueueStats CRenderQueue::CountStateChanges(const vector<unsigned int>& order) const
+{
+	RenderQueueStats stats;
+	memset(&stats, 0, sizeof(RenderQueueStats));
+	stats.items = (int)order.size();
+
+	int currentPipeline = -1;
+	UINT currentProgram = 0;
+	GLuint currentVAO = 0;
+	GLuint currentTextures[RENDER_MAX_TEXTURE_UNITS] = { 0 };
+
+	for (unsigned int i = 0; i < order.size(); i++) {
+		const RenderItem& item = m_items[order[i]];
+		if (item.pipeline != currentPipeline) {
+			currentPipeline = item.pipeline;
+			UINT program = m_pipelines[item.pipeline].program->GetProgramID();
+			if (program != currentProgram) {
+				currentProgram = program;
+				stats.programChanges++;
+			}
+			else
+				stats.pipelineChanges++;
+		}
+		if (item.vao != currentVAO) {
+			currentVAO = item.vao;
+			stats.vaoChanges++;
+		}
+		if (item.textureTarget != 0 && currentTextures[item.textureUnit] != item.texture) {
+			currentTextures[item.textureUnit] = item.texture;
+			stats.textureChanges++;
+		}
+	}
+	return stats;
+}
+
+// Issue the GL calls for the items in the given order, skipping any state that is already bound
+void CRenderQueue::Execute(const vector<unsigned int>& order)
+{
+	int currentPipeline = -1;
+	UINT currentProgram = 0;
+	GLuint currentVAO = 0;
+	GLuint currentTextures[RENDER_MAX_TEXTURE_UNITS] = { 0 };
+	unsigned char currentFlags = 0;
+
+	for (unsigned int i = 0; i < order.size(); i++) {
+		const RenderItem& item = m_items[order[i]];
+		const RenderPipeline& pipeline = m_pipelines[item.pipeline];
+
+		if (item.pipeline != currentPipeline) {
+			currentPipeline = item.pipeline;
+			if (pipeline.program->GetProgramID() != currentProgram) {
+				currentProgram = pipeline.program->GetProgramID();
+				pipeline.program->UseProgram();
+			}
+			if (pipeline.apply)
+				pipeline.apply(pipeline.program, pipeline.context);
+		}
+
+		if (item.flags != currentFlags) {
+			unsigned char changed = item.flags ^ currentFlags;
+			if (changed & RENDER_FLAG_NO_DEPTH_WRITE)
+				glDepthMask((item.flags & RENDER_FLAG_NO_DEPTH_WRITE) ? 0 : 1);
+			if (changed & RENDER_FLAG_NO_CULL) {
+				if (item.flags & RENDER_FLAG_NO_CULL)
+					glDisable(GL_CULL_FACE);
+				else
+					glEnable(GL_CULL_FACE);
+			}
+			currentFlags = item.flags;
+		}
+
+		if (item.vao != currentVAO) {
+			currentVAO = item.vao;
+			glBindVertexArray(item.vao);
+		}
+
+		if (item.textureTarget != 0 && currentTextures[item.textureUnit] != item.texture) {
+			currentTextures[item.textureUnit] = item.texture;
+			glActiveTexture(GL_TEXTURE0 + item.textureUnit);
+			glBindTexture(item.textureTarget, item.texture);
+			glBindSampler(item.textureUnit, item.sampler);
+		}
+
+		pipeline.program->SetUniform("matrices.modelViewMatrix", item.modelViewMatrix);
+		pipeline.program->SetUniform("matrices.normalMatrix", item.normalMatrix);
+		Draw(item);
+	}
+
+	// Put the fixed function state back to the defaults the rest of the frame expects
+	if (currentFlags & RENDER_FLAG_NO_DEPTH_WRITE)
+		glDepthMask(1);
+	if (currentFlags & RENDER_FLAG_NO_CULL)
+		glEnable(GL_CULL_FACE);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+// Lay down the depth of the opaque items, nearest first, without writing any colour
+void CRenderQueue::ExecuteDepthPrepass()
+{
+	m_prepassOrder.clear();
+	for (unsigned int i = 0; i < m_items.size(); i++) {
+		const RenderItem& item = m_items[i];
+		if (item.layer == RENDER_LAYER_OPAQUE && m_pipelines[item.pipeline].depthPrepass && !(item.flags & RENDER_FLAG_NO_DEPTH_WRITE) &&
+			item.occlusionQuery == 0)
+			m_prepassOrder.push_back(i);
+	}
+	const vector<RenderItem>& items = m_items;
+	std::sort(m_prepassOrder.begin(), m_prepassOrder.end(), [&items](unsigned int a, unsigned int b) {
+		return items[a].depth < items[b].depth;
+	});
+
+	// Nothing is shaded in the pre-pass, so it is also kept out of the stencil count of the overdraw heatmap
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glStencilMask(0);
+	m_pDepthPrepassProgram->UseProgram();
+	GLuint currentVAO = 0;
+	bool culling = true;
+	for (unsigned int i = 0; i < m_prepassOrder.size(); i++) {
+		const RenderItem& item = m_items[m_prepassOrder[i]];
+		if (((item.flags & RENDER_FLAG_NO_CULL) == 0) != culling) {
+			culling = !culling;
+			if (culling)
+				glEnable(GL_CULL_FACE);
+			else
+				glDisable(GL_CULL_FACE);
+		}
+		if (item.vao != currentVAO) {
+			currentVAO = item.vao;
+			glBindVertexArray(item.vao);
+		}
+		m_pDepthPrepassProgram->SetUniform("matrices.modelViewMatrix", item.modelViewMatrix);
+		Draw(item);
+	}
+	if (!culling)
+		glEnable(GL_CULL_FACE);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glStencilMask(0xFF);
+}
+
+void CRenderQueue::Draw(const RenderItem& item)
+{
+	// The GPU waits for the query and then skips the draw if it failed; the CPU does not wait
+	if (item.occlusionQuery != 0)
+		glBeginConditionalRender(item.occlusionQuery, GL_QUERY_WAIT);
+
+	if (item.indexType == 0)
+		glDrawArrays(item.mode, (GLint)item.first, item.count);
+	else if (item.baseVertex != 0)
+		glDrawElementsBaseVertex(item.mode, item.count, item.indexType, (GLvoid*)(uintptr_t)item.first, item.baseVertex);
+	else
+		glDrawElements(item.mode, item.count, item.indexType, (const GLvoid*)item.first);
+
+	if (item.occlusionQuery != 0)
+		glEndConditionalRender();
+}
+
+void CRenderQueue::Flush()
+{
+	// Without a callback the queries are not issued this frame, so their results must not be used
+	if (m_occlusionCallback == NULL) {
+		for (unsigned int i = 0; i < m_items.size(); i++)
+			m_items[i].occlusionQuery = 0;
+	}
+
+	m_submitOrder.resize(m_items.size());
+	for (unsigned int i = 0; i < m_items.size(); i++)
+		m_submitOrder[i] = i;
+
+	// Sort indices rather than the items themselves; ties keep their submission order.  Breaking ties on the index
+	// gives the same order as a stable sort without the temporary buffer that std::stable_sort allocates.
+	m_sortedOrder = m_submitOrder;
+	const vector<RenderItem>& items = m_items;
+	std::sort(m_sortedOrder.begin(), m_sortedOrder.end(), [&items](unsigned int a, unsigned int b) {
+		return items[a].key < items[b].key || (items[a].key == items[b].key && a < b);
+	});
+
+	m_unsortedStats = CountStateChanges(m_submitOrder);
+	m_sortedStats = CountStateChanges(m_sortedOrder);
+
+	if (m_depthPrepass && m_pDepthPrepassProgram)
+		ExecuteDepthPrepass();
+	else
+		m_prepassOrder.clear();
+
+	const vector<unsigned int>& order = m_sortingEnabled ? m_sortedOrder : m_submitOrder;
+	if (m_occlusionCallback == NULL) {
+		Execute(order);
+		m_items.clear();
+		return;
+	}
+
+	// Draw the opaque items, issue the occlusion queries against their depth, and then draw the opaque items that
+	// depend on the queries before the rest of the layers
+	m_opaqueOrder.clear();
+	m_conditionalOrder.clear();
+	m_laterOrder.clear();
+	for (unsigned int i = 0; i < order.size(); i++) {
+		const RenderItem& item = m_items[order[i]];
+		if (item.layer != RENDER_LAYER_OPAQUE)
+			m_laterOrder.push_back(order[i]);
+		else if (item.occlusionQuery != 0)
+			m_conditionalOrder.push_back(order[i]);
+		else
+			m_opaqueOrder.push_back(order[i]);
+	}
+	Execute(m_opaqueOrder);
+	m_occlusionCallback(m_occlusionContext);
+	Execute(m_conditionalOrder);
+	Execute(m_laterOrder);
+	m_items.clear();
+}
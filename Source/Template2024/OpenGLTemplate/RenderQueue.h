@@ -0,0 +1,203 @@
+#pragma once
+
+#include "Common.h"
+#include "Shaders.h"
+
+// Fixed function state a render item can ask for.  Anything not requested is left at the default
+// (depth writes on, back face culling on)
+#define RENDER_FLAG_NO_DEPTH_WRITE	0x01	// Draw without writing to the depth buffer (skybox)
+#define RENDER_FLAG_NO_CULL			0x02	// Draw with back face culling disabled (double sided geometry)
+
+// Layers give a coarse draw order; every item in a lower layer is drawn before any item in a higher layer.
+// The background (skybox) is drawn after the opaque layer, at the far plane, so that the depth test rejects it
+// wherever something opaque has already been drawn.
+enum RenderLayer
+{
+	RENDER_LAYER_OPAQUE = 0,
+	RENDER_LAYER_BACKGROUND = 1,
+	RENDER_LAYER_TRANSPARENT = 2,
+	RENDER_LAYER_OVERLAY = 3
+};
+
+// A pipeline is a shader program together with a callback that sets the uniforms that are shared by every
+// item drawn with it (for example bUsePhongModel for the trees).  The callback runs each time the queue
+// switches to the pipeline, so items only have to carry their own per-draw data.
+typedef void (*RenderPipelineApply)(CShaderProgram* program, void* context);
+
+struct RenderPipeline
+{
+	CShaderProgram* program;
+	RenderPipelineApply apply;
+	void* context;
+	bool depthPrepass;		// Opaque items drawn with this pipeline are also drawn in the depth pre-pass
+};
+
+// Called by Flush once the opaque items have been drawn, and before the opaque items with an occlusion query, to
+// issue the occlusion queries against the opaque scene's depth
+typedef void (*RenderOcclusionCallback)(void* context);
+
+// A single draw.  Items are small and self contained so they can be sorted freely before being executed.
+struct RenderItem
+{
+	unsigned long long key;		// 64-bit sort key, filled in by CRenderQueue::Submit
+	unsigned short pipeline;	// Index returned by CRenderQueue::AddPipeline
+	unsigned char layer;		// RenderLayer
+	unsigned char flags;		// RENDER_FLAG_*
+
+	GLuint vao;					// Vertex array object holding the vertex format and buffers
+	GLenum textureTarget;		// GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP, or 0 for no texture
+	GLuint texture;
+	GLuint sampler;
+	int textureUnit;
+
+	GLenum mode;				// GL_TRIANGLES, GL_TRIANGLE_STRIP...
+	GLenum indexType;			// 0 for glDrawArrays, otherwise the type of the indices (GL_UNSIGNED_INT...)
+	GLsizei count;				// Number of vertices or indices to draw
+	GLintptr first;				// First vertex (arrays) or byte offset into the index buffer (elements)
+	GLint baseVertex;			// Added to every index (elements only)
+	GLuint occlusionQuery;		// If not 0, drawn only if this query's samples passed (conditional render).  The
+								// query is issued by the occlusion callback, so the item is drawn after it.
+
+	float depth;				// View space distance, used to order items front to back
+	glm::mat4 modelViewMatrix;
+	glm::mat3 normalMatrix;
+
+	void SetTexture(GLenum target, GLuint textureID, GLuint samplerID, int unit = 0)
+	{
+		textureTarget = target;
+		texture = textureID;
+		sampler = samplerID;
+		textureUnit = unit;
+	}
+
+	void SetDrawArrays(GLenum drawMode, GLint firstVertex, GLsizei vertexCount)
+	{
+		mode = drawMode;
+		indexType = 0;
+		first = firstVertex;
+		count = vertexCount;
+		baseVertex = 0;
+	}
+
+	void SetDrawElements(GLenum drawMode, GLsizei indexCount, GLenum type, GLintptr byteOffset = 0, GLint vertexOffset = 0)
+	{
+		mode = drawMode;
+		indexType = type;
+		count = indexCount;
+		first = byteOffset;
+		baseVertex = vertexOffset;
+	}
+};
+
+// Number of GL state changes needed to execute a list of items in a given order
+struct RenderQueueStats
+{
+	int items;
+	int programChanges;
+	int pipelineChanges;		// Pipeline switches that keep the program, which only set the pipeline's uniforms
+	int textureChanges;
+	int vaoChanges;
+
+	int Total() const { return programChanges + pipelineChanges + textureChanges + vaoChanges; }
+};
+
+// Collects the draws for a frame, sorts them by a 64-bit key so that draws sharing a program, texture and
+// vertex array are adjacent, and then executes them with the minimum number of state changes.
+//
+// Key layout, most significant bits first:
+//   63-62  layer
+//   61-54  pipeline
+//   53-38  texture
+//   37-24  vertex array object
+//   23-0   depth (front to back; back to front in the transparent layer)
+// With front to back ordering the depth moves up to bits 61-38 for the opaque layer, so that near objects are
+// drawn first and hide the pixels of the ones behind them, and the state fields move down below it.
+//
+// The optional depth pre-pass draws the opaque items of the pipelines that allow it into the depth buffer only,
+// front to back, with a position only program.  The colour pass then shades each pixel once, since the depth
+// test (GL_LEQUAL) rejects every fragment that is not the nearest.
+//
+// With an occlusion callback set, the opaque layer is drawn in two parts: the items without an occlusion query, and
+// then, once the callback has tested the occlusion queries against their depth, the items drawn conditionally on them.
+class CRenderQueue
+{
+public:
+	CRenderQueue();
+	~CRenderQueue();
+
+	// Register a pipeline and return its index for use in RenderItem::pipeline
+	int AddPipeline(CShaderProgram* program, RenderPipelineApply apply = NULL, void* context = NULL);
+
+	// Change the program a pipeline draws with, e.g. to select a shader variant for the frame
+	void SetPipelineProgram(int pipeline, CShaderProgram* program);
+
+	// Allow the pipeline's opaque items in the depth pre-pass.  Its vertex shader must compute gl_Position from
+	// attribute 0 exactly as the depth program does.
+	void SetPipelineDepthPrepass(int pipeline, bool depthPrepass);
+
+	// Set the view space distance that maps to the largest depth value in the key
+	void SetFarDistance(float farDistance);
+
+	// Return an item with the per-draw data filled in and all draw state cleared
+	RenderItem CreateItem(int pipeline, const glm::mat4& modelViewMatrix, const glm::mat3& normalMatrix, RenderLayer layer = RENDER_LAYER_OPAQUE);
+
+	// Add an item to the queue
+	void Submit(const RenderItem& item);
+
+	// Sort (if enabled) and draw everything in the queue, then empty it
+	void Flush();
+
+	// Discard everything in the queue without drawing it
+	void Clear();
+
+	void SetSortingEnabled(bool enabled);
+	bool IsSortingEnabled() const;
+
+	// Order opaque items by depth first rather than by state.  Takes effect for items submitted afterwards.
+	void SetFrontToBackEnabled(bool enabled);
+	bool IsFrontToBackEnabled() const;
+
+	// The program used by the depth pre-pass.  It needs matrices.projMatrix set by the caller each frame.
+	void SetDepthPrepassProgram(CShaderProgram* program);
+	CShaderProgram* GetDepthPrepassProgram() const;
+	void SetDepthPrepassEnabled(bool enabled);
+	bool IsDepthPrepassEnabled() const;
+
+	// Set the callback that issues the occlusion queries, or NULL.  While a callback is set, opaque items with an
+	// occlusion query are drawn after it, conditional on their query, and are left out of the depth pre-pass.
+	// Without one nothing issues the queries, so the items are drawn unconditionally like any other.
+	void SetOcclusionCallback(RenderOcclusionCallback callback, void* context);
+
+	// Number of items drawn in the last frame's depth pre-pass
+	int GetNumDepthPrepassItems() const;
+
+	// State changes the last flushed frame would have needed in submission order and in sorted order
+	const RenderQueueStats& GetUnsortedStats() const;
+	const RenderQueueStats& GetSortedStats() const;
+
+private:
+	unsigned long long BuildKey(const RenderItem& item) const;
+	RenderQueueStats CountStateChanges(const vector<unsigned int>& order) const;
+	void Execute(const vector<unsigned int>& order);
+	void ExecuteDepthPrepass();
+	static void Draw(const RenderItem& item);
+
+	vector<RenderPipeline> m_pipelines;
+	vector<RenderItem> m_items;
+	vector<unsigned int> m_submitOrder;
+	vector<unsigned int> m_sortedOrder;
+	vector<unsigned int> m_prepassOrder;
+	vector<unsigned int> m_opaqueOrder;
+	vector<unsigned int> m_conditionalOrder;
+	vector<unsigned int> m_laterOrder;
+	float m_farDistance;
+	bool m_sortingEnabled;
+	bool m_frontToBack;
+	bool m_depthPrepass;
+	CShaderProgram* m_pDepthPrepassProgram;
+	RenderOcclusionCallback m_occlusionCallback;
+	void* m_occlusionContext;
+
+	RenderQueueStats m_unsortedStats;
+	RenderQueueStats m_sortedStats;
+};
@@ -0,0 +1,193 @@
+#include "RenderStatistics.h"
+
+#define OVERDRAW_LEVELS 8
+
+static const GLenum g_statisticTargets[PIPELINE_STATISTIC_COUNT] = {
+	GL_VERTICES_SUBMITTED_ARB,
+	GL_PRIMITIVES_SUBMITTED_ARB,
+	GL_CLIPPING_OUTPUT_PRIMITIVES_ARB,
+	GL_FRAGMENT_SHADER_INVOCATIONS_ARB
+};
+
+CPipelineStatistics::CPipelineStatistics()
+{
+	m_activeBlock = -1;
+	m_enabled = false;
+}
+
+CPipelineStatistics::~CPipelineStatistics()
+{
+	Release();
+}
+
+bool CPipelineStatistics::IsSupported()
+{
+	return GLEW_VERSION_4_6 || GLEW_ARB_pipeline_statistics_query;
+}
+
+void CPipelineStatistics::SetEnabled(bool enabled)
+{
+	m_enabled = enabled && IsSupported();
+}
+
+bool CPipelineStatistics::IsEnabled()
+{
+	return m_enabled;
+}
+
+void CPipelineStatistics::Begin(const string& name)
+{
+	if (!m_enabled || m_activeBlock >= 0)
+		return;
+
+	int b = 0;
+	while (b < (int)m_blocks.size() && m_blocks[b].name != name)
+		b++;
+	if (b == (int)m_blocks.size()) {
+		Block block;
+		block.name = name;
+		glGenQueries(2 * PIPELINE_STATISTIC_COUNT, &block.queries[0][0]);
+		block.pending[0] = false;
+		block.pending[1] = false;
+		block.current = 0;
+		for (int s = 0; s < PIPELINE_STATISTIC_COUNT; s++)
+			block.results[s] = 0;
+		m_blocks.push_back(block);
+	}
+
+	// Collect the results from the last time these query objects were used before reusing them
+	Block& block = m_blocks[b];
+	if (block.pending[block.current]) {
+		for (int s = 0; s < PIPELINE_STATISTIC_COUNT; s++)
+			glGetQueryObjectui64v(block.queries[block.current][s], GL_QUERY_RESULT, &block.results[s]);
+		block.pending[block.current] = false;
+	}
+
+	// Each statistic is a separate query target, so all of them can be active at once
+	for (int s = 0; s < PIPELINE_STATISTIC_COUNT; s++)
+		glBeginQuery(g_statisticTargets[s], block.queries[block.current][s]);
+	m_activeBlock = b;
+}
+
+void CPipelineStatistics::End()
+{
+	if (m_activeBlock < 0)
+		return;
+
+	Block& block = m_blocks[m_activeBlock];
+	for (int s = 0; s < PIPELINE_STATISTIC_COUNT; s++)
+		glEndQuery(g_statisticTargets[s]);
+	block.pending[block.current] = true;
+	block.current = 1 - block.current;
+	m_activeBlock = -1;
+}
+
+int CPipelineStatistics::GetNumBlocks()
+{
+	return (int)m_blocks.size();
+}
+
+const string& CPipelineStatistics::GetBlockName(int block)
+{
+	return m_blocks[block].name;
+}
+
+GLuint64 CPipelineStatistics::GetCounter(int block, PipelineStatistic statistic)
+{
+	return m_blocks[block].results[statistic];
+}
+
+const char* CPipelineStatistics::GetCounterName(PipelineStatistic statistic)
+{
+	static const char* names[PIPELINE_STATISTIC_COUNT] = { "vertices", "primitives", "clipped", "fragments" };
+	return names[statistic];
+}
+
+void CPipelineStatistics::Release()
+{
+	for (unsigned int i = 0; i < m_blocks.size(); i++)
+		glDeleteQueries(2 * PIPELINE_STATISTIC_COUNT, &m_blocks[i].queries[0][0]);
+	m_blocks.clear();
+	m_activeBlock = -1;
+}
+
+COverdrawHeatmap::COverdrawHeatmap()
+{
+	m_pProgram = NULL;
+	m_vao = 0;
+	m_enabled = false;
+}
+
+COverdrawHeatmap::~COverdrawHeatmap()
+{
+	Release();
+}
+
+void COverdrawHeatmap::Create(CShaderProgram* program)
+{
+	m_pProgram = program;
+
+	// The vertex shader makes a triangle covering the screen from gl_VertexID, but a vertex array must still be bound
+	glGenVertexArrays(1, &m_vao);
+}
+
+void COverdrawHeatmap::SetEnabled(bool enabled)
+{
+	m_enabled = enabled;
+}
+
+bool COverdrawHeatmap::IsEnabled()
+{
+	return m_enabled;
+}
+
+void COverdrawHeatmap::BeginCounting()
+{
+	glClearStencil(0);
+	glStencilMask(0xFF);
+	glClear(GL_STENCIL_BUFFER_BIT);
+	glEnable(GL_STENCIL_TEST);
+	glStencilFunc(GL_ALWAYS, 0, 0xFF);
+	glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+}
+
+void COverdrawHeatmap::EndCounting()
+{
+	glDisable(GL_STENCIL_TEST);
+}
+
+void COverdrawHeatmap::Render()
+{
+	static const glm::vec4 colours[OVERDRAW_LEVELS + 1] = {
+		glm::vec4(0.0f, 0.0f, 0.0f, 1.0f),		// Nothing drawn
+		glm::vec4(0.0f, 0.0f, 0.5f, 1.0f),
+		glm::vec4(0.0f, 0.3f, 1.0f, 1.0f),
+		glm::vec4(0.0f, 0.8f, 0.8f, 1.0f),
+		glm::vec4(0.0f, 0.8f, 0.0f, 1.0f),
+		glm::vec4(0.8f, 0.8f, 0.0f, 1.0f),
+		glm::vec4(1.0f, 0.5f, 0.0f, 1.0f),
+		glm::vec4(1.0f, 0.0f, 0.0f, 1.0f),
+		glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)		// Eight or more
+	};
+
+	glDisable(GL_DEPTH_TEST);
+	glEnable(GL_STENCIL_TEST);
+	glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+	m_pProgram->UseProgram();
+	glBindVertexArray(m_vao);
+	for (int i = 0; i <= OVERDRAW_LEVELS; i++) {
+		// The last level takes every count from there up
+		glStencilFunc(i < OVERDRAW_LEVELS ? GL_EQUAL : GL_LEQUAL, i, 0xFF);
+		m_pProgram->SetUniform("vColour", colours[i]);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+	}
+	glDisable(GL_STENCIL_TEST);
+	glEnable(GL_DEPTH_TEST);
+}
+
+void COverdrawHeatmap::Release()
+{
+	if (m_vao != 0)
+		glDeleteVertexArrays(1, &m_vao);
+	m_vao = 0;
+}
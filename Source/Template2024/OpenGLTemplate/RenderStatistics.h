@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Common.h"
+#include "Shaders.h"
+
+// Counters collected by CPipelineStatistics for each block
+enum PipelineStatistic
+{
+	PIPELINE_STATISTIC_VERTICES = 0,		// Vertices submitted
+	PIPELINE_STATISTIC_PRIMITIVES,			// Primitives submitted
+	PIPELINE_STATISTIC_CLIPPED_PRIMITIVES,	// Primitives left after clipping, to be culled and rasterised
+	PIPELINE_STATISTIC_FRAGMENTS,			// Fragment shader invocations
+	PIPELINE_STATISTIC_COUNT
+};
+
+// Counts the work the GPU does in named blocks of a frame with ARB_pipeline_statistics_query (core in 4.6).  As
+// with CGpuTimer, each block has two sets of queries used in turn and the results are one frame old.  Blocks
+// cannot be nested, and a block that is not reached in a frame keeps its last results.
+class CPipelineStatistics
+{
+public:
+	CPipelineStatistics();
+	~CPipelineStatistics();
+
+	static bool IsSupported();
+
+	// Begin and End do nothing while disabled or unsupported
+	void SetEnabled(bool enabled);
+	bool IsEnabled();
+
+	void Begin(const string& name);
+	void End();
+
+	int GetNumBlocks();
+	const string& GetBlockName(int block);
+	GLuint64 GetCounter(int block, PipelineStatistic statistic);
+	static const char* GetCounterName(PipelineStatistic statistic);
+
+	void Release();
+
+private:
+	struct Block {
+		string name;
+		GLuint queries[2][PIPELINE_STATISTIC_COUNT];
+		bool pending[2];
+		int current;
+		GLuint64 results[PIPELINE_STATISTIC_COUNT];
+	};
+
+	vector<Block> m_blocks;
+	int m_activeBlock;
+	bool m_enabled;
+};
+
+// Overdraw heatmap.  While counting, every fragment that passes the depth test increments the stencil buffer, so
+// afterwards each pixel's stencil value is the number of times it was shaded.  Render then replaces the image with
+// one colour per count, from dark blue for one fragment to white for eight or more.
+class COverdrawHeatmap
+{
+public:
+	COverdrawHeatmap();
+	~COverdrawHeatmap();
+
+	void Create(CShaderProgram* program);
+
+	void SetEnabled(bool enabled);
+	bool IsEnabled();
+
+	// Clear the stencil buffer and start counting, or stop counting
+	void BeginCounting();
+	void EndCounting();
+
+	// Draw the heatmap over the whole viewport
+	void Render();
+
+	void Release();
+
+private:
+	CShaderProgram* m_pProgram;
+	UINT m_vao;
+	bool m_enabled;
+};
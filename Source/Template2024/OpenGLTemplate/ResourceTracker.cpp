@@ -0,0 +1,227 @@
+#include "ResourceTracker.h"
+#include <map>
+#include <mutex>
+
+struct TrackedResource
+{
+	size_t bytes;
+	string owner;
+	string path;
+};
+
+typedef std::pair<int, unsigned long long> ResourceKey;
+
+// Meshes can be released on worker threads, so everything is guarded by one lock
+static std::mutex s_mutex;
+static std::map<ResourceKey, TrackedResource> s_resources;
+static std::map<string, size_t> s_ownerBytes;		// Entries are never removed, so the names stay valid
+static size_t s_totalBytes[RESOURCE_TYPE_COUNT];
+static int s_count[RESOURCE_TYPE_COUNT];
+
+void CResourceTracker::Track(ResourceType type, unsigned long long key, size_t bytes, const char* owner, const string& path)
+{
+	std::lock_guard<std::mutex> lock(s_mutex);
+
+	ResourceKey resourceKey(type, key);
+	std::map<ResourceKey, TrackedResource>::iterator it = s_resources.find(resourceKey);
+	if (it != s_resources.end()) {
+		s_totalBytes[type] -= it->second.bytes;
+		s_ownerBytes[it->second.owner] -= it->second.bytes;
+		s_count[type]--;
+	}
+
+	TrackedResource& resource = s_resources[resourceKey];
+	resource.bytes = bytes;
+	resource.owner = owner;
+	resource.path = path;
+	s_totalBytes[type] += bytes;
+	s_ownerBytes[resource.owner] += bytes;
+	s_count[type]++;
+}
+
+void CResourceTracker::Untrack(ResourceType type, unsigned long long key)
+{
+	std::lock_guard<std::mutex> lock(s_mutex);
+
+	std::map<ResourceKey, TrackedResource>::iterator it = s_resources.find(ResourceKey(type, key));
+	if (it == s_resources.end())
+		return;
+	s_totalBytes[type] -= it->second.bytes;
+	s_ownerBytes[it->second.owner] -= it->second.bytes;
+	s_count[type]--;
+	s_resources.erase(it);
+}
+
+void CResourceTracker::TrackBuffer(GLuint buffer, size_t bytes, const char* owner, const string& path)
+{
+	Track(RESOURCE_BUFFER, buffer, bytes, owner, path);
+}
+
+void CResourceTracker::TrackTexture(GLuint texture, size_t bytes, const char* owner, const string& path)
+{
+	Track(RESOURCE_TEXTURE, texture, bytes, owner, path);
+}
+
+void CResourceTracker::TrackCpuCopy(const void* data, size_t bytes, const char* owner, const string& path)
+{
+	Track(RESOURCE_CPU_COPY, (unsigned long long)(size_t)data, bytes, owner, path);
+}
+
+void CResourceTracker::UntrackBuffer(GLuint buffer)
+{
+	Untrack(RESOURCE_BUFFER, buffer);
+}
+
+void CResourceTracker::UntrackTexture(GLuint texture)
+{
+	Untrack(RESOURCE_TEXTURE, texture);
+}
+
+void CResourceTracker::UntrackCpuCopy(const void* data)
+{
+	Untrack(RESOURCE_CPU_COPY, (unsigned long long)(size_t)data);
+}
+
+size_t CResourceTracker::GetTextureBytes(GLenum internalFormat, int width, int height, bool mipmaps)
+{
+	size_t texelBytes;
+	switch (internalFormat) {
+	case GL_LUMINANCE:
+	case GL_RED:
+	case GL_R8:
+		texelBytes = 1;
+		break;
+	case GL_RGB16F:		// Drivers store three channel formats with a fourth channel
+	case GL_RGBA16F:
+		texelBytes = 8;
+		break;
+	case GL_RGB32F:
+	case GL_RGBA32F:
+		texelBytes = 16;
+		break;
+	default:			// RGB, RGBA and depth formats
+		texelBytes = 4;
+		break;
+	}
+
+	size_t bytes = texelBytes * width * height;
+	// Each level is a quarter of the one above it, so a full chain adds a third
+	return mipmaps ? bytes + bytes / 3 : bytes;
+}
+
+size_t CResourceTracker::GetTotalBytes(ResourceType type)
+{
+	std::lock_guard<std::mutex> lock(s_mutex);
+	return s_totalBytes[type];
+}
+
+int CResourceTracker::GetCount(ResourceType type)
+{
+	std::lock_guard<std::mutex> lock(s_mutex);
+	return s_count[type];
+}
+
+const char* CResourceTracker::GetTypeName(ResourceType type)
+{
+	static const char* names[RESOURCE_TYPE_COUNT] = { "buffer", "texture", "cpu copy" };
+	return names[type];
+}
+
+int CResourceTracker::GetLargestOwners(const char** owners, size_t* bytes, int maxOwners)
+{
+	std::lock_guard<std::mutex> lock(s_mutex);
+
+	// Insertion into the short sorted list, so the HUD can call this every frame without allocating
+	int numOwners = 0;
+	for (std::map<string, size_t>::iterator it = s_ownerBytes.begin(); it != s_ownerBytes.end(); ++it) {
+		if (it->second == 0)
+			continue;
+		int i = numOwners < maxOwners ? numOwners++ : maxOwners;
+		while (i > 0 && bytes[i - 1] < it->second) {
+			if (i < maxOwners) {
+				owners[i] = owners[i - 1];
+				bytes[i] = bytes[i - 1];
+			}
+			i--;
+		}
+		if (i < maxOwners) {
+			owners[i] = it->first.c_str();
+			bytes[i] = it->second;
+		}
+	}
+	return numOwners;
+}
+
+// Write s as a JSON string, escaping the backslashes in Windows paths
+static void WriteJsonString(FILE* fp, const string& s)
+{
+	fputc('"', fp);
+	for (unsigned int i = 0; i < s.size(); i++) {
+		if (s[i] == '"' || s[i] == '\\')
+			fputc('\\', fp);
+		fputc(s[i], fp);
+	}
+	fputc('"', fp);
+}
+
+bool CResourceTracker::WriteJson(const string& file)
+{
+	FILE* fp;
+	fopen_s(&fp, file.c_str(), "w");
+	if (!fp)
+		return false;
+
+	std::lock_guard<std::mutex> lock(s_mutex);
+
+	fprintf(fp, "{\n\t\"totals\": {");
+	for (int t = 0; t < RESOURCE_TYPE_COUNT; t++)
+		fprintf(fp, "%s\n\t\t\"%s\": { \"count\": %d, \"bytes\": %llu }", t == 0 ? "" : ",", GetTypeName((ResourceType)t),
+			s_count[t], (unsigned long long)s_totalBytes[t]);
+
+	fprintf(fp, "\n\t},\n\t\"resources\": [");
+	bool first = true;
+	for (std::map<ResourceKey, TrackedResource>::iterator it = s_resources.begin(); it != s_resources.end(); ++it) {
+		fprintf(fp, "%s\n\t\t{ \"type\": \"%s\", \"id\": %llu, \"bytes\": %llu, \"owner\": ", first ? "" : ",",
+			GetTypeName((ResourceType)it->first.first), it->first.first == RESOURCE_CPU_COPY ? 0ULL : it->first.second,
+			(unsigned long long)it->second.bytes);
+		WriteJsonString(fp, it->second.owner);
+		fprintf(fp, ", \"path\": ");
+		WriteJsonString(fp, it->second.path);
+		fprintf(fp, " }");
+		first = false;
+	}
+	fprintf(fp, "\n\t]\n}\n");
+
+	fclose(fp);
+	return true;
+}
+
+int CResourceTracker::ReportLeaks(const string& file)
+{
+	std::lock_guard<std::mutex> lock(s_mutex);
+
+	if (s_resources.empty())
+		return 0;
+
+	FILE* fp;
+	fopen_s(&fp, file.c_str(), "w");
+	if (!fp)
+		return (int)s_resources.size();
+
+	fprintf(fp, "%d resources still allocated at shutdown\n", (int)s_resources.size());
+	for (int t = 0; t < RESOURCE_TYPE_COUNT; t++)
+		fprintf(fp, "%s: %d, %llu bytes\n", GetTypeName((ResourceType)t), s_count[t], (unsigned long long)s_totalBytes[t]);
+	fprintf(fp, "\n");
+	for (std::map<ResourceKey, TrackedResource>::iterator it = s_resources.begin(); it != s_resources.end(); ++it) {
+		fprintf(fp, "%-8s %10llu bytes  %s", GetTypeName((ResourceType)it->first.first), (unsigned long long)it->second.bytes,
+			it->second.owner.c_str());
+		if (it->first.first != RESOURCE_CPU_COPY)
+			fprintf(fp, " (id %llu)", it->first.second);
+		if (!it->second.path.empty())
+			fprintf(fp, "  %s", it->second.path.c_str());
+		fprintf(fp, "\n");
+	}
+
+	fclose(fp);
+	return (int)s_resources.size();
+}
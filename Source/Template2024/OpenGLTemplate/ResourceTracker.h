@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Common.h"
+
+// Kinds of memory recorded by the resource tracker
+enum ResourceType
+{
+	RESOURCE_BUFFER = 0,
+	RESOURCE_TEXTURE,
+	RESOURCE_CPU_COPY,
+	RESOURCE_TYPE_COUNT
+};
+
+// Records the memory held by every GL buffer and texture, and by the copies of their data kept on the CPU after
+// upload.  Each resource has an owner (the kind of object that created it) and, if it came from a file, its path.
+// GL resources are identified by their names and CPU copies by the address of their data, and tracking one that is
+// already tracked replaces it, so a buffer can be tracked again whenever its storage is reallocated.
+//
+// The GPU sizes are the sizes asked for, so they leave out any padding and copies the driver makes.
+class CResourceTracker
+{
+public:
+	static void TrackBuffer(GLuint buffer, size_t bytes, const char* owner, const string& path = "");
+	static void TrackTexture(GLuint texture, size_t bytes, const char* owner, const string& path = "");
+	static void TrackCpuCopy(const void* data, size_t bytes, const char* owner, const string& path = "");
+	static void UntrackBuffer(GLuint buffer);
+	static void UntrackTexture(GLuint texture);
+	static void UntrackCpuCopy(const void* data);
+
+	// Size of a 2D texture, with the whole mipmap chain if mipmaps is true
+	static size_t GetTextureBytes(GLenum internalFormat, int width, int height, bool mipmaps);
+
+	static size_t GetTotalBytes(ResourceType type);
+	static int GetCount(ResourceType type);
+	static const char* GetTypeName(ResourceType type);
+
+	// The owners holding the most memory of all types, largest first.  Returns the number written.
+	static int GetLargestOwners(const char** owners, size_t* bytes, int maxOwners);
+
+	// Write every resource to a JSON file
+	static bool WriteJson(const string& file);
+
+	// Write the resources that are still tracked to a file, for use at shutdown once everything should have been
+	// released.  Returns the number of leaks; the file is only written if there are any.
+	static int ReportLeaks(const string& file);
+
+private:
+	static void Track(ResourceType type, unsigned long long key, size_t bytes, const char* owner, const string& path);
+	static void Untrack(ResourceType type, unsigned long long key);
+};
@@ -0,0 +1,237 @@
+#include "ShaderCache.h"
+#include "HighResolutionTimer.h"
+
+#define SHADER_DIRECTORY "resources\\shaders\\"
+#define SHADER_CACHE_VERSION 1
+
+// Header written in front of each cached binary
+struct ShaderCacheHeader
+{
+	unsigned int version;
+	unsigned int format;
+	unsigned int length;
+};
+
+CShaderCache::CShaderCache()
+{
+	m_binariesSupported = false;
+	m_numCacheHits = 0;
+	m_numCompiled = 0;
+	m_buildMilliseconds = 0.0;
+}
+
+CShaderCache::~CShaderCache()
+{}
+
+void CShaderCache::Initialise(const string& directory)
+{
+	m_directory = directory;
+	CreateDirectory(directory.c_str(), NULL);
+
+	m_driver = string((const char*)glGetString(GL_VENDOR)) + "|" + (const char*)glGetString(GL_RENDERER) + "|" + (const char*)glGetString(GL_VERSION);
+
+	// Program binaries are core in 4.1, and a driver may still support no binary formats at all
+	int numFormats = 0;
+	if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+	m_binariesSupported = numFormats > 0;
+
+	// Let the driver compile on as many threads as it likes
+	if (GLEW_KHR_parallel_shader_compile)
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+}
+
+int CShaderCache::GetShaderType(const string& file)
+{
+	string sExt = file.substr((int)file.size() - 4, 4);
+	if (sExt == "vert") return GL_VERTEX_SHADER;
+	if (sExt == "frag") return GL_FRAGMENT_SHADER;
+	if (sExt == "geom") return GL_GEOMETRY_SHADER;
+	if (sExt == "comp") return GL_COMPUTE_SHADER;
+	if (sExt == "tcnl") return GL_TESS_CONTROL_SHADER;
+	return GL_TESS_EVALUATION_SHADER;
+}
+
+CShaderProgram* CShaderCache::AddProgram(const vector<string>& files, const vector<string>& defines)
+{
+	Program program;
+	program.program = new CShaderProgram;
+	program.compute = false;
+	for (unsigned int i = 0; i < files.size(); i++) {
+		CShader shader;
+		shader.ReadSource(SHADER_DIRECTORY + files[i], GetShaderType(files[i]), defines);
+		program.shaders.push_back(shader);
+		if (shader.GetType() == GL_COMPUTE_SHADER)
+			program.compute = true;
+	}
+
+	char name[32];
+	sprintf_s(name, "%016llx.bin", HashProgram(program));
+	program.cacheFile = m_directory + "\\" + name;
+
+	m_programs.push_back(program);
+	return program.program;
+}
+
+void CShaderCache::AddVariants(CShaderVariants* variants, const vector<string>& files, const vector<unsigned int>& masks)
+{
+	for (unsigned int i = 0; i < masks.size(); i++)
+		variants->AddVariant(masks[i], AddProgram(files, variants->GetDefines(masks[i])));
+}
+
+// 64-bit FNV-1a hash of the driver strings and of the type and source of every shader in the program
+unsigned long long CShaderCache::HashProgram(Program& program)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	const unsigned long long prime = 1099511628211ULL;
+
+	for (unsigned int c = 0; c < m_driver.size(); c++)
+		hash = (hash ^ (unsigned char)m_driver[c]) * prime;
+
+	for (unsigned int i = 0; i < program.shaders.size(); i++) {
+		CShader& shader = program.shaders[i];
+		hash = (hash ^ (unsigned int)shader.GetType()) * prime;
+		const vector<string>& lines = shader.GetSource();
+		for (unsigned int l = 0; l < lines.size(); l++) {
+			for (unsigned int c = 0; c < lines[l].size(); c++)
+				hash = (hash ^ (unsigned char)lines[l][c]) * prime;
+		}
+	}
+	return hash;
+}
+
+bool CShaderCache::LoadFromCache(Program& program)
+{
+	if (!m_binariesSupported)
+		return false;
+
+	FILE* fp;
+	fopen_s(&fp, program.cacheFile.c_str(), "rb");
+	if (!fp)
+		return false;
+
+	ShaderCacheHeader header;
+	vector<BYTE> data;
+	bool read = fread(&header, sizeof(header), 1, fp) == 1 && header.version == SHADER_CACHE_VERSION && header.length > 0;
+	if (read) {
+		data.resize(header.length);
+		read = fread(&data[0], 1, header.length, fp) == header.length;
+	}
+	fclose(fp);
+
+	return read && program.program->LoadBinary(data, header.format);
+}
+
+void CShaderCache::SaveToCache(Program& program)
+{
+	if (!m_binariesSupported)
+		return;
+
+	vector<BYTE> data;
+	GLenum format;
+	if (!program.program->GetBinary(data, format))
+		return;
+
+	FILE* fp;
+	fopen_s(&fp, program.cacheFile.c_str(), "wb");
+	if (!fp)
+		return;
+
+	ShaderCacheHeader header;
+	header.version = SHADER_CACHE_VERSION;
+	header.format = format;
+	header.length = (unsigned int)data.size();
+	fwrite(&header, sizeof(header), 1, fp);
+	fwrite(&data[0], 1, data.size(), fp);
+	fclose(fp);
+}
+
+// Draw a triangle with the program while rasterisation is off, so the driver builds whatever it had left until first use
+void CShaderCache::Warm(Program& program)
+{
+	if (program.compute || !program.program->IsLinked())
+		return;
+
+	static GLuint vao = 0;
+	if (vao == 0)
+		glGenVertexArrays(1, &vao);
+
+	glEnable(GL_RASTERIZER_DISCARD);
+	program.program->UseProgram();
+	glBindVertexArray(vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	glDisable(GL_RASTERIZER_DISCARD);
+}
+
+bool CShaderCache::Build()
+{
+	CHighResolutionTimer timer;
+	timer.Start();
+
+	// Cache hits are ready straight away
+	vector<Program*> misses;
+	for (unsigned int i = 0; i < m_programs.size(); i++) {
+		m_programs[i].program->CreateProgram();
+		if (LoadFromCache(m_programs[i])) {
+			Warm(m_programs[i]);
+			m_numCacheHits++;
+		}
+		else
+			misses.push_back(&m_programs[i]);
+	}
+
+	// Start every compile, then every link, and only then wait for the results
+	for (unsigned int i = 0; i < misses.size(); i++) {
+		for (unsigned int s = 0; s < misses[i]->shaders.size(); s++)
+			misses[i]->shaders[s].Compile();
+	}
+	for (unsigned int i = 0; i < misses.size(); i++) {
+		for (unsigned int s = 0; s < misses[i]->shaders.size(); s++)
+			glAttachShader(misses[i]->program->GetProgramID(), misses[i]->shaders[s].GetShaderID());
+		if (m_binariesSupported)
+			misses[i]->program->SetBinaryRetrievable();
+		misses[i]->program->StartLink();
+	}
+
+	bool ok = true;
+	for (unsigned int i = 0; i < misses.size(); i++) {
+		Program& program = *misses[i];
+		bool compiled = true;
+		for (unsigned int s = 0; s < program.shaders.size(); s++)
+			compiled = program.shaders[s].CheckCompileStatus() && compiled;
+		if (compiled && program.program->CheckLinkStatus()) {
+			SaveToCache(program);
+			Warm(program);
+			m_numCompiled++;
+		}
+		else
+			ok = false;
+
+		// The linked program keeps what it needs, so the shader objects can go
+		for (unsigned int s = 0; s < program.shaders.size(); s++) {
+			glDetachShader(program.program->GetProgramID(), program.shaders[s].GetShaderID());
+			glDeleteShader(program.shaders[s].GetShaderID());
+		}
+	}
+	glUseProgram(0);
+
+	m_programs.clear();
+	m_buildMilliseconds += timer.Elapsed();
+	return ok;
+}
+
+int CShaderCache::GetNumCacheHits()
+{
+	return m_numCacheHits;
+}
+
+int CShaderCache::GetNumCompiled()
+{
+	return m_numCompiled;
+}
+
+double CShaderCache::GetBuildMilliseconds()
+{
+	return m_buildMilliseconds;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Common.h"
+#include "Shaders.h"
+
+// Builds the game's shader programs, keeping their binaries on disk so that later runs can skip compiling and
+// linking.  A binary is stored under a hash of the program's source (with includes expanded) and of the GL vendor,
+// renderer and version strings, so editing a shader or changing driver simply misses the cache.
+//
+// Programs are added first and then built together.  On a miss every shader is compiled, and every program linked,
+// before any result is waited on, so a driver with GL_KHR_parallel_shader_compile can do the work on all of its
+// threads at once.  Each new program is then used for a draw with rasterisation disabled, so the driver finishes
+// any deferred work at load time rather than on the first frame the program is used.
+class CShaderCache
+{
+public:
+	CShaderCache();
+	~CShaderCache();
+
+	// directory is created if it does not exist
+	void Initialise(const string& directory);
+
+	// Add a program made from shader files in resources\shaders.  The type of each shader comes from the file extension.
+	// The program returned is not usable until Build has been called.
+	CShaderProgram* AddProgram(const vector<string>& files, const vector<string>& defines = vector<string>());
+
+	// Add one program per feature mask to a set of variants
+	void AddVariants(CShaderVariants* variants, const vector<string>& files, const vector<unsigned int>& masks);
+
+	// Build every program added since the last call.  Returns false if any program failed to build.
+	bool Build();
+
+	int GetNumCacheHits();
+	int GetNumCompiled();
+	double GetBuildMilliseconds();
+
+private:
+	struct Program {
+		CShaderProgram* program;
+		vector<CShader> shaders;
+		string cacheFile;
+		bool compute;
+	};
+
+	static int GetShaderType(const string& file);
+	unsigned long long HashProgram(Program& program);
+	bool LoadFromCache(Program& program);
+	void SaveToCache(Program& program);
+	void Warm(Program& program);
+
+	string m_directory;
+	string m_driver;
+	bool m_binariesSupported;
+	vector<Program> m_programs;
+	int m_numCacheHits;
+	int m_numCompiled;
+	double m_buildMilliseconds;
+};
@@ -13,26 +13,53 @@ CShader::~CShader()
 // Loads a shader, stored as a text file with filename sFile.  The shader is of type iType (vertex, fragment, geometry, etc.)
 bool CShader::LoadShader(string sFile, int iType)
 {
-	vector<string> sLines;
+	if (!ReadSource(sFile, iType))
+		return false;
+	Compile();
+	return CheckCompileStatus();
+}
 
-	if(!GetLinesFromFile(sFile, false, &sLines)) {
+// Reads the source of a shader, including any files it includes
+bool CShader::ReadSource(string sFile, int iType, const vector<string>& defines)
+{
+	m_sLines.clear();
+	if(!GetLinesFromFile(sFile, false, &m_sLines)) {
 		char message[1024];
 		sprintf_s(message, "Cannot load shader\n%s\n", sFile.c_str());
 		MessageBox(NULL, message, "Error", MB_ICONERROR);
 		return false;
 	}
 
-	const char** sProgram = new const char*[(int)sLines.size()];
-	for (int i = 0; i < (int)sLines.size(); i++) 
-		sProgram[i] = sLines[i].c_str();
+	// #version has to stay the first line, so the defines go straight after it
+	int iInsertAt = (!m_sLines.empty() && m_sLines[0].find("#version") != string::npos) ? 1 : 0;
+	for (int i = 0; i < (int)defines.size(); i++)
+		m_sLines.insert(m_sLines.begin() + iInsertAt + i, "#define " + defines[i] + "\n");
+
+	m_sFile = sFile;
+	m_iType = iType;
+	return true;
+}
+
+// Starts compiling the source read by ReadSource.  The driver may finish the compile in the background.
+void CShader::Compile()
+{
+	const char** sProgram = new const char*[(int)m_sLines.size()];
+	for (int i = 0; i < (int)m_sLines.size(); i++) 
+		sProgram[i] = m_sLines[i].c_str();
 	
-	m_uiShader = glCreateShader(iType);
+	m_uiShader = glCreateShader(m_iType);
 
-	glShaderSource(m_uiShader, (int)sLines.size(), sProgram, NULL);
+	glShaderSource(m_uiShader, (int)m_sLines.size(), sProgram, NULL);
 	glCompileShader(m_uiShader);
 
 	delete[] sProgram;
+}
 
+// Waits for the compile to finish and reports any errors
+bool CShader::CheckCompileStatus()
+{
+	int iType = m_iType;
+	string sFile = m_sFile;
 	int iCompilationStatus;
 	glGetShaderiv(m_uiShader, GL_COMPILE_STATUS, &iCompilationStatus);
 
@@ -53,6 +80,8 @@ bool CShader::LoadShader(string sFile, int iType)
 			sprintf_s(sShaderType, "tesselation control shader");
 		else if (iType == GL_TESS_EVALUATION_SHADER)
 			sprintf_s(sShaderType, "tesselation evaluation shader");
+		else if (iType == GL_COMPUTE_SHADER)
+			sprintf_s(sShaderType, "compute shader");
 		else
 			sprintf_s(sShaderType, "unknown shader type");
 
@@ -61,12 +90,21 @@ bool CShader::LoadShader(string sFile, int iType)
 		MessageBox(NULL, sFinalMessage, "Error", MB_ICONERROR);
 		return false;
 	}
-	m_iType = iType;
 	m_bLoaded = true;
 
 	return true;
 }
 
+const vector<string>& CShader::GetSource()
+{
+	return m_sLines;
+}
+
+int CShader::GetType()
+{
+	return m_iType;
+}
+
 
 // Loads a file into a vector of strings (vResult)
 bool CShader::GetLinesFromFile(string sFile, bool bIncludePart, vector<string>* vResult)
@@ -168,8 +206,20 @@ bool CShaderProgram::AddShaderToProgram(CShader* shShader)
 
 // Performs final linkage of the OpenGL shader program
 bool CShaderProgram::LinkProgram()
+{
+	StartLink();
+	return CheckLinkStatus();
+}
+
+// Starts linking.  The driver may finish the link in the background.
+void CShaderProgram::StartLink()
 {
 	glLinkProgram(m_uiProgram);
+}
+
+// Waits for the link to finish and reports any errors
+bool CShaderProgram::CheckLinkStatus()
+{
 	int iLinkStatus;
 	glGetProgramiv(m_uiProgram, GL_LINK_STATUS, &iLinkStatus);
 
@@ -188,6 +238,47 @@ bool CShaderProgram::LinkProgram()
 	return m_bLinked;
 }
 
+bool CShaderProgram::IsLinked()
+{
+	return m_bLinked;
+}
+
+// Asks the driver to keep the binary of the program when it is next linked
+void CShaderProgram::SetBinaryRetrievable()
+{
+	glProgramParameteri(m_uiProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+// Gets the driver specific binary of a linked program
+bool CShaderProgram::GetBinary(vector<BYTE>& data, GLenum& format)
+{
+	if (!m_bLinked)
+		return false;
+
+	int iLength = 0;
+	glGetProgramiv(m_uiProgram, GL_PROGRAM_BINARY_LENGTH, &iLength);
+	if (iLength <= 0)
+		return false;
+
+	data.resize(iLength);
+	glGetProgramBinary(m_uiProgram, iLength, NULL, &format, &data[0]);
+	return true;
+}
+
+// Creates the program from a binary returned by GetBinary.  This fails, without reporting an error, if the binary
+// was made by a different driver; the caller should then build the program from source.
+bool CShaderProgram::LoadBinary(const vector<BYTE>& data, GLenum format)
+{
+	if (data.empty())
+		return false;
+
+	glProgramBinary(m_uiProgram, format, &data[0], (GLsizei)data.size());
+	int iLinkStatus;
+	glGetProgramiv(m_uiProgram, GL_LINK_STATUS, &iLinkStatus);
+	m_bLinked = iLinkStatus == GL_TRUE;
+	return m_bLinked;
+}
+
 // Deletes the program and frees memory on the GPU
 void CShaderProgram::DeleteProgram()
 {
@@ -214,94 +305,137 @@ UINT CShaderProgram::GetProgramID()
 
 // Setting floats
 
-void CShaderProgram::SetUniform(string sName, float* fValues, int iCount)
+void CShaderProgram::SetUniform(const char* sName, float* fValues, int iCount)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniform1fv(iLoc, iCount, fValues);
 }
 
-void CShaderProgram::SetUniform(string sName, const float fValue)
+void CShaderProgram::SetUniform(const char* sName, const float fValue)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniform1fv(iLoc, 1, &fValue);
 }
 
 // Setting vectors
 
-void CShaderProgram::SetUniform(string sName, glm::vec2* vVectors, int iCount)
+void CShaderProgram::SetUniform(const char* sName, glm::vec2* vVectors, int iCount)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniform2fv(iLoc, iCount, (GLfloat*)vVectors);
 }
 
-void CShaderProgram::SetUniform(string sName, const glm::vec2 vVector)
+void CShaderProgram::SetUniform(const char* sName, const glm::vec2 vVector)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniform2fv(iLoc, 1, (GLfloat*)&vVector);
 }
 
-void CShaderProgram::SetUniform(string sName, glm::vec3* vVectors, int iCount)
+void CShaderProgram::SetUniform(const char* sName, glm::vec3* vVectors, int iCount)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniform3fv(iLoc, iCount, (GLfloat*)vVectors);
 }
 
-void CShaderProgram::SetUniform(string sName, const glm::vec3 vVector)
+void CShaderProgram::SetUniform(const char* sName, const glm::vec3 vVector)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniform3fv(iLoc, 1, (GLfloat*)&vVector);
 }
 
-void CShaderProgram::SetUniform(string sName, glm::vec4* vVectors, int iCount)
+void CShaderProgram::SetUniform(const char* sName, glm::vec4* vVectors, int iCount)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniform4fv(iLoc, iCount, (GLfloat*)vVectors);
 }
 
-void CShaderProgram::SetUniform(string sName, const glm::vec4 vVector)
+void CShaderProgram::SetUniform(const char* sName, const glm::vec4 vVector)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniform4fv(iLoc, 1, (GLfloat*)&vVector);
 }
 
 // Setting 3x3 matrices
 
-void CShaderProgram::SetUniform(string sName, glm::mat3* mMatrices, int iCount)
+void CShaderProgram::SetUniform(const char* sName, glm::mat3* mMatrices, int iCount)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniformMatrix3fv(iLoc, iCount, FALSE, (GLfloat*)mMatrices);
 }
 
-void CShaderProgram::SetUniform(string sName, const glm::mat3 mMatrix)
+void CShaderProgram::SetUniform(const char* sName, const glm::mat3 mMatrix)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniformMatrix3fv(iLoc, 1, FALSE, (GLfloat*)&mMatrix);
 }
 
 // Setting 4x4 matrices
 
-void CShaderProgram::SetUniform(string sName, glm::mat4* mMatrices, int iCount)
+void CShaderProgram::SetUniform(const char* sName, glm::mat4* mMatrices, int iCount)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniformMatrix4fv(iLoc, iCount, FALSE, (GLfloat*)mMatrices);
 }
 
-void CShaderProgram::SetUniform(string sName, const glm::mat4 mMatrix)
+void CShaderProgram::SetUniform(const char* sName, const glm::mat4 mMatrix)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniformMatrix4fv(iLoc, 1, FALSE, (GLfloat*)&mMatrix);
 }
 
 // Setting integers
 
-void CShaderProgram::SetUniform(string sName, int* iValues, int iCount)
+void CShaderProgram::SetUniform(const char* sName, int* iValues, int iCount)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniform1iv(iLoc, iCount, iValues);
 }
 
-void CShaderProgram::SetUniform(string sName, const int iValue)
+void CShaderProgram::SetUniform(const char* sName, const int iValue)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniform1i(iLoc, iValue);
-}
\ No newline at end of file
+}
+CShaderVariants::CShaderVariants()
+{}
+
+void CShaderVariants::SetFeatures(const vector<string>& features)
+{
+	m_features = features;
+}
+
+vector<string> CShaderVariants::GetDefines(unsigned int mask)
+{
+	vector<string> defines;
+	for (int i = 0; i < (int)m_features.size(); i++) {
+		if (mask & (1u << i))
+			defines.push_back(m_features[i]);
+	}
+	return defines;
+}
+
+void CShaderVariants::AddVariant(unsigned int mask, CShaderProgram* program)
+{
+	m_variants[mask] = program;
+}
+
+CShaderProgram* CShaderVariants::GetVariant(unsigned int mask)
+{
+	map<unsigned int, CShaderProgram*>::iterator it = m_variants.find(mask);
+	if (it == m_variants.end())
+		return NULL;
+	return it->second;
+}
+
+int CShaderVariants::GetNumVariants()
+{
+	return (int)m_variants.size();
+}
+
+vector<CShaderProgram*> CShaderVariants::GetPrograms()
+{
+	vector<CShaderProgram*> programs;
+	for (map<unsigned int, CShaderProgram*>::iterator it = m_variants.begin(); it != m_variants.end(); ++it)
+		programs.push_back(it->second);
+	return programs;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Common.h"
+#include <map>
 
 
 // A class that provides a wrapper around an OpenGL shader
@@ -13,6 +14,15 @@ public:
 	bool LoadShader(string sFile, int iType);
 	void DeleteShader();
 
+	// LoadShader in steps, so that many shaders can be compiled before any of them is waited on.  ReadSource
+	// reads the file (with its includes), Compile starts the compile and CheckCompileStatus waits for the result.
+	// Each define is inserted as "#define <define>" after the #version line, so one file can build several variants.
+	bool ReadSource(string sFile, int iType, const vector<string>& defines = vector<string>());
+	void Compile();
+	bool CheckCompileStatus();
+	const vector<string>& GetSource();
+	int GetType();
+
 	bool GetLinesFromFile(string sFile, bool bIncludePart, vector<string>* vResult);
 
 	bool IsLoaded();
@@ -23,6 +33,8 @@ private:
 	UINT m_uiShader; // ID of shader
 	int m_iType; // GL_VERTEX_SHADER, GL_FRAGMENT_SHADER...
 	bool m_bLoaded; // Whether shader was loaded and compiled
+	string m_sFile; // File the source was read from
+	vector<string> m_sLines; // Source, with includes expanded
 };
 
 
@@ -38,36 +50,74 @@ public:
 	bool AddShaderToProgram(CShader* shShader);
 	bool LinkProgram();
 
+	// LinkProgram in two steps: StartLink starts the link and CheckLinkStatus waits for the result
+	void StartLink();
+	bool CheckLinkStatus();
+	bool IsLinked();
+
+	// Program binaries, used to skip compiling and linking on later runs.  SetBinaryRetrievable must be called
+	// before linking for GetBinary to work.
+	void SetBinaryRetrievable();
+	bool GetBinary(vector<BYTE>& data, GLenum& format);
+	bool LoadBinary(const vector<BYTE>& data, GLenum format);
+
 	void UseProgram();
 
 	UINT GetProgramID();
 
 	// Setting vectors
-	void SetUniform(string sName, glm::vec2* vVectors, int iCount = 1);
-	void SetUniform(string sName, const glm::vec2 vVector);
-	void SetUniform(string sName, glm::vec3* vVectors, int iCount = 1);
-	void SetUniform(string sName, const glm::vec3 vVector);
-	void SetUniform(string sName, glm::vec4* vVectors, int iCount = 1);
-	void SetUniform(string sName, const glm::vec4 vVector);
+	void SetUniform(const char* sName, glm::vec2* vVectors, int iCount = 1);
+	void SetUniform(const char* sName, const glm::vec2 vVector);
+	void SetUniform(const char* sName, glm::vec3* vVectors, int iCount = 1);
+	void SetUniform(const char* sName, const glm::vec3 vVector);
+	void SetUniform(const char* sName, glm::vec4* vVectors, int iCount = 1);
+	void SetUniform(const char* sName, const glm::vec4 vVector);
 
 	// Setting floats
-	void SetUniform(string sName, float* fValues, int iCount = 1);
-	void SetUniform(string sName, const float fValue);
+	void SetUniform(const char* sName, float* fValues, int iCount = 1);
+	void SetUniform(const char* sName, const float fValue);
 
 	// Setting 3x3 matrices
-	void SetUniform(string sName, glm::mat3* mMatrices, int iCount = 1);
-	void SetUniform(string sName, const glm::mat3 mMatrix);
+	void SetUniform(const char* sName, glm::mat3* mMatrices, int iCount = 1);
+	void SetUniform(const char* sName, const glm::mat3 mMatrix);
 
 	// Setting 4x4 matrices
-	void SetUniform(string sName, glm::mat4* mMatrices, int iCount = 1);
-	void SetUniform(string sName, const glm::mat4 mMatrix);
+	void SetUniform(const char* sName, glm::mat4* mMatrices, int iCount = 1);
+	void SetUniform(const char* sName, const glm::mat4 mMatrix);
 
 	// Setting integers
-	void SetUniform(string sName, int* iValues, int iCount = 1);
-	void SetUniform(string sName, const int iValue);
+	void SetUniform(const char* sName, int* iValues, int iCount = 1);
+	void SetUniform(const char* sName, const int iValue);
 
 
 private:
 	UINT m_uiProgram; // ID of program
 	bool m_bLinked; // Whether program was linked and is ready to use
+};
+
+
+// A family of programs built from the same shader files with different sets of #defines.  Each define is a feature;
+// bit i of a feature mask turns on feature i.  Only the masks that are actually used need to be built.
+class CShaderVariants
+{
+public:
+	CShaderVariants();
+
+	void SetFeatures(const vector<string>& features);
+
+	// The defines that make up the variant for a feature mask
+	vector<string> GetDefines(unsigned int mask);
+
+	void AddVariant(unsigned int mask, CShaderProgram* program);
+
+	// Returns the program for a feature mask, or NULL if that variant was not built
+	CShaderProgram* GetVariant(unsigned int mask);
+	int GetNumVariants();
+
+	// Every variant's program, in order of feature mask.  The variants do not own their programs.
+	vector<CShaderProgram*> GetPrograms();
+
+private:
+	vector<string> m_features;
+	map<unsigned int, CShaderProgram*> m_variants;
 };
\ No newline at end of file
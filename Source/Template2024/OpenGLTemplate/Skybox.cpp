@@ -1,6 +1,7 @@
 #include "Common.h"
 
 #include "skybox.h"
+#include "ResourceTracker.h"
 
 
 CSkybox::CSkybox()
@@ -57,13 +58,12 @@ void CSkybox::Create(float size)
 	};
 
 	glm::vec4 vColour = glm::vec4(1, 1, 1, 1);
-	for (int i = 0; i < 24; i++) {
-		m_vbo.AddData(&vSkyBoxVertices[i], sizeof(glm::vec3));
-		m_vbo.AddData(&vSkyBoxTexCoords[i%4], sizeof(glm::vec2));
-		m_vbo.AddData(&vSkyBoxNormals[i/4], sizeof(glm::vec3));
-	}
+	CVertexStream<TexturedVertex> vertices;
+	vertices.Reserve(24);
+	for (int i = 0; i < 24; i++)
+		vertices.Add(TexturedVertex(vSkyBoxVertices[i], vSkyBoxTexCoords[i%4], vSkyBoxNormals[i/4]));
 
-	m_vbo.UploadDataToGPU(GL_STATIC_DRAW);
+	m_vbo.UploadDataToGPU(vertices, GL_STATIC_DRAW, "skybox");
 
 	// Set the vertex attribute locations
 	GLsizei istride = 2*sizeof(glm::vec3)+sizeof(glm::vec2);
@@ -77,7 +77,19 @@ void CSkybox::Create(float size)
 	// Normal vectors
 	glEnableVertexAttribArray(2);
 	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, istride, (void*)(sizeof(glm::vec3)+sizeof(glm::vec2)));
-	
+
+	// Two triangles per face with the same winding as the face's strip, so the whole box is a single draw
+	GLuint indices[36];
+	for (int i = 0; i < 6; i++) {
+		GLuint faceIndices[6] = { 0, 1, 2, 2, 1, 3 };
+		for (int j = 0; j < 6; j++)
+			indices[i*6 + j] = i*4 + faceIndices[j];
+	}
+	glGenBuffers(1, &m_ibo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+	CResourceTracker::TrackBuffer(m_ibo, sizeof(indices), "skybox");
+	glBindVertexArray(0);
 }
 
 // Render the skybox
@@ -86,13 +98,21 @@ void CSkybox::Render(int textureUnit)
 	glDepthMask(0);
 	glBindVertexArray(m_vao);
 	m_cubemapTexture.Bind(textureUnit);
-	for (int i = 0; i < 6; i++) {
-		//m_textures[i].Bind();
-		glDrawArrays(GL_TRIANGLE_STRIP, i*4, 4);
-	}
+	glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
 	glDepthMask(1);
 }
 
+// Add the skybox to the render queue as one draw.  Depth writes are turned off by the item flags; the shader puts
+// the box on the far plane, so it should be submitted to the background layer, which is drawn after the opaque one.
+void CSkybox::Submit(CRenderQueue* queue, RenderItem item, int textureUnit)
+{
+	item.vao = m_vao;
+	item.flags |= RENDER_FLAG_NO_DEPTH_WRITE;
+	item.SetTexture(GL_TEXTURE_CUBE_MAP, m_cubemapTexture.GetTextureID(), m_cubemapTexture.GetSamplerID(), textureUnit);
+	item.SetDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT);
+	queue->Submit(item);
+}
+
 // Release the storage assocaited with the skybox
 void CSkybox::Release()
 {
@@ -100,5 +120,7 @@ void CSkybox::Release()
 		//m_textures[i].Release();
 	m_cubemapTexture.Release();
 	glDeleteVertexArrays(1, &m_vao);
+	CResourceTracker::UntrackBuffer(m_ibo);
+	glDeleteBuffers(1, &m_ibo);
 	m_vbo.Release();
 }
\ No newline at end of file
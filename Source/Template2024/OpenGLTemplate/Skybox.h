@@ -3,6 +3,7 @@
 #include "Texture.h"
 #include "VertexBufferObject.h"
 #include "Cubemap.h"
+#include "RenderQueue.h"
 
 // This is a class for creating and rendering a skybox
 class CSkybox
@@ -12,10 +13,12 @@ public:
 	~CSkybox();
 	void Create(float size);
 	void Render(int textureUnit);
+	void Submit(CRenderQueue* queue, RenderItem item, int textureUnit);
 	void Release();
 
 private:
 	UINT m_vao;
+	UINT m_ibo;
 	CVertexBufferObject m_vbo;
 	CCubemap m_cubemapTexture;
 	
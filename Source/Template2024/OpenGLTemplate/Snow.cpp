@@ -1,49 +1,308 @@
 #include "Common.h"
 #include "Snow.h"
-#define BUFFER_OFFSET(i) ((char *)NULL + (i))
+#include "ResourceTracker.h"
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+#define SNOW_WORKGROUP_SIZE 256
+#define SNOW_PARTICLES_PER_JOB 16384
 
 CSnow::CSnow()
-{}
+{
+	m_pRenderProgram = NULL;
+	m_pUpdateProgram = NULL;
+	m_pJobSystem = NULL;
+	m_pStreamBuffer = NULL;
+	m_x = NULL;
+	m_y = NULL;
+	m_z = NULL;
+	m_speed = NULL;
+	m_upload = NULL;
+	m_vao = 0;
+	m_quadBuffer = 0;
+	m_particleBuffer = 0;
+	m_drawBuffer = 0;
+	m_drawOffset = 0;
+	m_maxParticles = 0;
+	m_numParticles = 0;
+	m_gpuSimulation = false;
+	m_volumeSize = glm::vec3(300.0f, 150.0f, 300.0f);
+	m_wind = glm::vec3(3.0f, 0.0f, 1.5f);
+	m_flakeSize = 0.35f;
+	m_time = 0.0f;
+}
 
 CSnow::~CSnow()
-{}
+{
+	Release();
+}
+
+void CSnow::Create(CShaderProgram* renderProgram, CShaderProgram* updateProgram, CJobSystem* jobSystem, int maxParticles)
+{
+	m_pRenderProgram = renderProgram;
+	m_pUpdateProgram = updateProgram;
+	m_pJobSystem = jobSystem;
+	m_gpuSimulation = updateProgram != NULL;
+
+	// Round up to a whole number of SSE vectors so the CPU update never needs a scalar tail
+	m_maxParticles = (maxParticles + 3) & ~3;
+	m_x = (float*)_mm_malloc(m_maxParticles * sizeof(float), 16);
+	m_y = (float*)_mm_malloc(m_maxParticles * sizeof(float), 16);
+	m_z = (float*)_mm_malloc(m_maxParticles * sizeof(float), 16);
+	m_speed = (float*)_mm_malloc(m_maxParticles * sizeof(float), 16);
+	m_upload = (glm::vec4*)_mm_malloc(m_maxParticles * sizeof(glm::vec4), 16);
+
+	// Scatter the flakes through the box around the origin.  The first update moves the box to the camera.
+	srand(4321);
+	for (int i = 0; i < m_maxParticles; i++) {
+		m_x[i] = (rand() / (float)RAND_MAX - 0.5f) * m_volumeSize.x;
+		m_y[i] = (rand() / (float)RAND_MAX - 0.5f) * m_volumeSize.y;
+		m_z[i] = (rand() / (float)RAND_MAX - 0.5f) * m_volumeSize.z;
+		m_speed[i] = 6.0f + 8.0f * (rand() / (float)RAND_MAX);
+	}
+
+	// Corners of the quad drawn for each flake
+	glm::vec2 corners[4] = { glm::vec2(-1, -1), glm::vec2(1, -1), glm::vec2(-1, 1), glm::vec2(1, 1) };
+
+	glGenVertexArrays(1, &m_vao);
+	glBindVertexArray(m_vao);
+
+	glGenBuffers(1, &m_quadBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, m_quadBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), 0);
+
+	// The particle buffer is the instance data of the draw and the storage buffer of the compute shader
+	glGenBuffers(1, &m_particleBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, m_particleBuffer);
+	glBufferData(GL_ARRAY_BUFFER, m_maxParticles * sizeof(glm::vec4), NULL, GL_DYNAMIC_DRAW);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), 0);
+	glVertexAttribDivisor(1, 1);
+
+	glBindVertexArray(0);
+
+	CResourceTracker::TrackBuffer(m_quadBuffer, sizeof(corners), "snow");
+	m_drawBuffer = m_particleBuffer;
+	m_drawOffset = 0;
 
-void CSnow::Create()
+	CResourceTracker::TrackBuffer(m_particleBuffer, m_maxParticles * sizeof(glm::vec4), "snow");
+	CResourceTracker::TrackCpuCopy(m_upload, m_maxParticles * sizeof(glm::vec4), "snow");
+}
+
+void CSnow::SetStreamBuffer(CStreamBuffer* streamBuffer)
 {
-    // Define the vertices of the triangle
-    std::vector<glm::vec3> triangleVertices = {
-        glm::vec3(-0.5f, -0.5f, 0.0f),
-        glm::vec3(0.5f, -0.5f, 0.0f),
-        glm::vec3(0.0f, 0.5f, 0.0f)
-    };
+	m_pStreamBuffer = streamBuffer;
+}
 
-    // Use VAO to store state associated with vertices
-    glGenVertexArrays(1, &m_vao);
-    glBindVertexArray(m_vao);
+void CSnow::SetParticleCount(int count)
+{
+	if (count < 0)
+		count = 0;
+	if (count > m_maxParticles)
+		count = m_maxParticles;
+	m_numParticles = count;
 
-    // Create a VBO and bind it
-    m_vbo.Create();
-    m_vbo.Bind();
+	// The compute shader works on the buffer in place, so it needs the flakes that have just been switched on
+	if (m_gpuSimulation)
+		UploadParticles();
+}
 
-    // Upload vertex data to VBO
-    m_vbo.AddVertexData(triangleVertices.data(), triangleVertices.size() * sizeof(glm::vec3));
+int CSnow::GetParticleCount()
+{
+	return m_numParticles;
+}
 
-    // Set up vertex attribute pointers
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
+int CSnow::GetMaxParticles()
+{
+	return m_maxParticles;
 }
 
+void CSnow::SetGpuSimulation(bool gpu)
+{
+	if (gpu && m_pUpdateProgram == NULL)
+		return;
+	if (gpu && !m_gpuSimulation)
+		UploadParticles();
+	m_gpuSimulation = gpu;
+}
 
-void CSnow::Render()
+bool CSnow::IsGpuSimulation()
 {
-    glBindVertexArray(m_vao);
-    glDrawArrays(GL_TRIANGLES, 0, 3);
-    glBindVertexArray(0);
+	return m_gpuSimulation;
+}
+
+bool CSnow::IsGpuSimulationSupported()
+{
+	return m_pUpdateProgram != NULL;
+}
+
+// Copy the CPU arrays into the particle buffer
+void CSnow::UploadParticles()
+{
+	for (int i = 0; i < m_numParticles; i++)
+		m_upload[i] = glm::vec4(m_x[i], m_y[i], m_z[i], m_speed[i]);
+	glBindBuffer(GL_ARRAY_BUFFER, m_particleBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, m_numParticles * sizeof(glm::vec4), m_upload);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	m_drawBuffer = m_particleBuffer;
+	m_drawOffset = 0;
+}
+
+void CSnow::Update(float dt, const glm::vec3& centre)
+{
+	m_time += dt;
+	if (m_numParticles == 0)
+		return;
+
+	if (!m_gpuSimulation) {
+		UpdateCPU(dt, centre);
+		return;
+	}
+
+	m_pUpdateProgram->UseProgram();
+	m_pUpdateProgram->SetUniform("particleCount", m_numParticles);
+	m_pUpdateProgram->SetUniform("dt", dt);
+	m_pUpdateProgram->SetUniform("centre", centre);
+	m_pUpdateProgram->SetUniform("volumeSize", m_volumeSize);
+	m_pUpdateProgram->SetUniform("wind", m_wind);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_particleBuffer);
+	glDispatchCompute((m_numParticles + SNOW_WORKGROUP_SIZE - 1) / SNOW_WORKGROUP_SIZE, 1, 1);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+
+	// The draw reads the buffer as instanced vertex data
+	glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+// Split the flakes into blocks of whole SSE vectors, update them as jobs and upload the result
+void CSnow::UpdateCPU(float dt, const glm::vec3& centre)
+{
+	int numVectors = (m_numParticles + 3) / 4;
+
+	// Write straight into this frame's part of the stream buffer if it has room, otherwise into the CPU copy
+	StreamAllocation allocation;
+	bool streamed = m_pStreamBuffer != NULL && m_pStreamBuffer->Allocate(numVectors * 4 * sizeof(glm::vec4), sizeof(glm::vec4), allocation);
+	glm::vec4* output = streamed ? (glm::vec4*)allocation.data : m_upload;
+
+	m_pJobSystem->ParallelFor(numVectors, SNOW_PARTICLES_PER_JOB / 4, [this, dt, &centre, output](int first, int last) {
+		UpdateRange(first * 4, last * 4, dt, centre, output);
+	});
+
+	if (streamed) {
+		m_drawBuffer = allocation.buffer;
+		m_drawOffset = allocation.offset;
+		return;
+	}
+
+	// Orphan the buffer so the driver does not have to wait for last frame's draw to finish with it
+	glBindBuffer(GL_ARRAY_BUFFER, m_particleBuffer);
+	glBufferData(GL_ARRAY_BUFFER, m_maxParticles * sizeof(glm::vec4), NULL, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, m_numParticles * sizeof(glm::vec4), m_upload);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	m_drawBuffer = m_particleBuffer;
+	m_drawOffset = 0;
+}
+
+// Update flakes [first, last), which must be a whole number of SSE vectors, and write them out interleaved to output
+void CSnow::UpdateRange(int first, int last, float dt, const glm::vec3& centre, glm::vec4* output)
+{
+	const __m128 vdt = _mm_set1_ps(dt);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 windX = _mm_set1_ps(m_wind.x * dt);
+	const __m128 windY = _mm_set1_ps(m_wind.y * dt);
+	const __m128 windZ = _mm_set1_ps(m_wind.z * dt);
+
+	// Wrapping is p = boxMin + mod(p - boxMin, size), where boxMin is the corner of the box around centre
+	const __m128 minX = _mm_set1_ps(centre.x - 0.5f * m_volumeSize.x);
+	const __m128 minY = _mm_set1_ps(centre.y - 0.5f * m_volumeSize.y);
+	const __m128 minZ = _mm_set1_ps(centre.z - 0.5f * m_volumeSize.z);
+	const __m128 sizeX = _mm_set1_ps(m_volumeSize.x);
+	const __m128 sizeY = _mm_set1_ps(m_volumeSize.y);
+	const __m128 sizeZ = _mm_set1_ps(m_volumeSize.z);
+	const __m128 invSizeX = _mm_set1_ps(1.0f / m_volumeSize.x);
+	const __m128 invSizeY = _mm_set1_ps(1.0f / m_volumeSize.y);
+	const __m128 invSizeZ = _mm_set1_ps(1.0f / m_volumeSize.z);
+
+	for (int i = first; i < last; i += 4) {
+		__m128 speed = _mm_load_ps(m_speed + i);
+		__m128 rx = _mm_sub_ps(_mm_add_ps(_mm_load_ps(m_x + i), windX), minX);
+		__m128 ry = _mm_sub_ps(_mm_sub_ps(_mm_add_ps(_mm_load_ps(m_y + i), windY), _mm_mul_ps(speed, vdt)), minY);
+		__m128 rz = _mm_sub_ps(_mm_add_ps(_mm_load_ps(m_z + i), windZ), minZ);
+
+		// floor(r / size) with SSE2: truncate, then subtract one where truncation rounded a negative value up
+		__m128 tx = _mm_mul_ps(rx, invSizeX);
+		__m128 ty = _mm_mul_ps(ry, invSizeY);
+		__m128 tz = _mm_mul_ps(rz, invSizeZ);
+		__m128 fx = _mm_cvtepi32_ps(_mm_cvttps_epi32(tx));
+		__m128 fy = _mm_cvtepi32_ps(_mm_cvttps_epi32(ty));
+		__m128 fz = _mm_cvtepi32_ps(_mm_cvttps_epi32(tz));
+		fx = _mm_sub_ps(fx, _mm_and_ps(_mm_cmpgt_ps(fx, tx), one));
+		fy = _mm_sub_ps(fy, _mm_and_ps(_mm_cmpgt_ps(fy, ty), one));
+		fz = _mm_sub_ps(fz, _mm_and_ps(_mm_cmpgt_ps(fz, tz), one));
+
+		__m128 x = _mm_add_ps(minX, _mm_sub_ps(rx, _mm_mul_ps(fx, sizeX)));
+		__m128 y = _mm_add_ps(minY, _mm_sub_ps(ry, _mm_mul_ps(fy, sizeY)));
+		__m128 z = _mm_add_ps(minZ, _mm_sub_ps(rz, _mm_mul_ps(fz, sizeZ)));
+		_mm_store_ps(m_x + i, x);
+		_mm_store_ps(m_y + i, y);
+		_mm_store_ps(m_z + i, z);
+
+		// Four x, y, z, speed rows become four xyzw flakes
+		_MM_TRANSPOSE4_PS(x, y, z, speed);
+		float* out = (float*)(output + i);
+		_mm_store_ps(out, x);
+		_mm_store_ps(out + 4, y);
+		_mm_store_ps(out + 8, z);
+		_mm_store_ps(out + 12, speed);
+	}
+}
+
+void CSnow::Render(const glm::mat4& viewMatrix, const glm::mat4& projMatrix)
+{
+	if (m_numParticles == 0)
+		return;
+
+	m_pRenderProgram->UseProgram();
+	m_pRenderProgram->SetUniform("matrices.viewMatrix", viewMatrix);
+	m_pRenderProgram->SetUniform("matrices.projMatrix", projMatrix);
+	m_pRenderProgram->SetUniform("flakeSize", m_flakeSize);
+	m_pRenderProgram->SetUniform("time", m_time);
+	m_pRenderProgram->SetUniform("fadeDistance", 0.5f * glm::min(m_volumeSize.x, m_volumeSize.z));
+
+	// Flakes are blended over the scene and do not hide each other
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDepthMask(0);
+
+	// Point the instance data at wherever this frame's flakes are
+	glBindVertexArray(m_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, m_drawBuffer);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)m_drawOffset);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, m_numParticles);
+	glBindVertexArray(0);
+
+	glDepthMask(1);
+	glDisable(GL_BLEND);
 }
 
 void CSnow::Release()
 {
-    // Unbind VAO and VBO
-    glBindVertexArray(0);
-    m_vbo.Release();
+	if (m_vao != 0) {
+		CResourceTracker::UntrackBuffer(m_quadBuffer);
+		CResourceTracker::UntrackBuffer(m_particleBuffer);
+		CResourceTracker::UntrackCpuCopy(m_upload);
+		glDeleteBuffers(1, &m_quadBuffer);
+		glDeleteBuffers(1, &m_particleBuffer);
+		glDeleteVertexArrays(1, &m_vao);
+		m_vao = 0;
+	}
+	_mm_free(m_x);
+	_mm_free(m_y);
+	_mm_free(m_z);
+	_mm_free(m_speed);
+	_mm_free(m_upload);
+	m_x = m_y = m_z = m_speed = NULL;
+	m_upload = NULL;
 }
@@ -1,23 +1,72 @@
 #pragma once
 
-#include "Texture.h"
-#include "VertexBufferObjectIndexed.h"
-#include "VertexBufferObject.h"
+#include "Common.h"
+#include "Shaders.h"
+#include "JobSystem.h"
+#include "StreamBuffer.h"
 
-// Class for generating a unit sphere
+// Falling snow.  Every flake is a vec4 (xyz position, w fall speed) in one buffer that is drawn as an instanced
+// camera facing quad.  The flakes live in a box around the camera: a flake that leaves one side of the box comes
+// back in at the other, so the density around the viewer is constant however far the camera moves.
+//
+// The simulation runs in a compute shader when the context supports OpenGL 4.3.  Otherwise it runs on the CPU,
+// four flakes at a time with SSE, split into blocks run by the job system, and the result is uploaded each frame.
+// With a stream buffer the jobs write the flakes straight into its mapped memory and the draw reads them from there.
 class CSnow
 {
 public:
 	CSnow();
 	~CSnow();
-	void Create();
-	void Render();
+
+	// renderProgram draws the flakes.  updateProgram is the simulation compute shader, or NULL to always simulate on the CPU.
+	void Create(CShaderProgram* renderProgram, CShaderProgram* updateProgram, CJobSystem* jobSystem, int maxParticles = 1000000);
+
+	// Stream the CPU simulation's results through streamBuffer, or NULL to upload them into the particle buffer
+	void SetStreamBuffer(CStreamBuffer* streamBuffer);
+
+	// Move the flakes on by dt seconds and wrap them into the box around centre
+	void Update(float dt, const glm::vec3& centre);
+	void Render(const glm::mat4& viewMatrix, const glm::mat4& projMatrix);
+
+	// Number of flakes simulated and drawn, up to the maximum given to Create
+	void SetParticleCount(int count);
+	int GetParticleCount();
+	int GetMaxParticles();
+
+	void SetGpuSimulation(bool gpu);
+	bool IsGpuSimulation();
+	bool IsGpuSimulationSupported();
+
 	void Release();
+
 private:
+	void UpdateCPU(float dt, const glm::vec3& centre);
+	void UpdateRange(int first, int last, float dt, const glm::vec3& centre, glm::vec4* output);
+	void UploadParticles();
+
+	CShaderProgram* m_pRenderProgram;
+	CShaderProgram* m_pUpdateProgram;
+	CJobSystem* m_pJobSystem;
+	CStreamBuffer* m_pStreamBuffer;
+
+	// CPU copy of the flakes, one array per component so that SSE can work on four flakes at once
+	float* m_x;
+	float* m_y;
+	float* m_z;
+	float* m_speed;
+	glm::vec4* m_upload;	// Interleaved copy of the arrays in the layout of the GPU buffer
+
 	UINT m_vao;
-	CVertexBufferObjectIndexed m_vbo;
-	CTexture m_texture;
-	string m_directory;
-	string m_filename;
-	int m_numTriangles;
+	UINT m_quadBuffer;
+	UINT m_particleBuffer;
+	UINT m_drawBuffer;		// Where the draw reads the flakes: the particle buffer or the stream buffer
+	GLintptr m_drawOffset;
+	int m_maxParticles;
+	int m_numParticles;
+	bool m_gpuSimulation;
+
+	glm::vec3 m_volumeSize;
+	glm::vec3 m_wind;
+	float m_flakeSize;
+	float m_time;
 };
@@ -17,7 +17,7 @@ void CSphere::Create(string a_sDirectory, string a_sFilename, int slicesIn, int
 {
 	// check if filename passed in -- if so, load texture
 
-	m_texture.Load(a_sDirectory+a_sFilename);
+	m_texture.Load(a_sDirectory+a_sFilename, true, "sphere");
 
 	m_directory = a_sDirectory;
 	m_filename = a_sFilename;
@@ -35,6 +35,8 @@ void CSphere::Create(string a_sDirectory, string a_sFilename, int slicesIn, int
 	
 
 	// Compute vertex attributes and store in VBO
+	CVertexStream<TexturedVertex> vertices;
+	vertices.Reserve(stacksIn * (slicesIn + 1));
 	int vertexCount = 0;
 	for (int stacks = 0; stacks < stacksIn; stacks++) {
 		float phi = (stacks / (float) (stacksIn - 1)) * (float) M_PI;
@@ -45,9 +47,7 @@ void CSphere::Create(string a_sDirectory, string a_sFilename, int slicesIn, int
 			glm::vec2 t = glm::vec2(slices / (float) slicesIn, stacks / (float) stacksIn);
 			glm::vec3 n = v;
 
-			m_vbo.AddVertexData(&v, sizeof(glm::vec3));
-			m_vbo.AddVertexData(&t, sizeof(glm::vec2));
-			m_vbo.AddVertexData(&n, sizeof(glm::vec3));
+			vertices.Add(TexturedVertex(v, t, n));
 
 			vertexCount++;
 
@@ -55,6 +55,8 @@ void CSphere::Create(string a_sDirectory, string a_sFilename, int slicesIn, int
 	}
 
 	// Compute indices and store in VBO
+	CVertexStream<unsigned int> indices;
+	indices.Reserve(6 * stacksIn * slicesIn);
 	m_numTriangles = 0;
 	for (int stacks = 0; stacks < stacksIn; stacks++) {
 		for (int slices = 0; slices < slicesIn; slices++) {
@@ -66,20 +68,20 @@ void CSphere::Create(string a_sDirectory, string a_sFilename, int slicesIn, int
 			unsigned int index2 = stacks * (slicesIn+1) + nextSlice;
 			unsigned int index3 = nextStack * (slicesIn+1) + nextSlice;
 
-			m_vbo.AddIndexData(&index0, sizeof(unsigned int));
-			m_vbo.AddIndexData(&index1, sizeof(unsigned int));
-			m_vbo.AddIndexData(&index2, sizeof(unsigned int));
+			indices.Add(index0);
+			indices.Add(index1);
+			indices.Add(index2);
 			m_numTriangles++;
 
-			m_vbo.AddIndexData(&index2, sizeof(unsigned int));
-			m_vbo.AddIndexData(&index1, sizeof(unsigned int));
-			m_vbo.AddIndexData(&index3, sizeof(unsigned int));
+			indices.Add(index2);
+			indices.Add(index1);
+			indices.Add(index3);
 			m_numTriangles++;
 
 		}
 	}
 
-	m_vbo.UploadDataToGPU(GL_STATIC_DRAW);
+	m_vbo.UploadDataToGPU(vertices, indices, GL_STATIC_DRAW, "sphere");
 
 	GLsizei stride = 2*sizeof(glm::vec3)+sizeof(glm::vec2);
 
@@ -0,0 +1,351 @@
+#include "StaticBatch.h"
+#include "ResourceTracker.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <float.h>
+
+CStaticBatch::CStaticBatch()
+{
+	m_vao = 0;
+	m_vbo = 0;
+	m_ibo = 0;
+	m_indexType = GL_UNSIGNED_INT;
+	m_indexSize = sizeof(unsigned int);
+	m_visibleCells = 0;
+	m_submittedTriangles = 0;
+	m_lodPixelError = 1.0f;
+	m_lodEnabled = true;
+	m_pOcclusionCuller = NULL;
+}
+
+CStaticBatch::~CStaticBatch()
+{
+	Release();
+}
+
+void CStaticBatch::AddMesh(COpenAssetImportMesh* mesh, const glm::mat4& modelMatrix)
+{
+	const vector<Vertex>& vertices = mesh->GetVertices();
+	const vector<unsigned int>& indices = mesh->GetIndices();
+
+	// A mesh with levels of detail gets an object of its own, which chooses the level for all of its entries
+	int lodObject = -1;
+	glm::vec3 meshMin = glm::vec3(FLT_MAX);
+	glm::vec3 meshMax = glm::vec3(-FLT_MAX);
+	if (mesh->GetNumLods() > 1)
+		lodObject = (int)m_lodObjects.size();
+
+	for (unsigned int e = 0; e < mesh->GetNumEntries(); e++) {
+		unsigned int baseVertex, baseIndex, numIndices;
+		mesh->GetEntry(e, baseVertex, baseIndex, numIndices);
+
+		// Use the centre of the transformed entry to decide which cell it goes in
+		glm::vec3 boundsMin = glm::vec3(FLT_MAX);
+		glm::vec3 boundsMax = glm::vec3(-FLT_MAX);
+		for (unsigned int i = 0; i < numIndices; i++) {
+			glm::vec3 p = glm::vec3(modelMatrix * glm::vec4(vertices[baseVertex + indices[baseIndex + i]].m_pos, 1.0f));
+			boundsMin = glm::min(boundsMin, p);
+			boundsMax = glm::max(boundsMax, p);
+		}
+
+		Instance instance;
+		instance.mesh = mesh;
+		instance.modelMatrix = modelMatrix;
+		instance.entry = e;
+		instance.texture = mesh->GetEntryTexture(e);
+		instance.centre = (boundsMin + boundsMax) * 0.5f;
+		instance.cellX = 0;
+		instance.cellZ = 0;
+		instance.lodObject = lodObject;
+		m_instances.push_back(instance);
+		meshMin = glm::min(meshMin, boundsMin);
+		meshMax = glm::max(meshMax, boundsMax);
+	}
+
+	if (lodObject < 0)
+		return;
+
+	// The errors are in model units, so scale them by the largest scale of the model matrix
+	glm::mat3 m = glm::mat3(modelMatrix);
+	float scale = glm::max(glm::length(m[0]), glm::max(glm::length(m[1]), glm::length(m[2])));
+	LodObject object;
+	object.boundsMin = meshMin;
+	object.boundsMax = meshMax;
+	object.centre = (meshMin + meshMax) * 0.5f;
+	object.radius = glm::length(meshMax - meshMin) * 0.5f;
+	object.numLevels = (int)mesh->GetNumLods();
+	for (int l = 0; l < object.numLevels; l++)
+		object.errors[l] = mesh->GetLodError(l) * scale;
+	for (int v = 0; v < STATIC_BATCH_VIEWS; v++)
+		object.level[v] = 0;
+	object.occlusionObject = -1;
+	m_lodObjects.push_back(object);
+}
+
+void CStaticBatch::Build(float cellSize)
+{
+	ReleaseBuffers();
+	m_pOcclusionCuller = NULL;
+	for (unsigned int o = 0; o < m_lodObjects.size(); o++)
+		m_lodObjects[o].occlusionObject = -1;
+
+	for (unsigned int i = 0; i < m_instances.size(); i++) {
+		m_instances[i].cellX = (int)floor(m_instances[i].centre.x / cellSize);
+		m_instances[i].cellZ = (int)floor(m_instances[i].centre.z / cellSize);
+	}
+
+	// Order by cell, then by level of detail object, then by texture, so that each (cell, object, texture) is a
+	// contiguous run of instances
+	std::stable_sort(m_instances.begin(), m_instances.end(), [](const Instance& a, const Instance& b) {
+		if (a.cellX != b.cellX) return a.cellX < b.cellX;
+		if (a.cellZ != b.cellZ) return a.cellZ < b.cellZ;
+		if (a.lodObject != b.lodObject) return a.lodObject < b.lodObject;
+		return a.texture < b.texture;
+	});
+
+	vector<Vertex> batchVertices;
+	vector<unsigned int> batchIndices;
+
+	// The indices of each level of the range being built, which go into the index buffer one level after another
+	// when the range is finished
+	vector<unsigned int> rangeIndices[MAX_MESH_LODS];
+	auto finishRange = [this, &batchIndices, &rangeIndices]() {
+		if (m_ranges.empty())
+			return;
+		Range& range = m_ranges.back();
+		for (int l = 0; l < MAX_MESH_LODS; l++) {
+			range.baseIndex[l] = (unsigned int)batchIndices.size();
+			range.numIndices[l] = (unsigned int)rangeIndices[l].size();
+			batchIndices.insert(batchIndices.end(), rangeIndices[l].begin(), rangeIndices[l].end());
+			rangeIndices[l].clear();
+		}
+	};
+
+	for (unsigned int i = 0; i < m_instances.size(); i++) {
+		const Instance& instance = m_instances[i];
+		bool newCell = m_cells.empty() || instance.cellX != m_instances[i - 1].cellX || instance.cellZ != m_instances[i - 1].cellZ;
+		bool newRange = newCell || instance.lodObject != m_ranges.back().lodObject || instance.texture != m_ranges.back().texture;
+
+		if (newCell) {
+			Cell cell;
+			cell.boundsMin = glm::vec3(FLT_MAX);
+			cell.boundsMax = glm::vec3(-FLT_MAX);
+			cell.firstRange = (unsigned int)m_ranges.size();
+			cell.numRanges = 0;
+			m_cells.push_back(cell);
+		}
+		if (newRange) {
+			finishRange();
+			Range range;
+			range.texture = instance.texture;
+			range.lodObject = instance.lodObject;
+			range.baseVertex = (unsigned int)batchVertices.size();
+			m_ranges.push_back(range);
+			m_cells.back().numRanges++;
+		}
+
+		Range& range = m_ranges.back();
+		Cell& cell = m_cells.back();
+
+		const vector<Vertex>& vertices = instance.mesh->GetVertices();
+		const vector<unsigned int>& indices = instance.mesh->GetIndices();
+		unsigned int baseVertex, baseIndex, numIndices;
+		instance.mesh->GetEntry(instance.entry, baseVertex, baseIndex, numIndices);
+
+		// The entry's vertices run from baseVertex up to the largest index it uses
+		unsigned int numVertices = 0;
+		for (unsigned int j = 0; j < numIndices; j++) {
+			if (indices[baseIndex + j] + 1 > numVertices)
+				numVertices = indices[baseIndex + j] + 1;
+		}
+
+		// Pre-transform into world coordinates
+		glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(instance.modelMatrix)));
+		unsigned int rangeVertex = (unsigned int)batchVertices.size() - range.baseVertex;
+		for (unsigned int j = 0; j < numVertices; j++) {
+			const Vertex& v = vertices[baseVertex + j];
+			glm::vec3 p = glm::vec3(instance.modelMatrix * glm::vec4(v.m_pos, 1.0f));
+			glm::vec3 n = glm::normalize(normalMatrix * v.m_normal);
+			batchVertices.push_back(Vertex(p, v.m_tex, n));
+			cell.boundsMin = glm::min(cell.boundsMin, p);
+			cell.boundsMax = glm::max(cell.boundsMax, p);
+		}
+
+		// Every level indexes the same vertices
+		int numLevels = instance.lodObject >= 0 ? m_lodObjects[instance.lodObject].numLevels : 1;
+		for (int l = 0; l < numLevels; l++) {
+			instance.mesh->GetEntry(instance.entry, baseVertex, baseIndex, numIndices, l);
+			for (unsigned int j = 0; j < numIndices; j++)
+				rangeIndices[l].push_back(rangeVertex + indices[baseIndex + j]);
+		}
+	}
+	finishRange();
+
+	m_instances.clear();
+
+	if (batchVertices.empty())
+		return;
+
+	// Pack the vertices, and use 16 bit indices if every range's indices fit
+	bool halfTexCoords = CMeshOptimizer::CanUseHalfTexCoords(&batchVertices[0], (unsigned int)batchVertices.size());
+	vector<BYTE> packedVertices;
+	GLsizei stride = CMeshOptimizer::PackVertices(&batchVertices[0], (unsigned int)batchVertices.size(), halfTexCoords, packedVertices);
+	vector<GLushort> shortIndices;
+	const GLvoid* indexData = &batchIndices[0];
+	m_indexType = GL_UNSIGNED_INT;
+	m_indexSize = sizeof(unsigned int);
+	if (CMeshOptimizer::PackIndices16(batchIndices, shortIndices)) {
+		indexData = &shortIndices[0];
+		m_indexType = GL_UNSIGNED_SHORT;
+		m_indexSize = sizeof(GLushort);
+	}
+
+	glGenVertexArrays(1, &m_vao);
+	glBindVertexArray(m_vao);
+
+	glGenBuffers(1, &m_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBufferData(GL_ARRAY_BUFFER, packedVertices.size(), &packedVertices[0], GL_STATIC_DRAW);
+
+	glGenBuffers(1, &m_ibo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indexSize * batchIndices.size(), indexData, GL_STATIC_DRAW);
+	CResourceTracker::TrackBuffer(m_vbo, stride * batchVertices.size(), "static batch");
+	CResourceTracker::TrackBuffer(m_ibo, m_indexSize * batchIndices.size(), "static batch");
+
+	CMeshOptimizer::SetPackedVertexAttributes(halfTexCoords);
+	glBindVertexArray(0);
+}
+
+void CStaticBatch::Submit(CRenderQueue* queue, RenderItem item, const CFrustum& frustum, float pixelsPerUnit, int view)
+{
+	m_visibleCells = 0;
+	m_submittedTriangles = 0;
+	item.vao = m_vao;
+
+	// Choose each object's level from the size its error would have on screen.  An object only moves to a simpler
+	// level once that level's error is well inside the limit, and back once its own error is well outside it, so an
+	// object near the limit does not keep switching between two levels.
+	for (unsigned int o = 0; o < m_lodObjects.size(); o++) {
+		LodObject& object = m_lodObjects[o];
+		int& level = object.level[view];
+		float distance = glm::length(glm::vec3(item.modelViewMatrix * glm::vec4(object.centre, 1.0f)));
+		if (!m_lodEnabled || distance <= object.radius) {
+			level = 0;
+			continue;
+		}
+
+		float pixels = pixelsPerUnit / distance;
+		while (level > 0 && object.errors[level] * pixels > m_lodPixelError * STATIC_BATCH_LOD_HYSTERESIS)
+			level--;
+		while (level + 1 < object.numLevels && object.errors[level + 1] * pixels < m_lodPixelError / STATIC_BATCH_LOD_HYSTERESIS)
+			level++;
+	}
+
+	for (unsigned int c = 0; c < m_cells.size(); c++) {
+		const Cell& cell = m_cells[c];
+		if (!frustum.IsBoxVisible(cell.boundsMin, cell.boundsMax))
+			continue;
+		m_visibleCells++;
+
+		// Sort the cell by the view space depth of its centre
+		glm::vec3 centre = (cell.boundsMin + cell.boundsMax) * 0.5f;
+		item.depth = -(item.modelViewMatrix * glm::vec4(centre, 1.0f)).z;
+
+		for (unsigned int r = cell.firstRange; r < cell.firstRange + cell.numRanges; r++) {
+			const Range& range = m_ranges[r];
+			int level = 0;
+			if (range.lodObject >= 0) {
+				const LodObject& object = m_lodObjects[range.lodObject];
+				if (object.occlusionObject >= 0 && !m_pOcclusionCuller->IsVisible(object.occlusionObject, view))
+					continue;
+				level = object.level[view];
+			}
+			if (range.numIndices[level] == 0)
+				continue;
+			if (range.texture)
+				item.SetTexture(GL_TEXTURE_2D, range.texture->GetTextureID(), range.texture->GetSamplerID());
+			item.SetDrawElements(GL_TRIANGLES, range.numIndices[level], m_indexType, m_indexSize * range.baseIndex[level], range.baseVertex);
+			queue->Submit(item);
+			m_submittedTriangles += range.numIndices[level] / 3;
+		}
+	}
+}
+
+void CStaticBatch::AddOcclusionObjects(COcclusionCuller* culler)
+{
+	m_pOcclusionCuller = culler;
+	for (unsigned int o = 0; o < m_lodObjects.size(); o++)
+		m_lodObjects[o].occlusionObject = culler->AddObject(m_lodObjects[o].boundsMin, m_lodObjects[o].boundsMax);
+}
+
+void CStaticBatch::Release()
+{
+	ReleaseBuffers();
+	m_lodObjects.clear();
+	m_pOcclusionCuller = NULL;
+}
+
+void CStaticBatch::ReleaseBuffers()
+{
+	if (m_vbo) {
+		CResourceTracker::UntrackBuffer(m_vbo);
+		glDeleteBuffers(1, &m_vbo);
+	}
+	if (m_ibo) {
+		CResourceTracker::UntrackBuffer(m_ibo);
+		glDeleteBuffers(1, &m_ibo);
+	}
+	if (m_vao)
+		glDeleteVertexArrays(1, &m_vao);
+	m_vao = 0;
+	m_vbo = 0;
+	m_ibo = 0;
+	m_ranges.clear();
+	m_cells.clear();
+}
+
+int CStaticBatch::GetNumCells()
+{
+	return (int)m_cells.size();
+}
+
+int CStaticBatch::GetNumRanges()
+{
+	return (int)m_ranges.size();
+}
+
+int CStaticBatch::GetNumVisibleCells()
+{
+	return m_visibleCells;
+}
+
+int CStaticBatch::GetNumSubmittedTriangles()
+{
+	return m_submittedTriangles;
+}
+
+int CStaticBatch::GetNumLodObjects(int level)
+{
+	int count = 0;
+	for (unsigned int o = 0; o < m_lodObjects.size(); o++) {
+		if (m_lodObjects[o].level[0] == level)
+			count++;
+	}
+	return count;
+}
+
+void CStaticBatch::SetLodPixelError(float pixels)
+{
+	m_lodPixelError = pixels;
+}
+
+void CStaticBatch::SetLodEnabled(bool enabled)
+{
+	m_lodEnabled = enabled;
+}
+
+bool CStaticBatch::IsLodEnabled()
+{
+	return m_lodEnabled;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "Common.h"
+#include "OpenAssetImportMesh.h"
+#include "RenderQueue.h"
+#include "Frustum.h"
+#include "OcclusionCuller.h"
+
+#define STATIC_BATCH_VIEWS 2				// Views that choose their own levels of detail: the main camera and the TV
+#define STATIC_BATCH_LOD_HYSTERESIS 1.25f	// How far past the limit a level's error has to go before the level changes
+
+// Merges meshes that never move into a few large buffers.  Adding a mesh only records it with its model matrix; when
+// the batch is built the meshes are grouped by spatial cell and by texture and their vertices transformed into world
+// coordinates, so the whole batch can be drawn with one draw per visible cell and texture.
+//
+// Each mesh added with levels of detail (see COpenAssetImportMesh::GenerateLods) is kept in ranges of its own, which
+// hold every level, and draws the level that suits its size on screen.
+class CStaticBatch
+{
+public:
+	CStaticBatch();
+	~CStaticBatch();
+
+	// Add a copy of a mesh placed in the world with the given model matrix.  The mesh must stay loaded (its textures are used).
+	void AddMesh(COpenAssetImportMesh* mesh, const glm::mat4& modelMatrix);
+
+	// Build the GPU buffers from the meshes added so far.  cellSize is the width of the square cells on the xz plane.
+	void Build(float cellSize);
+
+	// Add an item for each texture in each cell that intersects the frustum.  The item should have the view matrix as its modelview matrix.
+	// pixelsPerUnit is the height in pixels of one unit at a distance of one unit (the viewport height over
+	// 2 tan(fovy / 2)), for choosing the levels of detail, and view is the view whose levels are used.
+	void Submit(CRenderQueue* queue, RenderItem item, const CFrustum& frustum, float pixelsPerUnit, int view = 0);
+
+	// Add the bounding box of each mesh with levels of detail (the heavy props) to the occlusion culler.  Submit
+	// then skips the meshes the culler found hidden.  Building the batch again forgets the culler.
+	void AddOcclusionObjects(COcclusionCuller* culler);
+
+	void Release();
+
+	// Meshes draw the simplest level whose error covers no more than this many pixels on screen
+	void SetLodPixelError(float pixels);
+	void SetLodEnabled(bool enabled);
+	bool IsLodEnabled();
+
+	int GetNumCells();
+	int GetNumRanges();
+	int GetNumVisibleCells();
+	int GetNumSubmittedTriangles();		// In the last Submit
+	int GetNumLodObjects(int level);	// Meshes drawn at a level in the main view
+
+private:
+	// One mesh entry waiting to be batched
+	struct Instance {
+		COpenAssetImportMesh* mesh;
+		glm::mat4 modelMatrix;
+		unsigned int entry;
+		CTexture* texture;
+		glm::vec3 centre;
+		int cellX, cellZ;
+		int lodObject;
+	};
+
+	// A mesh added with levels of detail.  All of its entries draw the same level.
+	struct LodObject {
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		glm::vec3 centre;
+		float radius;
+		float errors[MAX_MESH_LODS];	// In world units
+		int numLevels;
+		int level[STATIC_BATCH_VIEWS];
+		int occlusionObject;			// Index in the occlusion culler, or -1
+	};
+
+	// A range of the batch buffers drawn with one texture, with the indices of each level of detail
+	struct Range {
+		CTexture* texture;
+		int lodObject;					// Index in m_lodObjects, or -1 if the range only has the full meshes
+		unsigned int baseVertex;
+		unsigned int baseIndex[MAX_MESH_LODS];
+		unsigned int numIndices[MAX_MESH_LODS];
+	};
+
+	void ReleaseBuffers();
+
+	struct Cell {
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		unsigned int firstRange;
+		unsigned int numRanges;
+	};
+
+	vector<Instance> m_instances;
+	vector<Range> m_ranges;
+	vector<Cell> m_cells;
+	vector<LodObject> m_lodObjects;
+	COcclusionCuller* m_pOcclusionCuller;
+	GLuint m_vao;
+	GLuint m_vbo;
+	GLuint m_ibo;
+	GLenum m_indexType;
+	unsigned int m_indexSize;
+	int m_visibleCells;
+	int m_submittedTriangles;
+	float m_lodPixelError;
+	bool m_lodEnabled;
+};
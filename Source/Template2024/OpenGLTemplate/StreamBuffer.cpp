@@ -0,0 +1,177 @@
+#include "StreamBuffer.h"
+#include "HighResolutionTimer.h"
+#include "ResourceTracker.h"
+
+CStreamBuffer::CStreamBuffer()
+{
+	m_buffer = 0;
+	m_data = NULL;
+	m_frameSize = 0;
+	m_numFrames = 0;
+	m_frame = 0;
+	for (int i = 0; i < STREAM_BUFFER_MAX_FRAMES; i++)
+		m_fences[i] = NULL;
+	m_used = 0;
+	m_failures = 0;
+	m_lastFrameBytes = 0;
+	m_peakFrameBytes = 0;
+	m_lastFrameFailures = 0;
+	m_numStalls = 0;
+	m_stallMilliseconds = 0.0;
+}
+
+CStreamBuffer::~CStreamBuffer()
+{
+	Release();
+}
+
+bool CStreamBuffer::IsSupported()
+{
+	return GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+}
+
+bool CStreamBuffer::Create(size_t frameSize, int numFrames)
+{
+	if (!IsSupported())
+		return false;
+
+	m_frameSize = frameSize;
+	m_numFrames = glm::clamp(numFrames, 1, STREAM_BUFFER_MAX_FRAMES);
+	size_t totalSize = m_frameSize * m_numFrames;
+
+	// The copy target is not used for anything else, so creating the buffer there leaves other bindings alone
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glGenBuffers(1, &m_buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, totalSize, NULL, flags);
+	m_data = (BYTE*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, totalSize, flags);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	if (m_data == NULL) {
+		glDeleteBuffers(1, &m_buffer);
+		m_buffer = 0;
+		return false;
+	}
+
+	CResourceTracker::TrackBuffer(m_buffer, totalSize, "stream buffer");
+	m_frame = 0;
+	m_used = 0;
+	return true;
+}
+
+bool CStreamBuffer::IsCreated()
+{
+	return m_data != NULL;
+}
+
+void CStreamBuffer::BeginFrame()
+{
+	m_used = 0;
+	m_failures = 0;
+
+	GLsync& fence = m_fences[m_frame];
+	if (fence == NULL)
+		return;
+
+	// Only count a stall when the fence has not already signalled
+	GLenum result = glClientWaitSync(fence, 0, 0);
+	if (result == GL_TIMEOUT_EXPIRED) {
+		CHighResolutionTimer timer;
+		timer.Start();
+		do {
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		} while (result == GL_TIMEOUT_EXPIRED);
+		m_numStalls++;
+		m_stallMilliseconds += timer.Elapsed();
+	}
+	glDeleteSync(fence);
+	fence = NULL;
+}
+
+void CStreamBuffer::EndFrame()
+{
+	if (m_data == NULL)
+		return;
+
+	m_fences[m_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	m_frame = (m_frame + 1) % m_numFrames;
+
+	m_lastFrameBytes = m_used;
+	m_lastFrameFailures = m_failures;
+	if (m_used > m_peakFrameBytes)
+		m_peakFrameBytes = m_used;
+	m_used = 0;
+	m_failures = 0;
+}
+
+bool CStreamBuffer::Allocate(size_t size, size_t alignment, StreamAllocation& allocation)
+{
+	if (m_data == NULL)
+		return false;
+
+	size_t offset = (m_used + alignment - 1) / alignment * alignment;
+	if (offset + size > m_frameSize) {
+		m_failures++;
+		return false;
+	}
+	m_used = offset + size;
+
+	allocation.buffer = m_buffer;
+	allocation.offset = m_frame * m_frameSize + offset;
+	allocation.size = size;
+	allocation.data = m_data + allocation.offset;
+	return true;
+}
+
+size_t CStreamBuffer::GetFrameSize()
+{
+	return m_frameSize;
+}
+
+int CStreamBuffer::GetNumFrames()
+{
+	return m_numFrames;
+}
+
+size_t CStreamBuffer::GetLastFrameBytes()
+{
+	return m_lastFrameBytes;
+}
+
+size_t CStreamBuffer::GetPeakFrameBytes()
+{
+	return m_peakFrameBytes;
+}
+
+int CStreamBuffer::GetLastFrameFailures()
+{
+	return m_lastFrameFailures;
+}
+
+int CStreamBuffer::GetNumStalls()
+{
+	return m_numStalls;
+}
+
+double CStreamBuffer::GetStallMilliseconds()
+{
+	return m_stallMilliseconds;
+}
+
+void CStreamBuffer::Release()
+{
+	for (int i = 0; i < STREAM_BUFFER_MAX_FRAMES; i++) {
+		if (m_fences[i] != NULL)
+			glDeleteSync(m_fences[i]);
+		m_fences[i] = NULL;
+	}
+	if (m_buffer != 0) {
+		CResourceTracker::UntrackBuffer(m_buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		glDeleteBuffers(1, &m_buffer);
+		m_buffer = 0;
+	}
+	m_data = NULL;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Common.h"
+
+#define STREAM_BUFFER_MAX_FRAMES 4
+
+// Space for one upload in the stream buffer.  The data is written through the pointer and read by the GPU from the
+// buffer at the offset.
+struct StreamAllocation
+{
+	void* data;
+	GLuint buffer;
+	GLintptr offset;
+	GLsizeiptr size;
+};
+
+// A ring of buffer storage for data that is written by the CPU every frame and read by the GPU once.  The buffer is
+// created with glBufferStorage and mapped once, persistently and coherently, so writing to it needs no GL calls at
+// all.  It is split into one region per frame in flight (three by default); BeginFrame waits for the fence set when
+// the region was last used, which has normally signalled long ago, and EndFrame sets a new one.
+//
+// Persistent mapping needs OpenGL 4.4 or ARB_buffer_storage.  Without it Create fails and every Allocate returns
+// false, so users keep their own upload path as the fallback.
+class CStreamBuffer
+{
+public:
+	CStreamBuffer();
+	~CStreamBuffer();
+
+	static bool IsSupported();
+
+	// frameSize bytes for each of numFrames frames
+	bool Create(size_t frameSize, int numFrames = 3);
+	bool IsCreated();
+
+	// Wait until the GPU has finished with the next region, then allocate from it until EndFrame
+	void BeginFrame();
+	void EndFrame();
+
+	// Allocate size bytes at a multiple of alignment from this frame's region.  Returns false if there is no room.
+	bool Allocate(size_t size, size_t alignment, StreamAllocation& allocation);
+
+	size_t GetFrameSize();
+	int GetNumFrames();
+
+	// Bytes used by the last completed frame, and the most used by any frame
+	size_t GetLastFrameBytes();
+	size_t GetPeakFrameBytes();
+	// Allocations that did not fit in the last completed frame
+	int GetLastFrameFailures();
+	// Frames that had to wait for the GPU in BeginFrame, and the total time spent waiting
+	int GetNumStalls();
+	double GetStallMilliseconds();
+
+	void Release();
+
+private:
+	GLuint m_buffer;
+	BYTE* m_data;
+	size_t m_frameSize;
+	int m_numFrames;
+	int m_frame;				// Region being filled
+	GLsync m_fences[STREAM_BUFFER_MAX_FRAMES];
+
+	size_t m_used;				// Bytes allocated from the current region
+	int m_failures;
+	size_t m_lastFrameBytes;
+	size_t m_peakFrameBytes;
+	int m_lastFrameFailures;
+	int m_numStalls;
+	double m_stallMilliseconds;
+};
@@ -1,6 +1,7 @@
 #include "Common.h"
 
 #include "texture.h"
+#include "ResourceTracker.h"
 
 #include "include\freeimage\FreeImage.h"
 #pragma comment(lib, "lib/FreeImage.lib")
@@ -13,7 +14,7 @@ CTexture::~CTexture()
 {}
 
 // Create a texture from the data stored in bData.  
-void CTexture::CreateFromData(BYTE* data, int width, int height, int bpp, GLenum format, bool generateMipMaps)
+void CTexture::CreateFromData(BYTE* data, int width, int height, int bpp, GLenum format, bool generateMipMaps, const char* owner)
 {
 	// Generate an OpenGL texture ID for this texture
 	glGenTextures(1, &m_textureID);
@@ -27,6 +28,7 @@ void CTexture::CreateFromData(BYTE* data, int width, int height, int bpp, GLenum
 		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
 	if(generateMipMaps)glGenerateMipmap(GL_TEXTURE_2D);
 	glGenSamplers(1, &m_samplerObjectID);
+	CResourceTracker::TrackTexture(m_textureID, CResourceTracker::GetTextureBytes(format, width, height, generateMipMaps), owner);
 
 	m_path = "";
 	m_mipMapsGenerated = generateMipMaps;
@@ -36,7 +38,7 @@ void CTexture::CreateFromData(BYTE* data, int width, int height, int bpp, GLenum
 }
 
 // Loads a 2D texture given the filename (sPath).  bGenerateMipMaps will generate a mipmapped texture if true
-bool CTexture::Load(string path, bool generateMipMaps)
+bool CTexture::Load(string path, bool generateMipMaps, const char* owner)
 {
 	FREE_IMAGE_FORMAT fif = FIF_UNKNOWN;
 	FIBITMAP* dib(0);
@@ -76,6 +78,7 @@ bool CTexture::Load(string path, bool generateMipMaps)
 	FreeImage_Unload(dib);
 
 	m_path = path;
+	CResourceTracker::TrackTexture(m_textureID, CResourceTracker::GetTextureBytes(format, m_width, m_height, generateMipMaps), owner, path);
 
 	return true; // Success
 }
@@ -102,6 +105,7 @@ void CTexture::Bind(int iTextureUnit)
 // Frees memory on the GPU of the texture
 void CTexture::Release()
 {
+	CResourceTracker::UntrackTexture(m_textureID);
 	glDeleteSamplers(1, &m_samplerObjectID);
 	glDeleteTextures(1, &m_textureID);
 }
@@ -119,4 +123,14 @@ int CTexture::GetHeight()
 int CTexture::GetBPP()
 {
 	return m_bpp;
+}
+
+UINT CTexture::GetTextureID()
+{
+	return m_textureID;
+}
+
+UINT CTexture::GetSamplerID()
+{
+	return m_samplerObjectID;
 }
\ No newline at end of file
@@ -4,8 +4,8 @@
 class CTexture
 {
 public:
-	void CreateFromData(BYTE* data, int width, int height, int bpp, GLenum format, bool generateMipMaps = false);
-	bool Load(string path, bool generateMipMaps = true);
+	void CreateFromData(BYTE* data, int width, int height, int bpp, GLenum format, bool generateMipMaps = false, const char* owner = "texture");
+	bool Load(string path, bool generateMipMaps = true, const char* owner = "texture");
 	void Bind(int textureUnit = 0);
 
 	void SetSamplerObjectParameter(GLenum parameter, GLenum value);
@@ -14,6 +14,8 @@ public:
 	int GetWidth();
 	int GetHeight();
 	int GetBPP();
+	UINT GetTextureID();
+	UINT GetSamplerID();
 
 	void Release();
 
@@ -0,0 +1,176 @@
+#include "TrackIndex.h"
+#include <float.h>
+
+CTrackIndex::CTrackIndex()
+{
+	m_track = NULL;
+	m_origin = glm::vec2(0.0f);
+	m_cellSize = 1.0f;
+	m_numCellsX = 0;
+	m_numCellsZ = 0;
+}
+
+CTrackIndex::~CTrackIndex()
+{
+	Release();
+}
+
+void CTrackIndex::Build(CCatmullRom* track, float cellSize)
+{
+	Release();
+
+	const vector<glm::vec3>& points = track->m_centrelinePoints;
+	int N = (int)points.size();
+	if (N < 2)
+		return;
+
+	m_track = track;
+	m_cellSize = cellSize;
+	glm::vec2 boundsMin(FLT_MAX);
+	glm::vec2 boundsMax(-FLT_MAX);
+	for (int i = 0; i < N; i++) {
+		boundsMin = glm::min(boundsMin, glm::vec2(points[i].x, points[i].z));
+		boundsMax = glm::max(boundsMax, glm::vec2(points[i].x, points[i].z));
+	}
+	m_origin = boundsMin;
+	m_numCellsX = (int)((boundsMax.x - boundsMin.x) / cellSize) + 1;
+	m_numCellsZ = (int)((boundsMax.y - boundsMin.y) / cellSize) + 1;
+
+	// Count the segments in each cell, turn the counts into start offsets, then fill the cells.  Segment i runs from
+	// centreline point i to the next one, and the last segment closes the loop.
+	m_cellStart.assign(m_numCellsX * m_numCellsZ + 1, 0);
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = 0; i < N; i++) {
+			glm::vec2 a(points[i].x, points[i].z);
+			glm::vec2 b(points[(i + 1) % N].x, points[(i + 1) % N].z);
+			glm::ivec2 first = glm::ivec2((glm::min(a, b) - m_origin) / cellSize);
+			glm::ivec2 last = glm::ivec2((glm::max(a, b) - m_origin) / cellSize);
+			for (int z = first.y; z <= last.y; z++) {
+				for (int x = first.x; x <= last.x; x++) {
+					int cell = z * m_numCellsX + x;
+					if (pass == 0)
+						m_cellStart[cell + 1]++;
+					else
+						m_segments[m_cellStart[cell]++] = i;
+				}
+			}
+		}
+
+		if (pass == 0) {
+			for (unsigned int c = 1; c < m_cellStart.size(); c++)
+				m_cellStart[c] += m_cellStart[c - 1];
+			m_segments.resize(m_cellStart.back());
+		}
+	}
+
+	// Filling the cells moved each start on to the next cell's start, so move them back
+	for (int c = (int)m_cellStart.size() - 1; c > 0; c--)
+		m_cellStart[c] = m_cellStart[c - 1];
+	m_cellStart[0] = 0;
+}
+
+void CTrackIndex::TestSegment(int segment, const glm::vec3& position, float& bestGap, int& bestSegment, float& bestT) const
+{
+	const vector<glm::vec3>& points = m_track->m_centrelinePoints;
+	const glm::vec3& a = points[segment];
+	const glm::vec3& b = points[(segment + 1) % points.size()];
+
+	glm::vec3 ab = b - a;
+	float lengthSquared = glm::dot(ab, ab);
+	float t = lengthSquared > 0.0f ? glm::clamp(glm::dot(position - a, ab) / lengthSquared, 0.0f, 1.0f) : 0.0f;
+	float gap = glm::distance(position, a + ab * t);
+	if (gap < bestGap) {
+		bestGap = gap;
+		bestSegment = segment;
+		bestT = t;
+	}
+}
+
+bool CTrackIndex::Project(const glm::vec3& position, TrackProjection& projection) const
+{
+	if (m_segments.empty()) {
+		projection.distance = 0.0f;
+		projection.offset = 0.0f;
+		projection.gap = FLT_MAX;
+		projection.point = glm::vec3(0.0f);
+		projection.tangent = glm::vec3(0.0f);
+		projection.normal = glm::vec3(0.0f);
+		projection.binormal = glm::vec3(0.0f);
+		return false;
+	}
+
+	// A position outside the grid starts from the nearest cell on its edge
+	int cx = glm::clamp((int)floor((position.x - m_origin.x) / m_cellSize), 0, m_numCellsX - 1);
+	int cz = glm::clamp((int)floor((position.z - m_origin.y) / m_cellSize), 0, m_numCellsZ - 1);
+
+	float bestGap = FLT_MAX;
+	int bestSegment = -1;
+	float bestT = 0.0f;
+	int maxRing = glm::max(m_numCellsX, m_numCellsZ);
+	for (int ring = 0; ring < maxRing; ring++) {
+		for (int z = cz - ring; z <= cz + ring; z++) {
+			if (z < 0 || z >= m_numCellsZ)
+				continue;
+			// The rows in between only have a cell at each end of the ring
+			bool edgeRow = z == cz - ring || z == cz + ring;
+			int step = edgeRow ? 1 : 2 * ring;
+			for (int x = cx - ring; x <= cx + ring; x += step) {
+				if (x < 0 || x >= m_numCellsX)
+					continue;
+				int cell = z * m_numCellsX + x;
+				for (int s = m_cellStart[cell]; s < m_cellStart[cell + 1]; s++)
+					TestSegment(m_segments[s], position, bestGap, bestSegment, bestT);
+			}
+		}
+
+		// Every cell in the next ring is at least ring cells away on the xz plane
+		if (bestSegment >= 0 && bestGap <= ring * m_cellSize)
+			break;
+	}
+
+	const vector<glm::vec3>& points = m_track->m_centrelinePoints;
+	const glm::vec3& a = points[bestSegment];
+	const glm::vec3& b = points[(bestSegment + 1) % points.size()];
+	float segmentLength = m_track->GetSampleDistance(bestSegment + 1) - m_track->GetSampleDistance(bestSegment);
+
+	projection.distance = m_track->GetSampleDistance(bestSegment) + segmentLength * bestT;
+	projection.point = a + (b - a) * bestT;
+	projection.gap = bestGap;
+	projection.tangent = glm::normalize(b - a);
+	projection.normal = glm::normalize(glm::cross(projection.tangent, glm::vec3(0, 1, 0)));
+	projection.binormal = glm::normalize(glm::cross(projection.normal, projection.tangent));
+	projection.offset = glm::dot(position - projection.point, projection.normal);
+	return true;
+}
+
+void CTrackIndex::Project(const glm::vec3* positions, int count, TrackProjection* projections, CJobSystem* jobSystem) const
+{
+	if (jobSystem == NULL) {
+		for (int i = 0; i < count; i++)
+			Project(positions[i], projections[i]);
+		return;
+	}
+	jobSystem->ParallelFor(count, 256, [this, positions, projections](int first, int last) {
+		for (int i = first; i < last; i++)
+			Project(positions[i], projections[i]);
+	});
+}
+
+int CTrackIndex::GetNumCells()
+{
+	return m_numCellsX * m_numCellsZ;
+}
+
+int CTrackIndex::GetNumEntries()
+{
+	return (int)m_segments.size();
+}
+
+void CTrackIndex::Release()
+{
+	m_track = NULL;
+	m_numCellsX = 0;
+	m_numCellsZ = 0;
+	m_cellStart.clear();
+	m_segments.clear();
+}
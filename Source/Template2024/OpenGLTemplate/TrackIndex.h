@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Common.h"
+#include "CatmullRom.h"
+#include "JobSystem.h"
+
+// Where a position is relative to the track, in the same terms as the cars: a distance along the centreline and an
+// offset across it along the normal
+struct TrackProjection
+{
+	float distance;			// Distance along the centreline
+	float offset;			// Offset along the normal, like moveDist for the player's car
+	float gap;				// Distance from the position to the closest point
+	glm::vec3 point;		// Closest point on the centreline
+	glm::vec3 tangent;		// Frame of the track at the closest point, as the cars work it out
+	glm::vec3 normal;
+	glm::vec3 binormal;
+};
+
+// A grid on the xz plane over the segments between a track's centreline points, for finding the closest point on the
+// track to a position without testing every segment.  Each cell lists the segments whose bounds overlap it.  A query
+// searches rings of cells outwards from the position's cell and stops once the next ring cannot be any closer, so it
+// normally only tests the segments of a few cells.
+//
+// The index refers to the track's centreline points, so it has to be built again after the track is edited.
+class CTrackIndex
+{
+public:
+	CTrackIndex();
+	~CTrackIndex();
+
+	// Index the track's segments in square cells cellSize wide
+	void Build(CCatmullRom* track, float cellSize);
+
+	// Project one position onto the track.  Returns false if the index is empty, in which case the projection has a
+	// gap of FLT_MAX and every other field zero.
+	bool Project(const glm::vec3& position, TrackProjection& projection) const;
+
+	// Project count positions.  Queries only read the index, so if a job system is given they are spread over its
+	// workers.  Every projection is written: if the index is empty they all have a gap of FLT_MAX, as above.
+	void Project(const glm::vec3* positions, int count, TrackProjection* projections, CJobSystem* jobSystem = NULL) const;
+
+	int GetNumCells();
+	int GetNumEntries();		// Segments listed in all of the cells
+
+	void Release();
+
+private:
+	void TestSegment(int segment, const glm::vec3& position, float& bestGap, int& bestSegment, float& bestT) const;
+
+	CCatmullRom* m_track;
+	glm::vec2 m_origin;			// xz corner of the grid
+	float m_cellSize;
+	int m_numCellsX;
+	int m_numCellsZ;
+	vector<int> m_cellStart;	// Start of each cell's segments in m_segments, and the end of the last cell's
+	vector<int> m_segments;
+};
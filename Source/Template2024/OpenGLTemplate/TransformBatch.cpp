@@ -0,0 +1,250 @@
+#include "TransformBatch.h"
+#include <intrin.h>
+#include <immintrin.h>
+
+#define TRANSFORM_OUTPUT_FLOATS (sizeof(ObjectTransform) / sizeof(float))
+
+glm::mat3 ObjectTransform::GetNormalMatrix() const
+{
+	return glm::mat3(glm::vec3(normalMatrix[0]), glm::vec3(normalMatrix[1]), glm::vec3(normalMatrix[2]));
+}
+
+// Operations on four lanes with SSE
+struct LanesSSE
+{
+	typedef __m128 V;
+	static const int width = 4;
+	static V Load(const float* p) { return _mm_loadu_ps(p); }
+	static V Set(float f) { return _mm_set1_ps(f); }
+	static V Add(V a, V b) { return _mm_add_ps(a, b); }
+	static V Sub(V a, V b) { return _mm_sub_ps(a, b); }
+	static V Mul(V a, V b) { return _mm_mul_ps(a, b); }
+	static V Div(V a, V b) { return _mm_div_ps(a, b); }
+	static V MulAdd(V a, V b, V c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+
+	// Write column x, y, z, w of four objects, the first at dst and the others every ObjectTransform after it
+	static void StoreColumns(float* dst, V x, V y, V z, V w)
+	{
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+		_mm_storeu_ps(dst, x);
+		_mm_storeu_ps(dst + TRANSFORM_OUTPUT_FLOATS, y);
+		_mm_storeu_ps(dst + 2 * TRANSFORM_OUTPUT_FLOATS, z);
+		_mm_storeu_ps(dst + 3 * TRANSFORM_OUTPUT_FLOATS, w);
+	}
+};
+
+// Operations on eight lanes with AVX2 and FMA.  Only used after GetBestPath has found them.
+struct LanesAVX2
+{
+	typedef __m256 V;
+	static const int width = 8;
+	static V Load(const float* p) { return _mm256_loadu_ps(p); }
+	static V Set(float f) { return _mm256_set1_ps(f); }
+	static V Add(V a, V b) { return _mm256_add_ps(a, b); }
+	static V Sub(V a, V b) { return _mm256_sub_ps(a, b); }
+	static V Mul(V a, V b) { return _mm256_mul_ps(a, b); }
+	static V Div(V a, V b) { return _mm256_div_ps(a, b); }
+	static V MulAdd(V a, V b, V c) { return _mm256_fmadd_ps(a, b, c); }
+
+	static void StoreColumns(float* dst, V x, V y, V z, V w)
+	{
+		LanesSSE::StoreColumns(dst, _mm256_castps256_ps128(x), _mm256_castps256_ps128(y),
+			_mm256_castps256_ps128(z), _mm256_castps256_ps128(w));
+		LanesSSE::StoreColumns(dst + 4 * TRANSFORM_OUTPUT_FLOATS, _mm256_extractf128_ps(x, 1), _mm256_extractf128_ps(y, 1),
+			_mm256_extractf128_ps(z, 1), _mm256_extractf128_ps(w, 1));
+	}
+};
+
+// Transform whole groups of lanes and return how many objects were done
+template <class L>
+static int TransformLanes(float* const* streams, const glm::mat4& viewMatrix, ObjectTransform* output, int first, int count)
+{
+	typedef typename L::V V;
+	const float* tx = streams[0] + first;
+	const float* ty = streams[1] + first;
+	const float* tz = streams[2] + first;
+	const float* qx = streams[3] + first;
+	const float* qy = streams[4] + first;
+	const float* qz = streams[5] + first;
+	const float* qw = streams[6] + first;
+	const float* sx = streams[7] + first;
+	const float* sy = streams[8] + first;
+	const float* sz = streams[9] + first;
+
+	V view[4][3];
+	for (int c = 0; c < 4; c++) {
+		for (int r = 0; r < 3; r++)
+			view[c][r] = L::Set(viewMatrix[c][r]);
+	}
+	const V zero = L::Set(0.0f);
+	const V one = L::Set(1.0f);
+	const V two = L::Set(2.0f);
+
+	int i = 0;
+	for (; i + L::width <= count; i += L::width) {
+		// Rotation matrix of the quaternion, by columns
+		V x = L::Load(qx + i), y = L::Load(qy + i), z = L::Load(qz + i), w = L::Load(qw + i);
+		V x2 = L::Mul(x, two), y2 = L::Mul(y, two), z2 = L::Mul(z, two);
+		V xx = L::Mul(x, x2), yy = L::Mul(y, y2), zz = L::Mul(z, z2);
+		V xy = L::Mul(x, y2), xz = L::Mul(x, z2), yz = L::Mul(y, z2);
+		V wx = L::Mul(w, x2), wy = L::Mul(w, y2), wz = L::Mul(w, z2);
+		V rotation[3][3] = {
+			{ L::Sub(one, L::Add(yy, zz)), L::Add(xy, wz), L::Sub(xz, wy) },
+			{ L::Sub(xy, wz), L::Sub(one, L::Add(xx, zz)), L::Add(yz, wx) },
+			{ L::Add(xz, wy), L::Sub(yz, wx), L::Sub(one, L::Add(xx, yy)) }
+		};
+		V scale[3] = { L::Load(sx + i), L::Load(sy + i), L::Load(sz + i) };
+		float* dst = (float*)(output + i);
+
+		for (int c = 0; c < 3; c++) {
+			// The rotated axis in view space, scaled for the model-view matrix and divided by the scale for the normal matrix
+			V axis[3];
+			for (int r = 0; r < 3; r++)
+				axis[r] = L::MulAdd(view[0][r], rotation[c][0], L::MulAdd(view[1][r], rotation[c][1], L::Mul(view[2][r], rotation[c][2])));
+			L::StoreColumns(dst + 4 * c, L::Mul(axis[0], scale[c]), L::Mul(axis[1], scale[c]), L::Mul(axis[2], scale[c]), zero);
+			L::StoreColumns(dst + 16 + 4 * c, L::Div(axis[0], scale[c]), L::Div(axis[1], scale[c]), L::Div(axis[2], scale[c]), zero);
+		}
+
+		V t[3] = { L::Load(tx + i), L::Load(ty + i), L::Load(tz + i) };
+		V position[3];
+		for (int r = 0; r < 3; r++)
+			position[r] = L::MulAdd(view[0][r], t[0], L::MulAdd(view[1][r], t[1], L::MulAdd(view[2][r], t[2], view[3][r])));
+		L::StoreColumns(dst + 12, position[0], position[1], position[2], one);
+	}
+	return i;
+}
+
+CTransformBatch::CTransformBatch()
+{
+	for (int s = 0; s < NUM_STREAMS; s++)
+		m_streams[s] = NULL;
+	m_count = 0;
+	m_capacity = 0;
+	m_path = GetBestPath();
+}
+
+CTransformBatch::~CTransformBatch()
+{
+	Release();
+}
+
+// AVX2 needs the CPU to have it and FMA, and the OS to save the YMM registers on a context switch
+TransformPath CTransformBatch::GetBestPath()
+{
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return TRANSFORM_PATH_SSE;
+
+	__cpuid(info, 1);
+	bool fma = (info[2] & (1 << 12)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!fma || !osxsave || !avx || (_xgetbv(0) & 6) != 6)
+		return TRANSFORM_PATH_SSE;
+
+	__cpuidex(info, 7, 0);
+	bool avx2 = (info[1] & (1 << 5)) != 0;
+	return avx2 ? TRANSFORM_PATH_AVX2 : TRANSFORM_PATH_SSE;
+}
+
+const char* CTransformBatch::GetPathName(TransformPath path)
+{
+	static const char* names[] = { "scalar", "SSE", "AVX2" };
+	return names[path];
+}
+
+void CTransformBatch::SetPath(TransformPath path)
+{
+	TransformPath best = GetBestPath();
+	m_path = path < best ? path : best;
+}
+
+TransformPath CTransformBatch::GetPath()
+{
+	return m_path;
+}
+
+void CTransformBatch::Resize(int count)
+{
+	if (count > m_capacity) {
+		Release();
+		m_capacity = (count + 7) & ~7;
+		for (int s = 0; s < NUM_STREAMS; s++)
+			m_streams[s] = (float*)_mm_malloc(m_capacity * sizeof(float), 32);
+	}
+	m_count = count;
+}
+
+int CTransformBatch::GetCount()
+{
+	return m_count;
+}
+
+void CTransformBatch::SetTransform(int i, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+{
+	m_streams[TX][i] = translation.x;
+	m_streams[TY][i] = translation.y;
+	m_streams[TZ][i] = translation.z;
+	m_streams[QX][i] = rotation.x;
+	m_streams[QY][i] = rotation.y;
+	m_streams[QZ][i] = rotation.z;
+	m_streams[QW][i] = rotation.w;
+	m_streams[SX][i] = scale.x;
+	m_streams[SY][i] = scale.y;
+	m_streams[SZ][i] = scale.z;
+}
+
+void CTransformBatch::Transform(const glm::mat4& viewMatrix, ObjectTransform* output, int first, int count)
+{
+	if (m_path == TRANSFORM_PATH_AVX2)
+		TransformAVX2(viewMatrix, output, first, count);
+	else if (m_path == TRANSFORM_PATH_SSE)
+		TransformSSE(viewMatrix, output, first, count);
+	else
+		TransformScalar(viewMatrix, output, first, count);
+}
+
+// One object at a time, also used for the objects left over after the last whole group of lanes
+void CTransformBatch::TransformScalar(const glm::mat4& viewMatrix, ObjectTransform* output, int first, int count)
+{
+	glm::mat3 view(viewMatrix);
+	for (int i = 0; i < count; i++) {
+		int o = first + i;
+		glm::mat3 axes = view * glm::mat3_cast(glm::quat(m_streams[QW][o], m_streams[QX][o], m_streams[QY][o], m_streams[QZ][o]));
+		glm::vec3 scale(m_streams[SX][o], m_streams[SY][o], m_streams[SZ][o]);
+		glm::vec3 translation(m_streams[TX][o], m_streams[TY][o], m_streams[TZ][o]);
+
+		ObjectTransform& out = output[i];
+		for (int c = 0; c < 3; c++) {
+			out.modelViewMatrix[c] = glm::vec4(axes[c] * scale[c], 0.0f);
+			out.normalMatrix[c] = glm::vec4(axes[c] / scale[c], 0.0f);
+		}
+		out.modelViewMatrix[3] = glm::vec4(view * translation + glm::vec3(viewMatrix[3]), 1.0f);
+	}
+}
+
+void CTransformBatch::TransformSSE(const glm::mat4& viewMatrix, ObjectTransform* output, int first, int count)
+{
+	int done = TransformLanes<LanesSSE>(m_streams, viewMatrix, output, first, count);
+	TransformScalar(viewMatrix, output + done, first + done, count - done);
+}
+
+void CTransformBatch::TransformAVX2(const glm::mat4& viewMatrix, ObjectTransform* output, int first, int count)
+{
+	int done = TransformLanes<LanesAVX2>(m_streams, viewMatrix, output, first, count);
+	// Avoid the penalty for mixing AVX and SSE code on older CPUs
+	_mm256_zeroupper();
+	TransformScalar(viewMatrix, output + done, first + done, count - done);
+}
+
+void CTransformBatch::Release()
+{
+	for (int s = 0; s < NUM_STREAMS; s++) {
+		if (m_streams[s])
+			_mm_free(m_streams[s]);
+		m_streams[s] = NULL;
+	}
+	m_count = 0;
+	m_capacity = 0;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Common.h"
+#include "./include/glm/gtc/quaternion.hpp"
+
+// Model-view and normal matrix of one object, laid out as std140/std430 expect a mat4 and a mat3, so an array of
+// them can be written straight into a mapped uniform or storage buffer
+struct ObjectTransform
+{
+	glm::mat4 modelViewMatrix;
+	glm::vec4 normalMatrix[3];		// Columns of the mat3, each padded to a vec4
+
+	glm::mat3 GetNormalMatrix() const;
+};
+
+enum TransformPath
+{
+	TRANSFORM_PATH_SCALAR = 0,
+	TRANSFORM_PATH_SSE,
+	TRANSFORM_PATH_AVX2
+};
+
+// Translation, rotation and scale of many objects, stored as structure of arrays, and a kernel that turns them into
+// model-view and normal matrices for a view.  The kernel works on four objects at a time with SSE, or eight with
+// AVX2 and FMA when the CPU and OS support them, which is checked once at run time.  Each lane builds the rotation
+// from a quaternion, so there is no per object matrix multiply and no inverse: with a rigid view matrix the
+// normal matrix is just the rotated axes divided by their scales.
+class CTransformBatch
+{
+public:
+	CTransformBatch();
+	~CTransformBatch();
+
+	static TransformPath GetBestPath();
+	static const char* GetPathName(TransformPath path);
+
+	// The path used by Transform.  Starts as the best one supported.
+	void SetPath(TransformPath path);
+	TransformPath GetPath();
+
+	void Resize(int count);
+	int GetCount();
+	void SetTransform(int i, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale);
+
+	// Write the matrices of objects first to first + count - 1 to output[0] to output[count - 1].  viewMatrix must
+	// be a rotation and translation only.  Different ranges can be transformed on different threads at once.
+	void Transform(const glm::mat4& viewMatrix, ObjectTransform* output, int first, int count);
+
+	void Release();
+
+private:
+	enum Stream { TX, TY, TZ, QX, QY, QZ, QW, SX, SY, SZ, NUM_STREAMS };
+
+	void TransformScalar(const glm::mat4& viewMatrix, ObjectTransform* output, int first, int count);
+	void TransformSSE(const glm::mat4& viewMatrix, ObjectTransform* output, int first, int count);
+	void TransformAVX2(const glm::mat4& viewMatrix, ObjectTransform* output, int first, int count);
+
+	float* m_streams[NUM_STREAMS];
+	int m_count;
+	int m_capacity;
+	TransformPath m_path;
+};
@@ -4,7 +4,9 @@
 
 
 CTree::CTree()
-{}
+{
+    m_numTriangles = 0;
+}
 
 CTree::~CTree()
 {}
@@ -14,7 +16,7 @@ CTree::~CTree()
 void CTree::Create(string directory, string filename)
 {
     // Load the texture
-    m_texture.Load(directory + filename, true);
+    m_texture.Load(directory + filename, true, "tree");
 
     m_directory = directory;
     m_filename = filename;
@@ -38,23 +40,23 @@ void CTree::Create(string directory, string filename)
     auto normals = GetNormals(vertices, indices);
     auto texCoords = GetTexCoords();
 
+    CVertexStream<TexturedVertex> vertexStream;
+    vertexStream.Reserve((unsigned int)vertices.size());
     for (int i = 0; i < vertices.size(); i++)
-    {
-        m_vbo.AddVertexData(&vertices.at(i), sizeof(glm::vec3));
-        m_vbo.AddVertexData(&texCoords[i], sizeof(glm::vec2));
-        m_vbo.AddVertexData(&normals[i], sizeof(glm::vec3));
-    }
+        vertexStream.Add(TexturedVertex(vertices[i], texCoords[i], normals[i]));
 
+    CVertexStream<unsigned int> indexStream;
+    indexStream.Reserve(3 * (unsigned int)indices.size());
     for (int i = 0; i < indices.size(); i++)
     {
-        m_vbo.AddIndexData(&indices[i][0], sizeof(unsigned int));
-        m_vbo.AddIndexData(&indices[i][1], sizeof(unsigned int));
-        m_vbo.AddIndexData(&indices[i][2], sizeof(unsigned int));
+        indexStream.Add(indices[i][0]);
+        indexStream.Add(indices[i][1]);
+        indexStream.Add(indices[i][2]);
         m_numTriangles++;
     }
 
     // Upload the VBO to the GPU
-    m_vbo.UploadDataToGPU(GL_STATIC_DRAW);
+    m_vbo.UploadDataToGPU(vertexStream, indexStream, GL_STATIC_DRAW, "tree");
 
     GLsizei istride = 2 * sizeof(glm::vec3) + sizeof(glm::vec2);
 
@@ -191,6 +193,19 @@ void CTree::Render()
     glDrawElements(GL_TRIANGLES, m_numTriangles * 3, GL_UNSIGNED_INT, 0);
 }
 
+void CTree::Submit(CRenderQueue* queue, RenderItem item)
+{
+    item.vao = m_vao;
+    item.SetTexture(GL_TEXTURE_2D, m_texture.GetTextureID(), m_texture.GetSamplerID());
+    item.SetDrawElements(GL_TRIANGLES, m_numTriangles * 3, GL_UNSIGNED_INT);
+    queue->Submit(item);
+}
+
+CTexture* CTree::GetTexture()
+{
+    return &m_texture;
+}
+
 // Release resources
 void CTree::Release()
 {
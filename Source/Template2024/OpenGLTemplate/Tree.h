@@ -3,6 +3,7 @@
 #include "Texture.h"
 #include "VertexBufferObjectIndexed.h"
 #include "VertexBufferObject.h"
+#include "RenderQueue.h"
 
 // Class for generating a unit sphere
 class CTree
@@ -12,11 +13,13 @@ public:
 	~CTree();
 	void Create(string sDirectory, string sFilename);
 	void Render();
+	void Submit(CRenderQueue* queue, RenderItem item);
 	void Release();
 	std::vector<glm::vec3> GetVertices();
 	std::vector<std::vector<int>> GetIndices();
 	std::vector<glm::vec3> GetNormals(const std::vector<glm::vec3>&, const std::vector<std::vector<int>>&);
 	std::vector<glm::vec2> GetTexCoords();
+	CTexture* GetTexture();
 private:
 	UINT m_vao;
 	CVertexBufferObjectIndexed m_vbo;
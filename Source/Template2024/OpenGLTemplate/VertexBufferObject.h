@@ -1,6 +1,8 @@
 #pragma once
 
 #include "Common.h"
+#include "VertexStream.h"
+#include "ResourceTracker.h"
 
 // This class provides a wrapper around an OpenGL Vertex Buffer Object
 class CVertexBufferObject
@@ -13,12 +15,21 @@ public:
 	void Bind();									// Binds the VBO
 	void Release();									// Releases the VBO
 
-	void AddData(void* ptrData, UINT dataSize);	// Adds data to the VBO
-	void UploadDataToGPU(int usageHint);			// Uploads the VBO to the GPU
+	// Uploads a stream of vertices to the VBO in one call, or finishes a stream mapped onto it.  The VBO must be bound.
+	template <class T> void UploadDataToGPU(CVertexStream<T>& vertices, int usageHint, const char* owner = "vertex buffer")
+	{
+		CResourceTracker::TrackBuffer(m_vbo, vertices.GetSize(), owner);
+		m_dataUploaded = vertices.Upload(GL_ARRAY_BUFFER, usageHint);
+	}
+
+	// Replaces count vertices starting at vertex first, leaving the rest of the uploaded data alone.  The VBO must be bound.
+	template <class T> void UpdateDataOnGPU(unsigned int first, const T* vertices, unsigned int count)
+	{
+		glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(T), count * sizeof(T), vertices);
+	}
 
 	
 private:
 	UINT m_vbo;									// VBO id
-	vector<BYTE> m_data;							// Data to be put in the VBO
 	bool m_dataUploaded;							// A flag indicating if the data has been sent to the GPU
 };
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "Common.h"
+#include "VertexStream.h"
+#include "ResourceTracker.h"
 
 class CVertexBufferObjectIndexed
 {
@@ -12,17 +14,21 @@ public:
 	void Bind();									// Binds the VBO
 	void Release();									// Releases the VBO
 
-	void AddVertexData(void* pVertexData, UINT vertexDataSize);	// Adds vertex data
-	void AddIndexData(void* pIndexData, UINT indexDataSize);	// Adds index data
-	void UploadDataToGPU(int iUsageHint);			// Upload the VBO to the GPU
+	// Upload streams of vertices and indices, each in one call.  Either stream may instead have been mapped onto its
+	// buffer, in which case it is unmapped.  The buffers must be bound.
+	template <class T> void UploadDataToGPU(CVertexStream<T>& vertices, CVertexStream<unsigned int>& indices, int iUsageHint,
+		const char* owner = "indexed vertex buffer")
+	{
+		CResourceTracker::TrackBuffer(m_vboVertices, vertices.GetSize(), owner);
+		CResourceTracker::TrackBuffer(m_vboIndices, indices.GetSize(), owner);
+		bool verticesUploaded = vertices.Upload(GL_ARRAY_BUFFER, iUsageHint);
+		m_dataUploaded = indices.Upload(GL_ELEMENT_ARRAY_BUFFER, iUsageHint) && verticesUploaded;
+	}
 
 
 private:
 	GLuint m_vboVertices;		// VBO id for vertices
 	GLuint m_vboIndices;		// VBO id for indices
 
-	vector<BYTE> m_vertexData;	// Vertex data to be uploaded
-	vector<BYTE> m_indexData;	// Index data to be uploaded
-
 	bool m_dataUploaded;		// Flag indicating if data is uploaded to the GPU
 };
\ No newline at end of file
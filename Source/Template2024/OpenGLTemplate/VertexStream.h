@@ -0,0 +1,101 @@
+#pragma once
+
+#include "Common.h"
+#include <assert.h>
+
+// The interleaved vertex used by most of the game's meshes: attribute 0 is the position, 1 the texture coordinate
+// and 2 the normal
+struct TexturedVertex
+{
+	glm::vec3 position;
+	glm::vec2 texCoord;
+	glm::vec3 normal;
+
+	TexturedVertex() {}
+	TexturedVertex(const glm::vec3& position, const glm::vec2& texCoord, const glm::vec3& normal)
+		: position(position), texCoord(texCoord), normal(normal) {}
+};
+static_assert(sizeof(TexturedVertex) == 2 * sizeof(glm::vec3) + sizeof(glm::vec2), "TexturedVertex must be tightly packed");
+
+// Builds the contents of a vertex or index buffer one whole element of type T at a time.  By default the elements
+// are collected on the CPU and uploaded in one call, so Reserve should be called first when the count is known.
+// A stream can instead be mapped onto the buffer it is for, in which case each element is written straight into
+// the buffer and there is no CPU copy at all; the count must then be known up front.
+template <class T>
+class CVertexStream
+{
+public:
+	CVertexStream()
+	{
+		m_mapped = NULL;
+		m_mappedTarget = 0;
+		m_count = 0;
+		m_capacity = 0;
+	}
+
+	// Make room for count elements on the CPU, so adding them never reallocates
+	void Reserve(unsigned int count)
+	{
+		m_data.reserve(count);
+	}
+
+	// Allocate storage for count elements in the buffer bound to target and map it for writing.  Exactly count
+	// elements should then be added before the stream is uploaded.
+	bool Map(GLenum target, unsigned int count, GLenum usage)
+	{
+		glBufferData(target, count * sizeof(T), NULL, usage);
+		m_mapped = (T*)glMapBufferRange(target, 0, count * sizeof(T), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		m_mappedTarget = target;
+		m_count = 0;
+		m_capacity = count;
+		return m_mapped != NULL;
+	}
+
+	void Add(const T& element)
+	{
+		if (m_mapped) {
+			assert(m_count < m_capacity);
+			m_mapped[m_count++] = element;
+		}
+		else
+			m_data.push_back(element);
+	}
+
+	unsigned int GetCount()
+	{
+		return m_mapped ? m_count : (unsigned int)m_data.size();
+	}
+
+	// Size of the buffer storage the stream fills, in bytes
+	size_t GetSize()
+	{
+		return (m_mapped ? m_capacity : m_data.size()) * sizeof(T);
+	}
+
+	bool IsMapped()
+	{
+		return m_mapped != NULL;
+	}
+
+	// Upload the elements to the buffer bound to target and free the CPU copy, or unmap a mapped stream (which
+	// ignores the arguments).  Returns false if the driver lost the contents of the mapped buffer.
+	bool Upload(GLenum target, GLenum usage)
+	{
+		if (m_mapped) {
+			assert(m_count == m_capacity);
+			m_mapped = NULL;
+			return glUnmapBuffer(m_mappedTarget) == GL_TRUE;
+		}
+
+		glBufferData(target, m_data.size() * sizeof(T), m_data.empty() ? NULL : &m_data[0], usage);
+		vector<T>().swap(m_data);
+		return true;
+	}
+
+private:
+	vector<T> m_data;
+	T* m_mapped;
+	GLenum m_mappedTarget;
+	unsigned int m_count;
+	unsigned int m_capacity;
+};
@@ -0,0 +1,6 @@
+#version 400 core
+
+// Depth pre-pass: colour writes are masked off, so there is nothing to shade
+void main()
+{
+}
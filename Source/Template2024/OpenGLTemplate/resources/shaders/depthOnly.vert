@@ -0,0 +1,19 @@
+#version 400 core
+
+// Depth pre-pass.  gl_Position must come out bit for bit the same as in mainShader.vert, so that the colour pass
+// passes the GL_LEQUAL depth test on exactly the pixels laid down here.
+invariant gl_Position;
+
+// Structure for matrices
+uniform struct Matrices
+{
+	mat4 projMatrix;
+	mat4 modelViewMatrix;
+} matrices;
+
+layout (location = 0) in vec3 inPosition;
+
+void main()
+{
+	gl_Position = matrices.projMatrix * matrices.modelViewMatrix * vec4(inPosition, 1.0f);
+}
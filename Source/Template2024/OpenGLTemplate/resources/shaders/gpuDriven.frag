@@ -0,0 +1,34 @@
+#version 430 core
+
+// Fragment shader for objects drawn by CIndirectRenderer.  Uses the same simple lighting and fog as the trees in mainShader.frag
+
+in vec2 vTexCoord;
+in vec3 vNormal;
+in vec4 p;
+
+out vec4 vOutputColour;
+
+uniform sampler2D sampler0;
+
+uniform struct LightInfo
+{
+	vec4 position;
+	vec3 La;
+	vec3 Ld;
+	vec3 Ls;
+} light1;
+
+uniform float fogDensity;
+const vec3 fogColour = vec3(0.75f);
+
+void main()
+{
+	vec3 lightDir = normalize(vec3(light1.position));
+	float diff = max(dot(vNormal, lightDir), 0.0);
+	vec3 vColour = 0.3 * light1.La + diff * light1.Ld + light1.Ls;
+
+	vOutputColour = texture(sampler0, vTexCoord) * vec4(vColour, 1.0f);
+
+	float fogFactor = exp(-fogDensity * length(p.xyz));
+	vOutputColour.rgb = mix(fogColour, vOutputColour.rgb, fogFactor);
+}
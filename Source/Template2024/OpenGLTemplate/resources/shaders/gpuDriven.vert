@@ -0,0 +1,40 @@
+#version 430 core
+
+// Vertex shader for objects drawn by CIndirectRenderer.  The model matrix comes from the object buffer.
+
+uniform struct Matrices
+{
+	mat4 projMatrix;
+	mat4 viewMatrix;
+} matrices;
+
+struct Object
+{
+	mat4 modelMatrix;
+	vec4 boundingSphere;
+	uvec4 mesh;
+};
+
+layout (std430, binding = 0) readonly buffer Objects
+{
+	Object objects[];
+};
+
+layout (location = 0) in vec3 inPosition;
+layout (location = 1) in vec2 inCoord;
+layout (location = 2) in vec3 inNormal;
+layout (location = 3) in uint inObjectIndex;	// Per instance, from the visible list written by gpuCull.comp
+
+out vec2 vTexCoord;
+out vec3 vNormal;
+out vec4 p;
+
+void main()
+{
+	mat4 modelMatrix = objects[inObjectIndex].modelMatrix;
+	p = matrices.viewMatrix * modelMatrix * vec4(inPosition, 1.0f);
+	gl_Position = matrices.projMatrix * p;
+
+	vTexCoord = inCoord;
+	vNormal = normalize(mat3(modelMatrix) * inNormal);
+}
@@ -1,14 +1,16 @@
 #version 400 core
 
+// This file is compiled into several variants (see CShaderVariants), selected with these defines:
+//   SKYBOX        sample the cube map only, no lighting
+//   PHONG_MODEL   Phong lighting from light1; without it the simple directional lighting used for the trees
+//   CLUSTERED_LIGHTS  add the streetlights and headlights in the fragment's light cluster (Phong model only)
+//   LIGHTMAP      take the streetlights from the baked lightmap and only add the headlights from the clusters
+
 out vec4 vOutputColour;		// The output colour
 
 uniform sampler2D sampler0;  // The texture sampler
 uniform samplerCube CubeMapTex;
-uniform bool bUsePhongModel;
-uniform bool bUseTexture;    // A flag indicating if texture-mapping should be applied
-uniform bool renderSkybox;
-uniform bool bUseSpotlight;    // A flag indicating if spotlight should be shown
-uniform bool bUseStreetlight;    // A flag indicating if spotlight should be shown
+uniform float fogDensity;
 
 // Structure holding light information:  its position as well as ambient, diffuse, and specular colours
 struct LightInfo
@@ -28,27 +30,27 @@ struct MaterialInfo
 	float shininess;
 };
 
-// Structure holding spotlight information
-struct SpotlightInfo
-{
-	vec4 position;
-	vec3 La;
-	vec3 Ld;
-	vec3 Ls;
-	vec3 direction;
-	float exponent;
-	float cutoff;
-};
-
 // Lights and materials passed in as uniform variables from client programme
 uniform LightInfo light1;
-uniform SpotlightInfo spotlight1;
-uniform SpotlightInfo spotlight2;
-uniform SpotlightInfo spotlights[4];
-uniform SpotlightInfo streetlights[5];
 uniform MaterialInfo material1; 
-uniform MaterialInfo spotmaterial1;
-uniform MaterialInfo streetmaterial1;
+
+#ifdef CLUSTERED_LIGHTS
+// Light clusters built by CLightClusters.  Each light is five texels of clusterLights: view space position and
+// range, direction and cosine of the cutoff angle, then ambient, diffuse and specular colours with the exponent
+// and shininess in w.  clusterRanges holds the offset and count of each cluster's list in clusterIndices.
+uniform samplerBuffer clusterLights;
+uniform usamplerBuffer clusterRanges;
+uniform usamplerBuffer clusterIndices;
+uniform vec3 clusterCount;
+uniform vec2 clusterTileSize;
+uniform vec2 clusterDepthScale;		// Near plane distance, and slices per unit of log depth
+uniform int clusterDynamicLights;	// Lights from this index on are baked into the lightmap
+#endif
+
+#ifdef LIGHTMAP
+uniform sampler2D lightmap;
+in vec2 vLightmapCoord;
+#endif
 
 in vec3 worldPosition;
 in vec3 n;
@@ -78,91 +80,102 @@ vec3 PhongModel(vec4 eyePosition, vec3 eyeNorm)
 	return ambient + diffuse + specular;
 }
 
-vec3 BlinnPhongSpotlightModel(SpotlightInfo light, vec4 p, vec3 n, vec4 position, MaterialInfo material)
+#ifdef CLUSTERED_LIGHTS
+// Blinn-Phong spotlight, fading out to nothing at the light's range
+vec3 BlinnPhongSpotlightModel(int light, vec4 p, vec3 n)
 {
-	vec3 s = normalize(vec3(position - p));
-	float angle = acos(dot(-s, light.direction));
-	float cutoff = radians(clamp(light.cutoff, 0.0, 90.0));
-	vec3 ambient = light.La * material.Ma;
-	if (angle < cutoff) {
-		float spotFactor = pow(dot(-s, light.direction), light.exponent);
-		vec3 v = normalize(-p.xyz);
-		vec3 h = normalize(v + s);
-		float sDotN = max(dot(s, n), 0.0);
-		vec3 diffuse = light.Ld * material.Md * sDotN;
-		vec3 specular = vec3(0.0);
-		if (sDotN > 0.0)
-			specular = light.Ls * material.Ms * pow(max(dot(h, n), 0.0), material.shininess);
-		return ambient + spotFactor * (diffuse + specular);
-	} else 
-		return ambient;
+	vec4 positionRange = texelFetch(clusterLights, light);
+	vec3 toLight = positionRange.xyz - p.xyz;
+	float d = length(toLight);
+	if (d >= positionRange.w)
+		return vec3(0.0);
+	float attenuation = 1.0 - d / positionRange.w;
+	attenuation *= attenuation;
+
+	vec4 directionCutoff = texelFetch(clusterLights, light + 1);
+	vec4 ambient = texelFetch(clusterLights, light + 2);
+	vec3 s = toLight / d;
+	float cosAngle = dot(-s, directionCutoff.xyz);
+	if (cosAngle <= directionCutoff.w)
+		return attenuation * ambient.rgb;
+
+	vec4 diffuse = texelFetch(clusterLights, light + 3);
+	vec3 specular = texelFetch(clusterLights, light + 4).rgb;
+	float spotFactor = pow(cosAngle, ambient.w);
+	vec3 v = normalize(-p.xyz);
+	vec3 h = normalize(v + s);
+	float sDotN = max(dot(s, n), 0.0);
+	vec3 colour = diffuse.rgb * sDotN;
+	if (sDotN > 0.0)
+		colour += specular * pow(max(dot(h, n), 0.0), diffuse.w);
+	return attenuation * (ambient.rgb + spotFactor * colour);
 }
 
+// Sum the lights of the cluster that the fragment is in
+vec3 ClusteredLights(vec4 p, vec3 n)
+{
+	ivec3 cell;
+	cell.xy = ivec2(gl_FragCoord.xy / clusterTileSize);
+	cell.z = int(log(-p.z / clusterDepthScale.x) * clusterDepthScale.y);
+	cell = clamp(cell, ivec3(0), ivec3(clusterCount) - 1);
+	int cluster = (cell.z * int(clusterCount.y) + cell.y) * int(clusterCount.x) + cell.x;
+
+	uvec2 range = texelFetch(clusterRanges, cluster).xy;
+	vec3 colour = vec3(0.0);
+	for (uint i = 0u; i < range.y; i++) {
+		int light = int(texelFetch(clusterIndices, int(range.x + i)).x);
+#ifdef LIGHTMAP
+		// The baked lights are last in every list, and are already in the lightmap
+		if (light >= clusterDynamicLights)
+			break;
+#endif
+		colour += BlinnPhongSpotlightModel(light * 5, p, n);
+	}
+	return colour;
+}
+#endif
+
 // Fog parameters
-float rho = 0.001f;
 const vec3 fogColour = vec3(0.75f);
 
 void main()
 {
-	vec3 vColour;
-	
-	if(bUseSpotlight)
-	{
-		rho = 0.001f;
-		vColour += 2 * BlinnPhongSpotlightModel(spotlight1, p, n, spotlight1.position, spotmaterial1) + 2 * BlinnPhongSpotlightModel(spotlight2, p, n, spotlight2.position, spotmaterial1);
-
-		for(int i = 0; i < 4; i++)
-		{
-			vColour += BlinnPhongSpotlightModel(spotlights[i], p, n, spotlights[i].position, spotmaterial1);
-		}
-	}
-	if(bUseStreetlight)
-	{
-		rho = 0.003f;
-		for (int i = 0; i < 5; ++i)
-		{
-			vColour += BlinnPhongSpotlightModel(streetlights[i], p, n, streetlights[i].position, streetmaterial1);
-		}
-	}
-	if(bUsePhongModel)
-	{
-		// Apply the Phong model to compute the vertex colour
-		vColour += PhongModel(p, n);
-	}
-	else
-	{
-		// Calculate diffuse light
-		vec3 lightDir = normalize(vec3(light1.position));
-		float diff = max(dot(vNormal, lightDir), 0.0);
-		vec3 diffuse = diff * light1.Ld;
-	
-		 // Calculate ambient light
-		vec3 ambient = 0.3 * light1.La;
-	
-		// Combine diffuse, ambient, and specular lighting
-		vColour = ambient + diffuse + light1.Ls;
-	}
-
-	
-
-	if (renderSkybox) {
-		vOutputColour = texture(CubeMapTex, worldPosition);
-	}
-	else 
-	{
-		// Get the texel colour from the texture sampler
-		vec4 vTexColour = texture(sampler0, vTexCoord);	
-
-		if (bUseTexture)
-			vOutputColour = vTexColour*vec4(vColour, 1.0f);	// Combine object colour and texture 
-		else
-			vOutputColour = vec4(vColour, 1.0f);	// Just use the colour instead
-
-	}
+#ifdef SKYBOX
+	vOutputColour = texture(CubeMapTex, worldPosition);
+#else
+	vec3 vColour = vec3(0.0f);
+
+#ifdef PHONG_MODEL
+#ifdef CLUSTERED_LIGHTS
+	vColour += ClusteredLights(p, n);
+#endif
+#ifdef LIGHTMAP
+	vColour += texture(lightmap, vLightmapCoord).rgb;
+#endif
+
+	// Apply the Phong model to compute the vertex colour
+	vColour += PhongModel(p, n);
+#else
+	// Calculate diffuse light
+	vec3 lightDir = normalize(vec3(light1.position));
+	float diff = max(dot(vNormal, lightDir), 0.0);
+	vec3 diffuse = diff * light1.Ld;
+
+	 // Calculate ambient light
+	vec3 ambient = 0.3 * light1.La;
+
+	// Combine diffuse, ambient, and specular lighting
+	vColour = ambient + diffuse + light1.Ls;
+#endif
+
+	// Get the texel colour from the texture sampler and combine it with the lighting
+	vec4 vTexColour = texture(sampler0, vTexCoord);
+	vOutputColour = vTexColour*vec4(vColour, 1.0f);
+#endif
 
 	// Compute fog factor
     float d = length(p.xyz);  // Distance from the camera
-    float fogFactor = exp(-rho * d);  // Exponential fog factor
+    float fogFactor = exp(-fogDensity * d);  // Exponential fog factor
     
     // Apply fog by linear interpolation between fog colour and output colour
     vOutputColour.rgb = mix(fogColour, vOutputColour.rgb, fogFactor);
@@ -20,6 +20,15 @@ out vec4 p;
 out vec3 worldPosition;	// used for skybox
 out vec3 vNormal;
 
+// Must match the depth pre-pass exactly
+invariant gl_Position;
+
+#ifdef LIGHTMAP
+uniform mat4 inverseViewMatrix;
+uniform vec4 lightmapBounds;	// World x and z of the lightmap's corner, and one over its size
+out vec2 vLightmapCoord;
+#endif
+
 // This is the entry point into the vertex shader
 void main()
 {	
@@ -28,6 +37,10 @@ void main()
 
 	// Transform the vertex spatial position using 
 	gl_Position = matrices.projMatrix * matrices.modelViewMatrix * vec4(inPosition, 1.0f);
+#ifdef SKYBOX
+	// Put the sky on the far plane, so it is drawn after the opaque geometry and only where nothing else is
+	gl_Position = gl_Position.xyww;
+#endif
 	
 	// Get the vertex normal and vertex position in eye coordinates
 	n = normalize(matrices.normalMatrix * inNormal);
@@ -38,6 +51,11 @@ void main()
 
 	// Pass through normal coordinates
 	vNormal = inNormal;
+
+#ifdef LIGHTMAP
+	// The lightmap looks straight down on the world
+	vLightmapCoord = ((inverseViewMatrix * p).xz - lightmapBounds.xy) * lightmapBounds.zw;
+#endif
 	
 } 
 	
\ No newline at end of file
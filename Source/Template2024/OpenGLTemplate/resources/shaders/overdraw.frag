@@ -0,0 +1,11 @@
+#version 400 core
+
+// Colour of the overdraw level being drawn; the stencil test picks the pixels at that level
+uniform vec4 vColour;
+
+out vec4 vOutputColour;
+
+void main()
+{
+	vOutputColour = vColour;
+}
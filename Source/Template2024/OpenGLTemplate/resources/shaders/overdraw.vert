@@ -0,0 +1,8 @@
+#version 400 core
+
+// A single triangle that covers the whole screen, made from the vertex number
+void main()
+{
+	vec2 position = vec2((gl_VertexID & 1) * 4.0 - 1.0, (gl_VertexID >> 1) * 4.0 - 1.0);
+	gl_Position = vec4(position, 0.0, 1.0);
+}
@@ -1,7 +1,15 @@
-#version 330 core
+#version 400 core
 
-out vec4 FragColor;
+in vec2 vCorner;
+in float vAlpha;
 
-void main() {
-    FragColor = vec4(1.0,1 ,1, 1.0); // Orange color
-}
\ No newline at end of file
+out vec4 vOutputColour;
+
+void main()
+{
+	// Round, soft edged flake
+	float r = dot(vCorner, vCorner);
+	if (r > 1.0)
+		discard;
+	vOutputColour = vec4(1.0, 1.0, 1.0, (1.0 - r) * vAlpha);
+}
@@ -1,9 +1,34 @@
-#version 330 core
+#version 400 core
 
-layout(location = 0) in vec3 position;
+// Structure for matrices
+uniform struct Matrices
+{
+	mat4 projMatrix;
+	mat4 viewMatrix;
+} matrices;
 
-uniform mat4 viewProjectionMatrix;
+layout (location = 0) in vec2 inCorner;		// Corner of the flake's quad, -1 to 1
+layout (location = 1) in vec4 inParticle;	// xyz world position, w fall speed (one per instance)
 
-void main() {
-    gl_Position = viewProjectionMatrix * vec4(position, 1.0);
-}
\ No newline at end of file
+uniform float flakeSize;
+uniform float time;
+uniform float fadeDistance;
+
+out vec2 vCorner;
+out float vAlpha;
+
+void main()
+{
+	// Sway the flake from side to side.  The phase comes from the instance so neighbouring flakes move differently.
+	float phase = float(gl_InstanceID) * 0.618;
+	vec3 position = inParticle.xyz + vec3(sin(time * 1.3 + phase), 0.0, cos(time * 1.1 + phase * 1.7)) * 0.6;
+
+	// Expand the quad in eye space so it always faces the camera
+	vec4 eyePosition = matrices.viewMatrix * vec4(position, 1.0);
+	eyePosition.xy += inCorner * flakeSize;
+	gl_Position = matrices.projMatrix * eyePosition;
+
+	// Fade the flakes out towards the edge of the snow volume so they do not pop in when they wrap around
+	vCorner = inCorner;
+	vAlpha = 1.0 - smoothstep(0.6 * fadeDistance, fadeDistance, length(eyePosition.xyz));
+}